@@ -40,20 +40,49 @@
       'common',
     ],
     'sources': [
+      'src/shared/AtomTable.cpp',
+      'src/shared/AtomTable.h',
       'src/shared/AutoHandle.cpp',
       'src/shared/AutoHandle.h',
       'src/shared/Communication.cpp',
       'src/shared/Communication.h',
+      'src/shared/ContentTypeClassifier.cpp',
+      'src/shared/ContentTypeClassifier.h',
       'src/shared/CriticalSection.h',
       'src/shared/Dictionary.cpp',
       'src/shared/Dictionary.h',
+      'src/shared/ElementCache.h',
+      'src/shared/ElementHideBlob.cpp',
+      'src/shared/ElementHideBlob.h',
+      'src/shared/ElementHideIndex.cpp',
+      'src/shared/ElementHideIndex.h',
+      'src/shared/ElementHiding.cpp',
+      'src/shared/ElementHiding.h',
+      'src/shared/ElementSnapshot.cpp',
+      'src/shared/ElementSnapshot.h',
+      'src/shared/ElementView.h',
       'src/shared/EventWithSetter.cpp',
       'src/shared/EventWithSetter.h',
+      'src/shared/HttpHeaders.cpp',
+      'src/shared/HttpHeaders.h',
+      'src/shared/LruCache.h',
       'src/shared/Utils.cpp',
       'src/shared/Utils.h',
       'src/shared/Version.h',
       'src/shared/MsHTMLUtils.cpp',
       'src/shared/MsHTMLUtils.h',
+      'src/shared/RequestClassifier.cpp',
+      'src/shared/RequestClassifier.h',
+      'src/shared/SelectorProgram.cpp',
+      'src/shared/SelectorProgram.h',
+      'src/shared/SyntheticResponse.cpp',
+      'src/shared/SyntheticResponse.h',
+      'src/shared/StylesheetBuilder.cpp',
+      'src/shared/StylesheetBuilder.h',
+      'src/shared/UrlHashSet.cpp',
+      'src/shared/UrlHashSet.h',
+      'src/shared/WorkerPool.cpp',
+      'src/shared/WorkerPool.h',
     ],
     'include_dirs': [
       '$(ADBLOCKPLUS_ATL)/include',
@@ -124,6 +153,8 @@
       'src/plugin/AdblockPlusGuids.h',
       'src/plugin/ATL_Deprecate.h',
       'src/plugin/Config.h',
+      'src/plugin/DomMutationListener.cpp',
+      'src/plugin/DomMutationListener.h',
       'src/plugin/Instances.h',
       'src/plugin/NotificationMessage.cpp',
       'src/plugin/NotificationMessage.h',
@@ -209,11 +240,27 @@
       'libadblockplus/third_party/googletest.gyp:googletest_main',
     ],
     'sources': [
+      'test/Benchmark.h',
       'test/CommunicationTest.cpp',
+      'test/ContentTypeClassifierTest.cpp',
       'test/DictionaryTest.cpp',
+      'test/ElementCacheTest.cpp',
+      'test/ElementHideBlobTest.cpp',
+      'test/ElementHideIndexTest.cpp',
+      'test/ElementHidingTest.cpp',
+      'test/ElementSnapshotTest.cpp',
+      'test/HttpHeadersTest.cpp',
+      'test/LruCacheTest.cpp',
+      'test/RequestClassifierTest.cpp',
+      'test/SelectorProgramTest.cpp',
+      'test/StylesheetBuilderTest.cpp',
+      'test/SyntheticResponseTest.cpp',
+      'test/TestDom.h',
+      'test/UrlHashSetTest.cpp',
       'test/UtilTest.cpp',
       'test/UtilGetQueryStringTest.cpp',
       'test/UtilGetSchemeAndHierarchicalPartTest.cpp',
+      'test/WorkerPoolTest.cpp',
     ],
     'defines': ['WINVER=0x0501'],
     'link_settings': {
@@ -238,6 +285,8 @@
     'sources': [
       'src/plugin/PluginDebug.cpp',
       'test/plugin/DebugTest.cpp',
+      'src/plugin/PluginDomTraverserBase.h',
+      'test/plugin/DomTraverserTest.cpp',
       'src/plugin/Instances.h',
       'test/plugin/InstancesTest.cpp',
       'src/plugin/PluginUserSettings.cpp',
@@ -245,11 +294,14 @@
       'test/plugin/UserSettingsTest.cpp',
       'src/plugin/PluginUtil.h',
       'test/plugin/UtilTest.cpp',
+      'test/Benchmark.h',
+      'test/plugin/PluginFilterBenchmarkTest.cpp',
       #
       # required only for linking
       #
       'src/plugin/AdblockPlusClient.cpp',
       'src/plugin/AdblockPlusDomTraverser.cpp',
+      'src/plugin/DomMutationListener.cpp',
       'src/plugin/NotificationMessage.cpp',
       'src/plugin/Plugin.cpp',
       'src/plugin/PluginClientBase.cpp',
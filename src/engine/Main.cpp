@@ -20,7 +20,12 @@
   processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
 #include <AdblockPlus.h>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <future>
+#include <map>
+#include <unordered_map>
 #include <vector>
 #include <deque>
 #include <thread>
@@ -31,8 +36,11 @@
 #include "../shared/AutoHandle.h"
 #include "../shared/Communication.h"
 #include "../shared/Dictionary.h"
+#include "../shared/ElementHideBlob.h"
+#include "../shared/LruCache.h"
 #include "../shared/Utils.h"
 #include "../shared/Version.h"
+#include "../shared/WorkerPool.h"
 #include "../shared/CriticalSection.h"
 #include "IeVersion.h"
 #include "AdblockPlus.h"
@@ -89,8 +97,78 @@ namespace
 
   std::auto_ptr<AdblockPlus::FilterEngine> filterEngine;
   std::auto_ptr<Updater> updater;
+  // The high half identifies this engine instance, so that clients never
+  // take the generations of a previous engine for current ones.
+  int64_t InitialFilterGeneration()
+  {
+    uint32_t instance = (GetCurrentProcessId() ^ GetTickCount()) & 0x7FFFFFFF;
+    return static_cast<int64_t>(instance) << 32;
+  }
+
+  // Incremented on every change of filters or subscriptions, lets clients
+  // know when their cached element hiding filters are outdated.
+  std::atomic<int64_t> filterGeneration(InitialFilterGeneration());
+
+  // Binary element hiding indexes by domain and filter generation, shared
+  // with the tabs through named sections. A section stays alive as long as
+  // the engine or any tab has it open.
+  struct ElementHideSection
+  {
+    ElementHideSection(HANDLE handle, const std::wstring& name, uint32_t size)
+      : handle(handle), name(name), size(size)
+    {
+    }
+    AutoHandle handle;
+    std::wstring name;
+    uint32_t size;
+    // Set if the section only has the domain specific selectors, the generic
+    // ones are in this one then
+    std::shared_ptr<ElementHideSection> generic;
+  };
+  typedef std::shared_ptr<ElementHideSection> ElementHideSectionPtr;
+  typedef std::pair<std::string, int64_t> ElementHideSectionKey;
+  LruCache<ElementHideSectionKey, ElementHideSectionPtr> elementHideSections(32);
+  std::atomic<int> elementHideSectionCount(0);
+
+  // The selectors which apply to every domain, shared by the domain sections
+  // of the same filter generation
+  struct GenericElementHide
+  {
+    int64_t generation;
+    // Selector -> position, duplicates are left out
+    std::unordered_map<std::string, size_t> selectors;
+    ElementHideSectionPtr section;
+  };
+  std::mutex genericElementHideMutex;
+  std::shared_ptr<const GenericElementHide> genericElementHide;
+
+  // Sections are built off the client threads, a build is shared by all
+  // clients asking for the same domain and generation while it runs. A client
+  // waits for at most elementHideBuildWait, it falls back to the selectors
+  // after that and a later request gets the section.
+  const size_t elementHideBuildThreads = 2;
+  const size_t elementHideBuildQueueSize = 64;
+  const int elementHideBuildWait = 1000;
+  WorkerPool elementHideBuilder(elementHideBuildThreads, elementHideBuildQueueSize);
+  std::mutex elementHideBuildsMutex;
+  std::map<ElementHideSectionKey, std::shared_future<ElementHideSectionPtr> > elementHideBuilds;
+
   int activeConnections = 0;
-  CriticalSection activeConnectionsLock;
+  // Set when the last client has disconnected, reset when a client connects
+  bool isIdle = false;
+  // Set once the engine has decided to exit, clients connecting after that
+  // are turned away
+  bool isShuttingDown = false;
+  std::mutex activeConnectionsMutex;
+  std::condition_variable activeConnectionsChanged;
+  HANDLE engineReadyEvent = 0;
+  // Clients only spawn an engine if this mutex doesn't exist, see WinMain
+  HANDLE engineMutex = 0;
+
+  // Default time the engine stays resident after the last client has
+  // disconnected, can be overridden with the engine_linger_timeout
+  // preconfiguration value (in milliseconds).
+  const int defaultLingerTimeout = 5 * 60 * 1000;
   HWND callbackWindow;
 
   // it's a helper for the function below.
@@ -173,6 +251,181 @@ namespace
   CriticalSection updateCheckLock;
   bool firstRunActionExecuted = false;
   AdblockPlus::ReferrerMapping referrerMapping;
+  ElementHideSectionPtr WriteElementHideSection(const std::vector<std::string>& selectorList, int64_t generation)
+  {
+    std::vector<std::wstring> selectors = ToUtf16Strings(selectorList);
+    // The threads are shared with the other builds which might be running
+    size_t threadCount = std::thread::hardware_concurrency() / elementHideBuildThreads;
+    ElementHideMatcher matcher;
+    matcher.AddAll(selectors, threadCount > 0 ? threadCount : 1);
+    matcher.Build();
+    std::vector<char> blob;
+    ElementHideBlob::Write(matcher, selectors, generation, blob);
+
+    std::wstring name = L"Local\\AdblockPlusElementHiding_" + std::to_wstring(static_cast<unsigned long long>(GetCurrentProcessId())) +
+      L"_" + std::to_wstring(static_cast<long long>(++elementHideSectionCount));
+    uint32_t size = static_cast<uint32_t>(blob.size());
+    HANDLE handle = Communication::CreateSharedSection(name, size);
+    if (!handle)
+    {
+      DebugLastError("CreateSharedSection failed");
+      return ElementHideSectionPtr();
+    }
+    ElementHideSectionPtr section = std::make_shared<ElementHideSection>(handle, name, size);
+    void* view = MapViewOfFile(handle, FILE_MAP_WRITE, 0, 0, size);
+    if (!view)
+    {
+      DebugLastError("MapViewOfFile failed");
+      return ElementHideSectionPtr();
+    }
+    memcpy(view, &blob[0], size);
+    UnmapViewOfFile(view);
+    return section;
+  }
+
+  // Builds the generic section once per filter generation, domain builds
+  // running at the same time wait for it. Returns null if it can't be built
+  // or the generation is outdated.
+  std::shared_ptr<const GenericElementHide> GetGenericElementHide(int64_t generation)
+  {
+    std::lock_guard<std::mutex> lock(genericElementHideMutex);
+    if (genericElementHide && genericElementHide->generation >= generation)
+    {
+      return genericElementHide->generation == generation ? genericElementHide : std::shared_ptr<const GenericElementHide>();
+    }
+    // Without a domain only the selectors which apply everywhere are returned
+    std::vector<std::string> selectors = filterEngine->GetElementHidingSelectors("");
+    std::shared_ptr<GenericElementHide> generic = std::make_shared<GenericElementHide>();
+    generic->generation = generation;
+    for (auto it = selectors.begin(); it != selectors.end(); ++it)
+    {
+      generic->selectors.insert(std::make_pair(*it, generic->selectors.size()));
+    }
+    generic->section = WriteElementHideSection(selectors, generation);
+    if (!generic->section)
+    {
+      return std::shared_ptr<const GenericElementHide>();
+    }
+    genericElementHide = generic;
+    return generic;
+  }
+
+  ElementHideSectionPtr CreateElementHideSection(const std::string& domain, int64_t generation)
+  {
+    std::vector<std::string> selectors = filterEngine->GetElementHidingSelectors(domain);
+    std::shared_ptr<const GenericElementHide> generic = GetGenericElementHide(generation);
+    if (!generic)
+    {
+      return WriteElementHideSection(selectors, generation);
+    }
+    if (domain.empty())
+    {
+      return generic->section;
+    }
+
+    // The generic selectors can only be shared if the domain has all of
+    // them, exceptions for the domain disable some otherwise
+    std::vector<std::string> specific;
+    std::vector<bool> isGenericListed(generic->selectors.size(), false);
+    size_t genericListed = 0;
+    for (auto it = selectors.begin(); it != selectors.end(); ++it)
+    {
+      auto found = generic->selectors.find(*it);
+      if (found == generic->selectors.end())
+      {
+        specific.push_back(*it);
+      }
+      else if (!isGenericListed[found->second])
+      {
+        isGenericListed[found->second] = true;
+        genericListed++;
+      }
+    }
+    if (genericListed < generic->selectors.size())
+    {
+      return WriteElementHideSection(selectors, generation);
+    }
+    ElementHideSectionPtr section = WriteElementHideSection(specific, generation);
+    if (section)
+    {
+      section->generic = generic->section;
+    }
+    return section;
+  }
+
+  // Returns the cached section or waits for its build for a while, null if
+  // it isn't ready by then
+  ElementHideSectionPtr GetElementHideSection(const std::string& domain, int64_t generation)
+  {
+    ElementHideSectionKey key(domain, generation);
+    ElementHideSectionPtr section;
+    if (elementHideSections.Get(key, section))
+    {
+      return section;
+    }
+
+    std::shared_future<ElementHideSectionPtr> build;
+    {
+      std::lock_guard<std::mutex> lock(elementHideBuildsMutex);
+      auto it = elementHideBuilds.find(key);
+      // A finished build removes itself, a ready one left here has been
+      // dropped from the full queue
+      if (it != elementHideBuilds.end() && it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      {
+        build = it->second;
+      }
+      else
+      {
+        std::shared_ptr<std::promise<ElementHideSectionPtr> > promise = std::make_shared<std::promise<ElementHideSectionPtr> >();
+        build = promise->get_future().share();
+        elementHideBuilds[key] = build;
+        try
+        {
+          elementHideBuilder.Post([key, promise]()
+          {
+            ElementHideSectionPtr section;
+            try
+            {
+              section = CreateElementHideSection(key.first, key.second);
+            }
+            catch (const std::exception& e)
+            {
+              DebugException(e);
+            }
+            if (section)
+            {
+              elementHideSections.Put(key, section);
+            }
+            {
+              std::lock_guard<std::mutex> lock(elementHideBuildsMutex);
+              elementHideBuilds.erase(key);
+            }
+            promise->set_value(section);
+          });
+        }
+        catch (const std::system_error& e)
+        {
+          DebugException(e);
+          elementHideBuilds.erase(key);
+          return section;
+        }
+      }
+    }
+    if (build.wait_for(std::chrono::milliseconds(elementHideBuildWait)) != std::future_status::ready)
+    {
+      return section;
+    }
+    try
+    {
+      return build.get();
+    }
+    catch (const std::future_error&)
+    {
+      // Dropped from the full queue
+      return section;
+    }
+  }
+
   Communication::OutputBuffer HandleRequest(Communication::InputBuffer& request)
   {
     Communication::OutputBuffer response;
@@ -194,6 +447,30 @@ namespace
         response << (filter && filter->GetType() != Filter::TYPE_EXCEPTION);
         break;
       }
+      case Communication::PROC_MATCHES_BATCH:
+      {
+        using namespace AdblockPlus;
+        std::string documentUrl;
+        int32_t count;
+        request >> documentUrl >> count;
+        response << count;
+        for (int32_t i = 0; i < count; i++)
+        {
+          std::string url;
+          int32_t type;
+          request >> url >> type;
+          referrerMapping.Add(url, documentUrl);
+          auto contentType = static_cast<FilterEngine::ContentType>(type);
+          FilterPtr filter = filterEngine->Matches(url, contentType, referrerMapping.BuildReferrerChain(documentUrl));
+          response << (filter && filter->GetType() != Filter::TYPE_EXCEPTION);
+        }
+        break;
+      }
+      case Communication::PROC_GET_FILTER_GENERATION:
+      {
+        response << static_cast<int64_t>(filterGeneration);
+        break;
+      }
       case Communication::PROC_GET_ELEMHIDE_SELECTORS:
       {
         std::string domain;
@@ -201,6 +478,19 @@ namespace
         response << filterEngine->GetElementHidingSelectors(domain);
         break;
       }
+      case Communication::PROC_GET_ELEMHIDE_BLOB:
+      {
+        std::string domain;
+        request >> domain;
+        // Read before the selectors, see PluginTabBase
+        int64_t generation = filterGeneration;
+        ElementHideSectionPtr section = GetElementHideSection(domain, generation);
+        ElementHideSectionPtr generic = section ? section->generic : ElementHideSectionPtr();
+        // An empty name tells the client to request the selectors instead
+        response << (section ? section->name : std::wstring()) << static_cast<int32_t>(section ? section->size : 0)
+                 << (generic ? generic->name : std::wstring()) << static_cast<int32_t>(generic ? generic->size : 0);
+        break;
+      }
       case Communication::PROC_AVAILABLE_SUBSCRIPTIONS:
       {
         WriteSubscriptions(response, filterEngine->FetchAvailableSubscriptions());
@@ -461,9 +751,17 @@ namespace
     Debug("Client connected " + threadString);
 
     {
-      CriticalSection::Lock lock(activeConnectionsLock);
+      std::lock_guard<std::mutex> lock(activeConnectionsMutex);
+      if (isShuttingDown)
+      {
+        // The client starts a new engine once the pipe is closed
+        Debug("Client turned away, the engine is shutting down " + threadString);
+        return;
+      }
       activeConnections++;
+      isIdle = false;
     }
+    activeConnectionsChanged.notify_all();
 
     for (;;)
     {
@@ -487,25 +785,16 @@ namespace
     Debug("Client disconnected " + threadString);
 
     {
-      CriticalSection::Lock lock(activeConnectionsLock);
+      std::lock_guard<std::mutex> lock(activeConnectionsMutex);
       activeConnections--;
       if (activeConnections < 1)
       {
-        Debug("No connections left, shutting down the engine");
+        Debug("No connections left, the engine is idle");
         activeConnections = 0;
-
-        // The following exit(0) calls the destructor of _AtlModule from the
-        // current thread which results in the disaster because there is a
-        // running message loop as well as there can be alive notification
-        // window which holds v8::Value as well as m_tasks can hold v8::Value
-        // but JS Engine is destroyed before _AtlModule. BTW, various free
-        // running threads like Timeout also cause the crash because the engine
-        // is already destroyed.
-        _AtlModule.Finalize();
-        exit(0);
+        isIdle = true;
       }
     }
-
+    activeConnectionsChanged.notify_all();
   }
 
   void OnUpdateAvailable(AdblockPlus::JsValueList& params)
@@ -541,6 +830,51 @@ namespace
     }
   }
 
+  // Keeps the engine with its filters loaded for lingerTimeout after the last
+  // client has disconnected, so that a browser restart doesn't need to spawn
+  // a new engine. Shuts the engine down if nobody reconnects in time.
+  void LingerThread(int lingerTimeout, bool trimWorkingSet)
+  {
+    std::unique_lock<std::mutex> lock(activeConnectionsMutex);
+    for (;;)
+    {
+      activeConnectionsChanged.wait(lock, []() { return isIdle; });
+      if (trimWorkingSet)
+      {
+        // The pages are faulted back in on demand, which is still a lot
+        // cheaper than reloading the filters.
+        SetProcessWorkingSetSize(GetCurrentProcess(), static_cast<SIZE_T>(-1), static_cast<SIZE_T>(-1));
+      }
+      if (activeConnectionsChanged.wait_for(lock, std::chrono::milliseconds(lingerTimeout), []() { return !isIdle; }))
+      {
+        Debug("Client reconnected while lingering");
+        continue;
+      }
+
+      Debug("No connections left, shutting down the engine");
+      isShuttingDown = true;
+      lock.unlock();
+      if (engineReadyEvent)
+      {
+        // Clients which are about to connect should rather start a new engine
+        ResetEvent(engineReadyEvent);
+      }
+      // Finalizing takes a while, a client turned away meanwhile has to be
+      // able to spawn the new engine right away
+      CloseHandle(engineMutex);
+      // The following exit(0) calls the destructor of _AtlModule from the
+      // current thread which results in the disaster because there is a
+      // running message loop as well as there can be alive notification
+      // window which holds v8::Value as well as m_tasks can hold v8::Value
+      // but JS Engine is destroyed before _AtlModule. BTW, various free
+      // running threads like Timeout also cause the crash because the engine
+      // is already destroyed.
+      // The mutex must not be locked anymore, exit destroys it.
+      _AtlModule.Finalize();
+      exit(0);
+    }
+  }
+
 std::auto_ptr<AdblockPlus::FilterEngine> CreateFilterEngine(const std::wstring& locale)
 {
   AdblockPlus::AppInfo appInfo;
@@ -570,6 +904,10 @@ std::auto_ptr<AdblockPlus::FilterEngine> CreateFilterEngine(const std::wstring&
   preconfig["suppress_first_run_page"] = jsEngine->NewValue(
     PreconfigurationValueFromRegistry(L"suppress_first_run_page") == L"true");
   std::auto_ptr<AdblockPlus::FilterEngine> filterEngine(new AdblockPlus::FilterEngine(jsEngine, preconfig));
+  filterEngine->SetFilterChangeCallback([](const std::string& action, const AdblockPlus::JsValuePtr item)
+  {
+    filterGeneration++;
+  });
   return filterEngine;
 }
 
@@ -712,8 +1050,9 @@ void ABPAtlModule::ProcessTasks()
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int cmdShow)
 {
-  AutoHandle mutex(CreateMutexW(0, false, L"AdblockPlusEngine"));
-  if (!mutex)
+  // Closed by LingerThread or when the process exits
+  engineMutex = CreateMutexW(0, false, L"AdblockPlusEngine");
+  if (!engineMutex)
   {
     DebugLastError("CreateMutex failed");
     return 1;
@@ -725,6 +1064,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int cmdShow)
     return 1;
   }
 
+  // Clients wait for this event instead of polling the pipe. The event might
+  // have been left set by an instance which has crashed, so reset it first.
+  AutoHandle readyEvent(Communication::CreateEngineReadyEvent());
+  if (readyEvent)
+  {
+    ResetEvent(readyEvent);
+    engineReadyEvent = readyEvent;
+  }
+  else
+  {
+    DebugLastError("Failed to create the engine ready event");
+  }
+
   int argc;
   LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
   std::wstring locale(argc >= 2 ? argv[1] : L"");
@@ -733,13 +1085,34 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int cmdShow)
   filterEngine = CreateFilterEngine(locale);
   updater.reset(new Updater(filterEngine->GetJsEngine()));
 
+  int lingerTimeout = defaultLingerTimeout;
+  std::wstring lingerTimeoutValue = PreconfigurationValueFromRegistry(L"engine_linger_timeout");
+  if (!lingerTimeoutValue.empty())
+  {
+    lingerTimeout = _wtoi(lingerTimeoutValue.c_str());
+    if (lingerTimeout < 0)
+    {
+      lingerTimeout = 0;
+    }
+  }
+  bool trimWorkingSet = PreconfigurationValueFromRegistry(L"engine_trim_memory_when_idle") == L"true";
+  std::thread(LingerThread, lingerTimeout, trimWorkingSet).detach();
+
   std::thread communicationThread([]
   {
     for (;;)
     {
+      {
+        std::lock_guard<std::mutex> lock(activeConnectionsMutex);
+        if (isShuttingDown)
+        {
+          // Clients can only connect to the new engine from now on
+          return 0;
+        }
+      }
       try
       {
-        auto pipe = std::make_shared<Communication::Pipe>(Communication::pipeName, Communication::Pipe::MODE_CREATE);
+        auto pipe = std::make_shared<Communication::Pipe>(Communication::pipeName, Communication::Pipe::MODE_CREATE, engineReadyEvent);
     
         // TODO: we should wait for the finishing of the thread before exiting from this function.
         // It works now in most cases because the browser waits for the response in the pipe, and the
@@ -22,10 +22,15 @@
 #include "PluginFilter.h"
 #include "PluginMutex.h"
 #include "PluginClass.h"
+#include "../shared/AutoHandle.h"
 #include "../shared/Utils.h"
+#include "../shared/WorkerPool.h"
 
 namespace
 {
+  // Intentionally never destroyed, see filterWorkerPool in PluginTabBase.cpp
+  WorkerPool* matchingWorkerPool = new WorkerPool(SHOULD_BLOCK_WORKER_THREADS, SHOULD_BLOCK_WORKER_QUEUE_SIZE);
+
   class ScopedProcessInformation : public PROCESS_INFORMATION {
   public:
     ScopedProcessInformation()
@@ -64,30 +69,117 @@ namespace
     }
   }
 
-  Communication::Pipe* OpenEnginePipe()
+  // Serializes the engine startup between all tab processes
+  class CEngineSpawnLock : public CPluginMutex
+  {
+  public:
+    explicit CEngineSpawnLock(DWORD timeoutMsec) : CPluginMutex(L"EngineSpawn", PLUGIN_ERROR_MUTEX_ENGINE_SPAWN, timeoutMsec) {}
+  };
+
+  // The part of timeoutMsec which is left since startTime, 0 once it has elapsed
+  DWORD GetRemainingTime(DWORD startTime, DWORD timeoutMsec)
+  {
+    if (timeoutMsec == INFINITE)
+    {
+      return INFINITE;
+    }
+    DWORD elapsed = GetTickCount() - startTime;
+    return elapsed < timeoutMsec ? timeoutMsec - elapsed : 0;
+  }
+
+  Communication::Pipe* TryOpenEnginePipe(DWORD timeoutMsec)
   {
     try
     {
-      return new Communication::Pipe(Communication::pipeName, Communication::Pipe::MODE_CONNECT);
+      return new Communication::Pipe(Communication::pipeName, Communication::Pipe::MODE_CONNECT, 0, timeoutMsec);
     }
     catch (Communication::PipeConnectionError e)
+    {
+      return nullptr;
+    }
+  }
+
+  bool IsEngineRunning()
+  {
+    // The engine holds this mutex until it starts shutting down, see WinMain
+    // and LingerThread of the engine
+    HANDLE mutex = OpenMutexW(SYNCHRONIZE, FALSE, L"AdblockPlusEngine");
+    if (!mutex)
+    {
+      return false;
+    }
+    CloseHandle(mutex);
+    return true;
+  }
+
+  // Gives up once timeoutMsec since startTime have elapsed, the engine
+  // keeps starting up in that case and a later call connects to it
+  Communication::Pipe* OpenEnginePipe(DWORD startTime, DWORD timeoutMsec)
+  {
+    Communication::Pipe* pipe = TryOpenEnginePipe(GetRemainingTime(startTime, timeoutMsec));
+    if (pipe)
+    {
+      return pipe;
+    }
+
+    CEngineSpawnLock spawnLock(GetRemainingTime(startTime, timeoutMsec));
+    if (!spawnLock.IsLocked() && GetRemainingTime(startTime, timeoutMsec) == 0)
+    {
+      throw Communication::PipeTimeoutError();
+    }
+
+    // The engine might have been started while we were waiting for the lock
+    pipe = TryOpenEnginePipe(GetRemainingTime(startTime, timeoutMsec));
+    if (pipe)
+    {
+      return pipe;
+    }
+
+    // The event has to be opened before spawning, so that it cannot be missed
+    AutoHandle readyEvent(Communication::CreateEngineReadyEvent());
+    if (!IsEngineRunning())
     {
       SpawnAdblockPlusEngine();
+    }
 
-      const int step = 100;
-      for (int timeout = ENGINE_STARTUP_TIMEOUT; timeout > 0; timeout -= step)
+    // The engine sets the event as soon as it is listening. If the event is
+    // not available (e.g. the name resolves to a different object inside an
+    // AppContainer) or is stale, we fall back to polling.
+    bool useEvent = readyEvent;
+    const DWORD step = 100;
+    DWORD startupStartTime = GetTickCount();
+    for (;;)
+    {
+      DWORD remaining = std::min<DWORD>(GetRemainingTime(startTime, timeoutMsec),
+        GetRemainingTime(startupStartTime, ENGINE_STARTUP_TIMEOUT));
+      if (remaining == 0)
       {
-        Sleep(step);
-        try
-        {
-          return new Communication::Pipe(Communication::pipeName, Communication::Pipe::MODE_CONNECT);
-        }
-        catch (Communication::PipeConnectionError e)
-        {
-        }
+        break;
+      }
+      bool isSignaled = false;
+      if (useEvent)
+      {
+        isSignaled = WaitForSingleObject(readyEvent, std::min<DWORD>(step, remaining)) == WAIT_OBJECT_0;
+      }
+      else
+      {
+        Sleep(std::min<DWORD>(step, remaining));
+      }
+      pipe = TryOpenEnginePipe(GetRemainingTime(startTime, timeoutMsec));
+      if (pipe)
+      {
+        return pipe;
+      }
+      if (isSignaled)
+      {
+        useEvent = false;
       }
-      throw std::runtime_error("Unable to open Adblock Plus Engine pipe");
     }
+    if (GetRemainingTime(startTime, timeoutMsec) == 0)
+    {
+      throw Communication::PipeTimeoutError();
+    }
+    throw std::runtime_error("Unable to open Adblock Plus Engine pipe");
   }
 
   std::vector<SubscriptionDescription> ReadSubscriptions(Communication::InputBuffer& message)
@@ -117,20 +209,50 @@ namespace
 
 CAdblockPlusClient* CAdblockPlusClient::s_instance = NULL;
 CComAutoCriticalSection CAdblockPlusClient::s_criticalSectionLocal;
+std::atomic<uint32_t> CAdblockPlusClient::s_engineCallTimeouts(0);
 
-bool CAdblockPlusClient::CallEngine(Communication::OutputBuffer& message, Communication::InputBuffer& inputBuffer)
+bool CAdblockPlusClient::CallEngine(Communication::OutputBuffer& message, Communication::InputBuffer& inputBuffer, DWORD timeoutMsec)
 {
   DEBUG_GENERAL("CallEngine start");
-  CriticalSection::Lock lock(enginePipeLock);
+  // The deadline covers waiting for other calls and connecting as well
+  DWORD startTime = GetTickCount();
+  std::unique_lock<std::timed_mutex> lock(enginePipeLock, std::defer_lock);
+  if (!lock.try_lock_for(std::chrono::milliseconds(timeoutMsec)))
+  {
+    ++s_engineCallTimeouts;
+    DEBUG_GENERAL("CallEngine timed out waiting for another call");
+    return false;
+  }
   try
   {
-    if (!enginePipe)
-      enginePipe.reset(OpenEnginePipe());
-    enginePipe->WriteMessage(message);
-    inputBuffer = enginePipe->ReadMessage();
+    try
+    {
+      if (!enginePipe)
+        enginePipe.reset(OpenEnginePipe(startTime, timeoutMsec));
+      enginePipe->WriteMessage(message, GetRemainingTime(startTime, timeoutMsec));
+      inputBuffer = enginePipe->ReadMessage(GetRemainingTime(startTime, timeoutMsec));
+    }
+    catch (const Communication::PipeDisconnectedError&)
+    {
+      // The engine exited or turned us away because it is shutting down,
+      // the next connection starts a new one
+      enginePipe.reset(OpenEnginePipe(startTime, timeoutMsec));
+      enginePipe->WriteMessage(message, GetRemainingTime(startTime, timeoutMsec));
+      inputBuffer = enginePipe->ReadMessage(GetRemainingTime(startTime, timeoutMsec));
+    }
+  }
+  catch (const Communication::PipeTimeoutError& ex)
+  {
+    // The response may still arrive later, the only way to make sure it isn't
+    // read as the response to the next call is to drop the connection.
+    enginePipe.reset();
+    ++s_engineCallTimeouts;
+    DEBUG_EXCEPTION(ex);
+    return false;
   }
   catch (const std::exception& ex)
   {
+    enginePipe.reset();
     DEBUG_EXCEPTION(ex);
     return false;
   }
@@ -138,11 +260,16 @@ bool CAdblockPlusClient::CallEngine(Communication::OutputBuffer& message, Commun
   return true;
 }
 
-bool CAdblockPlusClient::CallEngine(Communication::ProcType proc, Communication::InputBuffer& inputBuffer)
+bool CAdblockPlusClient::CallEngine(Communication::ProcType proc, Communication::InputBuffer& inputBuffer, DWORD timeoutMsec)
 {
   Communication::OutputBuffer message;
   message << proc;
-  return CallEngine(message, inputBuffer);
+  return CallEngine(message, inputBuffer, timeoutMsec);
+}
+
+uint32_t CAdblockPlusClient::GetEngineCallTimeoutCount()
+{
+  return s_engineCallTimeouts;
 }
 
 CAdblockPlusClient::~CAdblockPlusClient()
@@ -173,21 +300,24 @@ CAdblockPlusClient* CAdblockPlusClient::GetInstance()
 
 namespace
 {
-  bool ShouldBlockLocal(const std::wstring& src, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain, bool addDebug)
+  // Returns false if the engine could not make a decision, `result` is then false.
+  bool ShouldBlockLocal(const std::wstring& src, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain, bool addDebug, bool& result)
   {
+    result = false;
     std::wstring srcTrimmed = TrimString(src);
 
     // We should not block the empty string, so all filtering does not make sense
     // Therefore we just return
     if (srcTrimmed.empty())
     {
-      return false;
+      return true;
     }
 
-    CPluginSettings* settings = CPluginSettings::GetInstance();
-
     CPluginClient* client = CPluginClient::GetInstance();
-    bool result = client->Matches(srcTrimmed, contentType, domain);
+    if (!client->TryMatches(srcTrimmed, contentType, domain, result))
+    {
+      return false;
+    }
 
 #ifdef ENABLE_DEBUG_RESULT
     if (addDebug)
@@ -203,7 +333,7 @@ namespace
       }
     }
 #endif
-    return result;
+    return true;
   }
 }
 
@@ -225,14 +355,16 @@ bool CAdblockPlusClient::ShouldBlock(const std::wstring& src, AdblockPlus::Filte
 
   if (!isCached)
   {
+    bool isDecided;
     m_criticalSectionFilter.Lock();
     {
-      isBlocked = ShouldBlockLocal(src, contentType, domain, addDebug);
+      isDecided = ShouldBlockLocal(src, contentType, domain, addDebug, isBlocked);
     }
     m_criticalSectionFilter.Unlock();
 
-    // Cache result, if content type is defined
-    if (contentType != AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_OTHER)
+    // Cache result, if content type is defined. Fail-open results are not
+    // cached, the engine should be asked again next time.
+    if (isDecided && contentType != AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_OTHER)
     {
       m_criticalSectionCache.Lock();
       {
@@ -244,6 +376,121 @@ bool CAdblockPlusClient::ShouldBlock(const std::wstring& src, AdblockPlus::Filte
   return isBlocked;
 }
 
+PendingShouldBlockPtr CAdblockPlusClient::ShouldBlockAsync(const std::vector<ShouldBlockRequest>& requests, const std::wstring& domain)
+{
+  PendingShouldBlockPtr pending = std::make_shared<PendingShouldBlock>(requests.size());
+
+  // Indexes (in `requests`) of the sources which are not cached yet
+  std::vector<size_t> uncachedIndexes;
+  std::vector<ShouldBlockRequest> uncachedRequests;
+  m_criticalSectionCache.Lock();
+  {
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+      auto it = m_cacheBlockedSources.find(requests[i].src);
+      if (it != m_cacheBlockedSources.end())
+      {
+        pending->m_results[i] = it->second;
+        continue;
+      }
+      // We should not block the empty string, see ShouldBlockLocal
+      ShouldBlockRequest request = requests[i];
+      request.src = TrimString(request.src);
+      if (!request.src.empty())
+      {
+        uncachedIndexes.push_back(i);
+        uncachedRequests.push_back(request);
+      }
+    }
+  }
+  m_criticalSectionCache.Unlock();
+
+  if (uncachedRequests.empty())
+  {
+    pending->m_event.Set();
+    return pending;
+  }
+
+  // Sets the event once all chunks have been matched, dropped by the pool or
+  // failed to be posted
+  std::shared_ptr<void> completion(nullptr, [pending](void*)
+  {
+    pending->m_event.Set();
+  });
+  // Bounded chunks, so that a big page doesn't exceed the deadline of a call
+  for (size_t begin = 0; begin < uncachedRequests.size(); begin += SHOULD_BLOCK_BATCH_MAX)
+  {
+    size_t end = std::min<size_t>(begin + SHOULD_BLOCK_BATCH_MAX, uncachedRequests.size());
+    std::vector<size_t> chunkIndexes(uncachedIndexes.begin() + begin, uncachedIndexes.begin() + end);
+    std::vector<ShouldBlockRequest> chunkRequests(uncachedRequests.begin() + begin, uncachedRequests.begin() + end);
+    try
+    {
+      matchingWorkerPool->Post([this, pending, completion, chunkIndexes, chunkRequests, domain]
+      {
+        try
+        {
+          std::vector<bool> results;
+          if (MatchesBatch(chunkRequests, domain, results) && results.size() == chunkRequests.size())
+          {
+            m_criticalSectionCache.Lock();
+            {
+              for (size_t i = 0; i < results.size(); i++)
+              {
+                const ShouldBlockRequest& request = chunkRequests[i];
+                pending->m_results[chunkIndexes[i]] = results[i];
+                // Cache result, if content type is defined
+                if (request.contentType != AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_OTHER)
+                {
+                  m_cacheBlockedSources[request.src] = results[i];
+                }
+              }
+            }
+            m_criticalSectionCache.Unlock();
+          }
+        }
+        catch (...)
+        {
+          // As a thread-main function, we truncate any C++ exception.
+        }
+      });
+    }
+    catch (const std::system_error& ex)
+    {
+      DEBUG_SYSTEM_EXCEPTION(ex, PLUGIN_ERROR_THREAD, PLUGIN_ERROR_SHOULD_BLOCK_THREAD_CREATE_PROCESS,
+        "Client::ShouldBlockAsync - Failed to start matching thread");
+      break;
+    }
+  }
+  return pending;
+}
+
+bool CAdblockPlusClient::MatchesBatch(const std::vector<ShouldBlockRequest>& requests, const std::wstring& domain, std::vector<bool>& results)
+{
+  Communication::OutputBuffer request;
+  request << Communication::PROC_MATCHES_BATCH << ToUtf8String(domain) << static_cast<int32_t>(requests.size());
+  for (auto it = requests.begin(); it != requests.end(); ++it)
+  {
+    request << ToUtf8String(it->src) << static_cast<int32_t>(it->contentType);
+  }
+
+  // The engine matches the URLs one after the other
+  DWORD timeoutMsec = ENGINE_CALL_TIMEOUT_MATCHING + static_cast<DWORD>(requests.size()) * ENGINE_CALL_TIMEOUT_MATCHING_PER_URL;
+  Communication::InputBuffer response;
+  if (!CallEngine(request, response, timeoutMsec))
+    return false;
+
+  int32_t count;
+  response >> count;
+  results.resize(count);
+  for (int32_t i = 0; i < count; i++)
+  {
+    bool match;
+    response >> match;
+    results[i] = match;
+  }
+  return true;
+}
+
 bool CAdblockPlusClient::IsWhitelistedUrl(const std::wstring& url, const std::vector<std::string>& frameHierarchy)
 {
   return !GetWhitelistingFilter(url, frameHierarchy).empty();
@@ -256,7 +503,7 @@ std::string CAdblockPlusClient::GetWhitelistingFilter(const std::wstring& url, c
   request << Communication::PROC_GET_WHITELISTING_FITER << ToUtf8String(url) << frameHierarchy;
 
   Communication::InputBuffer response;
-  if (!CallEngine(request, response)) 
+  if (!CallEngine(request, response, ENGINE_CALL_TIMEOUT_MATCHING))
     return "";
 
   std::string filterText;
@@ -272,7 +519,7 @@ bool CAdblockPlusClient::IsElemhideWhitelistedOnDomain(const std::wstring& url,
   request << Communication::PROC_IS_ELEMHIDE_WHITELISTED_ON_URL << ToUtf8String(url) << frameHierarchy;
 
   Communication::InputBuffer response;
-  if (!CallEngine(request, response)) 
+  if (!CallEngine(request, response, ENGINE_CALL_TIMEOUT_MATCHING))
     return false;
 
   bool isWhitelisted;
@@ -282,30 +529,87 @@ bool CAdblockPlusClient::IsElemhideWhitelistedOnDomain(const std::wstring& url,
 
 bool CAdblockPlusClient::Matches(const std::wstring& url, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain)
 {
+  bool match;
+  TryMatches(url, contentType, domain, match);
+  return match;
+}
+
+bool CAdblockPlusClient::TryMatches(const std::wstring& url, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain, bool& match)
+{
+  match = false;
   Communication::OutputBuffer request;
   request << Communication::PROC_MATCHES << ToUtf8String(url) << static_cast<int32_t>(contentType) << ToUtf8String(domain);
 
   Communication::InputBuffer response;
-  if (!CallEngine(request, response)) 
+  if (!CallEngine(request, response, ENGINE_CALL_TIMEOUT_MATCHING))
     return false;
 
-  bool match;
   response >> match;
-  return match;
+  return true;
 }
 
-std::vector<std::wstring> CAdblockPlusClient::GetElementHidingSelectors(const std::wstring& domain)
+bool CAdblockPlusClient::GetElementHidingSelectors(const std::wstring& domain, std::vector<std::wstring>& selectors)
 {
+  selectors.clear();
   Communication::OutputBuffer request;
   request << Communication::PROC_GET_ELEMHIDE_SELECTORS << ToUtf8String(domain);
 
   Communication::InputBuffer response;
-  if (!CallEngine(request, response)) 
-    return std::vector<std::wstring>();
+  if (!CallEngine(request, response))
+    return false;
+
+  std::vector<std::string> utf8Selectors;
+  response >> utf8Selectors;
+  selectors = ToUtf16Strings(utf8Selectors);
+  return true;
+}
+
+bool CAdblockPlusClient::GetElementHidingBlobs(const std::wstring& domain, std::wstring& name, size_t& size,
+  std::wstring& genericName, size_t& genericSize)
+{
+  Communication::OutputBuffer request;
+  request << Communication::PROC_GET_ELEMHIDE_BLOB << ToUtf8String(domain);
+
+  Communication::InputBuffer response;
+  if (!CallEngine(request, response))
+    return false;
+
+  int32_t blobSize;
+  int32_t genericBlobSize;
+  response >> name >> blobSize >> genericName >> genericBlobSize;
+  if (name.empty() || blobSize <= 0 || (!genericName.empty() && genericBlobSize <= 0))
+    return false;
+  size = blobSize;
+  genericSize = genericBlobSize;
+  return true;
+}
+
+std::shared_ptr<const void> CAdblockPlusClient::MapElementHidingBlob(const std::wstring& name, size_t size)
+{
+  // Fails in processes which can't see the engine's namespace, e.g. in
+  // Enhanced Protected Mode. The caller falls back to the selectors then.
+  AutoHandle section(OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str()));
+  if (!section)
+  {
+    DEBUG_GENERAL(L"MapElementHidingBlob: can't open " + name);
+    return std::shared_ptr<const void>();
+  }
+  // The view keeps the section alive after the handle is closed
+  const void* view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, size);
+  if (!view)
+    return std::shared_ptr<const void>();
+  return std::shared_ptr<const void>(view, UnmapViewOfFile);
+}
+
+int64_t CAdblockPlusClient::GetFilterGeneration()
+{
+  Communication::InputBuffer response;
+  if (!CallEngine(Communication::PROC_GET_FILTER_GENERATION, response, ENGINE_CALL_TIMEOUT_MATCHING))
+    return -1;
 
-  std::vector<std::string> selectors;
-  response >> selectors;
-  return ToUtf16Strings(selectors);
+  int64_t generation;
+  response >> generation;
+  return generation;
 }
 
 std::vector<SubscriptionDescription> CAdblockPlusClient::FetchAvailableSubscriptions()
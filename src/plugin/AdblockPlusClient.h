@@ -21,7 +21,10 @@
 #include <MsHTML.h>
 #include "../shared/Communication.h"
 #include "../shared/CriticalSection.h"
+#include "../shared/EventWithSetter.h"
 #include <AdblockPlus/FilterEngine.h>
+#include <atomic>
+#include <mutex>
 
 class CPluginFilter;
 
@@ -33,6 +36,46 @@ struct SubscriptionDescription
   bool listed;
 };
 
+struct ShouldBlockRequest
+{
+  std::wstring src;
+  AdblockPlus::FilterEngine::ContentType contentType;
+};
+
+/**
+ * Handle to the decisions of a `CAdblockPlusClient::ShouldBlockAsync` call.
+ *
+ * The results are written by a worker thread before the handle becomes ready,
+ * they must not be accessed before `IsReady` or `Wait` has returned true.
+ * If the engine cannot be reached, or the worker is too busy, the affected
+ * results are `false`.
+ */
+class PendingShouldBlock
+{
+  friend class CAdblockPlusClient;
+public:
+  explicit PendingShouldBlock(size_t count) : m_results(count, false) {}
+  bool IsReady()
+  {
+    return m_event.Wait(0);
+  }
+  bool Wait(int32_t timeoutMsec = Event::InfiniteTimeout)
+  {
+    return m_event.Wait(timeoutMsec);
+  }
+  const std::vector<bool>& GetResults() const
+  {
+    return m_results;
+  }
+private:
+  PendingShouldBlock(const PendingShouldBlock&);
+  void operator=(const PendingShouldBlock&);
+  Event m_event;
+  std::vector<bool> m_results;
+};
+
+typedef std::shared_ptr<PendingShouldBlock> PendingShouldBlockPtr;
+
 class CAdblockPlusClient
 {
 
@@ -45,14 +88,21 @@ private:
   std::map<std::wstring, bool> m_cacheBlockedSources;
 
   std::shared_ptr<Communication::Pipe> enginePipe;
-  CriticalSection enginePipeLock;
+  // Held for a whole call, timed so that waiting for it counts towards the deadline
+  std::timed_mutex enginePipeLock;
 
+  static std::atomic<uint32_t> s_engineCallTimeouts;
 
   // Private constructor used by the singleton pattern
   CAdblockPlusClient() {};
 
-  bool CallEngine(Communication::OutputBuffer& message, Communication::InputBuffer& inputBuffer = Communication::InputBuffer());
-  bool CallEngine(Communication::ProcType proc, Communication::InputBuffer& inputBuffer = Communication::InputBuffer());
+  // Returns false if the engine could not be reached or did not answer within
+  // timeoutMsec, the callers then return their fail-open default. The time
+  // spent waiting for other calls and connecting to the engine counts as well.
+  bool CallEngine(Communication::OutputBuffer& message, Communication::InputBuffer& inputBuffer = Communication::InputBuffer(), DWORD timeoutMsec = ENGINE_CALL_TIMEOUT_DEFAULT);
+  bool CallEngine(Communication::ProcType proc, Communication::InputBuffer& inputBuffer = Communication::InputBuffer(), DWORD timeoutMsec = ENGINE_CALL_TIMEOUT_DEFAULT);
+  bool TryMatches(const std::wstring& url, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain, bool& match);
+  bool MatchesBatch(const std::vector<ShouldBlockRequest>& requests, const std::wstring& domain, std::vector<bool>& results);
 public:
 
   static CAdblockPlusClient* s_instance;
@@ -61,16 +111,35 @@ public:
 
   static CAdblockPlusClient* GetInstance();
 
+  // Number of engine calls which have exceeded their deadline in this process
+  static uint32_t GetEngineCallTimeoutCount();
+
   // Removes the url from the list of whitelisted urls if present
   // Only called from ui thread
   bool ShouldBlock(const std::wstring& src, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain, bool addDebug=false);
 
+  // Returns immediately, cached decisions are resolved in place and the
+  // remaining ones are sent to the engine in batches of at most
+  // SHOULD_BLOCK_BATCH_MAX from a worker thread.
+  PendingShouldBlockPtr ShouldBlockAsync(const std::vector<ShouldBlockRequest>& requests, const std::wstring& domain);
+
   bool IsWhitelistedUrl(const std::wstring& url, const std::vector<std::string>& frameHierarchy = std::vector<std::string>());
   std::string GetWhitelistingFilter(const std::wstring& url, const std::vector<std::string>& frameHierarchy = std::vector<std::string>());
   bool IsElemhideWhitelistedOnDomain(const std::wstring& url, const std::vector<std::string>& frameHierarchy = std::vector<std::string>());
 
   bool Matches(const std::wstring& url, AdblockPlus::FilterEngine::ContentType contentType, const std::wstring& domain);
-  std::vector<std::wstring> GetElementHidingSelectors(const std::wstring& domain);
+  // Returns false if the engine didn't answer, `selectors` is empty then
+  bool GetElementHidingSelectors(const std::wstring& domain, std::vector<std::wstring>& selectors);
+  // Names the sections of the engine's binary element hiding indexes for the
+  // domain, see ElementHideBlob. `genericName` is set if the first one only
+  // has the domain specific selectors. Returns false if they aren't available.
+  bool GetElementHidingBlobs(const std::wstring& domain, std::wstring& name, size_t& size,
+    std::wstring& genericName, size_t& genericSize);
+  // Maps a section named by GetElementHidingBlobs read-only, returns a null
+  // pointer if that fails
+  static std::shared_ptr<const void> MapElementHidingBlob(const std::wstring& name, size_t size);
+  // Changes whenever filters or subscriptions change, returns -1 on failure
+  int64_t GetFilterGeneration();
   std::vector<SubscriptionDescription> FetchAvailableSubscriptions();
   std::vector<SubscriptionDescription> GetListedSubscriptions();
   bool IsAcceptableAdsEnabled();
@@ -20,27 +20,37 @@
 #include "AdblockPlusClient.h"
 #include "PluginFilter.h"
 #include "PluginSettings.h"
+#include "Instances.h"
 #include "..\shared\Utils.h"
 
+namespace
+{
+  // Thread timers don't carry user data, so we need to find the traverser by the timer id.
+  SyncMap<UINT_PTR, CPluginDomTraverser*, nullptr> s_decisionsTimers;
+  SyncMap<UINT_PTR, CPluginDomTraverser*, nullptr> s_traversalTimers;
+}
 
-CPluginDomTraverser::CPluginDomTraverser(const PluginFilterPtr& pluginFilter) : CPluginDomTraverserBase(pluginFilter)
+CPluginDomTraverser::CPluginDomTraverser(const PluginFilterPtr& pluginFilter)
+  : CPluginDomTraverserBase(pluginFilter), m_decisionsTimer(0), m_traversalTimer(0),
+    m_matchedElements(0), m_matchingComCalls(0)
 {
 }
 
 
-bool CPluginDomTraverser::OnIFrame(IHTMLElement* pEl, const std::wstring& url, const std::wstring& indent)
+CPluginDomTraverser::~CPluginDomTraverser()
 {
-  CPluginClient* client = CPluginClient::GetInstance();
+  StopTraversalTimer();
+  StopDecisionsTimer();
+}
 
-  // If src should be blocked, set style display:none on iframe
-  bool isBlocked = client->ShouldBlock(url,
-    AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_SUBDOCUMENT, m_documentUrl);
-  if (isBlocked)
-  {
-    HideElement(pEl, L"iframe", url, true, indent);
-  }
 
-  return !isBlocked;
+bool CPluginDomTraverser::OnIFrame(IHTMLElement* pEl, const std::wstring& url, const std::wstring& indent)
+{
+  // If src should be blocked, set style display:none on iframe.
+  // The content of a blocked iframe is replaced anyway, so it's cheaper to
+  // traverse it than to wait for the decision here.
+  QueueShouldBlock(pEl, L"iframe", url, AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_SUBDOCUMENT);
+  return true;
 }
 
 
@@ -51,7 +61,8 @@ bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const std::wstring& tag,
     return false;
   }
 
-  cache->m_isHidden = m_pluginFilter->IsElementHidden(tag, pEl, m_domain, indent);
+  m_matchedElements++;
+  cache->m_isHidden = m_pluginFilter->IsElementHidden(tag, pEl, m_domain, indent, &m_matchingComCalls);
   if (cache->m_isHidden)
   {
     HideElement(pEl, tag, L"", false, indent);
@@ -68,13 +79,7 @@ bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const std::wstring& tag,
       if (!src.empty())
       {
         // If src should be blocked, set style display:none on image
-        cache->m_isHidden = CPluginClient::GetInstance()->ShouldBlock(src,
-          AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_IMAGE, m_documentUrl);
-        if (cache->m_isHidden)
-        {
-          HideElement(pEl, L"image", src, true, indent);
-          return false;
-        }
+        QueueShouldBlock(pEl, L"image", src, AdblockPlus::FilterEngine::ContentType::CONTENT_TYPE_IMAGE);
       }
     }
   }
@@ -122,6 +127,166 @@ bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const std::wstring& tag,
 }
 
 
+void CPluginDomTraverser::OnTraversalComplete(const TraversalStats& stats)
+{
+  StopTraversalTimer();
+  DEBUG_GENERAL(L"DomTraverser::OnTraversalComplete elements: " + std::to_wstring(stats.elements) +
+    L", mutated elements: " + std::to_wstring(stats.mutatedElements) +
+    L", skipped subtrees: " + std::to_wstring(stats.skippedSubtrees) + L", max depth: " + std::to_wstring(stats.maxDepth) +
+    L", slices: " + std::to_wstring(stats.slices) + L", time: " + std::to_wstring(stats.wallMs) + L" ms" +
+    L", longest slice: " + std::to_wstring(stats.longestSliceMs) + L" ms" +
+    L", matched elements: " + std::to_wstring(m_matchedElements) +
+    L", COM calls: " + std::to_wstring(m_matchingComCalls) + L", per element: " +
+    std::to_wstring(m_matchedElements ? static_cast<double>(m_matchingComCalls) / m_matchedElements : 0.0));
+  m_matchedElements = 0;
+  m_matchingComCalls = 0;
+
+  RequestQueuedDecisions();
+}
+
+
+void CPluginDomTraverser::OnTraversalSuspended(const TraversalStats& stats)
+{
+  // Blocked elements of the part already traversed are hidden while the rest waits
+  RequestQueuedDecisions();
+
+  if (!m_traversalTimer)
+  {
+    m_traversalTimer = SetTimer(nullptr, 0, TIMER_INTERVAL_DOM_TRAVERSAL_SLICE, &CPluginDomTraverser::OnTraversalTimer);
+    if (m_traversalTimer)
+    {
+      s_traversalTimers.AddIfAbsent(m_traversalTimer, this);
+    }
+  }
+}
+
+
+void CPluginDomTraverser::RequestQueuedDecisions()
+{
+  if (!m_queuedRequests.empty())
+  {
+    PendingBatch batch;
+    batch.decisions = CPluginClient::GetInstance()->ShouldBlockAsync(m_queuedRequests, m_documentUrl);
+    batch.elements.swap(m_queuedElements);
+    m_queuedRequests.clear();
+    m_pendingBatches.push_back(std::move(batch));
+  }
+
+  // Everything might have been cached already
+  ApplyReadyDecisions();
+
+  if (!m_pendingBatches.empty() && !m_decisionsTimer)
+  {
+    m_decisionsTimer = SetTimer(nullptr, 0, TIMER_INTERVAL_SHOULD_BLOCK_DECISIONS, &CPluginDomTraverser::OnDecisionsTimer);
+    if (m_decisionsTimer)
+    {
+      s_decisionsTimers.AddIfAbsent(m_decisionsTimer, this);
+    }
+  }
+}
+
+
+void CPluginDomTraverser::QueueShouldBlock(IHTMLElement* pEl, const std::wstring& type, const std::wstring& src, AdblockPlus::FilterEngine::ContentType contentType)
+{
+  ShouldBlockRequest request;
+  request.src = src;
+  request.contentType = contentType;
+  m_queuedRequests.push_back(request);
+
+  PendingElement element;
+  element.element = pEl;
+  pEl->QueryInterface(&element.identity);
+  element.type = type;
+  element.src = src;
+  m_queuedElements.push_back(element);
+}
+
+
+void CPluginDomTraverser::ApplyReadyDecisions()
+{
+  for (auto batch = m_pendingBatches.begin(); batch != m_pendingBatches.end();)
+  {
+    if (!batch->decisions->IsReady())
+    {
+      ++batch;
+      continue;
+    }
+    const std::vector<bool>& results = batch->decisions->GetResults();
+    for (size_t i = 0; i < results.size() && i < batch->elements.size(); i++)
+    {
+      if (results[i])
+      {
+        const PendingElement& pending = batch->elements[i];
+        HideElement(pending.element, pending.type, pending.src, true, L"");
+        // So that the element isn't queued again by the next traversal. The
+        // entry is gone if the cache has been cleared in the meantime.
+        m_criticalSection.Lock();
+        {
+          CPluginDomTraverserCache* cache = pending.identity ? m_cacheElements.Find(pending.identity.p) : nullptr;
+          if (cache)
+          {
+            cache->m_isHidden = true;
+          }
+        }
+        m_criticalSection.Unlock();
+      }
+    }
+    batch = m_pendingBatches.erase(batch);
+  }
+
+  if (m_pendingBatches.empty())
+  {
+    StopDecisionsTimer();
+  }
+}
+
+
+void CPluginDomTraverser::StopDecisionsTimer()
+{
+  if (m_decisionsTimer)
+  {
+    KillTimer(nullptr, m_decisionsTimer);
+    s_decisionsTimers.RemoveIfPresent(m_decisionsTimer);
+    m_decisionsTimer = 0;
+  }
+}
+
+
+void CALLBACK CPluginDomTraverser::OnDecisionsTimer(HWND, UINT, UINT_PTR timerId, DWORD)
+{
+  CPluginDomTraverser* traverser = s_decisionsTimers.Locate(timerId);
+  if (!traverser)
+  {
+    KillTimer(nullptr, timerId);
+    return;
+  }
+  traverser->ApplyReadyDecisions();
+}
+
+
+void CPluginDomTraverser::StopTraversalTimer()
+{
+  if (m_traversalTimer)
+  {
+    KillTimer(nullptr, m_traversalTimer);
+    s_traversalTimers.RemoveIfPresent(m_traversalTimer);
+    m_traversalTimer = 0;
+  }
+}
+
+
+void CALLBACK CPluginDomTraverser::OnTraversalTimer(HWND, UINT, UINT_PTR timerId, DWORD)
+{
+  CPluginDomTraverser* traverser = s_traversalTimers.Locate(timerId);
+  if (!traverser)
+  {
+    KillTimer(nullptr, timerId);
+    return;
+  }
+  traverser->ContinueTraversal();
+}
+
+
 bool CPluginDomTraverser::IsEnabled()
 {
   CPluginClient* client = CPluginClient::GetInstance();
@@ -141,7 +306,11 @@ void CPluginDomTraverser::HideElement(IHTMLElement* pEl, const std::wstring& typ
       return;
     }
     static const CComBSTR sbstrNone(L"none");
-    if (SUCCEEDED(pStyle->put_display(sbstrNone)))
+    // Changing the style attribute isn't a change of the page
+    m_isModifyingElement = true;
+    HRESULT hr = pStyle->put_display(sbstrNone);
+    m_isModifyingElement = false;
+    if (SUCCEEDED(hr))
     {
       DEBUG_HIDE_EL(indent + L"HideEl::Hiding " + type + L" url:" + url)
 #ifdef ENABLE_DEBUG_RESULT
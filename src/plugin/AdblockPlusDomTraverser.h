@@ -20,6 +20,7 @@
 
 
 #include "PluginDomTraverserBase.h"
+#include "AdblockPlusClient.h"
 
 
 class CPluginTab;
@@ -43,16 +44,57 @@ class CPluginDomTraverser : public CPluginDomTraverserBase<CPluginDomTraverserCa
 public:
 
   explicit CPluginDomTraverser(const PluginFilterPtr& pluginFilter);
+  ~CPluginDomTraverser();
 
 protected:
 
   bool OnIFrame(IHTMLElement* pEl, const std::wstring& url, const std::wstring& indent);
   bool OnElement(IHTMLElement* pEl, const std::wstring& tag, CPluginDomTraverserCache* cache, bool isDebug, const std::wstring& indent);
+  void OnTraversalComplete(const TraversalStats& stats);
+  void OnTraversalSuspended(const TraversalStats& stats);
 
   bool IsEnabled();
 
   void HideElement(IHTMLElement* pEl, const std::wstring& type, const std::wstring& url, bool isDebug, const std::wstring& indent);
 
+private:
+
+  struct PendingElement
+  {
+    CComPtr<IHTMLElement> element;
+    // Finds the cache entry of the element once the decision arrives
+    CComPtr<IUnknown> identity;
+    std::wstring type;
+    std::wstring src;
+  };
+
+  struct PendingBatch
+  {
+    PendingShouldBlockPtr decisions;
+    std::vector<PendingElement> elements;
+  };
+
+  // Elements are collected during the traversal and their blocking decisions
+  // are requested as one batch at the end of every traversal slice.
+  void QueueShouldBlock(IHTMLElement* pEl, const std::wstring& type, const std::wstring& src, AdblockPlus::FilterEngine::ContentType contentType);
+  void RequestQueuedDecisions();
+  void ApplyReadyDecisions();
+  void StopDecisionsTimer();
+  static void CALLBACK OnDecisionsTimer(HWND hWnd, UINT message, UINT_PTR timerId, DWORD time);
+
+  // Continues a suspended traversal from the message loop
+  void StopTraversalTimer();
+  static void CALLBACK OnTraversalTimer(HWND hWnd, UINT message, UINT_PTR timerId, DWORD time);
+
+  std::vector<ShouldBlockRequest> m_queuedRequests;
+  std::vector<PendingElement> m_queuedElements;
+  std::vector<PendingBatch> m_pendingBatches;
+  UINT_PTR m_decisionsTimer;
+  UINT_PTR m_traversalTimer;
+
+  // Element hiding statistics of the current traversal
+  size_t m_matchedElements;
+  size_t m_matchingComCalls;
 };
 
 
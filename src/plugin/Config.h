@@ -20,6 +20,34 @@
 
 #define TIMER_THREAD_SLEEP_TAB_LOOP 10000
 
+// How often the DOM traverser polls for pending blocking decisions (ms)
+#define TIMER_INTERVAL_SHOULD_BLOCK_DECISIONS 15
+// Time the DOM traversal may block the UI thread before it yields, and the
+// delay before it continues
+#define DOM_TRAVERSAL_SLICE_BUDGET_MS 20
+#define TIMER_INTERVAL_DOM_TRAVERSAL_SLICE 10
+// While DOM mutation events are observed, the whole document is traversed at
+// most this often, and at most this many mutated elements wait for matching
+#define DOM_FULL_TRAVERSAL_INTERVAL 5000
+#define DOM_MUTATION_QUEUE_MAX 4096
+// Frame documents observed at once, the oldest one is dropped beyond that
+#define DOM_MUTATION_MAX_DOCUMENTS 32
+
+// Elements remembered per traverser, the cache is cleared on the next full
+// traversal beyond that, since its entries keep removed elements alive
+#define DOM_ELEMENT_CACHE_MAX 65536
+
+// Upper bounds of the frame URLs remembered per tab and per traverser
+#define FRAME_CACHE_CAPACITY 1024
+#define DOCUMENT_FRAME_CACHE_CAPACITY 256
+
+// Upper bound for the threads parsing the element hiding selectors
+#define FILTER_PARSE_MAX_THREADS 4
+
+// Bounds of the element hiding rules injected into the stylesheet
+#define CSS_RULE_MAX_SELECTORS 200
+#define CSS_RULE_MAX_LENGTH 16384
+
 // Should we to on debug information
 #ifdef _DEBUG
 #define ENABLE_DEBUG_INFO
@@ -109,6 +137,28 @@
 
 #define ENGINE_STARTUP_TIMEOUT 10000
 
+// Deadlines of the calls to the engine, in milliseconds. A call which is not
+// answered in time fails open, i.e. nothing gets blocked or hidden. Only
+// the per-request matching calls get the short deadline, the element hiding
+// selectors and index may take longer on a cold engine.
+#define ENGINE_CALL_TIMEOUT_MATCHING 1000
+#define ENGINE_CALL_TIMEOUT_DEFAULT 5000
+// Added to the matching deadline per URL of a batch
+#define ENGINE_CALL_TIMEOUT_MATCHING_PER_URL 10
+
+// Asynchronous matching: URLs per engine call and bounds of its worker, one
+// thread is enough since the calls share the pipe
+#define SHOULD_BLOCK_BATCH_MAX 100
+#define SHOULD_BLOCK_WORKER_THREADS 1
+#define SHOULD_BLOCK_WORKER_QUEUE_SIZE 64
+
+// Bounds of the worker pool which builds the element hiding filters
+#define FILTER_WORKER_THREADS 2
+#define FILTER_WORKER_QUEUE_SIZE 16
+
+// Number of parsed element hiding filters kept per process
+#define FILTER_CACHE_SIZE 32
+
 
 
 #endif // _CONFIG_H
@@ -0,0 +1,214 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginStdAfx.h"
+#include "DomMutationListener.h"
+#include "PluginUtil.h"
+#include "../shared/Utils.h"
+#include <algorithm>
+
+namespace
+{
+  const wchar_t* const nodeInsertedEvent = L"DOMNodeInserted";
+  const wchar_t* const attrModifiedEvent = L"DOMAttrModified";
+}
+
+DomMutationListener::DomMutationListener(const std::vector<std::wstring>& attributeNames, bool hasSiblingCombinators,
+                                         const OnMutation& onMutation)
+  : m_refCount(0), m_onMutation(onMutation), m_attributeNames(attributeNames), m_hasSiblingCombinators(hasSiblingCombinators)
+{
+}
+
+DomMutationListener::~DomMutationListener()
+{
+}
+
+ATL::CComPtr<DomMutationListener> DomMutationListener::Subscribe(IDispatch* document, const std::vector<std::wstring>& attributeNames,
+                                                                 bool hasSiblingCombinators, const OnMutation& onMutation)
+{
+  ATL::CComPtr<DomMutationListener> listener;
+  ATL::CComQIPtr<IEventTarget> target = document;
+  if (!target)
+  {
+    // Before IE9 or not in standards mode
+    return listener;
+  }
+  listener = new DomMutationListener(attributeNames, hasSiblingCombinators, onMutation);
+  // Capturing, so that elements inserted by scripts which stop the propagation are seen too
+  if (FAILED(target->addEventListener(ATL::CComBSTR(nodeInsertedEvent), listener, VARIANT_TRUE)))
+  {
+    listener.Release();
+    return listener;
+  }
+  if (FAILED(target->addEventListener(ATL::CComBSTR(attrModifiedEvent), listener, VARIANT_TRUE)))
+  {
+    target->removeEventListener(ATL::CComBSTR(nodeInsertedEvent), listener, VARIANT_TRUE);
+    listener.Release();
+    return listener;
+  }
+  listener->m_target = target;
+  return listener;
+}
+
+void DomMutationListener::Unsubscribe()
+{
+  m_onMutation = nullptr;
+  if (m_target)
+  {
+    // The document keeps a reference to the listener until it is removed
+    ATL::CComPtr<IEventTarget> target;
+    target.Attach(m_target.Detach());
+    target->removeEventListener(ATL::CComBSTR(nodeInsertedEvent), this, VARIANT_TRUE);
+    target->removeEventListener(ATL::CComBSTR(attrModifiedEvent), this, VARIANT_TRUE);
+  }
+}
+
+// Element hiding selectors only depend on these attributes and the tag
+bool DomMutationListener::IsSelectorAttribute(const ATL::CComBSTR& name) const
+{
+  return name && std::binary_search(m_attributeNames.begin(), m_attributeNames.end(), ToLowerString(ToWstring(name)));
+}
+
+bool DomMutationListener::IsListeningTo(IUnknown* document) const
+{
+  return m_target && m_target.IsEqualObject(document);
+}
+
+STDMETHODIMP DomMutationListener::QueryInterface(REFIID riid, void **ppvObj)
+{
+  if (!ppvObj)
+  {
+    return E_POINTER;
+  }
+  if (riid == IID_IUnknown || riid == IID_IDispatch)
+  {
+    *ppvObj = static_cast<IDispatch*>(this);
+    AddRef();
+    return S_OK;
+  }
+  *ppvObj = nullptr;
+  return E_NOINTERFACE;
+}
+
+ULONG __stdcall DomMutationListener::AddRef()
+{
+  return InterlockedIncrement(&m_refCount);
+}
+
+ULONG __stdcall DomMutationListener::Release()
+{
+  LONG refCount = InterlockedDecrement(&m_refCount);
+  if (refCount == 0)
+  {
+    delete this;
+  }
+  return refCount;
+}
+
+STDMETHODIMP DomMutationListener::GetTypeInfoCount(UINT* pctinfo)
+{
+  return E_NOTIMPL;
+}
+
+STDMETHODIMP DomMutationListener::GetTypeInfo(UINT itinfo, LCID lcid, ITypeInfo** pptinfo)
+{
+  return E_NOTIMPL;
+}
+
+STDMETHODIMP DomMutationListener::GetIDsOfNames(REFIID riid, LPOLESTR* rgszNames, UINT cNames, LCID lcid, DISPID* rgdispid)
+{
+  return E_NOTIMPL;
+}
+
+/**
+ * The event object is the only argument, its target is the inserted node
+ * or the element whose attribute has been modified.
+ */
+STDMETHODIMP DomMutationListener::Invoke(DISPID dispidMember, REFIID riid, LCID lcid, WORD wFlags, DISPPARAMS* pDispparams, VARIANT* pVarResult,
+                                         EXCEPINFO* pExcepinfo, UINT* pArgErr)
+{
+  if (dispidMember != DISPID_VALUE)
+  {
+    return DISP_E_MEMBERNOTFOUND;
+  }
+  if (!pDispparams)
+  {
+    return E_POINTER;
+  }
+  if (pDispparams->cArgs < 1 || pDispparams->rgvarg[pDispparams->cArgs - 1].vt != VT_DISPATCH)
+  {
+    return S_OK;
+  }
+  if (!m_onMutation)
+  {
+    return S_OK;
+  }
+  ATL::CComQIPtr<IDOMEvent> event = pDispparams->rgvarg[pDispparams->cArgs - 1].pdispVal;
+  if (!event)
+  {
+    return S_OK;
+  }
+  ATL::CComBSTR type;
+  if (FAILED(event->get_type(&type)) || !type)
+  {
+    return S_OK;
+  }
+  if (_wcsicmp(type, attrModifiedEvent) == 0)
+  {
+    ATL::CComQIPtr<IDOMMutationEvent> mutationEvent = event;
+    ATL::CComBSTR attrName;
+    if (!mutationEvent || FAILED(mutationEvent->get_attrName(&attrName)) || !IsSelectorAttribute(attrName))
+    {
+      return S_OK;
+    }
+  }
+  else if (_wcsicmp(type, nodeInsertedEvent) != 0)
+  {
+    return S_OK;
+  }
+  ATL::CComPtr<IEventTarget> target;
+  if (FAILED(event->get_target(&target)) || !target)
+  {
+    return S_OK;
+  }
+  // Text and comment nodes don't need to be matched
+  ATL::CComQIPtr<IHTMLElement> element = target;
+  if (!element)
+  {
+    return S_OK;
+  }
+  m_onMutation(element);
+  // With `+` and `~` the following siblings can match or stop matching too,
+  // the preceding ones and the rest of the parent's subtree can't
+  ATL::CComQIPtr<IHTMLDOMNode> node = element;
+  while (m_hasSiblingCombinators && node && m_onMutation)
+  {
+    ATL::CComPtr<IHTMLDOMNode> sibling;
+    if (FAILED(node->get_nextSibling(&sibling)) || !sibling)
+    {
+      break;
+    }
+    long nodeType = 0;
+    ATL::CComQIPtr<IHTMLElement> siblingElement = sibling;
+    if (SUCCEEDED(sibling->get_nodeType(&nodeType)) && nodeType == 1 && siblingElement)
+    {
+      m_onMutation(siblingElement);
+    }
+    node = sibling;
+  }
+  return S_OK;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DOM_MUTATION_LISTENER_H_
+#define _DOM_MUTATION_LISTENER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+Forwards the DOM mutation events of a document, available from IE9 on in
+standards mode, to a callback. The events are dispatched synchronously while
+the page modifies the DOM, so the callback should only queue the element.
+*/
+class DomMutationListener : public IDispatch
+{
+public:
+  // Called for inserted elements and for elements with a changed attribute
+  // the selectors depend on. If the selectors have sibling combinators, it
+  // is called for each of the element's following siblings as well.
+  typedef std::function<void(IHTMLElement* element)> OnMutation;
+
+  // Returns nullptr if the document doesn't support mutation events.
+  // `attributeNames` are sorted and lower case, see CPluginFilter::GetAttributeNames.
+  static ATL::CComPtr<DomMutationListener> Subscribe(IDispatch* document, const std::vector<std::wstring>& attributeNames,
+    bool hasSiblingCombinators, const OnMutation& onMutation);
+  // Removes the listener from the document, the callback isn't called anymore
+  void Unsubscribe();
+  bool IsListeningTo(IUnknown* document) const;
+
+  // IUnknown
+  STDMETHOD(QueryInterface)(REFIID riid, void **ppvObj);
+  ULONG __stdcall AddRef();
+  ULONG __stdcall Release();
+
+  // IDispatch
+  STDMETHOD(GetTypeInfoCount)(UINT* pctinfo);
+  STDMETHOD(GetTypeInfo)(UINT itinfo, LCID lcid, ITypeInfo** pptinfo);
+  STDMETHOD(GetIDsOfNames)(REFIID riid, LPOLESTR* rgszNames, UINT cNames, LCID lcid, DISPID* rgdispid);
+  STDMETHOD(Invoke)(DISPID dispidMember, REFIID riid, LCID lcid, WORD wFlags, DISPPARAMS* pDispparams, VARIANT* pVarResult,
+    EXCEPINFO* pExcepinfo, UINT* pArgErr);
+
+private:
+  DomMutationListener(const std::vector<std::wstring>& attributeNames, bool hasSiblingCombinators, const OnMutation& onMutation);
+  bool IsSelectorAttribute(const ATL::CComBSTR& name) const;
+  ~DomMutationListener();
+  DomMutationListener(const DomMutationListener&);
+  void operator=(const DomMutationListener&);
+
+  volatile LONG m_refCount;
+  ATL::CComPtr<IEventTarget> m_target;
+  OnMutation m_onMutation;
+  std::vector<std::wstring> m_attributeNames;
+  bool m_hasSiblingCombinators;
+};
+
+#endif // _DOM_MUTATION_LISTENER_H_
@@ -20,17 +20,40 @@
 
 #include "PluginTabBase.h"
 #include "PluginUtil.h"
+#include "DomMutationListener.h"
+#include "../shared/ElementCache.h"
+#include "../shared/UrlHashSet.h"
 
 class CPluginDomTraverserCacheBase
 {
 public:
 
   long m_elements;
+  // Keeps the element alive, so that its address identifies it in the cache
+  CComPtr<IUnknown> m_identity;
 
   CPluginDomTraverserCacheBase() : m_elements(0) {};
   void Init() { m_elements=0; }
 };
 
+// Counted per TraverseDocument/TraverseSubdocument call, frames included, or
+// per batch of mutated elements
+struct TraversalStats
+{
+  TraversalStats() : elements(0), mutatedElements(0), skippedSubtrees(0), maxDepth(0), slices(0), wallMs(0), longestSliceMs(0) {}
+  size_t elements;
+  // Elements which were traversed because they were inserted or changed
+  size_t mutatedElements;
+  // Subtrees whose element count didn't change since the last traversal
+  size_t skippedSubtrees;
+  size_t maxDepth;
+  // Number of times the traversal ran, it yields when its budget is used up
+  size_t slices;
+  // Time spent traversing, the time between the slices isn't included
+  double wallMs;
+  double longestSliceMs;
+};
+
 template <class T>
 class CPluginDomTraverserBase
 {
@@ -42,8 +65,18 @@ public:
 
   void TraverseHeader(bool isHeaderTraversed);
 
+  // Start a traversal, a running one is abandoned. The first slice is run
+  // right away, ContinueTraversal has to be called until it returns true.
+  // While mutation events of the main document are observed, only inserted
+  // and changed elements are matched and this is a periodic fallback.
   void TraverseDocument(IWebBrowser2* pBrowser, const std::wstring& domain, const std::wstring& documentUrl);
   void TraverseSubdocument(IWebBrowser2* pBrowser, const std::wstring& domain, const std::wstring& documentUrl);
+  // Runs the traversal until it is complete or the slice budget is used up.
+  // Returns true if there is nothing left to traverse.
+  bool ContinueTraversal();
+  bool IsTraversing() const;
+  // 0 disables slicing, the whole document is traversed at once
+  void SetSliceBudget(double milliseconds);
 
   virtual void ClearCache();
 
@@ -51,13 +84,30 @@ protected:
 
   virtual bool OnIFrame(IHTMLElement* pEl, const std::wstring& url, const std::wstring& indent) { return true; }
   virtual bool OnElement(IHTMLElement* pEl, const std::wstring& tag, T* cache, bool isDebug, const std::wstring& indent) { return true; }
+  // Called once the whole document including its frames has been traversed
+  virtual void OnTraversalComplete(const TraversalStats& stats) {}
+  // Called when a slice used up its budget or mutated elements have been
+  // queued, ContinueTraversal has to be called later on the same thread
+  virtual void OnTraversalSuspended(const TraversalStats& stats) {}
 
   virtual bool IsEnabled();
 
 protected:
 
-  void TraverseDocument(IWebBrowser2* pBrowser, bool isMainDoc, const std::wstring& indent);
-  void TraverseChild(IHTMLElement* pEl, IWebBrowser2* pBrowser, const std::wstring& indent, bool isCached=true);
+  // Visits the root element of the document and pushes its children
+  void BeginDocument(IWebBrowser2* pBrowser, bool isMainDoc);
+  // Queues the frames and iframes of the document which has been traversed
+  void QueueFrames(IHTMLDocument3* pDoc);
+  void ObserveMutations(IWebBrowser2* pBrowser, IDispatch* pDocDispatch, bool isMainDoc);
+  void QueueMutatedElement(IHTMLElement* pEl);
+  void StopObservingMutations();
+  // Returns true if the children of the element have to be traversed, they
+  // have to be pushed with the number of elements in its subtree then.
+  // `isCached` is reset if the element wasn't cached, its children aren't either then.
+  bool VisitElement(IHTMLElement* pEl, const std::wstring& indent, bool& isCached, long& allElementsCount);
+  // Records the number of elements in the subtree of a traversed element, the
+  // next traversal skips the subtree if the number didn't change
+  void CompleteSubtree(IUnknown* identity, long allElementsCount);
 
   CComAutoCriticalSection m_criticalSection;
 
@@ -66,28 +116,89 @@ protected:
 
   bool m_isHeaderTraversed;
 
-  int m_cacheIndexLast;
-  int m_cacheElementsMax;
-  std::set<std::wstring> m_cacheDocumentHasFrames;
-  std::set<std::wstring> m_cacheDocumentHasIframes;
-
-  T* m_cacheElements;
+  // The children of an element which are still to be traversed
+  struct TraversalFrame
+  {
+    TraversalFrame() : parentElements(0), childIndex(0), childCount(0), depth(0), isCached(true) {}
+    // Whose children these are, its subtree is complete once the frame is
+    // popped. An abandoned traversal leaves it incomplete and not skipped.
+    CComPtr<IUnknown> parent;
+    long parentElements;
+    // Next sibling to visit
+    CComPtr<IHTMLDOMNode> node;
+    // Used instead of node if IHTMLDOMNode isn't available
+    CComPtr<IHTMLElementCollection> children;
+    long childIndex;
+    long childCount;
+    size_t depth;
+    bool isCached;
+  };
+
+  struct PendingDocument
+  {
+    PendingDocument(IWebBrowser2* browser, bool isMainDoc) : browser(browser), isMainDoc(isMainDoc) {}
+    CComPtr<IWebBrowser2> browser;
+    bool isMainDoc;
+  };
+
+  void StartTraversal(IWebBrowser2* pBrowser, bool isMainDoc);
+  bool PushChildren(IHTMLElement* pEl, size_t depth, bool isCached, long allElementsCount);
+  static CComPtr<IHTMLElement> NextChild(TraversalFrame& frame);
+
+  // The traversal cursor: the elements of the current document which are
+  // left, then its frames, then the documents still to be traversed.
+  // Depth first and in document order, without recursion.
+  std::vector<TraversalFrame> m_traversalStack;
+  CComPtr<IHTMLDocument3> m_traversalDocument;
+  std::vector<PendingDocument> m_pendingDocuments;
+  TraversalStats m_traversalStats;
+  double m_sliceBudgetMs;
+
+  struct ObservedDocument
+  {
+    // Identifies the frame, its document is replaced when it navigates
+    CComPtr<IUnknown> browser;
+    CComPtr<DomMutationListener> listener;
+    bool isMainDoc;
+  };
+
+  // One listener per document, at most DOM_MUTATION_MAX_DOCUMENTS, see ObserveMutations
+  std::vector<ObservedDocument> m_observedDocuments;
+  // Inserted and changed elements, they are matched after the cursor is done
+  std::vector<CComPtr<IHTMLElement> > m_mutatedElements;
+  // Set if elements were dropped, the next full traversal finds them
+  bool m_isMutationQueueOverflown;
+  // Set while the traverser changes an element itself, e.g. hides it. The
+  // mutation events are dispatched synchronously and ignored meanwhile.
+  bool m_isModifyingElement;
+  CComPtr<IUnknown> m_observedMainDocument;
+  DWORD m_lastFullTraversal;
+
+  // Per element state by COM identity, the page itself is never modified
+  ElementCache<T> m_cacheElements;
+  // Identity of the body of the main document, a new one means a new document
+  CComPtr<IUnknown> m_cacheBody;
+  // Document URLs, bounded for long lived pages changing their URL
+  UrlHashSet m_cacheDocumentHasFrames;
+  UrlHashSet m_cacheDocumentHasIframes;
 
   std::shared_ptr<const CPluginFilter> m_pluginFilter;
 };
 
 template <class T>
 CPluginDomTraverserBase<T>::CPluginDomTraverserBase(const PluginFilterPtr& pluginFilter)
-  : m_pluginFilter(pluginFilter), m_isHeaderTraversed(false), m_cacheIndexLast(0), m_cacheElementsMax(5000)
+  : m_pluginFilter(pluginFilter), m_isHeaderTraversed(false), m_sliceBudgetMs(DOM_TRAVERSAL_SLICE_BUDGET_MS),
+    m_isMutationQueueOverflown(false), m_isModifyingElement(false), m_lastFullTraversal(0),
+    m_cacheDocumentHasFrames(DOCUMENT_FRAME_CACHE_CAPACITY), m_cacheDocumentHasIframes(DOCUMENT_FRAME_CACHE_CAPACITY)
 {
-  m_cacheElements = new T[m_cacheElementsMax];
 }
 
 
 template <class T>
 CPluginDomTraverserBase<T>::~CPluginDomTraverserBase()
 {
-  delete [] m_cacheElements;
+  // The documents might outlive us
+  StopObservingMutations();
 }
 
 template <class T>
@@ -101,7 +212,7 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, const
 {
   m_domain = domain;
   m_documentUrl = documentUrl;
-  TraverseDocument(pBrowser, true, L"");
+  StartTraversal(pBrowser, true);
 }
 
 
@@ -110,7 +221,154 @@ void CPluginDomTraverserBase<T>::TraverseSubdocument(IWebBrowser2* pBrowser, con
 {
   m_domain = domain;
   m_documentUrl = documentUrl;
-  TraverseDocument(pBrowser, false, L"");
+  StartTraversal(pBrowser, false);
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::StartTraversal(IWebBrowser2* pBrowser, bool isMainDoc)
+{
+  bool isCacheFull = isMainDoc && m_cacheElements.GetSize() >= DOM_ELEMENT_CACHE_MAX;
+  if (isMainDoc && !isCacheFull && m_observedMainDocument && !m_isMutationQueueOverflown &&
+      GetTickCount() - m_lastFullTraversal < DOM_FULL_TRAVERSAL_INTERVAL)
+  {
+    // The mutation events cover the changes since the last full traversal
+    CComPtr<IDispatch> pDocDispatch;
+    if (SUCCEEDED(pBrowser->get_Document(&pDocDispatch)) && m_observedMainDocument.IsEqualObject(pDocDispatch))
+    {
+      return;
+    }
+  }
+  if (isMainDoc)
+  {
+    m_lastFullTraversal = GetTickCount();
+    m_isMutationQueueOverflown = false;
+  }
+  if (isCacheFull)
+  {
+    // Elements removed from the page are only released this way, all
+    // elements are matched again by the traversal starting here
+    m_criticalSection.Lock();
+    {
+      m_cacheElements.Clear();
+    }
+    m_criticalSection.Unlock();
+  }
+
+  m_traversalStats = TraversalStats();
+  m_traversalStack.clear();
+  m_traversalDocument.Release();
+  m_pendingDocuments.clear();
+  m_pendingDocuments.push_back(PendingDocument(pBrowser, isMainDoc));
+  ContinueTraversal();
+}
+
+
+template <class T>
+bool CPluginDomTraverserBase<T>::IsTraversing() const
+{
+  return !m_traversalStack.empty() || m_traversalDocument || !m_pendingDocuments.empty() || !m_mutatedElements.empty();
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::SetSliceBudget(double milliseconds)
+{
+  m_sliceBudgetMs = milliseconds;
+}
+
+
+template <class T>
+bool CPluginDomTraverserBase<T>::ContinueTraversal()
+{
+  if (!IsTraversing())
+  {
+    return true;
+  }
+
+  LARGE_INTEGER frequency, start, now;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&start);
+  LONGLONG budget = static_cast<LONGLONG>(m_sliceBudgetMs * frequency.QuadPart / 1000);
+  now = start;
+#ifndef ENABLE_DEBUG_INFO
+  const std::wstring indent;
+#endif
+
+  // At least one element is visited per slice, so that the traversal progresses
+  do
+  {
+    if (!m_traversalStack.empty())
+    {
+      TraversalFrame& frame = m_traversalStack.back();
+      CComPtr<IHTMLElement> element = NextChild(frame);
+      if (!element)
+      {
+        CompleteSubtree(frame.parent, frame.parentElements);
+        m_traversalStack.pop_back();
+        continue;
+      }
+      // Copied, the frame reference is invalidated by PushChildren
+      size_t depth = frame.depth;
+      bool isChildCached = frame.isCached;
+#ifdef ENABLE_DEBUG_INFO
+      std::wstring indent(2 * depth, L' ');
+#endif
+      long allElementsCount = 0;
+      if (VisitElement(element, indent, isChildCached, allElementsCount))
+      {
+        PushChildren(element, depth + 1, isChildCached, allElementsCount);
+      }
+    }
+    else if (m_traversalDocument)
+    {
+      CComPtr<IHTMLDocument3> pDoc;
+      pDoc.Attach(m_traversalDocument.Detach());
+      QueueFrames(pDoc);
+    }
+    else if (!m_pendingDocuments.empty())
+    {
+      PendingDocument document = m_pendingDocuments.back();
+      m_pendingDocuments.pop_back();
+      BeginDocument(document.browser, document.isMainDoc);
+    }
+    else if (!m_mutatedElements.empty())
+    {
+      CComPtr<IHTMLElement> element;
+      element.Attach(m_mutatedElements.back().Detach());
+      m_mutatedElements.pop_back();
+      m_traversalStats.mutatedElements++;
+      // Not cached, so that changed elements are matched again
+      bool isCached = false;
+      long allElementsCount = 0;
+      if (VisitElement(element, L"", isCached, allElementsCount))
+      {
+        PushChildren(element, 1, isCached, allElementsCount);
+      }
+    }
+    else
+    {
+      break;
+    }
+    QueryPerformanceCounter(&now);
+  }
+  while (m_sliceBudgetMs <= 0 || now.QuadPart - start.QuadPart < budget);
+
+  double sliceMs = 1000.0 * (now.QuadPart - start.QuadPart) / frequency.QuadPart;
+  m_traversalStats.slices++;
+  m_traversalStats.wallMs += sliceMs;
+  if (sliceMs > m_traversalStats.longestSliceMs)
+  {
+    m_traversalStats.longestSliceMs = sliceMs;
+  }
+
+  if (IsTraversing())
+  {
+    OnTraversalSuspended(m_traversalStats);
+    return false;
+  }
+  OnTraversalComplete(m_traversalStats);
+  return true;
 }
 
 
@@ -122,7 +380,7 @@ bool CPluginDomTraverserBase<T>::IsEnabled()
 
 
 template <class T>
-void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool isMainDoc, const std::wstring& indent)
+void CPluginDomTraverserBase<T>::BeginDocument(IWebBrowser2* pBrowser, bool isMainDoc)
 {
   if (!IsEnabled()) return;
 
@@ -182,30 +440,39 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
     }
   }
 
-  // Clear cache (if eg. refreshing) ???
+  // Clear cache if the document has been replaced, e.g. when refreshing
   if (isMainDoc)
   {
-    CComVariant vCacheIndex;
-
-    if (FAILED(pBodyEl->getAttribute(ATL::CComBSTR(L"abp"), 0, &vCacheIndex)) || vCacheIndex.vt == VT_NULL)
+    CComPtr<IUnknown> bodyIdentity;
+    pBodyEl->QueryInterface(&bodyIdentity);
+    if (!bodyIdentity || !m_cacheBody.IsEqualObject(bodyIdentity))
     {
       ClearCache();
+      m_cacheBody = bodyIdentity;
     }
   }
 
+  ObserveMutations(pBrowser, pDocDispatch, isMainDoc);
+
   // Hide elements in body part
-  TraverseChild(pBodyEl, pBrowser, indent);
+  bool isCached = true;
+  long allElementsCount = 0;
+  if (VisitElement(pBodyEl, L"", isCached, allElementsCount))
+  {
+    PushChildren(pBodyEl, 1, isCached, allElementsCount);
+  }
+  // Its frames are queued once all its elements have been traversed
+  m_traversalDocument = pDoc;
+}
 
+template <class T>
+void CPluginDomTraverserBase<T>::QueueFrames(IHTMLDocument3* pDoc)
+{
   // Check frames and iframes
-  bool hasFrames = false;
-  bool hasIframes = false;
+  bool hasFrames = m_cacheDocumentHasFrames.Contains(m_documentUrl);
+  bool hasIframes = m_cacheDocumentHasIframes.Contains(m_documentUrl);
 
-  m_criticalSection.Lock();
-  {
-    hasFrames = m_cacheDocumentHasFrames.find(m_documentUrl) != m_cacheDocumentHasFrames.end();
-    hasIframes = m_cacheDocumentHasIframes.find(m_documentUrl) != m_cacheDocumentHasIframes.end();
-  }
-  m_criticalSection.Unlock();
+  std::vector<CComPtr<IWebBrowser2> > frameBrowsers;
 
   // Frames
   if (hasFrames)
@@ -238,7 +505,7 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
           }
           if (!src.empty())
           {
-            TraverseDocument(pFrameBrowser, false, indent);
+            frameBrowsers.push_back(pFrameBrowser);
           }
         }
       }
@@ -287,12 +554,12 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
               }
 
               // Check if Iframe should be traversed
-              if (OnIFrame(pFrameEl, src, indent))
+              if (OnIFrame(pFrameEl, src, L""))
               {
                 CComQIPtr<IWebBrowser2> pFrameBrowser = pFrameDispatch;
                 if (pFrameBrowser)
                 {
-                  TraverseDocument(pFrameBrowser, false, indent);
+                  frameBrowsers.push_back(pFrameBrowser);
                 }
               }
             }
@@ -301,55 +568,142 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
       }
     }
   }
+
+  // Reversed, the pending documents are a stack
+  for (auto it = frameBrowsers.rbegin(); it != frameBrowsers.rend(); ++it)
+  {
+    m_pendingDocuments.push_back(PendingDocument(*it, false));
+  }
 }
 
 template <class T>
-void CPluginDomTraverserBase<T>::TraverseChild(IHTMLElement* pEl, IWebBrowser2* pBrowser, const std::wstring& indent, bool isCached)
+void CPluginDomTraverserBase<T>::ObserveMutations(IWebBrowser2* pBrowser, IDispatch* pDocDispatch, bool isMainDoc)
 {
-  int  cacheIndex = -1;
-  long cacheAllElementsCount = -1;
-
-  m_criticalSection.Lock();
+  CComPtr<IUnknown> browserIdentity;
+  if (FAILED(pBrowser->QueryInterface(&browserIdentity)) || !browserIdentity)
+  {
+    return;
+  }
+  for (auto it = m_observedDocuments.begin(); it != m_observedDocuments.end(); ++it)
   {
-    CComVariant vCacheIndex;
-    if (isCached && SUCCEEDED(pEl->getAttribute(ATL::CComBSTR(L"abp"), 0, &vCacheIndex)) && vCacheIndex.vt == VT_I4)
+    if (it->listener->IsListeningTo(pDocDispatch))
     {
-      cacheIndex = vCacheIndex.intVal;
-
-      cacheAllElementsCount = m_cacheElements[cacheIndex].m_elements;
+      return;
     }
-    else
+    if (it->browser.IsEqualObject(browserIdentity))
     {
-      isCached = false;
-
-      cacheIndex = m_cacheIndexLast++;
-
-      // Resize cache???
-      if (cacheIndex >= m_cacheElementsMax)
+      // The frame navigated, the listener would keep its old document alive
+      it->listener->Unsubscribe();
+      m_observedDocuments.erase(it);
+      break;
+    }
+  }
+  if (m_observedDocuments.size() >= DOM_MUTATION_MAX_DOCUMENTS)
+  {
+    // Removed frames aren't noticed, so the oldest frame document is dropped.
+    // Its changes are found by the next full traversal.
+    for (auto it = m_observedDocuments.begin(); it != m_observedDocuments.end(); ++it)
+    {
+      if (!it->isMainDoc)
       {
-        T* oldCacheElements = m_cacheElements;
-
-        m_cacheElements = new T[2*m_cacheElementsMax];
-
-        memcpy(m_cacheElements, oldCacheElements, m_cacheElementsMax*sizeof(T));
+        it->listener->Unsubscribe();
+        m_observedDocuments.erase(it);
+        break;
+      }
+    }
+  }
+  CComPtr<DomMutationListener> listener = DomMutationListener::Subscribe(pDocDispatch,
+    m_pluginFilter->GetAttributeNames(), m_pluginFilter->HasSiblingCombinators(),
+    [this](IHTMLElement* pEl)
+    {
+      QueueMutatedElement(pEl);
+    });
+  if (!listener)
+  {
+    return;
+  }
+  ObservedDocument document;
+  document.browser = browserIdentity;
+  document.listener = listener;
+  document.isMainDoc = isMainDoc;
+  m_observedDocuments.push_back(document);
+  if (isMainDoc)
+  {
+    m_observedMainDocument = pDocDispatch;
+  }
+}
 
-        m_cacheElementsMax *= 2;
+template <class T>
+void CPluginDomTraverserBase<T>::QueueMutatedElement(IHTMLElement* pEl)
+{
+  if (m_isModifyingElement)
+  {
+    return;
+  }
+  if (m_mutatedElements.size() >= DOM_MUTATION_QUEUE_MAX)
+  {
+    m_isMutationQueueOverflown = true;
+    return;
+  }
+  // Scripts often change the same element several times in a row
+  if (!m_mutatedElements.empty() && m_mutatedElements.back().IsEqualObject(pEl))
+  {
+    return;
+  }
+  bool isIdle = !IsTraversing();
+  m_mutatedElements.push_back(pEl);
+  if (isIdle)
+  {
+    m_traversalStats = TraversalStats();
+    OnTraversalSuspended(m_traversalStats);
+  }
+}
 
-        delete [] oldCacheElements;
-      }
+template <class T>
+void CPluginDomTraverserBase<T>::StopObservingMutations()
+{
+  for (auto it = m_observedDocuments.begin(); it != m_observedDocuments.end(); ++it)
+  {
+    it->listener->Unsubscribe();
+  }
+  m_observedDocuments.clear();
+  m_mutatedElements.clear();
+  m_observedMainDocument.Release();
+}
 
-      m_cacheElements[cacheIndex].Init();
+template <class T>
+bool CPluginDomTraverserBase<T>::VisitElement(IHTMLElement* pEl, const std::wstring& indent, bool& isCached, long& allElementsCount)
+{
+  T* cache = nullptr;
+  long cacheAllElementsCount = -1;
+  m_traversalStats.elements++;
 
-      vCacheIndex.vt = VT_I4;
-      vCacheIndex.intVal = cacheIndex;
+  // The IUnknown pointer is the identity of the COM object
+  CComPtr<IUnknown> identity;
+  if (FAILED(pEl->QueryInterface(&identity)) || !identity)
+  {
+    return false;
+  }
 
-      pEl->setAttribute(ATL::CComBSTR(L"abp"), vCacheIndex);
+  m_criticalSection.Lock();
+  {
+    bool isNew = false;
+    cache = &m_cacheElements.Get(identity.p, isNew);
+    if (isCached && !isNew)
+    {
+      cacheAllElementsCount = cache->m_elements;
+    }
+    else
+    {
+      isCached = false;
+      cache->Init();
+      cache->m_identity = identity;
     }
   }
   m_criticalSection.Unlock();
 
   // Get number of elements in the scope of pEl
-  long allElementsCount = 0;
+  allElementsCount = 0;
 
   CComPtr<IDispatch> pAllCollectionDisp;
 
@@ -359,101 +713,150 @@ void CPluginDomTraverserBase<T>::TraverseChild(IHTMLElement* pEl, IWebBrowser2*
 
     if (SUCCEEDED(pAllCollectionDisp->QueryInterface(&pAllCollection)) && pAllCollection)
     {
-      // If number of elements = cached number, return
+      // If number of elements = cached number, the subtree hasn't changed
       if (SUCCEEDED(pAllCollection->get_length(&allElementsCount)) && allElementsCount == cacheAllElementsCount)
       {
-        return;
+        m_traversalStats.skippedSubtrees++;
+        return false;
       }
     }
   }
 
-  // Update cache
-  m_criticalSection.Lock();
-  {
-    m_cacheElements[cacheIndex].m_elements = allElementsCount;
-  }
-  m_criticalSection.Unlock();
-
   // Get tag
   CComBSTR bstrTag;
   if (FAILED(pEl->get_tagName(&bstrTag)) || !bstrTag)
   {
-    return;
+    CompleteSubtree(identity, allElementsCount);
+    return false;
   }
   std::wstring tag = ToLowerString(ToWstring(bstrTag));
 
   // Custom OnElement
-  if (!OnElement(pEl, tag, &m_cacheElements[cacheIndex], false, indent))
+  if (!OnElement(pEl, tag, cache, false, indent))
   {
-    return;
+    CompleteSubtree(identity, allElementsCount);
+    return false;
   }
 
   // Update frame/iframe cache
   if (tag == L"iframe")
   {
-    m_criticalSection.Lock();
-    {
-      m_cacheDocumentHasIframes.insert(m_documentUrl);
-    }
-    m_criticalSection.Unlock();
+    m_cacheDocumentHasIframes.Insert(m_documentUrl);
   }
   else if (tag == L"frame")
   {
-    m_criticalSection.Lock();
+    m_cacheDocumentHasFrames.Insert(m_documentUrl);
+  }
+
+  if (allElementsCount == 0)
+  {
+    CompleteSubtree(identity, allElementsCount);
+    return false;
+  }
+  return true;
+}
+
+template <class T>
+void CPluginDomTraverserBase<T>::CompleteSubtree(IUnknown* identity, long allElementsCount)
+{
+  m_criticalSection.Lock();
+  {
+    // Gone if the cache has been cleared in the meantime
+    T* cache = m_cacheElements.Find(identity);
+    if (cache)
     {
-      m_cacheDocumentHasFrames.insert(m_documentUrl);
+      cache->m_elements = allElementsCount;
     }
-    m_criticalSection.Unlock();
   }
+  m_criticalSection.Unlock();
+}
 
-  // Iterate through children of this element
-  if (allElementsCount > 0)
+template <class T>
+bool CPluginDomTraverserBase<T>::PushChildren(IHTMLElement* pEl, size_t depth, bool isCached, long allElementsCount)
+{
+  TraversalFrame frame;
+  frame.depth = depth;
+  frame.isCached = isCached;
+  frame.parentElements = allElementsCount;
+  if (FAILED(pEl->QueryInterface(&frame.parent)) || !frame.parent)
+  {
+    return false;
+  }
+  // Walking the siblings avoids creating a collection per element
+  CComQIPtr<IHTMLDOMNode> node = pEl;
+  if (node)
+  {
+    node->get_firstChild(&frame.node);
+    if (!frame.node)
+    {
+      CompleteSubtree(frame.parent, allElementsCount);
+      return false;
+    }
+  }
+  else
   {
-    long childElementsCount = 0;
-
     CComPtr<IDispatch> pChildCollectionDisp;
-    if (SUCCEEDED(pEl->get_children(&pChildCollectionDisp)) && pChildCollectionDisp)
+    if (FAILED(pEl->get_children(&pChildCollectionDisp)) || !pChildCollectionDisp ||
+        FAILED(pChildCollectionDisp->QueryInterface(&frame.children)) || !frame.children ||
+        FAILED(frame.children->get_length(&frame.childCount)))
     {
-      CComPtr<IHTMLElementCollection> pChildCollection;
-      if (SUCCEEDED(pChildCollectionDisp->QueryInterface(&pChildCollection)) && pChildCollection)
-      {
-        pChildCollection->get_length(&childElementsCount);
-
-        CComVariant vIndex(0);
-
-        // Iterate through all children
-        for (long i = 0; i < childElementsCount; i++)
-        {
-          CComPtr<IDispatch> pChildElDispatch;
-          CComVariant vRetIndex;
-
-          vIndex.intVal = i;
+      CompleteSubtree(frame.parent, allElementsCount);
+      return false;
+    }
+  }
+  m_traversalStack.push_back(frame);
+  if (depth > m_traversalStats.maxDepth)
+  {
+    m_traversalStats.maxDepth = depth;
+  }
+  return true;
+}
 
-          if (SUCCEEDED(pChildCollection->item(vIndex, vRetIndex, &pChildElDispatch)) && pChildElDispatch)
-          {
-            CComPtr<IHTMLElement> pChildEl;
-            if (SUCCEEDED(pChildElDispatch->QueryInterface(&pChildEl)) && pChildEl)
-            {
-              TraverseChild(pChildEl, pBrowser, indent + L"  ", isCached);
-            }
-          }
-        }
+template <class T>
+CComPtr<IHTMLElement> CPluginDomTraverserBase<T>::NextChild(TraversalFrame& frame)
+{
+  CComPtr<IHTMLElement> element;
+  if (frame.children)
+  {
+    while (!element && frame.childIndex < frame.childCount)
+    {
+      CComVariant vIndex(frame.childIndex++);
+      CComVariant vRetIndex;
+      CComPtr<IDispatch> pChildElDispatch;
+      if (SUCCEEDED(frame.children->item(vIndex, vRetIndex, &pChildElDispatch)) && pChildElDispatch)
+      {
+        pChildElDispatch->QueryInterface(&element);
       }
     }
+    return element;
+  }
+  while (!element && frame.node)
+  {
+    CComPtr<IHTMLDOMNode> node;
+    node.Attach(frame.node.Detach());
+    node->get_nextSibling(&frame.node);
+    // Only element nodes, no text or comments
+    long nodeType = 0;
+    if (SUCCEEDED(node->get_nodeType(&nodeType)) && nodeType == 1)
+    {
+      node->QueryInterface(&element);
+    }
   }
+  return element;
 }
 
-
 template <class T>
 void CPluginDomTraverserBase<T>::ClearCache()
 {
   m_criticalSection.Lock();
   {
-    m_cacheIndexLast = 0;
-    m_cacheDocumentHasFrames.clear();
-    m_cacheDocumentHasIframes.clear();
+    m_cacheElements.Clear();
+    m_cacheBody.Release();
+    m_cacheDocumentHasFrames.Clear();
+    m_cacheDocumentHasIframes.Clear();
   }
   m_criticalSection.Unlock();
+  StopObservingMutations();
 }
 
 
@@ -42,6 +42,7 @@
 #define PLUGIN_ERROR_THREAD 5
 #define PLUGIN_ERROR_MAIN_THREAD_CREATE_PROCESS 1
 #define PLUGIN_ERROR_TAB_THREAD_CREATE_PROCESS 2
+#define PLUGIN_ERROR_SHOULD_BLOCK_THREAD_CREATE_PROCESS 3
 
 #define PLUGIN_ERROR_GUID 6
 #define PLUGIN_ERROR_GUID_REG_OPEN_KEY 1
@@ -136,6 +137,8 @@
 
 #define PLUGIN_ERROR_MUTEX_CONFIG_FILE 95
 
+#define PLUGIN_ERROR_MUTEX_ENGINE_SPAWN 100
+
 #define PLUGIN_ERROR_HTTP_REQUEST 14
 #define PLUGIN_ERROR_HTTP_REQUEST_SEND 1
 #define PLUGIN_ERROR_HTTP_REQUEST_OPEN 2
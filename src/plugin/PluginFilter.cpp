@@ -25,202 +25,12 @@
 #include "PluginClass.h"
 #include "PluginUtil.h"
 #include "mlang.h"
-#include "..\shared\CriticalSection.h"
+#include <algorithm>
+#include <iterator>
+#include <thread>
 #include "..\shared\Utils.h"
 #include "..\shared\MsHTMLUtils.h"
 
-// The filters are described at http://adblockplus.org/en/filters
-
-static CriticalSection s_criticalSectionFilterMap;
-
-// ============================================================================
-// CFilterElementHide
-// ============================================================================
-namespace
-{
-  class ElementHideParseException
-    : public std::runtime_error
-  {
-    std::string message(const std::wstring& filterText, const std::string& reason)
-    {
-      std::string s(
-        "CFilterElementHide::CFilterElementHide, error parsing selector \""
-        + ToUtf8String(filterText) + "\" (" + reason + ")"
-        );
-      DEBUG_FILTER(ToUtf16String(s));
-      return s;
-    }
-  public:
-    ElementHideParseException(const std::wstring& filterText, const std::string& reason)
-      : std::runtime_error(message(filterText, reason))
-    {}
-  };
-}
-
-CFilterElementHide::CFilterElementHide(const std::wstring& filterText)
-  : m_filterText(filterText), m_type(ETraverserComplexType::TRAVERSER_TYPE_ERROR)
-{
-  std::wstring filterSuffix(filterText); // The unparsed remainder of the input filter text
-
-  // Find tag name, class or any (*)
-  wchar_t firstTag = filterText[0];
-  if (firstTag == '*')
-  {
-    // Any tag
-    filterSuffix = filterSuffix.substr(1);
-  }
-  else if (firstTag == '[' || firstTag == '.' || firstTag == '#')
-  {
-    // Any tag (implicitly)
-  }
-  else if (isalnum(firstTag))
-  {
-    // Real tag
-    // TODO: Add support for descendant selectors
-    auto pos = filterSuffix.find_first_of(L".#[(");
-    if (pos == std::wstring::npos)
-    {
-      pos = filterSuffix.length();
-    }
-    m_tag = ToLowerString(filterSuffix.substr(0, pos));
-    filterSuffix = filterSuffix.substr(pos);
-  }
-  else
-  {
-    // Error
-    throw ElementHideParseException(filterText, "invalid tag");
-  }
-
-  // Find Id and class name
-  if (!filterSuffix.empty())
-  {
-    wchar_t firstId = filterSuffix[0];
-
-    // Id
-    if (firstId == '#')
-    {
-      auto pos = filterSuffix.find('[');
-      if (pos == std::wstring::npos)
-      {
-        pos = filterSuffix.length();
-      }
-      m_tagId = filterSuffix.substr(1, pos - 1);
-      filterSuffix = filterSuffix.substr(pos);
-      pos = m_tagId.find(L".");
-      if (pos != std::wstring::npos)
-      {
-        if (pos == 0)
-        {
-          throw ElementHideParseException(filterText, "empty tag id");
-        }
-        m_tagClassName = m_tagId.substr(pos + 1);
-        m_tagId = m_tagId.substr(0, pos);
-      }
-    }
-    // Class name
-    else if (firstId == '.')
-    {
-      auto pos = filterSuffix.find('[');
-      if (pos == std::wstring::npos)
-      {
-        pos = filterSuffix.length();
-      }
-      m_tagClassName = filterSuffix.substr(1, pos - 1);
-      filterSuffix = filterSuffix.substr(pos);
-    }
-  }
-
-  while (!filterSuffix.empty())
-  {
-    if (filterSuffix[0] != '[')
-    {
-      throw ElementHideParseException(filterText, "expected '['");
-    }
-    auto endPos = filterSuffix.find(']') ;
-    if (endPos == std::wstring::npos)
-    {
-      throw ElementHideParseException(filterText, "expected ']'");
-    }
-    std::wstring arg = filterSuffix.substr(1, endPos - 1);
-    filterSuffix = filterSuffix.substr(endPos + 1);
-
-    CFilterElementHideAttrSelector attrSelector;
-    auto posEquals = arg.find('=');
-    if (posEquals != std::wstring::npos)
-    {
-      if (posEquals == 0)
-      {
-        throw ElementHideParseException(filterText, "empty attribute name before '='");
-      }
-      attrSelector.m_value = arg.substr(posEquals + 1);
-      if (attrSelector.m_value.length() >= 2 && attrSelector.m_value[0] == '\"' && attrSelector.m_value[attrSelector.m_value.length() - 1] == '\"')
-      {
-        attrSelector.m_value = attrSelector.m_value.substr(1, attrSelector.m_value.length() - 2);
-      }
-
-      if (arg[posEquals - 1] == '^')
-      {
-        attrSelector.m_pos = CFilterElementHideAttrPos::STARTING;
-      }
-      else if (arg[posEquals - 1] == '*')
-      {
-        attrSelector.m_pos = CFilterElementHideAttrPos::ANYWHERE;
-      }
-      else if (arg[posEquals - 1] == '$')
-      {
-        attrSelector.m_pos = CFilterElementHideAttrPos::ENDING;
-      }
-      if (attrSelector.m_pos != CFilterElementHideAttrPos::POS_NONE)
-      {
-        if (posEquals == 1)
-        {
-          throw ElementHideParseException(filterText, "empty attribute name before " + std::string(1, static_cast<char>(arg[0])) + "'='");
-        }
-        attrSelector.m_attr = arg.substr(0, posEquals - 1);
-      }
-      else
-      {
-        attrSelector.m_pos = CFilterElementHideAttrPos::EXACT;
-        attrSelector.m_attr = arg.substr(0, posEquals);
-      }
-    }
-
-    if (attrSelector.m_attr == L"style")
-    {
-      attrSelector.m_type = CFilterElementHideAttrType::STYLE;
-      attrSelector.m_value = ToLowerString(attrSelector.m_value);
-    }
-    else if (attrSelector.m_attr == L"id")
-    {
-      attrSelector.m_type = CFilterElementHideAttrType::ID;
-    }
-    else if (attrSelector.m_attr == L"class")
-    {
-      attrSelector.m_type = CFilterElementHideAttrType::CLASS;
-    }
-    m_attributeSelectors.push_back(attrSelector);
-  }
-
-  // End check
-  if (!filterSuffix.empty())
-  {
-    throw ElementHideParseException(filterText, "extra characters at end");
-  }
-}
-
-CFilterElementHide::CFilterElementHide(const CFilterElementHide& filter)
-{
-  m_filterText = filter.m_filterText;
-
-  m_tagId = filter.m_tagId;
-  m_tagClassName = filter.m_tagClassName;
-
-  m_attributeSelectors = filter.m_attributeSelectors;
-
-  m_predecessor = filter.m_predecessor;
-}
-
-
 // ============================================================================
 // CFilter
 // ============================================================================
@@ -249,397 +59,126 @@ CFilter::CFilter() : m_isMatchCase(false), m_isFirstParty(false),
 }
 
 
-bool CFilterElementHide::IsMatchFilterElementHide(IHTMLElement* pEl) const
+// ============================================================================
+// CPluginFilter
+// ============================================================================
+
+namespace
 {
-  HRESULT hr;
-  /*
-   * If a tag id is specified, it must match
-   */
-  if (!m_tagId.empty())
-  {
-    CComBSTR idBstr;
-    if (FAILED(pEl->get_id(&idBstr)) || !idBstr || m_tagId != ToWstring(idBstr))
-    {
-      return false;
-    }
-  }
-  /*
-   * If a class name is specified, it must match
-   */
-  if (!m_tagClassName.empty())
-  {
-    CComBSTR classNameListBstr;
-    hr = pEl->get_className(&classNameListBstr);
-    if (FAILED(hr) || !classNameListBstr)
-    {
-      return false; // We can't match a class name if there's no class name
-    }
-    std::wstring classNameList(ToWstring(classNameListBstr));
-    if (classNameList.empty())
-    {
-      return false;
-    }
-    // TODO: Consider case of multiple classes. (m_tagClassName can be something like "foo.bar")
-    /*
-     * Match when 'm_tagClassName' appears as a token within classNameList
-     */
-    bool foundMatch = false;
-    wchar_t* nextToken = nullptr;
-    const wchar_t* token = wcstok_s(&classNameList[0], L" ", &nextToken);
-    while (token != nullptr)
-    {
-      if (std::wstring(token) == m_tagClassName)
-      {
-        foundMatch = true;
-        break;
-      }
-      token = wcstok_s(nullptr, L" ", &nextToken);
-    }
-    if (!foundMatch)
-    {
-      return false;
-    }
-  }
-  /*
-   * If a tag name is specified, it must match
-   */
-  if (!m_tag.empty())
-  {
-    CComBSTR tagNameBstr;
-    if (FAILED(pEl->get_tagName(&tagNameBstr)) || !tagNameBstr)
-    {
-      return false;
-    }
-    if (m_tag != ToLowerString(ToWstring(tagNameBstr)))
-    {
-      return false;
-    }
-  }
-  /*
-   * Match each attribute
-   */
-  for (auto attrIt = m_attributeSelectors.begin(); attrIt != m_attributeSelectors.end(); ++attrIt)
+  // Reads the selector lists in place from the mapped blobs, the ones of
+  // `genericBlob` follow the ones of `blob`
+  class BlobSelectorList : public StylesheetBuilder::SelectorList
   {
-    std::wstring value;
-    bool attrFound = false;
-    if (attrIt->m_type == CFilterElementHideAttrType::STYLE)
+  public:
+    BlobSelectorList(const ElementHideBlob& blob, const ElementHideBlob* genericBlob)
+      : m_blob(blob), m_genericBlob(genericBlob)
     {
-      CComPtr<IHTMLStyle> pStyle;
-      if (SUCCEEDED(pEl->get_style(&pStyle)) && pStyle)
-      {
-        CComBSTR styleBstr;
-        if (SUCCEEDED(pStyle->get_cssText(&styleBstr)) && styleBstr)
-        {
-          value = ToLowerString(ToWstring(styleBstr));
-          attrFound = true;
-        }
-      }
     }
-    else if (attrIt->m_type == CFilterElementHideAttrType::CLASS)
+    size_t GetSize() const
     {
-      CComBSTR classNamesBstr;
-      if (SUCCEEDED(pEl->get_className(&classNamesBstr)) && classNamesBstr)
-      {
-        value = ToWstring(classNamesBstr);
-        attrFound = true;
-      }
+      return m_blob.GetSelectorListSize() + (m_genericBlob ? m_genericBlob->GetSelectorListSize() : 0);
     }
-    else if (attrIt->m_type == CFilterElementHideAttrType::ID)
+    const std::wstring& Get(size_t index, std::wstring& buffer) const
     {
-      CComBSTR idBstr;
-      if (SUCCEEDED(pEl->get_id(&idBstr)) && idBstr)
+      size_t size = m_blob.GetSelectorListSize();
+      if (index < size)
       {
-        value = ToWstring(idBstr);
-        attrFound = true;
+        m_blob.GetListSelector(index, buffer);
       }
-    }
-    else
-    {
-      CComBSTR attrArgument(attrIt->m_attr.length(), attrIt->m_attr.c_str());
-      auto x = GetHtmlElementAttribute(*pEl, attrArgument);
-      attrFound = x.isAttributeFound;
-      if (attrFound)
+      else
       {
-        value = x.attributeValue;
+        m_genericBlob->GetListSelector(index - size, buffer);
       }
+      return buffer;
     }
 
-    if (attrFound)
-    {
-      if (attrIt->m_pos == CFilterElementHideAttrPos::EXACT)
-      {
-        // TODO: IE rearranges the style attribute completely. Figure out if anything can be done about it.
-        if (value != attrIt->m_value)
-          return false;
-      }
-      else if (attrIt->m_pos == CFilterElementHideAttrPos::STARTING)
-      {
-        if (value.compare(0, attrIt->m_value.length(), attrIt->m_value) != 0)
-          return false;
-      }
-      else if (attrIt->m_pos == CFilterElementHideAttrPos::ENDING)
-      {
-        size_t valueLength = value.length();
-        size_t attrLength = attrIt->m_value.length();
-        if (valueLength < attrLength)
-          return false;
-        if (value.compare(valueLength - attrLength, attrLength, attrIt->m_value) != 0)
-          return false;
-      }
-      else if (attrIt->m_pos == CFilterElementHideAttrPos::ANYWHERE)
-      {
-        if (value.find(attrIt->m_value) == std::wstring::npos)
-          return false;
-      }
-      else if (attrIt->m_value.empty())
-      {
-        return true;
-      }
-    }
-    else
-    {
-      return false;
-    }
-  }
+  private:
+    const ElementHideBlob& m_blob;
+    const ElementHideBlob* m_genericBlob;
 
-  if (m_predecessor)
-  {
-    CComPtr<IHTMLElement> pDomPredecessor;
-    HRESULT hr = S_FALSE;
-    switch (m_predecessor->m_type)
-    {
-    case ETraverserComplexType::TRAVERSER_TYPE_PARENT:
-      hr = pEl->get_parentElement(&pDomPredecessor);
-      break;
-    case ETraverserComplexType::TRAVERSER_TYPE_IMMEDIATE:
-      hr = S_FALSE;
-      CComQIPtr<IHTMLDOMNode> pPrevSiblingNode = pEl;
-      long type = 0;
-      while (pPrevSiblingNode && type != 1)
-      {
-        IHTMLDOMNode* tmpNode;
-        pPrevSiblingNode->get_previousSibling(&tmpNode);
-        pPrevSiblingNode.Attach(tmpNode);
-        if (pPrevSiblingNode)
-        {
-          hr = pPrevSiblingNode->get_nodeType(&type);
-          if (hr != S_OK)
-            pPrevSiblingNode.Release();
-        }
-      }
-
-      if (pPrevSiblingNode)
-        hr = pPrevSiblingNode.QueryInterface(&pDomPredecessor);
-      else
-        return false;
-      break;
-    }
-    if (hr != S_OK)
-      return false;
-    return m_predecessor->IsMatchFilterElementHide(pDomPredecessor);
-  }
-
-  return true;
+    BlobSelectorList(const BlobSelectorList&);
+    void operator=(const BlobSelectorList&);
+  };
 }
 
-
-
-// ============================================================================
-// CPluginFilter
-// ============================================================================
-
-
-bool CPluginFilter::AddFilterElementHide(std::wstring filterText)
+bool CPluginFilter::IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent, size_t* comCallCount) const
 {
-  DEBUG_FILTER(L"Input: " + filterText + L" filterFile" + filterFile);
-  CriticalSection::Lock filterEngineLock(s_criticalSectionFilterMap);
-  {
-    // Create filter descriptor
-    std::auto_ptr<CFilterElementHide> filter;
-    wchar_t separatorChar;
-    do
-    {
-      auto chunkEnd = filterText.find_first_of(L"+>");
-      if (chunkEnd != std::wstring::npos && chunkEnd > 0)
-      {
-        separatorChar = filterText[chunkEnd];
-      }
-      else
-      {
-        chunkEnd = filterText.length();
-        separatorChar = L'\0';
-      }
-
-      std::auto_ptr<CFilterElementHide> filterParent(filter);
-      filter.reset(new CFilterElementHide(TrimStringRight(filterText.substr(0, chunkEnd))));
-      if (filterParent.get() != 0)
-      {
-        filter->m_predecessor.reset(filterParent.release());
-      }
-
-      if (separatorChar != L'\0') // complex selector
-      {
-        filterText = TrimStringLeft(filterText.substr(chunkEnd + 1));
-        if (separatorChar == '+')
-          filter->m_type = CFilterElementHide::TRAVERSER_TYPE_IMMEDIATE;
-        else if (separatorChar == '>')
-          filter->m_type = CFilterElementHide::TRAVERSER_TYPE_PARENT;
-      }
-      else // Terminating element (simple selector)
-      {
-        if (!filter->m_tagId.empty())
-        {
-          m_elementHideTagsId.insert(std::make_pair(std::make_pair(filter->m_tag, filter->m_tagId), *filter));
-        }
-        else if (!filter->m_tagClassName.empty())
-        {
-          m_elementHideTagsClass.insert(std::make_pair(std::make_pair(filter->m_tag, filter->m_tagClassName), *filter));
-        }
-        else
-        {
-          m_elementHideTags.insert(std::make_pair(filter->m_tag, *filter));
-        }
-      }
-    } while (separatorChar != '\0');
+  // No lock is needed, the matcher is not modified after construction and
+  // the blob synchronizes itself.
+  ElementHideMatcher::Match match;
+  MsHTMLElementView view(pEl, comCallCount);
+  bool isHidden = false;
+  if (m_genericBlob)
+  {
+    // Both blobs read the element through one snapshot, so that its
+    // properties are only fetched once
+    ElementSnapshot snapshot(view);
+    snapshot.SetTagName(tag);
+    isHidden = m_blob->blob.FindMatch(tag, snapshot, match) || m_genericBlob->blob.FindMatch(tag, snapshot, match);
   }
-
-  return true;
-}
-
-bool CPluginFilter::IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent) const
-{
-  std::wstring id;
-  CComBSTR idBstr;
-  if (SUCCEEDED(pEl->get_id(&idBstr)) && idBstr)
+  else
   {
-    id = ToWstring(idBstr);
+    isHidden = m_blob ? m_blob->blob.FindMatch(tag, view, match) : m_matcher.FindMatch(tag, view, match);
   }
-  std::wstring classNames;
-  CComBSTR classNamesBstr;
-  if (SUCCEEDED(pEl->get_className(&classNamesBstr)) && classNamesBstr)
+  if (!isHidden)
   {
-    classNames = ToWstring(classNamesBstr);
+    return false;
   }
-
-  CriticalSection::Lock filterEngineLock(s_criticalSectionFilterMap);
-  {
-    // Search tag/id filters
-    if (!id.empty())
-    {
-      auto idItEnum = m_elementHideTagsId.equal_range(std::make_pair(tag, id));
-      for (auto idIt = idItEnum.first; idIt != idItEnum.second; ++idIt)
-      {
-        if (idIt->second.IsMatchFilterElementHide(pEl))
-        {
 #ifdef ENABLE_DEBUG_RESULT
-          DEBUG_HIDE_EL(indent + L"HideEl::Found (tag/id) filter:" + idIt->second.m_filterText);
-          CPluginDebug::DebugResultHiding(tag, L"id:" + id, idIt->second.m_filterText);
+  DEBUG_HIDE_EL(indent + L"HideEl::Found (" + match.indexName + L") filter:" + match.filter->m_filterText);
+  CPluginDebug::DebugResultHiding(tag, match.key, match.filter->m_filterText);
 #endif
-          return true;
-        }
-      }
-
-      // Search general id
-      idItEnum = m_elementHideTagsId.equal_range(std::make_pair(L"", id));
-      for (auto idIt = idItEnum.first; idIt != idItEnum.second; ++idIt)
-      {
-        if (idIt->second.IsMatchFilterElementHide(pEl))
-        {
-#ifdef ENABLE_DEBUG_RESULT
-          DEBUG_HIDE_EL(indent + L"HideEl::Found (?/id) filter:" + idIt->second.m_filterText);
-          CPluginDebug::DebugResultHiding(tag, L"id:" + id, idIt->second.m_filterText);
-#endif
-          return true;
-        }
-      }
-    }
-
-    // Search tag/className filters
-    if (!classNames.empty())
-    {
-      wchar_t* nextToken = nullptr;
-      const wchar_t* token = wcstok_s(&classNames[0], L" \t\n\r", &nextToken);
-      while (token != nullptr)
-      {
-        std::wstring className(token);
-        auto classItEnum = m_elementHideTagsClass.equal_range(std::make_pair(tag, className));
-        for (auto classIt = classItEnum.first; classIt != classItEnum.second; ++classIt)
-        {
-          if (classIt->second.IsMatchFilterElementHide(pEl))
-          {
-#ifdef ENABLE_DEBUG_RESULT
-            DEBUG_HIDE_EL(indent + L"HideEl::Found (tag/class) filter:" + classIt->second.m_filterText);
-            CPluginDebug::DebugResultHiding(tag, L"class:" + className, classIt->second.m_filterText);
-#endif
-            return true;
-          }
-        }
-
-        // Search general class name
-        classItEnum = m_elementHideTagsClass.equal_range(std::make_pair(L"", className));
-        for (auto classIt = classItEnum.first; classIt != classItEnum.second; ++ classIt)
-        {
-          if (classIt->second.IsMatchFilterElementHide(pEl))
-          {
-#ifdef ENABLE_DEBUG_RESULT
-            DEBUG_HIDE_EL(indent + L"HideEl::Found (?/class) filter:" + classIt->second.m_filterText);
-            CPluginDebug::DebugResultHiding(tag, L"class:" + className, classIt->second.m_filterText);
-#endif
-            return true;
-          }
-        }
-        token = wcstok_s(nullptr, L" \t\n\r", &nextToken);
-      }
-    }
+  return true;
+}
 
-    // Search tag filters
-    auto tagItEnum = m_elementHideTags.equal_range(tag);
-    for (auto tagIt = tagItEnum.first; tagIt != tagItEnum.second; ++tagIt)
-    {
-      if (tagIt->second.IsMatchFilterElementHide(pEl))
-      {
-#ifdef ENABLE_DEBUG_RESULT
-        DEBUG_HIDE_EL(indent + L"HideEl::Found (tag) filter:" + tagIt->second.m_filterText);
-        CPluginDebug::DebugResultHiding(tag, L"-", tagIt->second.m_filterText);
-#endif
-        return true;
-      }
-    }
+std::shared_ptr<const StylesheetBuilder::Stylesheet> CPluginFilter::GetStylesheet(const StylesheetBuilder& builder) const
+{
+  std::lock_guard<std::mutex> lock(m_stylesheetMutex);
+  if (!m_stylesheet || m_stylesheet->rejectedCount != builder.GetRejectedCount())
+  {
+    m_stylesheet = builder.CreateStylesheet(*m_selectors);
   }
-
-  return false;
+  return m_stylesheet;
 }
 
 CPluginFilter::CPluginFilter(const std::vector<std::wstring>& filters)
+  : m_hasSiblingCombinators(false)
 {
   m_hideFilters = filters;
-  CPluginClient* client = CPluginClient::GetInstance();
+  m_selectors.reset(new StylesheetBuilder::SelectorVector(m_hideFilters));
 
-  // Parse hide string
-  int pos = 0;
-  CriticalSection::Lock filterEngineLock(s_criticalSectionFilterMap);
+  // See http://adblockplus.org/en/filters for further documentation
+  size_t threadCount = std::thread::hardware_concurrency();
+  if (threadCount == 0 || threadCount > FILTER_PARSE_MAX_THREADS)
   {
-    for (auto it = filters.begin(); it < filters.end(); ++it)
-    {
-      std::wstring filter(TrimString(*it));
-      // If the line is not commented out
-      if (!filter.empty() && filter[0] != '!' && filter[0] != '[')
-      {
-        int filterType = 0;
-
-        // See http://adblockplus.org/en/filters for further documentation
-
-        try
-        {
-          AddFilterElementHide(filter);
-        }
-        catch(...)
-        {
+    threadCount = FILTER_PARSE_MAX_THREADS;
+  }
+  std::vector<ElementHideMatcher::ParseFailure> failures = m_matcher.AddAll(filters, threadCount);
+  for (auto it = failures.begin(); it != failures.end(); ++it)
+  {
+    DEBUG_FILTER(L"Error parsing selector " + filters[it->index] + L": " + ToUtf16String(GetElementHideParseErrorText(it->error)));
 #ifdef ENABLE_DEBUG_RESULT
-          CPluginDebug::DebugResult(L"Error loading hide filter: " + filter);
+    CPluginDebug::DebugResult(L"Error loading hide filter: " + filters[it->index]);
 #endif
-        }
-      }
-    }
+  }
+
+  m_matcher.Build();
+  m_attributeNames = m_matcher.GetAttributeNames();
+  m_hasSiblingCombinators = m_matcher.HasSiblingCombinators();
+}
+
+CPluginFilter::CPluginFilter(const MappedElementHideBlobPtr& blob, const MappedElementHideBlobPtr& genericBlob)
+  : m_blob(blob), m_genericBlob(genericBlob), m_hasSiblingCombinators(false)
+{
+  m_selectors.reset(new BlobSelectorList(m_blob->blob, m_genericBlob ? &m_genericBlob->blob : nullptr));
+  m_attributeNames = m_blob->blob.GetAttributeNames();
+  m_hasSiblingCombinators = m_blob->blob.HasSiblingCombinators();
+  if (m_genericBlob)
+  {
+    std::vector<std::wstring> names = m_genericBlob->blob.GetAttributeNames();
+    std::vector<std::wstring> merged;
+    std::set_union(m_attributeNames.begin(), m_attributeNames.end(), names.begin(), names.end(), std::back_inserter(merged));
+    m_attributeNames.swap(merged);
+    m_hasSiblingCombinators = m_hasSiblingCombinators || m_genericBlob->blob.HasSiblingCombinators();
   }
 }
@@ -19,68 +19,11 @@
 #define _PLUGIN_FILTER_H_
 
 #include <memory>
+#include <mutex>
 #include <AdblockPlus/FilterEngine.h>
-
-enum CFilterElementHideAttrPos
-{
-  POS_NONE = 0, STARTING, ENDING, ANYWHERE, EXACT
-};
-
-enum CFilterElementHideAttrType
-{
-  TYPE_NONE = 0, STYLE, ID, CLASS
-};
-// ============================================================================
-// CFilterElementHideAttrSelector
-// ============================================================================
-
-struct CFilterElementHideAttrSelector
-{
-  CFilterElementHideAttrPos m_pos;
-  CFilterElementHideAttrType m_type;
-  std::wstring m_attr;
-  std::wstring m_value;
-
-  CFilterElementHideAttrSelector()
-    : m_type(TYPE_NONE), m_pos(POS_NONE)
-  {
-  }
-};
-
-
-
-// ============================================================================
-// CFilterElementHide
-// ============================================================================
-class CFilterElementHide
-{
-
-public:
-
-  enum ETraverserComplexType
-  {
-    TRAVERSER_TYPE_PARENT,
-    TRAVERSER_TYPE_IMMEDIATE,
-    TRAVERSER_TYPE_ERROR
-  };
-
-  std::wstring m_filterText;
-
-  // For domain specific filters only
-  std::wstring m_tagId;
-  std::wstring m_tagClassName;
-  std::wstring m_tag;
-
-  std::vector<CFilterElementHideAttrSelector> m_attributeSelectors;
-  std::shared_ptr<CFilterElementHide> m_predecessor;
-
-  CFilterElementHide(const std::wstring& filterText = L"");
-  CFilterElementHide(const CFilterElementHide& filter);
-  ETraverserComplexType m_type;
-
-  bool IsMatchFilterElementHide(IHTMLElement* pEl) const;
-
-};
+#include "../shared/ElementHideBlob.h"
+#include "../shared/ElementHiding.h"
+#include "../shared/StylesheetBuilder.h"
 
 // ============================================================================
 // CFilter
@@ -117,31 +60,64 @@ public:
 // CPluginFilter
 // ============================================================================
 
-class CPluginFilter
+// An ElementHideBlob opened on a view of the engine's section, which stays
+// mapped as long as the blob is used
+struct MappedElementHideBlob
 {
+  std::shared_ptr<const void> view;
+  ElementHideBlob blob;
+};
 
-private:
-
-  // (Tag,Name) -> Filter
-  typedef std::multimap<std::pair<std::wstring, std::wstring>, CFilterElementHide> TFilterElementHideTagsNamed;
+typedef std::shared_ptr<const MappedElementHideBlob> MappedElementHideBlobPtr;
 
-  // Tag -> Filter
-  typedef std::multimap<std::wstring, CFilterElementHide> TFilterElementHideTags;
+/**
+ * Element hiding filters of a single document.
+ *
+ * The filter is immutable once constructed, so `IsElementHidden` can be
+ * called from any number of threads without locking. It has to be published
+ * to other threads in a thread-safe way, e.g. through a mutex or an event.
+ */
+class CPluginFilter
+{
 
+private:
 
-  TFilterElementHideTagsNamed m_elementHideTagsId;
-  TFilterElementHideTagsNamed m_elementHideTagsClass;
-  TFilterElementHideTags m_elementHideTags;
+  ElementHideMatcher m_matcher;
+  // Used instead of m_matcher if the filter was created from the engine's blob.
+  // The generic selectors can be in a second blob shared by all domains.
+  MappedElementHideBlobPtr m_blob;
+  MappedElementHideBlobPtr m_genericBlob;
+  // Empty if the filter was created from the blob, the selectors are read from it
   std::vector<std::wstring> m_hideFilters;
+  std::unique_ptr<StylesheetBuilder::SelectorList> m_selectors;
+  std::vector<std::wstring> m_attributeNames;
+  bool m_hasSiblingCombinators;
+  // Created on first use, shared by all documents and frames using the filter
+  mutable std::mutex m_stylesheetMutex;
+  mutable std::shared_ptr<const StylesheetBuilder::Stylesheet> m_stylesheet;
 
+  CPluginFilter(const CPluginFilter&);
+  void operator=(const CPluginFilter&);
 
 public:
   explicit CPluginFilter(const std::vector<std::wstring>& filters);
-  bool AddFilterElementHide(std::wstring filter);
-  bool IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent) const;
-  const std::vector<std::wstring>& GetHideFilters() const {
-    return m_hideFilters;
+  // Both blobs have been opened successfully, `genericBlob` can be null
+  CPluginFilter(const MappedElementHideBlobPtr& blob, const MappedElementHideBlobPtr& genericBlob);
+  // Adds the number of COM calls made for the element to `comCallCount` if it isn't null
+  bool IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent, size_t* comCallCount = nullptr) const;
+  const StylesheetBuilder::SelectorList& GetHideFilters() const {
+    return *m_selectors;
+  }
+  // Attributes whose changes can affect the matching, see ElementHideMatcher::GetAttributeNames
+  const std::vector<std::wstring>& GetAttributeNames() const {
+    return m_attributeNames;
+  }
+  bool HasSiblingCombinators() const {
+    return m_hasSiblingCombinators;
   }
+  // The hide filters as stylesheet text, recreated only if `builder` has
+  // rejected selectors since the last call
+  std::shared_ptr<const StylesheetBuilder::Stylesheet> GetStylesheet(const StylesheetBuilder& builder) const;
 };
 
 typedef std::shared_ptr<CPluginFilter> PluginFilterPtr;
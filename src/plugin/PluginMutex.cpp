@@ -21,7 +21,7 @@
 #include "PluginClientBase.h"
 
 
-CPluginMutex::CPluginMutex(const std::wstring& name, int errorSubidBase) 
+CPluginMutex::CPluginMutex(const std::wstring& name, int errorSubidBase, DWORD timeoutMsec) 
   : m_isLocked(false), m_errorSubidBase(errorSubidBase), system_name(L"Global\\AdblockPlus" + name)
 {
   if (m_errorSubidBase != PLUGIN_ERROR_MUTEX_DEBUG_FILE)
@@ -50,7 +50,7 @@ CPluginMutex::CPluginMutex(const std::wstring& name, int errorSubidBase)
       else
       // TODO: Combine this block with identical one below.
       {
-        switch (::WaitForSingleObject(m_hMutex, 3000))
+        switch (::WaitForSingleObject(m_hMutex, timeoutMsec))
         {
           // The thread got ownership of the mutex
         case WAIT_OBJECT_0: 
@@ -73,7 +73,7 @@ CPluginMutex::CPluginMutex(const std::wstring& name, int errorSubidBase)
   else
   // TODO: Combine this block with identical one above.
   {
-    switch (::WaitForSingleObject(m_hMutex, 3000))
+    switch (::WaitForSingleObject(m_hMutex, timeoutMsec))
     {
       // The thread got ownership of the mutex
     case WAIT_OBJECT_0: 
@@ -31,7 +31,8 @@ private:
 
 public:
 
-  CPluginMutex(const std::wstring& name, int errorSubidBase);
+  // Waits for at most timeoutMsec, IsLocked returns false if that elapsed
+  CPluginMutex(const std::wstring& name, int errorSubidBase, DWORD timeoutMsec = 3000);
   ~CPluginMutex();
 
   bool IsLocked() const;
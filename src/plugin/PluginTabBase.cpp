@@ -24,67 +24,236 @@
 #include "IeVersion.h"
 #include "../shared/Utils.h"
 #include "../shared/EventWithSetter.h"
+#include "../shared/LruCache.h"
+#include "../shared/StylesheetBuilder.h"
+#include "../shared/WorkerPool.h"
 #include <Mshtmhst.h>
 #include <mutex>
 
+namespace
+{
+  // Intentionally never destroyed, waiting for the worker threads while the
+  // DLL is being unloaded would dead-lock on the loader lock.
+  WorkerPool* filterWorkerPool = new WorkerPool(FILTER_WORKER_THREADS, FILTER_WORKER_QUEUE_SIZE);
+
+  // The filters are immutable, so they can be shared between all tabs showing
+  // the same domain, as long as the filters of the engine haven't changed.
+  typedef std::pair<std::wstring, int64_t> FilterCacheKey;
+  LruCache<FilterCacheKey, PluginFilterPtr> filterCache(FILTER_CACHE_SIZE);
+
+  // Shared by all tabs, so that selectors rejected by the browser are only
+  // tried once per process
+  StylesheetBuilder stylesheetBuilder(CSS_RULE_MAX_SELECTORS, CSS_RULE_MAX_LENGTH);
+}
+
 class CPluginTab::AsyncPluginFilter
 {
 public:
+  explicit AsyncPluginFilter(const std::wstring& domain)
+    : domain(domain), cancellationToken(std::make_shared<CancellationToken>())
+  {
+  }
+  ~AsyncPluginFilter()
+  {
+    // Nobody is interested in the filter anymore
+    cancellationToken->Cancel();
+  }
   static std::shared_ptr<AsyncPluginFilter> CreateAsync(const std::wstring& domain)
   {
-    std::shared_ptr<AsyncPluginFilter> asyncFilter = std::make_shared<AsyncPluginFilter>();
+    std::lock_guard<std::mutex> lock(s_inFlightMutex);
+    // Tabs navigating to the same domain share the filter which is being built
+    auto it = s_inFlight.find(domain);
+    if (it != s_inFlight.end())
+    {
+      std::shared_ptr<AsyncPluginFilter> inFlight = it->second.lock();
+      if (inFlight && !inFlight->cancellationToken->IsCancelled() && !inFlight->event.Wait(0))
+      {
+        return inFlight;
+      }
+      s_inFlight.erase(it);
+    }
+
+    std::shared_ptr<AsyncPluginFilter> asyncFilter = std::make_shared<AsyncPluginFilter>(domain);
     std::weak_ptr<AsyncPluginFilter> weakAsyncData = asyncFilter;
     auto eventSetter = asyncFilter->event.CreateSetter();
+    CancellationTokenPtr cancellationToken = asyncFilter->cancellationToken;
     try
     {
-      std::thread([domain, weakAsyncData, eventSetter]
+      filterWorkerPool->Post([domain, weakAsyncData, eventSetter, cancellationToken]
       {
-        try
-        {
-          CreateAsyncImpl(domain, weakAsyncData, eventSetter);
-        }
-	catch (...)
-        {
-          // As a thread-main function, we truncate any C++ exception.
-        }
-      }).detach();
-      // TODO: we should do something with that `detach` above.
+        CreateAsyncImpl(domain, weakAsyncData, eventSetter, cancellationToken);
+      }, cancellationToken);
+      s_inFlight[domain] = asyncFilter;
     }
     catch (const std::system_error& ex)
     {
       DEBUG_SYSTEM_EXCEPTION(ex, PLUGIN_ERROR_THREAD, PLUGIN_ERROR_MAIN_THREAD_CREATE_PROCESS,
         "Class::Thread - Failed to start filter loader thread");
     }
+#ifdef ENABLE_DEBUG_INFO
+    WorkerPool::Stats stats = filterWorkerPool->GetStats();
+    DEBUG_GENERAL(L"AsyncPluginFilter::CreateAsync queued: " + std::to_wstring(stats.queued) +
+      L", running: " + std::to_wstring(stats.running) + L", completed: " + std::to_wstring(stats.completed) +
+      L", cancelled: " + std::to_wstring(stats.cancelled) + L", dropped: " + std::to_wstring(stats.dropped));
+#endif
     return asyncFilter;
   }
   PluginFilterPtr GetFilter()
   {
-    if (!event.Wait())
-      return PluginFilterPtr();
+    bool isCreated = event.Wait();
     std::lock_guard<std::mutex> lock(mutex);
+    if (!isCreated && !filter)
+    {
+      // The pool dropped the task because it was too busy, or it couldn't be
+      // posted at all. The tab would be left without a filter otherwise.
+      DEBUG_GENERAL(L"AsyncPluginFilter::GetFilter creating the filter for " + domain + L" synchronously");
+      filter = CreateFilter(domain, cancellationToken);
+      RemoveInFlight(domain, this);
+    }
     return filter;
   }
 private:
-  static void CreateAsyncImpl(const std::wstring& domain, std::weak_ptr<AsyncPluginFilter> weakAsyncData, const std::shared_ptr<EventWithSetter::Setter>& setter)
+  // Maps and opens a section named by the engine, returns a null pointer if
+  // it can't be mapped or was written by a different version
+  static MappedElementHideBlobPtr OpenBlob(const std::wstring& name, size_t size, const std::wstring& domain)
+  {
+    std::shared_ptr<MappedElementHideBlob> blob = std::make_shared<MappedElementHideBlob>();
+    blob->view = CPluginClient::MapElementHidingBlob(name, size);
+    if (!blob->view)
+    {
+      return MappedElementHideBlobPtr();
+    }
+    ElementHideBlob::Status status = blob->blob.Open(blob->view.get(), size);
+    if (status != ElementHideBlob::STATUS_OK)
+    {
+      DEBUG_GENERAL(L"Element hiding blob for " + domain + L" rejected, status " + std::to_wstring(static_cast<int>(status)));
+      return MappedElementHideBlobPtr();
+    }
+    return blob;
+  }
+  // Uses the indexes built by the engine, returns a null pointer if they
+  // aren't available
+  static PluginFilterPtr CreateFromBlob(CPluginClient* client, const std::wstring& domain)
   {
-    std::unique_ptr<CPluginFilter> pluginFilter(new CPluginFilter(CPluginClient::GetInstance()->GetElementHidingSelectors(domain)));
-    if (auto asyncData = weakAsyncData.lock())
+    std::wstring name;
+    std::wstring genericName;
+    size_t size = 0;
+    size_t genericSize = 0;
+    if (!client->GetElementHidingBlobs(domain, name, size, genericName, genericSize))
+    {
+      return PluginFilterPtr();
+    }
+    MappedElementHideBlobPtr blob = OpenBlob(name, size, domain);
+    if (!blob)
+    {
+      return PluginFilterPtr();
+    }
+    MappedElementHideBlobPtr genericBlob;
+    if (!genericName.empty())
+    {
+      // Opened once for all domains, so that its selectors are compiled once
+      std::lock_guard<std::mutex> lock(s_genericBlobMutex);
+      if (s_genericBlobName == genericName)
+      {
+        genericBlob = s_genericBlob.lock();
+      }
+      if (!genericBlob)
+      {
+        genericBlob = OpenBlob(genericName, genericSize, domain);
+        if (!genericBlob)
+        {
+          return PluginFilterPtr();
+        }
+        s_genericBlobName = genericName;
+        s_genericBlob = genericBlob;
+      }
+    }
+    return std::make_shared<CPluginFilter>(blob, genericBlob);
+  }
+  // Returns a null pointer if the token is cancelled before the filter is complete
+  static PluginFilterPtr CreateFilter(const std::wstring& domain, const CancellationTokenPtr& cancellationToken)
+  {
+    CPluginClient* client = CPluginClient::GetInstance();
+    // The generation has to be requested before the selectors, otherwise a
+    // filter built from outdated selectors could be cached as the new one.
+    int64_t generation = client->GetFilterGeneration();
+    PluginFilterPtr pluginFilter;
+    if (generation >= 0 && filterCache.Get(FilterCacheKey(domain, generation), pluginFilter))
+    {
+      return pluginFilter;
+    }
+    bool isComplete = true;
+    pluginFilter = CreateFromBlob(client, domain);
+    std::vector<std::wstring> selectors;
+    if (!pluginFilter)
+    {
+      isComplete = client->GetElementHidingSelectors(domain, selectors);
+    }
+    // The tab might have navigated away while we were waiting for the engine
+    if (cancellationToken->IsCancelled())
+    {
+      return PluginFilterPtr();
+    }
+    if (!pluginFilter)
+    {
+      pluginFilter = std::make_shared<CPluginFilter>(selectors);
+    }
+    // Without the selectors the tab hides nothing, but the next one tries again
+    if (generation >= 0 && isComplete)
+    {
+      filterCache.Put(FilterCacheKey(domain, generation), pluginFilter);
+    }
+    return pluginFilter;
+  }
+  static void CreateAsyncImpl(const std::wstring& domain, std::weak_ptr<AsyncPluginFilter> weakAsyncData,
+    const std::shared_ptr<EventWithSetter::Setter>& setter, const CancellationTokenPtr& cancellationToken)
+  {
+    PluginFilterPtr pluginFilter = CreateFilter(domain, cancellationToken);
+    std::shared_ptr<AsyncPluginFilter> asyncData = weakAsyncData.lock();
+    if (pluginFilter && asyncData)
     {
       {
         std::lock_guard<std::mutex> lock(asyncData->mutex);
-        asyncData->filter = move(pluginFilter);
+        asyncData->filter = pluginFilter;
       }
       setter->Set();
     }
+    RemoveInFlight(domain, asyncData.get());
+  }
+  // Drops the entry of the domain unless another filter is being built for it
+  // by now, so that the map only holds filters which are being built.
+  static void RemoveInFlight(const std::wstring& domain, const AsyncPluginFilter* asyncData)
+  {
+    std::lock_guard<std::mutex> lock(s_inFlightMutex);
+    auto it = s_inFlight.find(domain);
+    if (it != s_inFlight.end() && (it->second.expired() || it->second.lock().get() == asyncData))
+    {
+      s_inFlight.erase(it);
+    }
   }
+  static std::mutex s_inFlightMutex;
+  static std::map<std::wstring, std::weak_ptr<AsyncPluginFilter>> s_inFlight;
+  // The generic blob of the filters created last, by section name
+  static std::mutex s_genericBlobMutex;
+  static std::wstring s_genericBlobName;
+  static std::weak_ptr<const MappedElementHideBlob> s_genericBlob;
+  std::wstring domain;
   EventWithSetter event;
+  CancellationTokenPtr cancellationToken;
   std::mutex mutex;
   PluginFilterPtr filter;
 };
 
+std::mutex CPluginTab::AsyncPluginFilter::s_inFlightMutex;
+std::map<std::wstring, std::weak_ptr<CPluginTab::AsyncPluginFilter>> CPluginTab::AsyncPluginFilter::s_inFlight;
+std::mutex CPluginTab::AsyncPluginFilter::s_genericBlobMutex;
+std::wstring CPluginTab::AsyncPluginFilter::s_genericBlobName;
+std::weak_ptr<const MappedElementHideBlob> CPluginTab::AsyncPluginFilter::s_genericBlob;
+
 CPluginTab::CPluginTab()
   : m_isActivated(false)
   , m_continueThreadRunning(true)
+  , m_cacheFrames(FRAME_CACHE_CAPACITY)
 {
   CPluginClient* client = CPluginClient::GetInstance();
   if (AdblockPlus::IE::InstalledMajorVersion() < 10)
@@ -254,7 +423,23 @@ bool CPluginTab::IsCSSInjectionEnabled()
 
 namespace
 {
-  void InjectABPCSS(IHTMLDocument2& htmlDocument2, const std::vector<std::wstring>& hideFilters)
+  // Returns -1 on failure
+  long GetRuleCount(IHTMLStyleSheet4& styleSheet4)
+  {
+    ATL::CComPtr<IDispatch> rules;
+    if (FAILED(styleSheet4.get_cssRules(&rules)) || !rules)
+    {
+      return -1;
+    }
+    ATL::CComVariant length;
+    if (FAILED(rules.GetPropertyByName(L"length", &length)) || FAILED(length.ChangeType(VT_I4)))
+    {
+      return -1;
+    }
+    return length.lVal;
+  }
+
+  void InjectABPCSS(IHTMLDocument2& htmlDocument2, const CPluginFilter& pluginFilter)
   {
     // pseudocode: styleHtmlElement = htmlDocument2.createElement("style");
     ATL::CComQIPtr<IHTMLStyleElement> styleHtmlElement;
@@ -301,23 +486,41 @@ namespace
         return;
       }
     }
-    // pseudocode: for (auto i = 0; i < hideFilters.length; ++i) {
-    // pseudocode:   i = styleSheet4.insertRule(hideFilters + cssValue, i);
-    // pseudocode: }
-    long newIndex = 0;
-    std::wstring cssValue = L"{ display: none !important; }";
-    for (const auto& selector : hideFilters)
+    // The stylesheet text is created once per filter and assigned in one go.
+    // IE drops rules with unsupported selectors silently, so if rules are
+    // missing they are inserted one by one instead, which finds and
+    // remembers the rejected selectors for the next stylesheet text.
+    std::shared_ptr<const StylesheetBuilder::Stylesheet> stylesheet = pluginFilter.GetStylesheet(stylesheetBuilder);
+    ATL::CComQIPtr<IHTMLStyleSheet> styleSheet = styleSheet4;
+    bool isComplete = false;
+    if (styleSheet && SUCCEEDED(styleSheet->put_cssText(ATL::CComBSTR(static_cast<int>(stylesheet->text.size()), stylesheet->text.c_str()))))
     {
-      auto cssRule = selector + cssValue;
-      ATL::CComBSTR selector(cssRule.size(), cssRule.c_str());
-      if (SUCCEEDED(styleSheet4->insertRule(selector, newIndex, &newIndex)))
+      long ruleCount = GetRuleCount(*styleSheet4);
+      isComplete = ruleCount >= 0 && static_cast<size_t>(ruleCount) == stylesheet->ruleCount;
+      if (!isComplete)
       {
-        ++newIndex;
+        DEBUG_GENERAL(L"Stylesheet has " + std::to_wstring(ruleCount) + L" of " + std::to_wstring(stylesheet->ruleCount) +
+          L" rules, inserting them one by one");
+        styleSheet->put_cssText(ATL::CComBSTR(L""));
       }
-      else
+    }
+    if (!isComplete)
+    {
+      long newIndex = 0;
+      StylesheetBuilder::Stats stats = stylesheetBuilder.Insert(pluginFilter.GetHideFilters(), [&](const std::wstring& cssRule) -> bool
       {
-        DEBUG_GENERAL(L"Cannot add rule for selector " + cssRule);
-      }
+        ATL::CComBSTR rule(static_cast<int>(cssRule.size()), cssRule.c_str());
+        if (FAILED(styleSheet4->insertRule(rule, newIndex, &newIndex)))
+        {
+          return false;
+        }
+        ++newIndex;
+        return true;
+      });
+      DEBUG_GENERAL(L"Inserted " + std::to_wstring(pluginFilter.GetHideFilters().GetSize()) + L" selectors as " +
+        std::to_wstring(stats.rules) + L" rules with " + std::to_wstring(stats.insertCalls) + L" calls, " +
+        std::to_wstring(stats.rejectedSelectors) + L" rejected, " +
+        std::to_wstring(stats.skippedSelectors) + L" skipped as rejected before");
     }
 
     // pseudocode: htmlDocument2.head.appendChild(styleHtmlElement);
@@ -470,7 +673,7 @@ void CPluginTab::OnDocumentComplete(IWebBrowser2* browser, const std::wstring& u
         assert(pluginFilter && "Plugin filter should be a valid object");
         if (pluginFilter)
         {
-          InjectABPCSS(*pDoc, pluginFilter->GetHideFilters());
+          InjectABPCSS(*pDoc, *pluginFilter);
         }
       }
     }
@@ -537,24 +740,13 @@ std::wstring CPluginTab::GetDocumentUrl()
 // ============================================================================
 bool CPluginTab::IsFrameCached(const std::wstring& url)
 {
-  bool isFrame;
-
-  m_criticalSectionCache.Lock();
-  {
-    isFrame = m_cacheFrames.find(url) != m_cacheFrames.end();
-  }
-  m_criticalSectionCache.Unlock();
-
-  return isFrame;
+  // Called for every request, so it doesn't lock
+  return m_cacheFrames.Contains(url);
 }
 
 void CPluginTab::CacheFrame(const std::wstring& url)
 {
-  m_criticalSectionCache.Lock();
-  {
-    m_cacheFrames.insert(url);
-  }
-  m_criticalSectionCache.Unlock();
+  m_cacheFrames.Insert(url);
 }
 
 void CPluginTab::ClearFrameCache(const std::wstring& domain)
@@ -563,7 +755,7 @@ void CPluginTab::ClearFrameCache(const std::wstring& domain)
   {
     if (domain.empty() || domain != m_cacheDomain)
     {
-      m_cacheFrames.clear();
+      m_cacheFrames.Clear();
       m_cacheDomain = domain;
     }
   }
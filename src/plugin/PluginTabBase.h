@@ -23,6 +23,7 @@ class CPluginDomTraverser;
 #include "PluginUserSettings.h"
 #include "PluginFilter.h"
 #include "../shared/CriticalSection.h"
+#include "../shared/UrlHashSet.h"
 #include <thread>
 #include <atomic>
 
@@ -44,8 +45,9 @@ public:
   std::shared_ptr<AsyncPluginFilter> m_asyncPluginFilter;
 private:
   void ThreadProc();
+  // Guards m_cacheDomain, m_cacheFrames is read without locking
   CComAutoCriticalSection m_criticalSectionCache;
-  std::set<std::wstring> m_cacheFrames;
+  UrlHashSet m_cacheFrames;
   std::wstring m_cacheDomain;
   void InjectABP(IWebBrowser2* browser);
   bool IsTraverserEnabled();
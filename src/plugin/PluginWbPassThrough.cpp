@@ -22,52 +22,22 @@
 #include "PluginClass.h"
 #include "PluginUtil.h"
 #include <WinInet.h>
+#include "../shared/ContentTypeClassifier.h"
+#include "../shared/HttpHeaders.h"
+#include "../shared/RequestClassifier.h"
+#include "../shared/SyntheticResponse.h"
 #include "../shared/Utils.h"
 #include "IeVersion.h"
 
 namespace
 {
-  const std::string g_blockedByABPPage = "<!DOCTYPE html>"
-    "<html>"
-        "<body>"
-          "<!-- blocked by AdblockPlus -->"
-        "</body>"
-    "</html>";
-
-  template <typename T>
-  T ASCIIStringToLower(const T& text)
-  {
-    T textlower;
-    std::transform(text.begin(), text.end(), std::back_inserter(textlower), 
-      [](T::value_type ch)
-      {
-        return std::tolower(ch, std::locale());
-      }
-    );
-    return textlower;
-  }
-
   typedef AdblockPlus::FilterEngine::ContentType ContentType;
 
-  template <class T>
-  T ExtractHttpHeader(const T& allHeaders, const T& targetHeaderNameWithColon, const T& delimiter)
-  {
-    const T allHeadersLower = ASCIIStringToLower(allHeaders);
-    auto targetHeaderBeginsAt = allHeadersLower.find(ASCIIStringToLower(targetHeaderNameWithColon));
-    if (targetHeaderBeginsAt == T::npos)
-    {
-      return T();
-    }
-    targetHeaderBeginsAt += targetHeaderNameWithColon.length();
-    auto targetHeaderEndsAt = allHeadersLower.find(ASCIIStringToLower(delimiter), targetHeaderBeginsAt);
-    if (targetHeaderEndsAt == T::npos)
-    {
-      return T();
-    }
-    return allHeaders.substr(targetHeaderBeginsAt, targetHeaderEndsAt - targetHeaderBeginsAt);
-  }
+  static_assert(flashBindFlags == (BINDF_ASYNCHRONOUS | BINDF_ASYNCSTORAGE | BINDF_PULLDATA) &&
+    flashBindOptions == (BINDINFO_OPTIONS_ENABLE_UTF8 | BINDINFO_OPTIONS_USE_IE_ENCODING),
+    "The bind info of Flash requests doesn't match urlmon.h");
 
-  std::string ExtractHttpAcceptHeader(IInternetProtocol* internetProtocol)
+  std::wstring ExtractHttpAcceptHeader(IInternetProtocol* internetProtocol)
   {
     // Despite there being HTTP_QUERY_ACCEPT and other query info flags, they don't work here,
     // only HTTP_QUERY_RAW_HEADERS_CRLF | HTTP_QUERY_FLAG_REQUEST_HEADERS does work.
@@ -75,63 +45,31 @@ namespace
     HRESULT hr = internetProtocol->QueryInterface(&winInetHttpInfo);
     if (FAILED(hr) || !winInetHttpInfo)
     {
-      return "";
+      return L"";
     }
-    DWORD size = 0;
+    // Request headers usually fit, so the size doesn't have to be queried first
+    char stackBuffer[2048];
+    std::string heapBuffer;
+    char* buffer = stackBuffer;
+    DWORD size = sizeof(stackBuffer);
     DWORD flags = 0;
     DWORD queryOption = HTTP_QUERY_RAW_HEADERS_CRLF | HTTP_QUERY_FLAG_REQUEST_HEADERS;
-    hr = winInetHttpInfo->QueryInfo(queryOption, /*buffer*/ nullptr, /*get size*/ &size, &flags, /*reserved*/ 0);
-    if (FAILED(hr))
+    hr = winInetHttpInfo->QueryInfo(queryOption, buffer, &size, &flags, /*reserved*/ 0);
+    if (FAILED(hr) && size > sizeof(stackBuffer))
     {
-      return "";
+      heapBuffer.resize(size);
+      buffer = &heapBuffer[0];
+      hr = winInetHttpInfo->QueryInfo(queryOption, buffer, &size, &flags, 0);
     }
-    std::string buf(size, '\0');
-    hr = winInetHttpInfo->QueryInfo(queryOption, &buf[0], &size, &flags, 0);
     if (FAILED(hr))
     {
-      return "";
-    }
-    return ExtractHttpHeader<std::string>(buf, "Accept:", "\r\n");
-  }
-
-  bool IsXmlHttpRequest(const std::wstring& additionalHeaders)
-  {
-    auto requestedWithHeader = ExtractHttpHeader<std::wstring>(additionalHeaders, L"X-Requested-With:", L"\n");
-    return TrimString(requestedWithHeader) == L"XMLHttpRequest";
-  }
-
-  ContentType GetContentTypeFromString(const std::wstring& value)
-  {
-    auto lastDotPos = value.rfind(L'.');
-    if (lastDotPos == std::wstring::npos)
-      return ContentType::CONTENT_TYPE_OTHER;
-
-    std::wstring ext = ASCIIStringToLower(value.substr(lastDotPos + 1));
-    if (ext == L"jpg" || ext == L"gif" || ext == L"png" || ext == L"jpeg")
-    {
-      return ContentType::CONTENT_TYPE_IMAGE;
-    }
-    else if (ext == L"css")
-    {
-      return ContentType::CONTENT_TYPE_STYLESHEET;
-    }
-    else if (ext == L"js")
-    {
-      return ContentType::CONTENT_TYPE_SCRIPT;
-    }
-    else if (ext == L"xml")
-    {
-      return ContentType::CONTENT_TYPE_XMLHTTPREQUEST;
-    }
-    else if (ext == L"swf")
-    {
-      return ContentType::CONTENT_TYPE_OBJECT;
+      return L"";
     }
-    else if (ext == L"jsp" || ext == L"php" || ext == L"html")
-    {
-      return ContentType::CONTENT_TYPE_SUBDOCUMENT;
-    }
-    return ContentType::CONTENT_TYPE_OTHER;
+    // On success size is the length of the headers without the terminating null
+    HttpHeaders<char> headers(buffer, buffer + size);
+    HttpHeaders<char>::Range accept = headers.Find("Accept");
+    // Media types are ASCII, but the header can contain anything
+    return ToUtf16String(std::string(accept.begin, accept.end));
   }
 }
 
@@ -139,88 +77,66 @@ WBPassthruSink::WBPassthruSink()
   : m_currentPositionOfSentPage(0)
   , m_contentType(ContentType::CONTENT_TYPE_OTHER)
   , m_isCustomResponse(false)
+  , m_syntheticResponse(nullptr)
 {
 }
 
 namespace
 {
-  /**
-   * Heuristic to infer an ABP content type from the media type list of an Accept: header field.
-   *
-   * Known IE Accept: strings for documents and images:
-   *     text/html, application/xhtml+xml, image/jxr, *\/*
-   *     image/png, image/svg+xml, image/jxr, image/*;q=0.8, *\/*;q = 0.5
-   * In IE9 the image/jxr part is missing.
-   */
-  ContentType InferContentTypeFromMediaTypeList(const std::wstring& mediaTypeList)
+  ContentType ToContentType(RequestContentType type)
   {
-    if ((mediaTypeList.find(L"text/html") != std::wstring::npos) ||
-      (mediaTypeList.find(L"application/xhtml+xml") != std::wstring::npos))
-    {
-      return ContentType::CONTENT_TYPE_SUBDOCUMENT;
-    }
-    if (mediaTypeList.find(L"image/") != std::wstring::npos)
+    switch (type)
     {
+    case REQUEST_TYPE_IMAGE:
       return ContentType::CONTENT_TYPE_IMAGE;
-    }
-    if (mediaTypeList.find(L"text/css") != std::wstring::npos)
-    {
+    case REQUEST_TYPE_STYLESHEET:
       return ContentType::CONTENT_TYPE_STYLESHEET;
-    }
-    if ((mediaTypeList.find(L"application/javascript") != std::wstring::npos) || (mediaTypeList.find(L"application/json") != std::wstring::npos))
-    {
+    case REQUEST_TYPE_SCRIPT:
       return ContentType::CONTENT_TYPE_SCRIPT;
-    }
-    if (mediaTypeList.find(L"application/x-shockwave-flash") != std::wstring::npos)
-    {
-      return ContentType::CONTENT_TYPE_OBJECT;
-    }
-    // It is important to have this check last, since it is rather generic, and might overlay text/html, for example
-    if (mediaTypeList.find(L"xml") != std::wstring::npos)
-    {
+    case REQUEST_TYPE_XMLHTTPREQUEST:
       return ContentType::CONTENT_TYPE_XMLHTTPREQUEST;
+    case REQUEST_TYPE_OBJECT:
+      return ContentType::CONTENT_TYPE_OBJECT;
+    case REQUEST_TYPE_SUBDOCUMENT:
+      return ContentType::CONTENT_TYPE_SUBDOCUMENT;
+    case REQUEST_TYPE_OBJECT_SUBREQUEST:
+      return ContentType::CONTENT_TYPE_OBJECT_SUBREQUEST;
+    default:
+      return ContentType::CONTENT_TYPE_OTHER;
     }
-    return ContentType::CONTENT_TYPE_OTHER;
   }
 
-  ContentType InferContentTypeFromUrl(const std::wstring& src)
+  /**
+   * Lookups of the request classification, answered by the tab and the
+   * filter engine.
+   */
+  class PluginRequestEnvironment : public RequestEnvironment
   {
-    std::wstring schemeAndHierarchicalPart = GetSchemeAndHierarchicalPart(src);
-    auto contentType = GetContentTypeFromString(schemeAndHierarchicalPart);
-    if (contentType == ContentType::CONTENT_TYPE_OTHER &&
-      AdblockPlus::IE::InstalledMajorVersion() == 8)
+  public:
+    PluginRequestEnvironment(CPluginTab* tab, CPluginClient* client)
+      : m_tab(tab), m_client(client)
     {
-      std::wstring queryString = GetQueryString(src);
-      wchar_t* nextToken = nullptr;
-      const wchar_t* token = wcstok_s(&queryString[0], L"&=", &nextToken);
-      while (token != nullptr)
-      {
-        contentType = GetContentTypeFromString(token);
-        if (contentType != ContentType::CONTENT_TYPE_OTHER)
-        {
-           return contentType;
-        }
-        token = wcstok_s(nullptr, L"&=", &nextToken);
-      }
     }
-    return contentType;
-  }
 
-  ContentType InferContentType(const std::wstring& mediaTypeList, const std::wstring& domain, const std::wstring& src)
-  {
-    // No referer or mime type
-    // BINDSTRING_XDR_ORIGIN works only for IE v8+
-    if (mediaTypeList.empty() && domain.empty() && AdblockPlus::IE::InstalledMajorVersion() >= 8)
+    bool IsFilteringEnabled(const std::wstring& documentUrl)
     {
-      return ContentType::CONTENT_TYPE_XMLHTTPREQUEST;
+      return m_client && CPluginSettings::GetInstance()->IsPluginEnabled() && !m_client->IsWhitelistedUrl(documentUrl);
     }
-    ContentType contentType = InferContentTypeFromMediaTypeList(mediaTypeList);
-    if (contentType == ContentType::CONTENT_TYPE_OTHER)
+
+    bool IsFrameCached(const std::wstring& url)
     {
-      contentType = InferContentTypeFromUrl(src);
+      return m_tab && m_tab->IsFrameCached(url);
     }
-    return contentType;
-  }
+
+    bool ShouldBlock(const std::wstring& url, RequestContentType contentType, const std::wstring& referrer)
+    {
+      return m_client && m_client->ShouldBlock(url, ToContentType(contentType), referrer, /*debug flag but must be set*/true);
+    }
+
+  private:
+    CPluginTab* m_tab;
+    CPluginClient* m_client;
+  };
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -246,12 +162,13 @@ HRESULT WBPassthruSink::OnRead(void* pv, ULONG cb, ULONG* pcbRead)
 
   if (PassthroughAPP::CustomSinkStartPolicy<WbPassthroughProtocol, WBPassthruSink>::GetProtocol(this)->m_shouldSupplyCustomContent)
   {
-    ULONG blockedByABPPageSize = static_cast<ULONG>(g_blockedByABPPage.size());
-    auto positionGrow = std::min<ULONG>(cb, static_cast<ULONG>(blockedByABPPageSize - m_currentPositionOfSentPage));
+    ULONG responseSize = m_syntheticResponse->size;
+    auto positionGrow = std::min<ULONG>(cb, static_cast<ULONG>(responseSize - m_currentPositionOfSentPage));
     if (positionGrow == 0) {
       return S_FALSE;
     }
-    std::copy(g_blockedByABPPage.begin(), g_blockedByABPPage.begin() + positionGrow,
+    const char* responseBody = m_syntheticResponse->body + m_currentPositionOfSentPage;
+    std::copy(responseBody, responseBody + positionGrow,
       stdext::make_checked_array_iterator(static_cast<char*>(pv), cb));
     *pcbRead = positionGrow;
     m_currentPositionOfSentPage += positionGrow;
@@ -259,11 +176,11 @@ HRESULT WBPassthruSink::OnRead(void* pv, ULONG cb, ULONG* pcbRead)
     if (m_spInternetProtocolSink)
     {
       m_spInternetProtocolSink->ReportData(BSCF_INTERMEDIATEDATANOTIFICATION,
-        static_cast<ULONG>(m_currentPositionOfSentPage), blockedByABPPageSize);
+        static_cast<ULONG>(m_currentPositionOfSentPage), responseSize);
     }
-    if (blockedByABPPageSize == m_currentPositionOfSentPage && m_spInternetProtocolSink)
+    if (responseSize == m_currentPositionOfSentPage && m_spInternetProtocolSink)
     {
-      m_spInternetProtocolSink->ReportData(BSCF_DATAFULLYAVAILABLE, blockedByABPPageSize, blockedByABPPageSize);
+      m_spInternetProtocolSink->ReportData(BSCF_DATAFULLYAVAILABLE, responseSize, responseSize);
       m_spInternetProtocolSink->ReportResult(S_OK, 0, nullptr);
     }
     return S_OK;
@@ -297,38 +214,6 @@ STDMETHODIMP WBPassthruSink::Switch(
   return m_spInternetProtocolSink ? m_spInternetProtocolSink->Switch(pProtocolData) : E_UNEXPECTED;
 }
 
-// This is the heuristic which detects the requests issued by Flash.ocx.
-// It turned out that the implementation from ''Flash.ocx'' (tested version is 15.0.0.152)
-// returns quite minimal configuration in comparison with the implementation from Microsofts'
-// libraries (see grfBINDF and bindInfo.dwOptions). The impl from MS often includes something
-// else.
-bool WBPassthruSink::IsFlashRequest(const wchar_t* const* additionalHeaders)
-{
-  if (additionalHeaders && *additionalHeaders)
-  {
-    auto flashVersionHeader = ExtractHttpHeader<std::wstring>(*additionalHeaders, L"x-flash-version:", L"\n");
-    if (!TrimString(flashVersionHeader).empty())
-    {
-      return true;
-    }
-  }
-  ATL::CComPtr<IBindStatusCallback> bscb;
-  if (SUCCEEDED(QueryServiceFromClient(&bscb)) && !!bscb)
-  {
-    DWORD grfBINDF = 0;
-    BINDINFO bindInfo = {};
-    bindInfo.cbSize = sizeof(bindInfo);
-    if (SUCCEEDED(bscb->GetBindInfo(&grfBINDF, &bindInfo)) &&
-      (BINDF_ASYNCHRONOUS | BINDF_ASYNCSTORAGE| BINDF_PULLDATA) == grfBINDF &&
-      (BINDINFO_OPTIONS_ENABLE_UTF8 | BINDINFO_OPTIONS_USE_IE_ENCODING) == bindInfo.dwOptions
-      )
-    {
-      return true;
-    }
-  }
-  return false;
-}
-
 STDMETHODIMP WBPassthruSink::BeginningTransaction(LPCWSTR szURL, LPCWSTR szHeaders, DWORD dwReserved, LPWSTR* pszAdditionalHeaders)
 {
   if (!szURL)
@@ -349,53 +234,51 @@ STDMETHODIMP WBPassthruSink::BeginningTransaction(LPCWSTR szURL, LPCWSTR szHeade
   // There doesn't seem to be any other way to get this header before the request has been made.
   HRESULT nativeHr = httpNegotiate ? httpNegotiate->BeginningTransaction(szURL, szHeaders, dwReserved, pszAdditionalHeaders) : S_OK;
 
-  if (pszAdditionalHeaders && *pszAdditionalHeaders)
-  {
-    m_boundDomain = ExtractHttpHeader<std::wstring>(*pszAdditionalHeaders, L"Referer:", L"\n");
-  }
-  m_boundDomain = TrimString(m_boundDomain);
-  m_contentType = InferContentType(ToUtf16String(ExtractHttpAcceptHeader(m_spTargetProtocol)), m_boundDomain, src);
-
+  RequestDescriptor request;
+  request.url = src;
+  request.additionalHeaders = pszAdditionalHeaders ? *pszAdditionalHeaders : nullptr;
+  request.accept = ExtractHttpAcceptHeader(m_spTargetProtocol);
+  request.ieMajorVersion = AdblockPlus::IE::InstalledMajorVersion();
+  GetClientBindInfo(request);
   CPluginTab* tab = CPluginClass::GetTabForCurrentThread();
-  CPluginClient* client = CPluginClient::GetInstance();
-
-  if (tab && client)
-  {
-    std::wstring documentUrl = tab->GetDocumentUrl();
-    // Page is identical to document => don't block
-    if (documentUrl == src)
-    {
-      return nativeHr;
-    }
-    else if (CPluginSettings::GetInstance()->IsPluginEnabled() && !client->IsWhitelistedUrl(documentUrl))
-    {
-      if (tab->IsFrameCached(src))
-      {
-        m_contentType = ContentType::CONTENT_TYPE_SUBDOCUMENT;
-      }
-    }
-  }
-
-  if (IsFlashRequest(pszAdditionalHeaders))
+  if (tab)
   {
-    m_contentType = ContentType::CONTENT_TYPE_OBJECT_SUBREQUEST;
+    request.hasTab = true;
+    request.documentUrl = tab->GetDocumentUrl();
   }
 
-  if (pszAdditionalHeaders && *pszAdditionalHeaders && IsXmlHttpRequest(*pszAdditionalHeaders))
+  PluginRequestEnvironment environment(tab, CPluginClient::GetInstance());
+  RequestDecision decision = ClassifyRequest(request, environment);
+  m_boundDomain = decision.referrer;
+  m_contentType = ToContentType(decision.contentType);
+  if (decision.shouldBlock)
   {
-    m_contentType = ContentType::CONTENT_TYPE_XMLHTTPREQUEST;
+    m_isCustomResponse = decision.isCustomResponse;
+    // Blocked images, scripts and stylesheets get an empty resource of their
+    // own type, so that the page doesn't try to parse HTML as one of them.
+    m_syntheticResponse = &GetSyntheticResponse(decision.contentType);
+    return E_ABORT;
   }
+  return nativeHr;
+}
 
-  if (client->ShouldBlock(src, m_contentType, m_boundDomain, /*debug flag but must be set*/true))
+// The bind info is one of the signs of requests issued by Flash.ocx, see
+// RequestStages::IsObjectSubrequest.
+void WBPassthruSink::GetClientBindInfo(RequestDescriptor& request)
+{
+  ATL::CComPtr<IBindStatusCallback> bscb;
+  if (SUCCEEDED(QueryServiceFromClient(&bscb)) && !!bscb)
   {
-    // NOTE: Feeding custom HTML to Flash, instead of original object subrequest
-    // doesn't have much sense. It also can manifest in unwanted result
-    // like video being blocked (See https://issues.adblockplus.org/ticket/1669)
-    // So we report blocked object subrequests as failed, not just empty HTML.
-    m_isCustomResponse = m_contentType != ContentType::CONTENT_TYPE_OBJECT_SUBREQUEST;
-    return E_ABORT;
+    DWORD grfBINDF = 0;
+    BINDINFO bindInfo = {};
+    bindInfo.cbSize = sizeof(bindInfo);
+    if (SUCCEEDED(bscb->GetBindInfo(&grfBINDF, &bindInfo)))
+    {
+      request.hasBindInfo = true;
+      request.bindFlags = grfBINDF;
+      request.bindOptions = bindInfo.dwOptions;
+    }
   }
-  return nativeHr;
 }
 
 STDMETHODIMP WBPassthruSink::OnResponse(DWORD dwResponseCode, LPCWSTR szResponseHeaders, LPCWSTR szRequestHeaders, LPWSTR *pszAdditionalRequestHeaders)
@@ -438,8 +321,8 @@ HRESULT WbPassthroughSinkStartPolicy::OnStart(LPCWSTR szUrl,
   if (hr == E_ABORT && pSink->m_isCustomResponse)
   {
     GetProtocol(pSink)->m_shouldSupplyCustomContent = true;
-    pSink->m_spInternetProtocolSink->ReportProgress(BINDSTATUS_MIMETYPEAVAILABLE, L"text/html");
-    pSink->m_spInternetProtocolSink->ReportData(BSCF_FIRSTDATANOTIFICATION, 0, static_cast<ULONG>(g_blockedByABPPage.size()));
+    pSink->m_spInternetProtocolSink->ReportProgress(BINDSTATUS_MIMETYPEAVAILABLE, pSink->m_syntheticResponse->mimeType);
+    pSink->m_spInternetProtocolSink->ReportData(BSCF_FIRSTDATANOTIFICATION, 0, pSink->m_syntheticResponse->size);
     return S_OK;
   }
   return hr;
@@ -20,6 +20,10 @@
 #include <AdblockPlus/FilterEngine.h>
 #include "passthroughapp/ProtocolCF.h"
 #include "passthroughapp/ProtocolImpl.h"
+
+struct RequestDescriptor;
+struct SyntheticResponse;
+
 #define IE_MAX_URL_LENGTH 2048
 
 class WBPassthruSink :
@@ -32,13 +36,15 @@ public:
   WBPassthruSink();
 
   bool m_isCustomResponse;
+  // What is served instead of a blocked request, set with m_isCustomResponse
+  const SyntheticResponse* m_syntheticResponse;
 
 private:
   uint64_t m_currentPositionOfSentPage;
   CComPtr<IInternetProtocol> m_pTargetProtocol;
   AdblockPlus::FilterEngine::ContentType m_contentType;
   std::wstring m_boundDomain;
-  bool IsFlashRequest(const wchar_t* const* additionalHeaders);
+  void GetClientBindInfo(RequestDescriptor& request);
 
 public:
   BEGIN_COM_MAP(WBPassthruSink)
@@ -0,0 +1,127 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+
+#include "AtomTable.h"
+
+namespace
+{
+  const size_t initialSlots = 64;
+}
+
+AtomTable::AtomTable()
+  : m_slots(initialSlots, 0)
+{
+  Intern(L"", 0);
+}
+
+size_t AtomTable::Hash(const wchar_t* str, size_t length)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= static_cast<uint32_t>(str[i]);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+size_t AtomTable::FindSlot(const wchar_t* str, size_t length, size_t hash) const
+{
+  size_t mask = m_slots.size() - 1;
+  for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+  {
+    uint32_t entry = m_slots[slot];
+    if (entry == 0)
+    {
+      return slot;
+    }
+    const AtomInfo& info = m_atoms[entry - 1];
+    if (info.hash == static_cast<uint32_t>(hash) && info.length == length &&
+        (length == 0 || std::memcmp(&m_chars[info.offset], str, length * sizeof(wchar_t)) == 0))
+    {
+      return slot;
+    }
+  }
+}
+
+AtomTable::Atom AtomTable::Intern(const wchar_t* str, size_t length)
+{
+  size_t hash = Hash(str, length);
+  size_t slot = FindSlot(str, length, hash);
+  if (m_slots[slot] != 0)
+  {
+    return m_slots[slot] - 1;
+  }
+
+  AtomInfo info;
+  info.hash = static_cast<uint32_t>(hash);
+  info.offset = static_cast<uint32_t>(m_chars.size());
+  info.length = static_cast<uint32_t>(length);
+  m_chars.insert(m_chars.end(), str, str + length);
+  Atom atom = static_cast<Atom>(m_atoms.size());
+  m_atoms.push_back(info);
+  m_slots[slot] = atom + 1;
+
+  // Keep the load factor below 1/2
+  if (m_atoms.size() * 2 > m_slots.size())
+  {
+    Grow();
+  }
+  return atom;
+}
+
+AtomTable::Atom AtomTable::Find(const wchar_t* str, size_t length, size_t hash) const
+{
+  uint32_t entry = m_slots[FindSlot(str, length, hash)];
+  return entry == 0 ? NotFound : entry - 1;
+}
+
+std::wstring AtomTable::GetString(Atom atom) const
+{
+  if (atom >= m_atoms.size())
+  {
+    return std::wstring();
+  }
+  const AtomInfo& info = m_atoms[atom];
+  return info.length == 0 ? std::wstring() : std::wstring(&m_chars[info.offset], info.length);
+}
+
+size_t AtomTable::GetMemoryUsage() const
+{
+  return m_chars.capacity() * sizeof(wchar_t) + m_atoms.capacity() * sizeof(AtomInfo) +
+    m_slots.capacity() * sizeof(uint32_t);
+}
+
+void AtomTable::Grow()
+{
+  std::vector<uint32_t> slots(m_slots.size() * 2, 0);
+  size_t mask = slots.size() - 1;
+  for (size_t i = 0; i < m_atoms.size(); i++)
+  {
+    size_t slot = m_atoms[i].hash & mask;
+    while (slots[slot] != 0)
+    {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = static_cast<uint32_t>(i + 1);
+  }
+  m_slots.swap(slots);
+}
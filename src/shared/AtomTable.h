@@ -0,0 +1,78 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ATOM_TABLE_H
+#define ATOM_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Interns strings and hands out small integer ids (atoms) for them.
+///
+/// The characters of all strings are stored in a single arena, the table
+/// itself uses open addressing. The empty string is always atom 0.
+class AtomTable
+{
+public:
+  typedef uint32_t Atom;
+  static const Atom NotFound = 0xFFFFFFFF;
+
+  AtomTable();
+
+  static size_t Hash(const wchar_t* str, size_t length);
+
+  Atom Intern(const std::wstring& str)
+  {
+    return Intern(str.c_str(), str.length());
+  }
+  Atom Intern(const wchar_t* str, size_t length);
+
+  /// Returns NotFound if the string hasn't been interned.
+  Atom Find(const std::wstring& str) const
+  {
+    return Find(str.c_str(), str.length(), Hash(str.c_str(), str.length()));
+  }
+  /// Lookup with a hash which has been calculated by `Hash` before.
+  Atom Find(const wchar_t* str, size_t length, size_t hash) const;
+
+  std::wstring GetString(Atom atom) const;
+  size_t GetSize() const
+  {
+    return m_atoms.size();
+  }
+  size_t GetMemoryUsage() const;
+
+private:
+  struct AtomInfo
+  {
+    uint32_t hash;
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  size_t FindSlot(const wchar_t* str, size_t length, size_t hash) const;
+  void Grow();
+
+  std::vector<wchar_t> m_chars;
+  std::vector<AtomInfo> m_atoms;
+  // Atom + 1 per slot, 0 marks an empty slot. The size is a power of two.
+  std::vector<uint32_t> m_slots;
+};
+
+#endif
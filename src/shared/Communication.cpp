@@ -69,21 +69,25 @@ namespace
     return sid;
   }
 
+  const DWORD fullAccess = STANDARD_RIGHTS_ALL | SPECIFIC_RIGHTS_ALL;
+
   // Creates a security descriptor: 
-  // Allows ALL access to Logon SID and to all app containers in DACL.
+  // Allows `accessPermissions` to Logon SID and to all app containers in DACL.
+  // Before Windows 8 the DACL is only set if the access is restricted,
+  // otherwise it is left NULL.
   // Sets Low Integrity in SACL.
-  std::auto_ptr<SECURITY_DESCRIPTOR> CreateSecurityDescriptor(PSID logonSid)
+  std::auto_ptr<SECURITY_DESCRIPTOR> CreateSecurityDescriptor(PSID logonSid, DWORD accessPermissions)
   {
     std::auto_ptr<SECURITY_DESCRIPTOR> securityDescriptor((SECURITY_DESCRIPTOR*)new char[SECURITY_DESCRIPTOR_MIN_LENGTH]);
     if (!InitializeSecurityDescriptor(securityDescriptor.get(), SECURITY_DESCRIPTOR_REVISION)) 
       return std::auto_ptr<SECURITY_DESCRIPTOR>(0);
     // TODO: Would be better to detect if AppContainers are supported instead of checking the Windows version
     bool isAppContainersSupported = IsWindows8OrLater();
-    if (isAppContainersSupported)
+    if (isAppContainersSupported || accessPermissions != fullAccess)
     {
       EXPLICIT_ACCESSW explicitAccess[2] = {};
 
-      explicitAccess[0].grfAccessPermissions = STANDARD_RIGHTS_ALL | SPECIFIC_RIGHTS_ALL;
+      explicitAccess[0].grfAccessPermissions = accessPermissions;
       explicitAccess[0].grfAccessMode = SET_ACCESS;
       explicitAccess[0].grfInheritance= NO_INHERITANCE;
       explicitAccess[0].Trustee.TrusteeForm = TRUSTEE_IS_SID;
@@ -97,26 +101,32 @@ namespace
       // Which blocks all the calls from outside, making it impossible to communicate
       // with the engine when IE is launched with different security settings.
       PSID allAppContainersSid = 0;
-      SID_IDENTIFIER_AUTHORITY applicationAuthority = SECURITY_APP_PACKAGE_AUTHORITY;
-
-      AllocateAndInitializeSid(&applicationAuthority, 
-              SECURITY_BUILTIN_APP_PACKAGE_RID_COUNT,
-              SECURITY_APP_PACKAGE_BASE_RID,
-              SECURITY_BUILTIN_PACKAGE_ANY_PACKAGE,
-              0, 0, 0, 0, 0, 0,
-              &allAppContainersSid);
-      std::tr1::shared_ptr<SID> sharedAllAppContainersSid(static_cast<SID*>(allAppContainersSid), FreeSid); // Just to simplify cleanup
-
-      explicitAccess[1].grfAccessPermissions = STANDARD_RIGHTS_ALL | SPECIFIC_RIGHTS_ALL;
-      explicitAccess[1].grfAccessMode = SET_ACCESS;
-      explicitAccess[1].grfInheritance= NO_INHERITANCE;
-      explicitAccess[1].Trustee.TrusteeForm = TRUSTEE_IS_SID;
-      explicitAccess[1].Trustee.TrusteeType = TRUSTEE_IS_GROUP;
-      explicitAccess[1].Trustee.ptstrName = static_cast<LPWSTR>(allAppContainersSid);
+      std::tr1::shared_ptr<SID> sharedAllAppContainersSid; // Just to simplify cleanup
+      ULONG entryCount = 1;
+      if (isAppContainersSupported)
+      {
+        SID_IDENTIFIER_AUTHORITY applicationAuthority = SECURITY_APP_PACKAGE_AUTHORITY;
+
+        AllocateAndInitializeSid(&applicationAuthority, 
+                SECURITY_BUILTIN_APP_PACKAGE_RID_COUNT,
+                SECURITY_APP_PACKAGE_BASE_RID,
+                SECURITY_BUILTIN_PACKAGE_ANY_PACKAGE,
+                0, 0, 0, 0, 0, 0,
+                &allAppContainersSid);
+        sharedAllAppContainersSid.reset(static_cast<SID*>(allAppContainersSid), FreeSid);
+
+        explicitAccess[1].grfAccessPermissions = accessPermissions;
+        explicitAccess[1].grfAccessMode = SET_ACCESS;
+        explicitAccess[1].grfInheritance= NO_INHERITANCE;
+        explicitAccess[1].Trustee.TrusteeForm = TRUSTEE_IS_SID;
+        explicitAccess[1].Trustee.TrusteeType = TRUSTEE_IS_GROUP;
+        explicitAccess[1].Trustee.ptstrName = static_cast<LPWSTR>(allAppContainersSid);
+        entryCount = 2;
+      }
 
       // Will be released later
       PACL acl = 0;
-      if (SetEntriesInAcl(2, explicitAccess, 0, &acl) != ERROR_SUCCESS)
+      if (SetEntriesInAcl(entryCount, explicitAccess, 0, &acl) != ERROR_SUCCESS)
         return std::auto_ptr<SECURITY_DESCRIPTOR>(0);
 
       // NOTE: This only references the acl, not copies it. 
@@ -161,6 +171,7 @@ namespace
 }
 
 const std::wstring Communication::pipeName = L"\\\\.\\pipe\\adblockplusengine_" + GetUserName();
+const std::wstring Communication::engineReadyEventName = L"AdblockPlusEngineReady_" + GetUserName();
 
 void Communication::InputBuffer::CheckType(Communication::ValueType expectedType)
 {
@@ -201,6 +212,11 @@ Communication::PipeDisconnectedError::PipeDisconnectedError()
 {
 }
 
+Communication::PipeTimeoutError::PipeTimeoutError()
+  : std::runtime_error("Timeout while waiting for a named pipe operation")
+{
+}
+
 void FreeAbsoluteSecurityDescriptor(SECURITY_DESCRIPTOR* securityDescriptor)
 {
   BOOL aclPresent = FALSE;
@@ -222,41 +238,85 @@ void FreeAbsoluteSecurityDescriptor(SECURITY_DESCRIPTOR* securityDescriptor)
   free(securityDescriptor);
 }
 
-Communication::Pipe::Pipe(const std::wstring& pipeName, Communication::Pipe::Mode mode)
+namespace
 {
-  pipe = INVALID_HANDLE_VALUE;
-  if (mode == MODE_CREATE)
+  // Returns the security descriptor referenced by securityAttributes, it has
+  // to be kept alive until the object is created.
+  std::tr1::shared_ptr<SECURITY_DESCRIPTOR> InitSecurityAttributes(SECURITY_ATTRIBUTES& securityAttributes,
+    DWORD accessPermissions = fullAccess)
   {
-    SECURITY_ATTRIBUTES securityAttributes = {};
     securityAttributes.nLength = sizeof(securityAttributes);
     securityAttributes.bInheritHandle = TRUE;
 
     std::tr1::shared_ptr<SECURITY_DESCRIPTOR> sharedSecurityDescriptor; // Just to simplify cleanup
     AutoHandle token;
     OpenProcessToken(GetCurrentProcess(), TOKEN_READ, token);
-    
+
     if (IsWindowsVistaOrLater())
     {
       std::auto_ptr<SID> logonSid = GetLogonSid(token);
       // Create a SECURITY_DESCRIPTOR that has both Low Integrity and allows access to all AppContainers
       // This is needed since IE likes to jump out of Enhanced Protected Mode for specific pages (bing.com)
-      std::auto_ptr<SECURITY_DESCRIPTOR> securityDescriptor = CreateSecurityDescriptor(logonSid.get());
+      std::auto_ptr<SECURITY_DESCRIPTOR> securityDescriptor = CreateSecurityDescriptor(logonSid.get(), accessPermissions);
 
       securityAttributes.lpSecurityDescriptor = securityDescriptor.release();
       sharedSecurityDescriptor.reset(static_cast<SECURITY_DESCRIPTOR*>(securityAttributes.lpSecurityDescriptor), FreeAbsoluteSecurityDescriptor);
     }
+    return sharedSecurityDescriptor;
+  }
+}
+
+HANDLE Communication::CreateEngineReadyEvent()
+{
+  SECURITY_ATTRIBUTES securityAttributes = {};
+  std::tr1::shared_ptr<SECURITY_DESCRIPTOR> sharedSecurityDescriptor = InitSecurityAttributes(securityAttributes);
+  securityAttributes.bInheritHandle = FALSE;
+  return CreateEventW(&securityAttributes, TRUE, FALSE, engineReadyEventName.c_str());
+}
+
+HANDLE Communication::CreateSharedSection(const std::wstring& name, uint32_t size)
+{
+  // Browser processes may only map the section for reading, the creator's
+  // handle has full access regardless of the DACL.
+  SECURITY_ATTRIBUTES securityAttributes = {};
+  std::tr1::shared_ptr<SECURITY_DESCRIPTOR> sharedSecurityDescriptor = InitSecurityAttributes(securityAttributes,
+    STANDARD_RIGHTS_READ | SECTION_MAP_READ | SECTION_QUERY);
+  securityAttributes.bInheritHandle = FALSE;
+  HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, &securityAttributes, PAGE_READWRITE, 0, size, name.c_str());
+  if (section && GetLastError() == ERROR_ALREADY_EXISTS)
+  {
+    // Someone else created it, we can't rely on its security descriptor
+    CloseHandle(section);
+    SetLastError(ERROR_ALREADY_EXISTS);
+    return 0;
+  }
+  return section;
+}
+
+Communication::Pipe::Pipe(const std::wstring& pipeName, Communication::Pipe::Mode mode, HANDLE listeningEvent, DWORD connectTimeoutMsec)
+{
+  pipe = INVALID_HANDLE_VALUE;
+  overlapped = mode == MODE_CONNECT;
+  if (mode == MODE_CREATE)
+  {
+    SECURITY_ATTRIBUTES securityAttributes = {};
+    std::tr1::shared_ptr<SECURITY_DESCRIPTOR> sharedSecurityDescriptor = InitSecurityAttributes(securityAttributes);
     pipe = CreateNamedPipeW(pipeName.c_str(),  PIPE_ACCESS_DUPLEX, PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
       PIPE_UNLIMITED_INSTANCES, bufferSize, bufferSize, 0, &securityAttributes);
+    if (pipe != INVALID_HANDLE_VALUE && listeningEvent)
+      SetEvent(listeningEvent);
   }
   else
   {
-    pipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+    // Client pipes are overlapped so that the reads and writes can time out
+    pipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
     if (pipe == INVALID_HANDLE_VALUE && GetLastError() == ERROR_PIPE_BUSY)
     {
-      if (!WaitNamedPipeW(pipeName.c_str(), 10000))
+      // A timeout of 0 would mean the default timeout of the pipe
+      if (connectTimeoutMsec == 0 || !WaitNamedPipeW(pipeName.c_str(), connectTimeoutMsec))
         throw PipeBusyError();
 
-      pipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+      pipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
     }
   }
 
@@ -279,15 +339,49 @@ Communication::Pipe::~Pipe()
   CloseHandle(pipe);
 }
 
-Communication::InputBuffer Communication::Pipe::ReadMessage()
+bool Communication::Pipe::WaitForOverlapped(OVERLAPPED& operation, DWORD& bytesTransferred, DWORD timeoutMsec)
+{
+  DWORD lastError = GetLastError();
+  if (lastError != ERROR_IO_PENDING && lastError != ERROR_MORE_DATA)
+    return false;
+
+  if (lastError == ERROR_IO_PENDING && WaitForSingleObject(operation.hEvent, timeoutMsec) != WAIT_OBJECT_0)
+  {
+    // The operation has to be finished before OVERLAPPED goes out of scope.
+    // CancelIoEx isn't available on XP, CancelIo cancels the I/O issued by this thread.
+    CancelIo(pipe);
+    GetOverlappedResult(pipe, &operation, &bytesTransferred, TRUE);
+    throw PipeTimeoutError();
+  }
+  return GetOverlappedResult(pipe, &operation, &bytesTransferred, FALSE) != FALSE;
+}
+
+Communication::InputBuffer Communication::Pipe::ReadMessage(DWORD timeoutMsec)
 {
   std::stringstream stream;
   std::unique_ptr<char[]> buffer(new char[bufferSize]);
+  AutoHandle readEvent(overlapped ? CreateEventW(0, TRUE, FALSE, 0) : 0);
+  if (overlapped && !readEvent)
+    throw std::runtime_error(AppendErrorCode("Failed to create an event"));
+  DWORD startTime = GetTickCount();
   bool doneReading = false;
   while (!doneReading)
   {
-    DWORD bytesRead;
-    if (ReadFile(pipe, buffer.get(), bufferSize * sizeof(char), &bytesRead, 0))
+    DWORD bytesRead = 0;
+    OVERLAPPED operation = {};
+    operation.hEvent = readEvent;
+    bool success = ReadFile(pipe, buffer.get(), bufferSize * sizeof(char), &bytesRead, overlapped ? &operation : 0) != FALSE;
+    if (!success && overlapped)
+    {
+      DWORD remaining = INFINITE;
+      if (timeoutMsec != INFINITE)
+      {
+        DWORD elapsed = GetTickCount() - startTime;
+        remaining = elapsed < timeoutMsec ? timeoutMsec - elapsed : 0;
+      }
+      success = WaitForOverlapped(operation, bytesRead, remaining);
+    }
+    if (success)
       doneReading = true;
     else
     {
@@ -309,10 +403,23 @@ Communication::InputBuffer Communication::Pipe::ReadMessage()
   return Communication::InputBuffer(stream.str());
 }
 
-void Communication::Pipe::WriteMessage(Communication::OutputBuffer& message)
+void Communication::Pipe::WriteMessage(Communication::OutputBuffer& message, DWORD timeoutMsec)
 {
   DWORD bytesWritten;
   std::string data = message.Get();
-  if (!WriteFile(pipe, data.c_str(), static_cast<DWORD>(data.length()), &bytesWritten, 0))
+  if (!overlapped)
+  {
+    if (!WriteFile(pipe, data.c_str(), static_cast<DWORD>(data.length()), &bytesWritten, 0))
+      throw std::runtime_error("Failed to write to pipe");
+    return;
+  }
+
+  AutoHandle writeEvent(CreateEventW(0, TRUE, FALSE, 0));
+  if (!writeEvent)
+    throw std::runtime_error(AppendErrorCode("Failed to create an event"));
+  OVERLAPPED operation = {};
+  operation.hEvent = writeEvent;
+  if (!WriteFile(pipe, data.c_str(), static_cast<DWORD>(data.length()), &bytesWritten, &operation) &&
+      !WaitForOverlapped(operation, bytesWritten, timeoutMsec))
     throw std::runtime_error("Failed to write to pipe");
 }
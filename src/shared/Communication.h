@@ -29,8 +29,17 @@
 namespace Communication
 {
   extern const std::wstring pipeName;
+  extern const std::wstring engineReadyEventName;
   extern std::wstring browserSID;
 
+  // Creates or opens the manual-reset event which the engine sets as soon as
+  // it is listening on the pipe. Returns 0 on failure.
+  HANDLE CreateEngineReadyEvent();
+
+  // Creates a named file mapping of `size` bytes which browser processes of
+  // the same user can open read-only. Returns 0 on failure.
+  HANDLE CreateSharedSection(const std::wstring& name, uint32_t size);
+
   enum ProcType : uint32_t {
     PROC_MATCHES,
     PROC_GET_ELEMHIDE_SELECTORS,
@@ -52,7 +61,10 @@ namespace Communication
     PROC_GET_DOCUMENTATION_LINK,
     PROC_TOGGLE_PLUGIN_ENABLED,
     PROC_GET_HOST,
-    PROC_COMPARE_VERSIONS
+    PROC_COMPARE_VERSIONS,
+    PROC_MATCHES_BATCH,
+    PROC_GET_FILTER_GENERATION,
+    PROC_GET_ELEMHIDE_BLOB
   };
   enum ValueType : uint32_t {
     TYPE_PROC, TYPE_STRING, TYPE_WSTRING, TYPE_INT64, TYPE_INT32, TYPE_BOOL, TYPE_STRINGS
@@ -228,19 +240,34 @@ namespace Communication
     PipeDisconnectedError();
   };
 
+  class PipeTimeoutError : public std::runtime_error
+  {
+  public:
+    PipeTimeoutError();
+  };
+
   class Pipe
   {
   public:
     enum Mode {MODE_CREATE, MODE_CONNECT};
 
-    Pipe(const std::wstring& name, Mode mode);
+    // For MODE_CREATE the optional listeningEvent is set once the pipe
+    // instance exists, i.e. before waiting for a client to connect.
+    // For MODE_CONNECT connectTimeoutMsec limits the wait for a busy pipe.
+    Pipe(const std::wstring& name, Mode mode, HANDLE listeningEvent = 0, DWORD connectTimeoutMsec = 10000);
     ~Pipe();
 
-    InputBuffer ReadMessage();
-    void WriteMessage(OutputBuffer& message);
+    // Timeouts are only supported for pipes opened with MODE_CONNECT, a pipe
+    // which timed out is left in an undefined state and has to be discarded.
+    InputBuffer ReadMessage(DWORD timeoutMsec = INFINITE);
+    void WriteMessage(OutputBuffer& message, DWORD timeoutMsec = INFINITE);
 
   protected:
     HANDLE pipe;
+    bool overlapped;
+
+    // Waits for the overlapped operation to complete, returns false if it failed.
+    bool WaitForOverlapped(OVERLAPPED& operation, DWORD& bytesTransferred, DWORD timeoutMsec);
   };
 }
 
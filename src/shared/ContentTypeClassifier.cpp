@@ -0,0 +1,282 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ContentTypeClassifier.h"
+#include <cstddef>
+
+namespace
+{
+  wchar_t ToLowerAscii(wchar_t ch)
+  {
+    return ch >= L'A' && ch <= L'Z' ? ch - L'A' + L'a' : ch;
+  }
+
+  struct Extension
+  {
+    const wchar_t* name;
+    RequestContentType type;
+  };
+
+  const size_t maxExtensionLength = 4;
+  const size_t extensionSlots = 16;
+
+  // (length + first + last character) % 16 is a perfect hash of the known
+  // extensions, each one is in the slot of its hash. ContentTypeClassifierTest
+  // checks this whenever an extension is added.
+  const Extension extensions[extensionSlots] =
+  {
+    {L"gif", REQUEST_TYPE_IMAGE},
+    {nullptr, REQUEST_TYPE_OTHER},
+    {nullptr, REQUEST_TYPE_OTHER},
+    {L"php", REQUEST_TYPE_SUBDOCUMENT},
+    {L"jpg", REQUEST_TYPE_IMAGE},
+    {L"jpeg", REQUEST_TYPE_IMAGE},
+    {nullptr, REQUEST_TYPE_OTHER},
+    {L"xml", REQUEST_TYPE_XMLHTTPREQUEST},
+    {L"html", REQUEST_TYPE_SUBDOCUMENT},
+    {L"css", REQUEST_TYPE_STYLESHEET},
+    {L"png", REQUEST_TYPE_IMAGE},
+    {nullptr, REQUEST_TYPE_OTHER},
+    {L"swf", REQUEST_TYPE_OBJECT},
+    {L"jsp", REQUEST_TYPE_SUBDOCUMENT},
+    {nullptr, REQUEST_TYPE_OTHER},
+    {L"js", REQUEST_TYPE_SCRIPT}
+  };
+
+  RequestContentType ClassifyExtension(const wchar_t* begin, const wchar_t* end)
+  {
+    size_t length = end - begin;
+    if (length == 0 || length > maxExtensionLength)
+    {
+      return REQUEST_TYPE_OTHER;
+    }
+    const Extension& candidate = extensions[(length + ToLowerAscii(begin[0]) + ToLowerAscii(end[-1])) % extensionSlots];
+    if (!candidate.name)
+    {
+      return REQUEST_TYPE_OTHER;
+    }
+    const wchar_t* name = candidate.name;
+    for (const wchar_t* it = begin; it != end; ++it, ++name)
+    {
+      if (*name == L'\0' || ToLowerAscii(*it) != *name)
+      {
+        return REQUEST_TYPE_OTHER;
+      }
+    }
+    return *name == L'\0' ? candidate.type : REQUEST_TYPE_OTHER;
+  }
+
+  bool StartsWith(const wchar_t* begin, const wchar_t* end, const wchar_t* prefix)
+  {
+    for (; *prefix; ++begin, ++prefix)
+    {
+      if (begin == end || *begin != *prefix)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool EndsWith(const wchar_t* begin, const wchar_t* end, const wchar_t* suffix, size_t suffixLength)
+  {
+    if (static_cast<size_t>(end - begin) < suffixLength)
+    {
+      return false;
+    }
+    for (const wchar_t* it = end - suffixLength; it != end; ++it, ++suffix)
+    {
+      if (*it != *suffix)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool IsMediaTypeSeparator(wchar_t ch)
+  {
+    return ch == L',' || ch == L';' || ch == L' ' || ch == L'\t';
+  }
+
+  // Media type patterns found in the list, in order of precedence
+  enum MediaTypeFlags
+  {
+    FOUND_DOCUMENT = 1,
+    FOUND_IMAGE = 2,
+    FOUND_STYLESHEET = 4,
+    FOUND_SCRIPT = 8,
+    FOUND_OBJECT = 16,
+    FOUND_XML = 32
+  };
+
+  // None of the patterns contains a separator, so each occurrence lies within
+  // a token. All but "xml" contain a single '/', which has to be one of the
+  // slashes of the token.
+  int ClassifyMediaTypeToken(const wchar_t* begin, const wchar_t* end)
+  {
+    int found = 0;
+    for (const wchar_t* it = begin; it != end; ++it)
+    {
+      if (*it == L'x' && end - it >= 3 && it[1] == L'm' && it[2] == L'l')
+      {
+        found |= FOUND_XML;
+      }
+      if (*it != L'/')
+      {
+        continue;
+      }
+      const wchar_t* subtype = it + 1;
+      if (EndsWith(begin, it, L"text", 4))
+      {
+        if (StartsWith(subtype, end, L"html"))
+        {
+          found |= FOUND_DOCUMENT;
+        }
+        else if (StartsWith(subtype, end, L"css"))
+        {
+          found |= FOUND_STYLESHEET;
+        }
+      }
+      else if (EndsWith(begin, it, L"image", 5))
+      {
+        found |= FOUND_IMAGE;
+      }
+      else if (EndsWith(begin, it, L"application", 11))
+      {
+        if (StartsWith(subtype, end, L"xhtml+xml"))
+        {
+          found |= FOUND_DOCUMENT;
+        }
+        else if (StartsWith(subtype, end, L"javascript") || StartsWith(subtype, end, L"json"))
+        {
+          found |= FOUND_SCRIPT;
+        }
+        else if (StartsWith(subtype, end, L"x-shockwave-flash"))
+        {
+          found |= FOUND_OBJECT;
+        }
+      }
+    }
+    return found;
+  }
+}
+
+RequestContentType ClassifyFileName(const wchar_t* begin, const wchar_t* end)
+{
+  for (const wchar_t* it = end; it != begin; --it)
+  {
+    if (it[-1] == L'.')
+    {
+      return ClassifyExtension(it, end);
+    }
+  }
+  return REQUEST_TYPE_OTHER;
+}
+
+RequestContentType ClassifyMediaTypeList(const wchar_t* begin, const wchar_t* end)
+{
+  int found = 0;
+  const wchar_t* token = begin;
+  for (const wchar_t* it = begin; ; ++it)
+  {
+    if (it == end || IsMediaTypeSeparator(*it))
+    {
+      if (it != token)
+      {
+        found |= ClassifyMediaTypeToken(token, it);
+        // Nothing takes precedence over a document
+        if (found & FOUND_DOCUMENT)
+        {
+          return REQUEST_TYPE_SUBDOCUMENT;
+        }
+      }
+      if (it == end)
+      {
+        break;
+      }
+      token = it + 1;
+    }
+  }
+  if (found & FOUND_IMAGE)
+  {
+    return REQUEST_TYPE_IMAGE;
+  }
+  if (found & FOUND_STYLESHEET)
+  {
+    return REQUEST_TYPE_STYLESHEET;
+  }
+  if (found & FOUND_SCRIPT)
+  {
+    return REQUEST_TYPE_SCRIPT;
+  }
+  if (found & FOUND_OBJECT)
+  {
+    return REQUEST_TYPE_OBJECT;
+  }
+  if (found & FOUND_XML)
+  {
+    return REQUEST_TYPE_XMLHTTPREQUEST;
+  }
+  return REQUEST_TYPE_OTHER;
+}
+
+RequestContentType ClassifyUrl(const wchar_t* begin, const wchar_t* end, bool searchQueryString)
+{
+  const wchar_t* query = begin;
+  while (query != end && *query != L'?')
+  {
+    ++query;
+  }
+  const wchar_t* pathEnd = query;
+  if (query == end)
+  {
+    pathEnd = begin;
+    while (pathEnd != end && *pathEnd != L'#')
+    {
+      ++pathEnd;
+    }
+  }
+  RequestContentType type = ClassifyFileName(begin, pathEnd);
+  if (type != REQUEST_TYPE_OTHER || !searchQueryString || query == end)
+  {
+    return type;
+  }
+
+  const wchar_t* part = query + 1;
+  for (const wchar_t* it = part; ; ++it)
+  {
+    bool isQueryEnd = it == end || *it == L'#';
+    if (isQueryEnd || *it == L'&' || *it == L'=')
+    {
+      if (it != part)
+      {
+        type = ClassifyFileName(part, it);
+        if (type != REQUEST_TYPE_OTHER)
+        {
+          return type;
+        }
+      }
+      if (isQueryEnd)
+      {
+        break;
+      }
+      part = it + 1;
+    }
+  }
+  return REQUEST_TYPE_OTHER;
+}
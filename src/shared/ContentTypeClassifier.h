@@ -0,0 +1,56 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTENT_TYPE_CLASSIFIER_H
+#define CONTENT_TYPE_CLASSIFIER_H
+
+/// Content type of a request guessed from its URL or its Accept header, the
+/// plugin maps it to `AdblockPlus::FilterEngine::ContentType`.
+enum RequestContentType
+{
+  REQUEST_TYPE_OTHER = 0,
+  REQUEST_TYPE_IMAGE,
+  REQUEST_TYPE_STYLESHEET,
+  REQUEST_TYPE_SCRIPT,
+  REQUEST_TYPE_XMLHTTPREQUEST,
+  REQUEST_TYPE_OBJECT,
+  REQUEST_TYPE_SUBDOCUMENT,
+  // Requests of plugins like Flash, never returned by the functions below but
+  // set by `ClassifyRequest` from the request headers
+  REQUEST_TYPE_OBJECT_SUBREQUEST
+};
+
+/// Classifies by the extension after the last '.' of [begin, end), compared
+/// case insensitively: jpg, jpeg, gif, png, css, js, xml, swf, jsp, php and
+/// html are known.
+RequestContentType ClassifyFileName(const wchar_t* begin, const wchar_t* end);
+
+/// Classifies the media type list of an Accept header. The first of these
+/// which occurs anywhere in the list wins: text/html or
+/// application/xhtml+xml, image/, text/css, application/javascript or
+/// application/json, application/x-shockwave-flash and lastly xml.
+/// Comparisons are case sensitive and the list is scanned once.
+RequestContentType ClassifyMediaTypeList(const wchar_t* begin, const wchar_t* end);
+
+/// Classifies the file name of the URL in [begin, end), i.e. the part before
+/// the query string or else before the fragment. If that fails and
+/// `searchQueryString` is set, the first of the parts of the query string
+/// separated by '&' and '=' which has a known extension is used. Nothing is
+/// copied.
+RequestContentType ClassifyUrl(const wchar_t* begin, const wchar_t* end, bool searchQueryString);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ELEMENT_CACHE_H
+#define ELEMENT_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Side table with an entry of type `T` per DOM element, so that no state
+/// has to be stored in the page itself.
+///
+/// Elements are identified by a pointer which stays the same for the lifetime
+/// of the element, e.g. the `IUnknown` pointer of a COM object, together with
+/// the generation of the cache. `Clear` starts a new generation, entries of
+/// older generations are never returned even if an element of the new one
+/// happens to get the same address. The caller has to keep the elements
+/// alive as long as their entries are used, otherwise their addresses could
+/// be reused within a generation as well.
+///
+/// Entries are allocated from slabs of `slabSize` entries which are kept
+/// across generations, so references to entries stay valid until `Clear`.
+template<typename T>
+class ElementCache
+{
+public:
+  ElementCache()
+    : m_size(0), m_generation(0), m_slots(initialSlots, 0)
+  {
+  }
+
+  /// Returns the entry of the element, creating it if needed. `isNew` is set
+  /// if it has been created, its value is `T()` then.
+  T& Get(const void* identity, bool& isNew)
+  {
+    size_t slot = FindSlot(identity);
+    isNew = m_slots[slot] == 0;
+    if (!isNew)
+    {
+      return GetEntry(m_slots[slot] - 1).value;
+    }
+
+    if (m_size == m_slabs.size() * slabSize)
+    {
+      m_slabs.push_back(std::unique_ptr<Entry[]>(new Entry[slabSize]));
+    }
+    uint32_t index = static_cast<uint32_t>(m_size++);
+    Entry& entry = GetEntry(index);
+    entry.identity = identity;
+    entry.generation = m_generation;
+    m_slots[slot] = index + 1;
+    // Keep the load factor below 1/2
+    if (m_size * 2 > m_slots.size())
+    {
+      Grow();
+    }
+    return entry.value;
+  }
+
+  /// Returns null if the element has no entry in the current generation.
+  T* Find(const void* identity)
+  {
+    uint32_t entry = m_slots[FindSlot(identity)];
+    return entry == 0 ? nullptr : &GetEntry(entry - 1).value;
+  }
+
+  /// Resets all entries and starts a new generation, the slabs are reused.
+  void Clear()
+  {
+    for (size_t i = 0; i < m_size; i++)
+    {
+      GetEntry(i).value = T();
+    }
+    m_size = 0;
+    m_generation++;
+    std::vector<uint32_t>(initialSlots, 0).swap(m_slots);
+  }
+
+  size_t GetSize() const
+  {
+    return m_size;
+  }
+  uint32_t GetGeneration() const
+  {
+    return m_generation;
+  }
+  size_t GetMemoryUsage() const
+  {
+    return m_slabs.size() * slabSize * sizeof(Entry) + m_slots.capacity() * sizeof(uint32_t);
+  }
+
+  static const size_t slabSize = 1024;
+
+private:
+  static const size_t initialSlots = 64;
+
+  struct Entry
+  {
+    Entry() : identity(nullptr), generation(0)
+    {
+    }
+    const void* identity;
+    uint32_t generation;
+    T value;
+  };
+
+  static size_t Hash(const void* identity)
+  {
+    // Finalizer of MurmurHash3, the low bits of aligned objects are always zero
+    uint64_t key = reinterpret_cast<uintptr_t>(identity);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+
+  Entry& GetEntry(size_t index)
+  {
+    return m_slabs[index / slabSize][index % slabSize];
+  }
+
+  // Returns the slot of the entry or the empty slot where it belongs
+  size_t FindSlot(const void* identity)
+  {
+    size_t mask = m_slots.size() - 1;
+    for (size_t slot = Hash(identity) & mask; ; slot = (slot + 1) & mask)
+    {
+      uint32_t entry = m_slots[slot];
+      if (entry == 0)
+      {
+        return slot;
+      }
+      const Entry& candidate = GetEntry(entry - 1);
+      if (candidate.identity == identity && candidate.generation == m_generation)
+      {
+        return slot;
+      }
+    }
+  }
+
+  void Grow()
+  {
+    std::vector<uint32_t> slots(m_slots.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+    for (size_t i = 0; i < m_size; i++)
+    {
+      size_t slot = Hash(GetEntry(i).identity) & mask;
+      while (slots[slot] != 0)
+      {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot] = static_cast<uint32_t>(i + 1);
+    }
+    m_slots.swap(slots);
+  }
+
+  std::vector<std::unique_ptr<Entry[]> > m_slabs;
+  size_t m_size;
+  uint32_t m_generation;
+  // Entry index + 1 per slot, 0 marks an empty slot. The size is a power of two.
+  std::vector<uint32_t> m_slots;
+
+  ElementCache(const ElementCache&);
+  void operator=(const ElementCache&);
+};
+
+#endif
@@ -0,0 +1,552 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "ElementHideBlob.h"
+
+struct ElementHideBlob::Section
+{
+  uint32_t offset;
+  uint32_t count;
+};
+
+struct ElementHideBlob::Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  // Of everything after the header
+  uint32_t checksum;
+  int64_t generation;
+  // uint16_t
+  Section chars;
+  // AtomEntry
+  Section atoms;
+  // uint32_t, atom + 1 or 0 for an empty slot. The count is a power of two.
+  Section atomSlots;
+  // StringRef, the selector texts by record
+  Section selectors;
+  // StringRef, the complete list, including selectors which didn't parse
+  Section listSelectors;
+  // StringRef, see ElementHideMatcher::GetAttributeNames
+  Section attributeNames;
+  uint32_t flags;
+  uint32_t reserved;
+  // IndexSlot, the count is a power of two
+  Section indexSlots[INDEX_COUNT];
+  // uint32_t, the records of all keys of an index
+  Section indexRecords[INDEX_COUNT];
+};
+
+struct ElementHideBlob::AtomEntry
+{
+  uint32_t hash;
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct ElementHideBlob::StringRef
+{
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct ElementHideBlob::IndexSlot
+{
+  uint32_t tag;
+  uint32_t name;
+  // Into the records of the index, empty slots have begin == end
+  uint32_t begin;
+  uint32_t end;
+};
+
+namespace
+{
+  // "ABEH"
+  const uint32_t blobMagic = 0x48454241;
+  const size_t minSlots = 16;
+  const uint32_t flagSiblingCombinators = 1;
+
+  size_t HashKey(uint32_t tag, uint32_t name)
+  {
+    // Finalizer of MurmurHash3, like ElementHideIndex
+    uint64_t key = (static_cast<uint64_t>(tag) << 32) | name;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+
+  uint32_t Checksum(const char* data, size_t length)
+  {
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++)
+    {
+      hash ^= static_cast<uint8_t>(data[i]);
+      hash *= 16777619U;
+    }
+    return hash;
+  }
+
+  size_t GetSlotCount(size_t keyCount)
+  {
+    size_t slotCount = minSlots;
+    while (slotCount < keyCount * 2)
+    {
+      slotCount *= 2;
+    }
+    return slotCount;
+  }
+
+  bool IsPowerOfTwo(uint32_t value)
+  {
+    return value != 0 && (value & (value - 1)) == 0;
+  }
+
+  // wchar_t is UTF-16 on Windows, other platforms are only used for testing
+  void AppendString(std::vector<uint16_t>& chars, const std::wstring& str)
+  {
+    for (auto it = str.begin(); it != str.end(); ++it)
+    {
+      chars.push_back(static_cast<uint16_t>(*it));
+    }
+  }
+
+  template<typename Section, typename T>
+  void AppendSection(std::vector<char>& blob, Section& section, const std::vector<T>& items)
+  {
+    // Keep every section 4 byte aligned
+    blob.resize((blob.size() + 3) & ~static_cast<size_t>(3));
+    section.offset = static_cast<uint32_t>(blob.size());
+    section.count = static_cast<uint32_t>(items.size());
+    if (!items.empty())
+    {
+      const char* data = reinterpret_cast<const char*>(&items[0]);
+      blob.insert(blob.end(), data, data + items.size() * sizeof(T));
+    }
+  }
+}
+
+ElementHideBlob::ElementHideBlob()
+  : m_data(nullptr), m_header(nullptr), m_compiledCount(0)
+{
+}
+
+ElementHideBlob::~ElementHideBlob()
+{
+  if (m_header)
+  {
+    for (uint32_t i = 0; i < m_header->selectors.count; i++)
+    {
+      delete m_compiled[i].load();
+    }
+  }
+}
+
+void ElementHideBlob::Write(const ElementHideMatcher& matcher, const std::vector<std::wstring>& selectorList,
+  int64_t generation, std::vector<char>& blob)
+{
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = blobMagic;
+  header.version = formatVersion;
+  header.generation = generation;
+  header.flags = matcher.HasSiblingCombinators() ? flagSiblingCombinators : 0;
+
+  // The atoms keep their numbers, the indexes refer to them
+  std::vector<uint16_t> chars;
+  std::vector<AtomEntry> atoms;
+  std::vector<uint32_t> atomSlots(GetSlotCount(matcher.m_atoms.GetSize()), 0);
+  size_t atomMask = atomSlots.size() - 1;
+  for (size_t atom = 0; atom < matcher.m_atoms.GetSize(); atom++)
+  {
+    std::wstring str = matcher.m_atoms.GetString(static_cast<AtomTable::Atom>(atom));
+    AtomEntry entry;
+    entry.hash = static_cast<uint32_t>(AtomTable::Hash(str.c_str(), str.length()));
+    entry.offset = static_cast<uint32_t>(chars.size());
+    entry.length = static_cast<uint32_t>(str.length());
+    AppendString(chars, str);
+    atoms.push_back(entry);
+
+    size_t slot = entry.hash & atomMask;
+    while (atomSlots[slot] != 0)
+    {
+      slot = (slot + 1) & atomMask;
+    }
+    atomSlots[slot] = static_cast<uint32_t>(atom + 1);
+  }
+
+  std::vector<StringRef> selectors;
+  for (auto it = matcher.m_records.begin(); it != matcher.m_records.end(); ++it)
+  {
+    StringRef ref;
+    ref.offset = static_cast<uint32_t>(chars.size());
+    ref.length = static_cast<uint32_t>(it->m_filterText.length());
+    AppendString(chars, it->m_filterText);
+    selectors.push_back(ref);
+  }
+
+  std::vector<StringRef> listSelectors;
+  for (auto it = selectorList.begin(); it != selectorList.end(); ++it)
+  {
+    StringRef ref;
+    ref.offset = static_cast<uint32_t>(chars.size());
+    ref.length = static_cast<uint32_t>(it->length());
+    AppendString(chars, *it);
+    listSelectors.push_back(ref);
+  }
+
+  std::vector<StringRef> attributeNames;
+  for (auto it = matcher.GetAttributeNames().begin(); it != matcher.GetAttributeNames().end(); ++it)
+  {
+    StringRef ref;
+    ref.offset = static_cast<uint32_t>(chars.size());
+    ref.length = static_cast<uint32_t>(it->length());
+    AppendString(chars, *it);
+    attributeNames.push_back(ref);
+  }
+
+  std::vector<IndexSlot> indexSlots[INDEX_COUNT];
+  std::vector<uint32_t> indexRecords[INDEX_COUNT];
+  for (int type = 0; type < INDEX_COUNT; type++)
+  {
+    std::vector<IndexSlot>& slots = indexSlots[type];
+    std::vector<uint32_t>& records = indexRecords[type];
+    IndexSlot emptySlot = {AtomTable::NotFound, AtomTable::NotFound, 0, 0};
+    slots.assign(GetSlotCount(matcher.m_indexes[type].GetKeyCount()), emptySlot);
+    size_t mask = slots.size() - 1;
+    matcher.m_indexes[type].ForEachKey([&](uint32_t tag, uint32_t name, ElementHideIndex::Range range)
+    {
+      size_t slot = HashKey(tag, name) & mask;
+      while (slots[slot].begin != slots[slot].end)
+      {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot].tag = tag;
+      slots[slot].name = name;
+      slots[slot].begin = static_cast<uint32_t>(records.size());
+      records.insert(records.end(), range.first, range.second);
+      slots[slot].end = static_cast<uint32_t>(records.size());
+    });
+  }
+
+  blob.assign(sizeof(Header), 0);
+  AppendSection(blob, header.atoms, atoms);
+  AppendSection(blob, header.atomSlots, atomSlots);
+  AppendSection(blob, header.selectors, selectors);
+  AppendSection(blob, header.listSelectors, listSelectors);
+  AppendSection(blob, header.attributeNames, attributeNames);
+  for (int type = 0; type < INDEX_COUNT; type++)
+  {
+    AppendSection(blob, header.indexSlots[type], indexSlots[type]);
+    AppendSection(blob, header.indexRecords[type], indexRecords[type]);
+  }
+  AppendSection(blob, header.chars, chars);
+
+  header.size = static_cast<uint32_t>(blob.size());
+  header.checksum = Checksum(&blob[sizeof(Header)], blob.size() - sizeof(Header));
+  std::memcpy(&blob[0], &header, sizeof(Header));
+}
+
+template<typename T>
+const T* ElementHideBlob::GetSection(const Section& section) const
+{
+  return reinterpret_cast<const T*>(m_data + section.offset);
+}
+
+ElementHideBlob::Status ElementHideBlob::Open(const void* data, size_t size)
+{
+  static_assert(sizeof(Header) == 128, "The header layout has to be the same for all compilers");
+  const char* bytes = static_cast<const char*>(data);
+  if (size < sizeof(Header))
+  {
+    return STATUS_TOO_SMALL;
+  }
+  if (reinterpret_cast<uintptr_t>(bytes) % sizeof(uint64_t) != 0)
+  {
+    return STATUS_BAD_LAYOUT;
+  }
+  const Header* header = reinterpret_cast<const Header*>(bytes);
+  if (header->magic != blobMagic)
+  {
+    return STATUS_BAD_MAGIC;
+  }
+  if (header->version != formatVersion)
+  {
+    return STATUS_VERSION_MISMATCH;
+  }
+  // Mapped sections can be larger than the blob
+  if (header->size < sizeof(Header) || header->size > size)
+  {
+    return STATUS_BAD_SIZE;
+  }
+  if (header->checksum != Checksum(bytes + sizeof(Header), header->size - sizeof(Header)))
+  {
+    return STATUS_BAD_CHECKSUM;
+  }
+
+  // The checksum only detects corruption, the bounds are checked here once
+  // so that lookups don't have to.
+  struct
+  {
+    const Section* section;
+    size_t itemSize;
+  } sections[] =
+  {
+    {&header->chars, sizeof(uint16_t)},
+    {&header->atoms, sizeof(AtomEntry)},
+    {&header->atomSlots, sizeof(uint32_t)},
+    {&header->selectors, sizeof(StringRef)},
+    {&header->listSelectors, sizeof(StringRef)},
+    {&header->attributeNames, sizeof(StringRef)},
+    {&header->indexSlots[INDEX_TAG_ID], sizeof(IndexSlot)},
+    {&header->indexSlots[INDEX_TAG_CLASS], sizeof(IndexSlot)},
+    {&header->indexSlots[INDEX_TAG], sizeof(IndexSlot)},
+    {&header->indexRecords[INDEX_TAG_ID], sizeof(uint32_t)},
+    {&header->indexRecords[INDEX_TAG_CLASS], sizeof(uint32_t)},
+    {&header->indexRecords[INDEX_TAG], sizeof(uint32_t)}
+  };
+  for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++)
+  {
+    const Section& section = *sections[i].section;
+    if (section.offset < sizeof(Header) || section.offset % 4 != 0 ||
+        section.offset + static_cast<uint64_t>(section.count) * sections[i].itemSize > header->size)
+    {
+      return STATUS_BAD_LAYOUT;
+    }
+  }
+  // There has to be an empty slot, otherwise lookups wouldn't terminate
+  if (!IsPowerOfTwo(header->atomSlots.count) || header->atoms.count == 0 ||
+      header->atoms.count >= header->atomSlots.count)
+  {
+    return STATUS_BAD_LAYOUT;
+  }
+
+  m_data = bytes;
+  uint32_t charCount = header->chars.count;
+  const AtomEntry* atoms = GetSection<AtomEntry>(header->atoms);
+  for (uint32_t i = 0; i < header->atoms.count; i++)
+  {
+    if (atoms[i].offset > charCount || atoms[i].length > charCount - atoms[i].offset)
+    {
+      return STATUS_BAD_LAYOUT;
+    }
+  }
+  const uint32_t* atomSlots = GetSection<uint32_t>(header->atomSlots);
+  for (uint32_t i = 0; i < header->atomSlots.count; i++)
+  {
+    if (atomSlots[i] > header->atoms.count)
+    {
+      return STATUS_BAD_LAYOUT;
+    }
+  }
+  const Section* stringSections[] = {&header->selectors, &header->listSelectors, &header->attributeNames};
+  for (size_t section = 0; section < sizeof(stringSections) / sizeof(stringSections[0]); section++)
+  {
+    const StringRef* strings = GetSection<StringRef>(*stringSections[section]);
+    for (uint32_t i = 0; i < stringSections[section]->count; i++)
+    {
+      if (strings[i].offset > charCount || strings[i].length > charCount - strings[i].offset)
+      {
+        return STATUS_BAD_LAYOUT;
+      }
+    }
+  }
+  for (int type = 0; type < INDEX_COUNT; type++)
+  {
+    if (!IsPowerOfTwo(header->indexSlots[type].count))
+    {
+      return STATUS_BAD_LAYOUT;
+    }
+    const IndexSlot* slots = GetSection<IndexSlot>(header->indexSlots[type]);
+    bool hasEmptySlot = false;
+    for (uint32_t i = 0; i < header->indexSlots[type].count; i++)
+    {
+      if (slots[i].begin > slots[i].end || slots[i].end > header->indexRecords[type].count)
+      {
+        return STATUS_BAD_LAYOUT;
+      }
+      hasEmptySlot |= slots[i].begin == slots[i].end;
+    }
+    if (!hasEmptySlot)
+    {
+      return STATUS_BAD_LAYOUT;
+    }
+    const uint32_t* records = GetSection<uint32_t>(header->indexRecords[type]);
+    for (uint32_t i = 0; i < header->indexRecords[type].count; i++)
+    {
+      if (records[i] >= header->selectors.count)
+      {
+        return STATUS_BAD_LAYOUT;
+      }
+    }
+  }
+
+  m_compiled.reset(new std::atomic<Compiled*>[header->selectors.count]);
+  for (uint32_t i = 0; i < header->selectors.count; i++)
+  {
+    m_compiled[i].store(nullptr);
+  }
+  m_header = header;
+  return STATUS_OK;
+}
+
+int64_t ElementHideBlob::GetGeneration() const
+{
+  return m_header ? m_header->generation : -1;
+}
+
+size_t ElementHideBlob::GetSelectorCount() const
+{
+  return m_header ? m_header->selectors.count : 0;
+}
+
+size_t ElementHideBlob::GetSelectorListSize() const
+{
+  return m_header ? m_header->listSelectors.count : 0;
+}
+
+void ElementHideBlob::GetListSelector(size_t index, std::wstring& selector) const
+{
+  const StringRef& ref = GetSection<StringRef>(m_header->listSelectors)[index];
+  const uint16_t* text = GetSection<uint16_t>(m_header->chars) + ref.offset;
+  selector.assign(text, text + ref.length);
+}
+
+std::vector<std::wstring> ElementHideBlob::GetAttributeNames() const
+{
+  std::vector<std::wstring> names;
+  if (!m_header)
+  {
+    return names;
+  }
+  const uint16_t* chars = GetSection<uint16_t>(m_header->chars);
+  const StringRef* strings = GetSection<StringRef>(m_header->attributeNames);
+  names.reserve(m_header->attributeNames.count);
+  for (uint32_t i = 0; i < m_header->attributeNames.count; i++)
+  {
+    names.push_back(std::wstring(chars + strings[i].offset, chars + strings[i].offset + strings[i].length));
+  }
+  return names;
+}
+
+bool ElementHideBlob::HasSiblingCombinators() const
+{
+  return m_header && (m_header->flags & flagSiblingCombinators) != 0;
+}
+
+size_t ElementHideBlob::GetCompiledCount() const
+{
+  return m_compiledCount;
+}
+
+AtomTable::Atom ElementHideBlob::FindAtom(const std::wstring& str) const
+{
+  uint32_t hash = static_cast<uint32_t>(AtomTable::Hash(str.c_str(), str.length()));
+  const uint16_t* chars = GetSection<uint16_t>(m_header->chars);
+  const AtomEntry* atoms = GetSection<AtomEntry>(m_header->atoms);
+  const uint32_t* slots = GetSection<uint32_t>(m_header->atomSlots);
+  uint32_t mask = m_header->atomSlots.count - 1;
+  for (uint32_t slot = hash & mask; slots[slot] != 0; slot = (slot + 1) & mask)
+  {
+    const AtomEntry& entry = atoms[slots[slot] - 1];
+    if (entry.hash != hash || entry.length != str.length())
+    {
+      continue;
+    }
+    size_t i = 0;
+    while (i < str.length() && chars[entry.offset + i] == static_cast<uint16_t>(str[i]))
+    {
+      i++;
+    }
+    if (i == str.length())
+    {
+      return slots[slot] - 1;
+    }
+  }
+  return AtomTable::NotFound;
+}
+
+const ElementHideBlob::Compiled* ElementHideBlob::GetCompiled(uint32_t record) const
+{
+  Compiled* compiled = m_compiled[record].load(std::memory_order_acquire);
+  if (compiled)
+  {
+    return compiled;
+  }
+
+  std::lock_guard<std::mutex> lock(m_compileMutex);
+  compiled = m_compiled[record].load(std::memory_order_relaxed);
+  if (!compiled)
+  {
+    const StringRef& ref = GetSection<StringRef>(m_header->selectors)[record];
+    const uint16_t* text = GetSection<uint16_t>(m_header->chars) + ref.offset;
+    std::wstring selector(text, text + ref.length);
+    CFilterElementHide filter;
+    // The selectors have been parsed before writing, with the same format
+    // version the parser is the same
+    if (CFilterElementHide::Parse(selector, filter) != PARSE_OK)
+    {
+      return nullptr;
+    }
+    compiled = new Compiled(filter);
+    m_compiled[record].store(compiled, std::memory_order_release);
+    m_compiledCount++;
+  }
+  return compiled;
+}
+
+const CFilterElementHide* ElementHideBlob::FindInIndex(ElementHideIndexType type, AtomTable::Atom tag, AtomTable::Atom name, const ElementSnapshot& element) const
+{
+  if (tag == AtomTable::NotFound)
+  {
+    return nullptr;
+  }
+  const IndexSlot* slots = GetSection<IndexSlot>(m_header->indexSlots[type]);
+  const uint32_t* records = GetSection<uint32_t>(m_header->indexRecords[type]);
+  size_t mask = m_header->indexSlots[type].count - 1;
+  for (size_t slot = HashKey(tag, name) & mask; slots[slot].begin != slots[slot].end; slot = (slot + 1) & mask)
+  {
+    if (slots[slot].tag != tag || slots[slot].name != name)
+    {
+      continue;
+    }
+    for (uint32_t i = slots[slot].begin; i < slots[slot].end; i++)
+    {
+      const Compiled* compiled = GetCompiled(records[i]);
+      if (compiled && compiled->program.Matches(element))
+      {
+        return &compiled->filter;
+      }
+    }
+    return nullptr;
+  }
+  return nullptr;
+}
+
+bool ElementHideBlob::FindMatch(const std::wstring& tag, const ElementView& element, ElementHideMatcher::Match& match) const
+{
+  if (!m_header)
+  {
+    return false;
+  }
+  return ElementHideMatcher::FindMatchIn(*this, tag, element, match);
+}
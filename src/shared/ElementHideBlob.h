@@ -0,0 +1,133 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ELEMENT_HIDE_BLOB_H
+#define ELEMENT_HIDE_BLOB_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ElementHiding.h"
+
+/// Read-only view of a built `ElementHideMatcher` in a flat binary format,
+/// so that it can be created once by the engine and mapped by every tab.
+///
+/// The format only contains offsets, no pointers, and is queried in place:
+/// opening it validates the header, the checksum and the section bounds but
+/// doesn't copy or parse anything. Selectors are parsed and compiled the
+/// first time the index returns them for an element, so most of them never
+/// are. `FindMatch` returns the same selector as the matcher the blob was
+/// written from.
+///
+/// Lookups rely on that validation and don't check the offsets again, so the
+/// memory must not change while the blob is open. The engine shares it in a
+/// section which browser processes can only map for reading.
+///
+/// All integers are stored in the byte order of the machine, which is fine
+/// since engine and plugin always run on the same one. Strings are UTF-16.
+class ElementHideBlob
+{
+public:
+  enum Status
+  {
+    STATUS_OK = 0,
+    STATUS_TOO_SMALL,
+    STATUS_BAD_MAGIC,
+    // Written by a different version, the selectors have to be parsed from text
+    STATUS_VERSION_MISMATCH,
+    STATUS_BAD_SIZE,
+    STATUS_BAD_CHECKSUM,
+    STATUS_BAD_LAYOUT
+  };
+
+  /// Increment on every change of the format
+  static const uint32_t formatVersion = 2;
+
+  ElementHideBlob();
+  ~ElementHideBlob();
+
+  /// Serializes `matcher`, which has to be built already. `selectorList` is
+  /// the list it was built from, it is stored as it is for the stylesheet.
+  static void Write(const ElementHideMatcher& matcher, const std::vector<std::wstring>& selectorList,
+    int64_t generation, std::vector<char>& blob);
+
+  /// `data` isn't copied, it has to stay valid and unchanged as long as the
+  /// blob and any match returned by it are used. Can only be called once.
+  Status Open(const void* data, size_t size);
+
+  /// The filter generation passed to `Write`.
+  int64_t GetGeneration() const;
+  /// Number of selectors in the matcher.
+  size_t GetSelectorCount() const;
+  /// Number of selectors in the list passed to `Write`.
+  size_t GetSelectorListSize() const;
+  /// Selector `index` of the list passed to `Write`, copied out of the blob
+  /// into `selector`.
+  void GetListSelector(size_t index, std::wstring& selector) const;
+  /// Same as `ElementHideMatcher::GetAttributeNames`.
+  std::vector<std::wstring> GetAttributeNames() const;
+  /// Same as `ElementHideMatcher::HasSiblingCombinators`.
+  bool HasSiblingCombinators() const;
+  /// Number of selectors which have been parsed and compiled so far.
+  size_t GetCompiledCount() const;
+
+  /// Same as `ElementHideMatcher::FindMatch`. Thread-safe.
+  bool FindMatch(const std::wstring& tag, const ElementView& element, ElementHideMatcher::Match& match) const;
+
+private:
+  struct Header;
+  struct Section;
+  struct AtomEntry;
+  struct IndexSlot;
+  struct StringRef;
+
+  struct Compiled
+  {
+    explicit Compiled(const CFilterElementHide& filter)
+      : filter(filter), program(filter)
+    {
+    }
+    CFilterElementHide filter;
+    SelectorProgram program;
+  };
+
+  AtomTable::Atom FindAtom(const std::wstring& str) const;
+  const CFilterElementHide* FindInIndex(ElementHideIndexType type, AtomTable::Atom tag, AtomTable::Atom name, const ElementSnapshot& element) const;
+  const Compiled* GetCompiled(uint32_t record) const;
+
+  template<typename T>
+  const T* GetSection(const Section& section) const;
+
+  const char* m_data;
+  const Header* m_header;
+
+  // Compiled selectors by record, created on first use
+  std::unique_ptr<std::atomic<Compiled*>[]> m_compiled;
+  mutable std::atomic<size_t> m_compiledCount;
+  mutable std::mutex m_compileMutex;
+
+  // Runs the lookup of FindMatch
+  friend class ElementHideMatcher;
+
+  ElementHideBlob(const ElementHideBlob&);
+  void operator=(const ElementHideBlob&);
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+
+#include "ElementHideIndex.h"
+
+namespace
+{
+  // Never a valid key, atoms are smaller than 0xFFFFFFFF
+  const uint64_t emptyKey = 0xFFFFFFFFFFFFFFFFULL;
+
+  bool CompareKeys(const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b)
+  {
+    return a.first < b.first;
+  }
+}
+
+ElementHideIndex::ElementHideIndex()
+  : m_keyCount(0)
+{
+}
+
+size_t ElementHideIndex::HashKey(uint64_t key)
+{
+  // Finalizer of MurmurHash3
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return static_cast<size_t>(key);
+}
+
+void ElementHideIndex::Add(uint32_t tag, uint32_t name, uint32_t record)
+{
+  m_pending.push_back(std::make_pair(MakeKey(tag, name), record));
+}
+
+void ElementHideIndex::Build()
+{
+  std::stable_sort(m_pending.begin(), m_pending.end(), CompareKeys);
+
+  m_keyCount = 0;
+  for (size_t i = 0; i < m_pending.size(); i++)
+  {
+    if (i == 0 || m_pending[i].first != m_pending[i - 1].first)
+    {
+      m_keyCount++;
+    }
+  }
+
+  size_t slotCount = 16;
+  while (slotCount < m_keyCount * 2)
+  {
+    slotCount *= 2;
+  }
+  Slot emptySlot = {emptyKey, 0, 0};
+  std::vector<Slot>(slotCount, emptySlot).swap(m_slots);
+  m_records.clear();
+  m_records.reserve(m_pending.size());
+
+  size_t mask = slotCount - 1;
+  for (size_t i = 0; i < m_pending.size();)
+  {
+    uint64_t key = m_pending[i].first;
+    uint32_t begin = static_cast<uint32_t>(m_records.size());
+    for (; i < m_pending.size() && m_pending[i].first == key; i++)
+    {
+      m_records.push_back(m_pending[i].second);
+    }
+    size_t slot = HashKey(key) & mask;
+    while (m_slots[slot].key != emptyKey)
+    {
+      slot = (slot + 1) & mask;
+    }
+    m_slots[slot].key = key;
+    m_slots[slot].begin = begin;
+    m_slots[slot].end = static_cast<uint32_t>(m_records.size());
+  }
+  std::vector<std::pair<uint64_t, uint32_t> >().swap(m_pending);
+}
+
+ElementHideIndex::Range ElementHideIndex::Find(uint32_t tag, uint32_t name) const
+{
+  if (m_keyCount == 0)
+  {
+    return Range(nullptr, nullptr);
+  }
+  uint64_t key = MakeKey(tag, name);
+  size_t mask = m_slots.size() - 1;
+  for (size_t slot = HashKey(key) & mask; m_slots[slot].key != emptyKey; slot = (slot + 1) & mask)
+  {
+    if (m_slots[slot].key == key)
+    {
+      const uint32_t* records = &m_records[0];
+      return Range(records + m_slots[slot].begin, records + m_slots[slot].end);
+    }
+  }
+  return Range(nullptr, nullptr);
+}
+
+size_t ElementHideIndex::GetMemoryUsage() const
+{
+  return m_records.capacity() * sizeof(uint32_t) + m_slots.capacity() * sizeof(Slot);
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ELEMENT_HIDE_INDEX_H
+#define ELEMENT_HIDE_INDEX_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// Maps (tag atom, name atom) keys to the ids of the selector records which
+/// are indexed by them, see `AtomTable`.
+///
+/// Keys are added first, `Build` then groups the record ids of equal keys
+/// into one contiguous array (keeping the order in which they were added)
+/// and creates a flat open addressing hash table over the groups.
+class ElementHideIndex
+{
+public:
+  typedef std::pair<const uint32_t*, const uint32_t*> Range;
+
+  ElementHideIndex();
+
+  void Add(uint32_t tag, uint32_t name, uint32_t record);
+  void Build();
+
+  /// Returns the records for the key in the order they were added, only
+  /// valid after `Build`.
+  Range Find(uint32_t tag, uint32_t name) const;
+
+  /// Calls `callback(tag, name, range)` for every key, in no particular
+  /// order. Only valid after `Build`.
+  template<typename Callback>
+  void ForEachKey(Callback callback) const
+  {
+    for (auto slot = m_slots.begin(); slot != m_slots.end(); ++slot)
+    {
+      // Every key has at least one record, empty slots have none
+      if (slot->begin != slot->end)
+      {
+        const uint32_t* records = &m_records[0];
+        callback(static_cast<uint32_t>(slot->key >> 32), static_cast<uint32_t>(slot->key),
+          Range(records + slot->begin, records + slot->end));
+      }
+    }
+  }
+
+  size_t GetKeyCount() const
+  {
+    return m_keyCount;
+  }
+  size_t GetMemoryUsage() const;
+
+private:
+  struct Slot
+  {
+    uint64_t key;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  static uint64_t MakeKey(uint32_t tag, uint32_t name)
+  {
+    return (static_cast<uint64_t>(tag) << 32) | name;
+  }
+  static size_t HashKey(uint64_t key);
+
+  std::vector<std::pair<uint64_t, uint32_t> > m_pending;
+  std::vector<uint32_t> m_records;
+  std::vector<Slot> m_slots;
+  size_t m_keyCount;
+};
+
+#endif
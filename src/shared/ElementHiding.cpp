@@ -0,0 +1,864 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+#include <map>
+#include <set>
+#include <thread>
+#include "ElementHiding.h"
+
+// The filters are described at http://adblockplus.org/en/filters
+
+namespace
+{
+  // Selector lists are split into shards of at least this size for parsing
+  const size_t minShardSize = 2000;
+
+  void ToLowerInPlace(std::wstring& text)
+  {
+    for (auto it = text.begin(); it != text.end(); ++it)
+    {
+      *it = static_cast<wchar_t>(std::towlower(*it));
+    }
+  }
+
+  bool IsWhitespace(wchar_t c)
+  {
+    return c == L' ' || c == L'\t' || c == L'\n' || c == L'\r' || c == L'\f';
+  }
+
+  bool IsNewline(wchar_t c)
+  {
+    return c == L'\n' || c == L'\r' || c == L'\f';
+  }
+
+  // Returns -1 if c isn't a hex digit
+  int HexDigitValue(wchar_t c)
+  {
+    if (c >= L'0' && c <= L'9')
+    {
+      return c - L'0';
+    }
+    if (c >= L'a' && c <= L'f')
+    {
+      return c - L'a' + 10;
+    }
+    if (c >= L'A' && c <= L'F')
+    {
+      return c - L'A' + 10;
+    }
+    return -1;
+  }
+
+  // Appends a valid code point, as a surrogate pair where wchar_t is UTF-16
+  void AppendCodePoint(std::wstring& text, uint32_t codePoint)
+  {
+    if (sizeof(wchar_t) == 2 && codePoint > 0xFFFF)
+    {
+      codePoint -= 0x10000;
+      text += static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+      text += static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF));
+      return;
+    }
+    text += static_cast<wchar_t>(codePoint);
+  }
+
+  // Recursive descent parser for the selector subset described at
+  // CFilterElementHide. It works on the caller's buffer and only allocates
+  // for the parts that are stored. Parse functions return false on error,
+  // the first error is kept in m_error.
+  class SelectorParser
+  {
+  public:
+    SelectorParser(const wchar_t* begin, const wchar_t* end)
+      : m_begin(begin), m_end(end), m_pos(begin), m_error(PARSE_OK)
+    {
+    }
+
+    ElementHideParseError ParseSelector(CFilterElementHide& result)
+    {
+      while (m_begin < m_end && IsWhitespace(m_end[-1]))
+      {
+        m_end--;
+      }
+      SkipWhitespace();
+      m_begin = m_pos;
+      if (AtEnd())
+      {
+        return PARSE_ERROR_EMPTY;
+      }
+
+      std::shared_ptr<CFilterElementHide> left;
+      while (true)
+      {
+        std::shared_ptr<CFilterElementHide> compound = std::make_shared<CFilterElementHide>();
+        if (!ParseCompound(*compound, false))
+        {
+          return m_error;
+        }
+        compound->m_predecessor = left;
+
+        bool hadWhitespace = SkipWhitespace();
+        if (AtEnd())
+        {
+          compound->m_filterText.assign(m_begin, m_end);
+          result = *compound;
+          return PARSE_OK;
+        }
+        switch (*m_pos)
+        {
+        case L'>':
+          compound->m_type = CFilterElementHide::TRAVERSER_TYPE_PARENT;
+          break;
+        case L'+':
+          compound->m_type = CFilterElementHide::TRAVERSER_TYPE_IMMEDIATE;
+          break;
+        case L'~':
+          compound->m_type = CFilterElementHide::TRAVERSER_TYPE_SIBLING;
+          break;
+        default:
+          if (!hadWhitespace)
+          {
+            return PARSE_ERROR_UNEXPECTED_CHARACTER;
+          }
+          compound->m_type = CFilterElementHide::TRAVERSER_TYPE_ANCESTOR;
+          break;
+        }
+        if (compound->m_type != CFilterElementHide::TRAVERSER_TYPE_ANCESTOR)
+        {
+          m_pos++;
+          SkipWhitespace();
+        }
+        left = compound;
+      }
+    }
+
+  private:
+    bool AtEnd() const
+    {
+      return m_pos >= m_end;
+    }
+
+    wchar_t Peek() const
+    {
+      return AtEnd() ? L'\0' : *m_pos;
+    }
+
+    bool SkipWhitespace()
+    {
+      const wchar_t* start = m_pos;
+      while (!AtEnd() && IsWhitespace(*m_pos))
+      {
+        m_pos++;
+      }
+      return m_pos > start;
+    }
+
+    bool Fail(ElementHideParseError error)
+    {
+      if (m_error == PARSE_OK)
+      {
+        m_error = error;
+      }
+      return false;
+    }
+
+    bool Expect(wchar_t c, ElementHideParseError error)
+    {
+      if (Peek() != c)
+      {
+        return Fail(error);
+      }
+      m_pos++;
+      return true;
+    }
+
+    // Consumes the backslash at m_pos and what it escapes, and appends the
+    // character it stands for. Hex escapes are decoded as described in
+    // "consume an escaped code point" of CSS Syntax Level 3, together with
+    // the whitespace which may end them.
+    bool ParseEscape(std::wstring& text)
+    {
+      if (++m_pos == m_end)
+      {
+        return Fail(PARSE_ERROR_UNTERMINATED);
+      }
+      if (HexDigitValue(*m_pos) < 0)
+      {
+        text += *m_pos++;
+        return true;
+      }
+      uint32_t codePoint = 0;
+      for (int digits = 0; digits < 6 && !AtEnd() && HexDigitValue(*m_pos) >= 0; digits++)
+      {
+        codePoint = codePoint * 16 + HexDigitValue(*m_pos++);
+      }
+      if (!AtEnd() && IsWhitespace(*m_pos))
+      {
+        // "\r\n" counts as a single whitespace
+        if (*m_pos == L'\r' && m_pos + 1 < m_end && m_pos[1] == L'\n')
+        {
+          m_pos++;
+        }
+        m_pos++;
+      }
+      if (codePoint == 0 || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+      {
+        codePoint = 0xFFFD;
+      }
+      AppendCodePoint(text, codePoint);
+      return true;
+    }
+
+    // Reads up to the next unescaped delimiter, see ParseEscape for escapes
+    bool ParseIdentifier(const wchar_t* delimiters, std::wstring& identifier)
+    {
+      const wchar_t* start = m_pos;
+      bool hasEscapes = false;
+      while (!AtEnd() && !IsWhitespace(*m_pos) && !wcschr(delimiters, *m_pos))
+      {
+        if (*m_pos != L'\\')
+        {
+          if (hasEscapes)
+          {
+            identifier += *m_pos;
+          }
+          m_pos++;
+          continue;
+        }
+        // Only copied once there is an escape
+        if (!hasEscapes)
+        {
+          identifier.assign(start, m_pos);
+          hasEscapes = true;
+        }
+        if (!ParseEscape(identifier))
+        {
+          return false;
+        }
+      }
+      if (m_pos == start)
+      {
+        return Fail(PARSE_ERROR_EMPTY_NAME);
+      }
+      if (!hasEscapes)
+      {
+        identifier.assign(start, m_pos);
+      }
+      return true;
+    }
+
+    bool ParseCompound(CFilterElementHide& compound, bool isNegation)
+    {
+      static const wchar_t* delimiters = L"#.[]:()>+~*,=\"'";
+      const wchar_t* start = m_pos;
+      if (Peek() == L'*')
+      {
+        // Any tag
+        m_pos++;
+      }
+      else if (!AtEnd() && !wcschr(delimiters, *m_pos) && !IsWhitespace(*m_pos))
+      {
+        if (!ParseIdentifier(delimiters, compound.m_tag))
+        {
+          return false;
+        }
+        ToLowerInPlace(compound.m_tag);
+      }
+
+      while (true)
+      {
+        switch (Peek())
+        {
+        case L'#':
+          {
+            m_pos++;
+            std::wstring id;
+            if (!ParseIdentifier(delimiters, id))
+            {
+              return false;
+            }
+            if (!compound.m_tagId.empty() && compound.m_tagId != id)
+            {
+              return Fail(PARSE_ERROR_MULTIPLE_IDS);
+            }
+            compound.m_tagId.swap(id);
+          }
+          continue;
+        case L'.':
+          m_pos++;
+          compound.m_tagClassNames.push_back(std::wstring());
+          if (!ParseIdentifier(delimiters, compound.m_tagClassNames.back()))
+          {
+            return false;
+          }
+          continue;
+        case L'[':
+          if (!ParseAttribute(compound))
+          {
+            return false;
+          }
+          continue;
+        case L':':
+          {
+            m_pos++;
+            std::wstring pseudoClass;
+            if (!ParseIdentifier(delimiters, pseudoClass))
+            {
+              return false;
+            }
+            ToLowerInPlace(pseudoClass);
+            if (pseudoClass != L"not" || isNegation)
+            {
+              return Fail(PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS);
+            }
+            if (!Expect(L'(', PARSE_ERROR_UNEXPECTED_CHARACTER))
+            {
+              return false;
+            }
+            SkipWhitespace();
+            compound.m_negations.push_back(CFilterElementHide());
+            if (!ParseCompound(compound.m_negations.back(), true))
+            {
+              return false;
+            }
+            SkipWhitespace();
+            if (!Expect(L')', PARSE_ERROR_UNTERMINATED))
+            {
+              return false;
+            }
+          }
+          continue;
+        default:
+          break;
+        }
+        break;
+      }
+
+      if (m_pos == start)
+      {
+        return Fail(AtEnd() ? PARSE_ERROR_EMPTY : PARSE_ERROR_UNEXPECTED_CHARACTER);
+      }
+      return true;
+    }
+
+    bool ParseAttribute(CFilterElementHide& compound)
+    {
+      m_pos++;
+      SkipWhitespace();
+      compound.m_attributeSelectors.push_back(CFilterElementHideAttrSelector());
+      CFilterElementHideAttrSelector& attrSelector = compound.m_attributeSelectors.back();
+      if (!ParseIdentifier(L"[]=^$*~|\"'", attrSelector.m_attr))
+      {
+        return false;
+      }
+      ToLowerInPlace(attrSelector.m_attr);
+      SkipWhitespace();
+
+      wchar_t op = Peek();
+      if (op == L'=')
+      {
+        attrSelector.m_pos = EXACT;
+      }
+      else if (op == L'^' || op == L'$' || op == L'*')
+      {
+        attrSelector.m_pos = op == L'^' ? STARTING : (op == L'$' ? ENDING : ANYWHERE);
+        m_pos++;
+        if (Peek() != L'=')
+        {
+          return Fail(PARSE_ERROR_UNSUPPORTED_OPERATOR);
+        }
+      }
+      else if (op != L']')
+      {
+        return Fail(AtEnd() ? PARSE_ERROR_UNTERMINATED : PARSE_ERROR_UNSUPPORTED_OPERATOR);
+      }
+
+      if (attrSelector.m_pos != POS_NONE)
+      {
+        m_pos++;
+        SkipWhitespace();
+        wchar_t quote = Peek();
+        if (quote == L'"' || quote == L'\'')
+        {
+          m_pos++;
+          while (!AtEnd() && *m_pos != quote)
+          {
+            if (*m_pos != L'\\')
+            {
+              attrSelector.m_value += *m_pos++;
+            }
+            else if (m_pos + 1 < m_end && IsNewline(m_pos[1]))
+            {
+              // An escaped newline continues the string on the next line
+              m_pos += m_pos[1] == L'\r' && m_pos + 2 < m_end && m_pos[2] == L'\n' ? 3 : 2;
+            }
+            else if (!ParseEscape(attrSelector.m_value))
+            {
+              return false;
+            }
+          }
+          if (!Expect(quote, PARSE_ERROR_UNTERMINATED))
+          {
+            return false;
+          }
+        }
+        else
+        {
+          while (!AtEnd() && *m_pos != L']' && !IsWhitespace(*m_pos))
+          {
+            if (*m_pos != L'\\')
+            {
+              attrSelector.m_value += *m_pos++;
+            }
+            else if (!ParseEscape(attrSelector.m_value))
+            {
+              return false;
+            }
+          }
+        }
+        SkipWhitespace();
+      }
+      if (!Expect(L']', PARSE_ERROR_UNTERMINATED))
+      {
+        return false;
+      }
+
+      if (attrSelector.m_attr == L"style")
+      {
+        attrSelector.m_type = STYLE;
+        ToLowerInPlace(attrSelector.m_value);
+      }
+      else if (attrSelector.m_attr == L"id")
+      {
+        attrSelector.m_type = ID;
+      }
+      else if (attrSelector.m_attr == L"class")
+      {
+        attrSelector.m_type = CLASS;
+      }
+      return true;
+    }
+
+    const wchar_t* m_begin;
+    const wchar_t* m_end;
+    const wchar_t* m_pos;
+    ElementHideParseError m_error;
+  };
+}
+
+const char* GetElementHideParseErrorText(ElementHideParseError error)
+{
+  switch (error)
+  {
+  case PARSE_OK:
+    return "no error";
+  case PARSE_ERROR_EMPTY:
+    return "empty selector";
+  case PARSE_ERROR_EMPTY_NAME:
+    return "empty name";
+  case PARSE_ERROR_UNEXPECTED_CHARACTER:
+    return "unexpected character";
+  case PARSE_ERROR_UNTERMINATED:
+    return "unterminated string, attribute or escape";
+  case PARSE_ERROR_MULTIPLE_IDS:
+    return "more than one id";
+  case PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS:
+    return "unsupported pseudo-class";
+  case PARSE_ERROR_UNSUPPORTED_OPERATOR:
+    return "unsupported attribute operator";
+  default:
+    return "unknown error";
+  }
+}
+
+// ============================================================================
+// CFilterElementHide
+// ============================================================================
+
+CFilterElementHide::CFilterElementHide()
+  : m_type(TRAVERSER_TYPE_ERROR)
+{
+}
+
+ElementHideParseError CFilterElementHide::Parse(const wchar_t* begin, const wchar_t* end, CFilterElementHide& result)
+{
+  return SelectorParser(begin, end).ParseSelector(result);
+}
+
+bool CFilterElementHide::IsMatchCompound(const ElementSnapshot& element) const
+{
+  /*
+   * If a tag id is specified, it must match
+   */
+  if (!m_tagId.empty())
+  {
+    std::wstring id;
+    if (!element.GetId(id) || m_tagId != id)
+    {
+      return false;
+    }
+  }
+  /*
+   * Each class name must appear as a token of the class name
+   */
+  for (auto it = m_tagClassNames.begin(); it != m_tagClassNames.end(); ++it)
+  {
+    if (!element.HasClass(*it))
+    {
+      return false;
+    }
+  }
+  /*
+   * If a tag name is specified, it must match
+   */
+  if (!m_tag.empty() && m_tag != element.GetLowerTagName())
+  {
+    return false;
+  }
+  /*
+   * Match each attribute
+   */
+  for (auto attrIt = m_attributeSelectors.begin(); attrIt != m_attributeSelectors.end(); ++attrIt)
+  {
+    std::wstring value;
+    bool attrFound = false;
+    if (attrIt->m_type == STYLE)
+    {
+      const std::wstring* style = element.GetLowerStyle();
+      attrFound = style != nullptr;
+      if (attrFound)
+      {
+        value = *style;
+      }
+    }
+    else if (attrIt->m_type == CLASS)
+    {
+      attrFound = element.GetClassName(value);
+    }
+    else if (attrIt->m_type == ID)
+    {
+      attrFound = element.GetId(value);
+    }
+    else
+    {
+      attrFound = element.GetAttribute(attrIt->m_attr, value);
+    }
+
+    if (!attrFound)
+    {
+      return false;
+    }
+    if (attrIt->m_pos == EXACT)
+    {
+      // TODO: IE rearranges the style attribute completely. Figure out if anything can be done about it.
+      if (value != attrIt->m_value)
+        return false;
+    }
+    else if (attrIt->m_pos == STARTING)
+    {
+      if (value.compare(0, attrIt->m_value.length(), attrIt->m_value) != 0)
+        return false;
+    }
+    else if (attrIt->m_pos == ENDING)
+    {
+      size_t valueLength = value.length();
+      size_t attrLength = attrIt->m_value.length();
+      if (valueLength < attrLength)
+        return false;
+      if (value.compare(valueLength - attrLength, attrLength, attrIt->m_value) != 0)
+        return false;
+    }
+    else if (attrIt->m_pos == ANYWHERE)
+    {
+      if (value.find(attrIt->m_value) == std::wstring::npos)
+        return false;
+    }
+  }
+  /*
+   * None of the :not() arguments may match
+   */
+  for (auto it = m_negations.begin(); it != m_negations.end(); ++it)
+  {
+    if (it->IsMatchCompound(element))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CFilterElementHide::IsMatchFilterElementHide(const ElementSnapshot& element) const
+{
+  if (!IsMatchCompound(element))
+  {
+    return false;
+  }
+  if (!m_predecessor)
+  {
+    return true;
+  }
+
+  switch (m_predecessor->m_type)
+  {
+  case TRAVERSER_TYPE_PARENT:
+    {
+      const ElementSnapshot* parent = element.GetParentSnapshot();
+      return parent && m_predecessor->IsMatchFilterElementHide(*parent);
+    }
+  case TRAVERSER_TYPE_IMMEDIATE:
+    {
+      const ElementSnapshot* sibling = element.GetPreviousSiblingSnapshot();
+      return sibling && m_predecessor->IsMatchFilterElementHide(*sibling);
+    }
+  case TRAVERSER_TYPE_ANCESTOR:
+    for (const ElementSnapshot* ancestor = element.GetParentSnapshot(); ancestor; ancestor = ancestor->GetParentSnapshot())
+    {
+      if (m_predecessor->IsMatchFilterElementHide(*ancestor))
+        return true;
+    }
+    return false;
+  case TRAVERSER_TYPE_SIBLING:
+    for (const ElementSnapshot* sibling = element.GetPreviousSiblingSnapshot(); sibling; sibling = sibling->GetPreviousSiblingSnapshot())
+    {
+      if (m_predecessor->IsMatchFilterElementHide(*sibling))
+        return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+// ============================================================================
+// ElementHideMatcher
+// ============================================================================
+
+ElementHideMatcher::ElementHideMatcher()
+  : m_hasSiblingCombinators(false)
+{
+}
+
+ElementHideParseError ElementHideMatcher::Add(const std::wstring& selector)
+{
+  CFilterElementHide filter;
+  ElementHideParseError error = CFilterElementHide::Parse(selector, filter);
+  if (error == PARSE_OK)
+  {
+    m_programs.push_back(SelectorProgram(filter));
+    m_records.push_back(filter);
+  }
+  return error;
+}
+
+namespace
+{
+  struct ParseShard
+  {
+    std::vector<CFilterElementHide> records;
+    std::vector<SelectorProgram> programs;
+    std::vector<ElementHideMatcher::ParseFailure> failures;
+  };
+
+  // Adds the attributes `compound` depends on, the ones of its negations included
+  void CollectAttributeNames(const CFilterElementHide& compound, std::set<std::wstring>& names)
+  {
+    if (!compound.m_tagId.empty())
+    {
+      names.insert(L"id");
+    }
+    if (!compound.m_tagClassNames.empty())
+    {
+      names.insert(L"class");
+    }
+    for (auto it = compound.m_attributeSelectors.begin(); it != compound.m_attributeSelectors.end(); ++it)
+    {
+      names.insert(it->m_attr);
+    }
+    for (auto it = compound.m_negations.begin(); it != compound.m_negations.end(); ++it)
+    {
+      CollectAttributeNames(*it, names);
+    }
+  }
+
+  void ParseSelectors(const std::vector<std::wstring>& selectors, size_t begin, size_t end, ParseShard& shard)
+  {
+    shard.records.reserve(end - begin);
+    shard.programs.reserve(end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+      const std::wstring& selector = selectors[i];
+      const wchar_t* first = selector.data();
+      const wchar_t* last = first + selector.length();
+      while (first < last && IsWhitespace(*first))
+      {
+        first++;
+      }
+      if (first == last || *first == L'!')
+      {
+        continue;
+      }
+
+      shard.records.push_back(CFilterElementHide());
+      ElementHideParseError error = CFilterElementHide::Parse(first, last, shard.records.back());
+      if (error != PARSE_OK)
+      {
+        shard.records.pop_back();
+        shard.failures.push_back(ElementHideMatcher::ParseFailure(i, error));
+        continue;
+      }
+      shard.programs.push_back(SelectorProgram(shard.records.back()));
+    }
+  }
+}
+
+std::vector<ElementHideMatcher::ParseFailure> ElementHideMatcher::AddAll(const std::vector<std::wstring>& selectors, size_t threadCount)
+{
+  size_t shardCount = selectors.size() / minShardSize;
+  if (shardCount > threadCount)
+  {
+    shardCount = threadCount;
+  }
+  if (shardCount == 0)
+  {
+    shardCount = 1;
+  }
+
+  // The first shard is parsed on the calling thread
+  std::vector<ParseShard> shards(shardCount);
+  std::vector<std::thread> threads;
+  size_t shardSize = (selectors.size() + shardCount - 1) / shardCount;
+  for (size_t i = 1; i < shardCount; i++)
+  {
+    size_t begin = i * shardSize;
+    size_t end = begin + shardSize < selectors.size() ? begin + shardSize : selectors.size();
+    ParseShard* shard = &shards[i];
+    threads.push_back(std::thread([&selectors, begin, end, shard]()
+    {
+      ParseSelectors(selectors, begin, end, *shard);
+    }));
+  }
+  ParseSelectors(selectors, 0, shardSize < selectors.size() ? shardSize : selectors.size(), shards[0]);
+  for (auto it = threads.begin(); it != threads.end(); ++it)
+  {
+    it->join();
+  }
+
+  std::vector<ParseFailure> failures;
+  size_t total = m_records.size();
+  for (auto shard = shards.begin(); shard != shards.end(); ++shard)
+  {
+    total += shard->records.size();
+  }
+  m_records.reserve(total);
+  m_programs.reserve(total);
+  for (auto shard = shards.begin(); shard != shards.end(); ++shard)
+  {
+    m_records.insert(m_records.end(), shard->records.begin(), shard->records.end());
+    m_programs.insert(m_programs.end(), shard->programs.begin(), shard->programs.end());
+    failures.insert(failures.end(), shard->failures.begin(), shard->failures.end());
+  }
+  return failures;
+}
+
+void ElementHideMatcher::Build()
+{
+  // The least common class is the most selective one
+  std::map<std::wstring, size_t> classCounts;
+  for (auto it = m_records.begin(); it != m_records.end(); ++it)
+  {
+    for (auto name = it->m_tagClassNames.begin(); name != it->m_tagClassNames.end(); ++name)
+    {
+      classCounts[*name]++;
+    }
+  }
+
+  for (size_t i = 0; i < m_records.size(); i++)
+  {
+    const CFilterElementHide& filter = m_records[i];
+    uint32_t record = static_cast<uint32_t>(i);
+    AtomTable::Atom tag = m_atoms.Intern(filter.m_tag);
+    if (!filter.m_tagId.empty())
+    {
+      m_indexes[INDEX_TAG_ID].Add(tag, m_atoms.Intern(filter.m_tagId), record);
+    }
+    else if (!filter.m_tagClassNames.empty())
+    {
+      const std::wstring* rarest = &filter.m_tagClassNames.front();
+      for (auto name = filter.m_tagClassNames.begin(); name != filter.m_tagClassNames.end(); ++name)
+      {
+        if (classCounts[*name] < classCounts[*rarest])
+        {
+          rarest = &*name;
+        }
+      }
+      m_indexes[INDEX_TAG_CLASS].Add(tag, m_atoms.Intern(*rarest), record);
+    }
+    else
+    {
+      m_indexes[INDEX_TAG].Add(tag, 0, record);
+    }
+  }
+
+  for (int type = 0; type < INDEX_COUNT; type++)
+  {
+    m_indexes[type].Build();
+  }
+
+  std::set<std::wstring> attributeNames;
+  m_hasSiblingCombinators = false;
+  for (auto it = m_records.begin(); it != m_records.end(); ++it)
+  {
+    for (const CFilterElementHide* compound = &*it; compound; compound = compound->m_predecessor.get())
+    {
+      CollectAttributeNames(*compound, attributeNames);
+      if (compound->m_predecessor &&
+          (compound->m_predecessor->m_type == CFilterElementHide::TRAVERSER_TYPE_IMMEDIATE ||
+           compound->m_predecessor->m_type == CFilterElementHide::TRAVERSER_TYPE_SIBLING))
+      {
+        m_hasSiblingCombinators = true;
+      }
+    }
+  }
+  m_attributeNames.assign(attributeNames.begin(), attributeNames.end());
+}
+
+bool ElementHideMatcher::FindMatch(const std::wstring& tag, const ElementView& element, Match& match) const
+{
+  return FindMatchIn(*this, tag, element, match);
+}
+
+const CFilterElementHide* ElementHideMatcher::FindInIndex(ElementHideIndexType type, AtomTable::Atom tag, AtomTable::Atom name, const ElementSnapshot& element) const
+{
+  if (tag == AtomTable::NotFound)
+  {
+    return nullptr;
+  }
+  ElementHideIndex::Range range = m_indexes[type].Find(tag, name);
+  for (const uint32_t* record = range.first; record != range.second; ++record)
+  {
+    if (m_programs[*record].Matches(element))
+    {
+      return &m_records[*record];
+    }
+  }
+  return nullptr;
+}
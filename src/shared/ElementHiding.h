@@ -0,0 +1,313 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ELEMENT_HIDING_H
+#define ELEMENT_HIDING_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "AtomTable.h"
+#include "ElementHideIndex.h"
+#include "ElementSnapshot.h"
+#include "SelectorProgram.h"
+
+enum CFilterElementHideAttrPos
+{
+  POS_NONE = 0, STARTING, ENDING, ANYWHERE, EXACT
+};
+
+enum CFilterElementHideAttrType
+{
+  TYPE_NONE = 0, STYLE, ID, CLASS
+};
+
+// ============================================================================
+// CFilterElementHideAttrSelector
+// ============================================================================
+
+struct CFilterElementHideAttrSelector
+{
+  CFilterElementHideAttrPos m_pos;
+  CFilterElementHideAttrType m_type;
+  std::wstring m_attr;
+  std::wstring m_value;
+
+  CFilterElementHideAttrSelector()
+    : m_pos(POS_NONE), m_type(TYPE_NONE)
+  {
+  }
+};
+
+// ============================================================================
+// CFilterElementHide
+// ============================================================================
+
+enum ElementHideParseError
+{
+  PARSE_OK = 0,
+  PARSE_ERROR_EMPTY,
+  PARSE_ERROR_EMPTY_NAME,
+  PARSE_ERROR_UNEXPECTED_CHARACTER,
+  PARSE_ERROR_UNTERMINATED,
+  PARSE_ERROR_MULTIPLE_IDS,
+  PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS,
+  PARSE_ERROR_UNSUPPORTED_OPERATOR
+};
+
+/// Returns a static description of `error` for logging.
+const char* GetElementHideParseErrorText(ElementHideParseError error);
+
+/// A compound selector, the chain of `m_predecessor`s holds the compounds to
+/// the left of it. `m_type` of a predecessor is the combinator between it and
+/// the compound to its right.
+///
+/// Supported are type, universal, id, class and attribute selectors
+/// (`[a]`, `[a=v]`, `[a^=v]`, `[a$=v]`, `[a*=v]`), `:not()` of a compound
+/// and the descendant, `>`, `+` and `~` combinators.
+class CFilterElementHide
+{
+public:
+  enum ETraverserComplexType
+  {
+    TRAVERSER_TYPE_PARENT,
+    TRAVERSER_TYPE_IMMEDIATE,
+    TRAVERSER_TYPE_ANCESTOR,
+    TRAVERSER_TYPE_SIBLING,
+    TRAVERSER_TYPE_ERROR
+  };
+
+  // Only set for the rightmost compound
+  std::wstring m_filterText;
+
+  std::wstring m_tagId;
+  std::vector<std::wstring> m_tagClassNames;
+  std::wstring m_tag;
+
+  std::vector<CFilterElementHideAttrSelector> m_attributeSelectors;
+  // Compounds which must not match, from :not()
+  std::vector<CFilterElementHide> m_negations;
+  std::shared_ptr<CFilterElementHide> m_predecessor;
+  ETraverserComplexType m_type;
+
+  CFilterElementHide();
+
+  /// Parses the selector in [begin, end) into its rightmost compound.
+  /// Surrounding whitespace is ignored. `result` is only assigned on success.
+  static ElementHideParseError Parse(const wchar_t* begin, const wchar_t* end, CFilterElementHide& result);
+  static ElementHideParseError Parse(const std::wstring& filterText, CFilterElementHide& result)
+  {
+    return Parse(filterText.data(), filterText.data() + filterText.length(), result);
+  }
+
+  /// Interprets the selector, `ElementHideMatcher` runs the compiled
+  /// `SelectorProgram` instead.
+  bool IsMatchFilterElementHide(const ElementSnapshot& element) const;
+
+private:
+  bool IsMatchCompound(const ElementSnapshot& element) const;
+};
+
+// ============================================================================
+// ElementHideMatcher
+// ============================================================================
+
+/// The indexes of `ElementHideMatcher` and `ElementHideBlob`
+enum ElementHideIndexType
+{
+  // (Tag,Id) -> Filter
+  INDEX_TAG_ID,
+  // (Tag,Class) -> Filter
+  INDEX_TAG_CLASS,
+  // (Tag,"") -> Filter, ("","") for selectors without tag, id and class
+  INDEX_TAG,
+  INDEX_COUNT
+};
+
+/// Finds the element hiding selector matching an element, independent of the
+/// DOM implementation.
+///
+/// Each selector is indexed by the most selective key of its rightmost
+/// compound: the id, else its least common class, else the tag. Selectors
+/// without any of them are checked for every element. All selectors have to
+/// be added before `Build` is called, after that the matcher is immutable and
+/// can be used from several threads at once.
+class ElementHideMatcher
+{
+public:
+  struct Match
+  {
+    Match() : filter(nullptr)
+    {
+    }
+    const CFilterElementHide* filter;
+    // The index which had the selector, e.g. "tag/id", and its key, e.g. "id:ad"
+    std::wstring indexName;
+    std::wstring key;
+  };
+
+  struct ParseFailure
+  {
+    ParseFailure(size_t index, ElementHideParseError error)
+      : index(index), error(error)
+    {
+    }
+    // Position in the list passed to AddAll
+    size_t index;
+    ElementHideParseError error;
+  };
+
+  ElementHideMatcher();
+
+  /// Nothing is added if the selector doesn't parse.
+  ElementHideParseError Add(const std::wstring& selector);
+  /// Adds a list of selectors, skipping empty lines and "!" comments. Lists
+  /// large enough are parsed on up to `threadCount` threads, the selectors
+  /// keep their order either way. Returns the selectors which didn't parse.
+  std::vector<ParseFailure> AddAll(const std::vector<std::wstring>& selectors, size_t threadCount);
+  /// Creates the indexes, all selectors have to be added before.
+  void Build();
+
+  /// `tag` is the lower case tag name of `element`. Every property of the
+  /// element is read at most once, see `ElementSnapshot`.
+  bool FindMatch(const std::wstring& tag, const ElementView& element, Match& match) const;
+
+  size_t GetSelectorCount() const
+  {
+    return m_records.size();
+  }
+
+  /// Sorted lower case names of the attributes the selectors depend on,
+  /// "id" and "class" included if they are used. Only valid after `Build`.
+  const std::vector<std::wstring>& GetAttributeNames() const
+  {
+    return m_attributeNames;
+  }
+
+  /// Whether a selector has a `+` or `~` combinator, then a change to an
+  /// element can affect whether its following siblings match. Only valid
+  /// after `Build`.
+  bool HasSiblingCombinators() const
+  {
+    return m_hasSiblingCombinators;
+  }
+
+private:
+  // The selectors are stored once, the indexes refer to them by position.
+  // m_programs[i] is the compiled form of m_records[i].
+  std::vector<CFilterElementHide> m_records;
+  std::vector<SelectorProgram> m_programs;
+  AtomTable m_atoms;
+
+  ElementHideIndex m_indexes[INDEX_COUNT];
+  std::vector<std::wstring> m_attributeNames;
+  bool m_hasSiblingCombinators;
+
+  AtomTable::Atom FindAtom(const std::wstring& str) const
+  {
+    return m_atoms.Find(str);
+  }
+  const CFilterElementHide* FindInIndex(ElementHideIndexType type, AtomTable::Atom tag, AtomTable::Atom name, const ElementSnapshot& element) const;
+
+  // The lookup order of `FindMatch`, shared with `ElementHideBlob`. `Lookup`
+  // provides `FindAtom` and `FindInIndex` like the matcher itself.
+  template<typename Lookup>
+  static bool FindMatchIn(const Lookup& lookup, const std::wstring& tag, const ElementView& element, Match& match);
+
+  // Serializes the atoms, indexes and selector texts
+  friend class ElementHideBlob;
+
+  ElementHideMatcher(const ElementHideMatcher&);
+  void operator=(const ElementHideMatcher&);
+};
+
+template<typename Lookup>
+bool ElementHideMatcher::FindMatchIn(const Lookup& lookup, const std::wstring& tag, const ElementView& element, Match& match)
+{
+  ElementSnapshot snapshot(element);
+  snapshot.SetTagName(tag);
+
+  // Strings which aren't used by any selector have no atom, nothing can match them.
+  AtomTable::Atom tagAtom = lookup.FindAtom(tag);
+
+  // Search tag/id filters
+  std::wstring id;
+  if (snapshot.GetId(id) && !id.empty())
+  {
+    AtomTable::Atom idAtom = lookup.FindAtom(id);
+    if (idAtom != AtomTable::NotFound)
+    {
+      match.filter = lookup.FindInIndex(INDEX_TAG_ID, tagAtom, idAtom, snapshot);
+      match.indexName = L"tag/id";
+      if (!match.filter)
+      {
+        // Search general id
+        match.filter = lookup.FindInIndex(INDEX_TAG_ID, 0, idAtom, snapshot);
+        match.indexName = L"?/id";
+      }
+      if (match.filter)
+      {
+        match.key = L"id:" + id;
+        return true;
+      }
+    }
+  }
+
+  // Search tag/className filters
+  const std::vector<std::wstring>& classList = snapshot.GetClassList();
+  for (auto it = classList.begin(); it != classList.end(); ++it)
+  {
+    AtomTable::Atom classAtom = lookup.FindAtom(*it);
+    if (classAtom == AtomTable::NotFound)
+    {
+      continue;
+    }
+    match.filter = lookup.FindInIndex(INDEX_TAG_CLASS, tagAtom, classAtom, snapshot);
+    match.indexName = L"tag/class";
+    if (!match.filter)
+    {
+      // Search general class name
+      match.filter = lookup.FindInIndex(INDEX_TAG_CLASS, 0, classAtom, snapshot);
+      match.indexName = L"?/class";
+    }
+    if (match.filter)
+    {
+      match.key = L"class:" + *it;
+      return true;
+    }
+  }
+
+  // Search tag filters
+  match.filter = lookup.FindInIndex(INDEX_TAG, tagAtom, 0, snapshot);
+  match.indexName = L"tag";
+  if (!match.filter && tagAtom != 0)
+  {
+    // Search selectors without tag, id and class
+    match.filter = lookup.FindInIndex(INDEX_TAG, 0, 0, snapshot);
+    match.indexName = L"?";
+  }
+  if (match.filter)
+  {
+    match.key = L"-";
+    return true;
+  }
+  match.indexName.clear();
+  return false;
+}
+
+#endif
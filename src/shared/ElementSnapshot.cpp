@@ -0,0 +1,246 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cwctype>
+#include "ElementSnapshot.h"
+
+namespace
+{
+  std::wstring ToLower(std::wstring text)
+  {
+    for (auto it = text.begin(); it != text.end(); ++it)
+    {
+      *it = static_cast<wchar_t>(std::towlower(*it));
+    }
+    return text;
+  }
+
+  bool IsSeparator(wchar_t c)
+  {
+    return c == L' ' || c == L'\t' || c == L'\n' || c == L'\r';
+  }
+}
+
+ElementSnapshot::ElementSnapshot(const ElementView& source)
+  : m_source(source), m_isClassListSplit(false),
+    m_isParentFetched(false), m_isPreviousSiblingFetched(false)
+{
+}
+
+ElementSnapshot::ElementSnapshot(ElementViewPtr source)
+  : m_ownedSource(std::move(source)), m_source(*m_ownedSource), m_isClassListSplit(false),
+    m_isParentFetched(false), m_isPreviousSiblingFetched(false)
+{
+}
+
+void ElementSnapshot::SetTagName(const std::wstring& tagName)
+{
+  m_tagName.isFetched = true;
+  m_tagName.isAvailable = true;
+  m_tagName.value = tagName;
+  m_lowerTagName = ToLower(tagName);
+}
+
+const ElementSnapshot::CachedValue& ElementSnapshot::Fetch(CachedValue& cached, bool (ElementView::*getter)(std::wstring&) const) const
+{
+  if (!cached.isFetched)
+  {
+    cached.isAvailable = (m_source.*getter)(cached.value);
+    cached.isFetched = true;
+  }
+  return cached;
+}
+
+bool ElementSnapshot::Copy(const CachedValue& cached, std::wstring& value)
+{
+  if (!cached.isAvailable)
+  {
+    return false;
+  }
+  value = cached.value;
+  return true;
+}
+
+const std::wstring& ElementSnapshot::GetLowerTagName() const
+{
+  if (!m_tagName.isFetched)
+  {
+    Fetch(m_tagName, &ElementView::GetTagName);
+    m_lowerTagName = ToLower(m_tagName.value);
+  }
+  return m_lowerTagName;
+}
+
+const std::wstring* ElementSnapshot::GetLowerStyle() const
+{
+  if (!m_style.isFetched)
+  {
+    Fetch(m_style, &ElementView::GetStyle);
+    m_lowerStyle = ToLower(m_style.value);
+  }
+  return m_style.isAvailable ? &m_lowerStyle : nullptr;
+}
+
+const std::vector<std::wstring>& ElementSnapshot::GetClassList() const
+{
+  if (!m_isClassListSplit)
+  {
+    const std::wstring& className = Fetch(m_className, &ElementView::GetClassName).value;
+    size_t pos = 0;
+    while (pos < className.length())
+    {
+      while (pos < className.length() && IsSeparator(className[pos]))
+      {
+        ++pos;
+      }
+      size_t end = pos;
+      while (end < className.length() && !IsSeparator(className[end]))
+      {
+        ++end;
+      }
+      if (end > pos)
+      {
+        m_classList.push_back(className.substr(pos, end - pos));
+      }
+      pos = end;
+    }
+    std::sort(m_classList.begin(), m_classList.end());
+    m_isClassListSplit = true;
+  }
+  return m_classList;
+}
+
+bool ElementSnapshot::HasClass(const std::wstring& className) const
+{
+  const std::vector<std::wstring>& classList = GetClassList();
+  return std::binary_search(classList.begin(), classList.end(), className);
+}
+
+const std::wstring* ElementSnapshot::FindId() const
+{
+  const CachedValue& cached = Fetch(m_id, &ElementView::GetId);
+  return cached.isAvailable ? &cached.value : nullptr;
+}
+
+const std::wstring* ElementSnapshot::FindClassName() const
+{
+  const CachedValue& cached = Fetch(m_className, &ElementView::GetClassName);
+  return cached.isAvailable ? &cached.value : nullptr;
+}
+
+const std::wstring* ElementSnapshot::FindAttribute(const std::wstring& name) const
+{
+  CachedValue& cached = m_attributes[name];
+  if (!cached.isFetched)
+  {
+    cached.isAvailable = m_source.GetAttribute(name, cached.value);
+    cached.isFetched = true;
+  }
+  return cached.isAvailable ? &cached.value : nullptr;
+}
+
+const ElementSnapshot* ElementSnapshot::GetParentSnapshot() const
+{
+  if (!m_isParentFetched)
+  {
+    ElementViewPtr parent = m_source.GetParent();
+    if (parent)
+    {
+      m_parent.reset(new ElementSnapshot(std::move(parent)));
+    }
+    m_isParentFetched = true;
+  }
+  return m_parent.get();
+}
+
+const ElementSnapshot* ElementSnapshot::GetPreviousSiblingSnapshot() const
+{
+  if (!m_isPreviousSiblingFetched)
+  {
+    ElementViewPtr sibling = m_source.GetPreviousSibling();
+    if (sibling)
+    {
+      m_previousSibling.reset(new ElementSnapshot(std::move(sibling)));
+    }
+    m_isPreviousSiblingFetched = true;
+  }
+  return m_previousSibling.get();
+}
+
+bool ElementSnapshot::FindMemo(const void* key, bool& result) const
+{
+  for (auto it = m_memo.begin(); it != m_memo.end(); ++it)
+  {
+    if (it->first == key)
+    {
+      result = it->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ElementSnapshot::SetMemo(const void* key, bool result) const
+{
+  m_memo.push_back(std::make_pair(key, result));
+}
+
+bool ElementSnapshot::GetTagName(std::wstring& tagName) const
+{
+  GetLowerTagName();
+  return Copy(m_tagName, tagName);
+}
+
+bool ElementSnapshot::GetId(std::wstring& id) const
+{
+  return Copy(Fetch(m_id, &ElementView::GetId), id);
+}
+
+bool ElementSnapshot::GetClassName(std::wstring& className) const
+{
+  return Copy(Fetch(m_className, &ElementView::GetClassName), className);
+}
+
+bool ElementSnapshot::GetStyle(std::wstring& cssText) const
+{
+  return Copy(Fetch(m_style, &ElementView::GetStyle), cssText);
+}
+
+bool ElementSnapshot::GetAttribute(const std::wstring& name, std::wstring& value) const
+{
+  const std::wstring* attribute = FindAttribute(name);
+  if (!attribute)
+  {
+    return false;
+  }
+  value = *attribute;
+  return true;
+}
+
+ElementViewPtr ElementSnapshot::GetParent() const
+{
+  const ElementSnapshot* parent = GetParentSnapshot();
+  return ElementViewPtr(parent ? new ElementSnapshot(static_cast<const ElementView&>(*parent)) : nullptr);
+}
+
+ElementViewPtr ElementSnapshot::GetPreviousSibling() const
+{
+  const ElementSnapshot* sibling = GetPreviousSiblingSnapshot();
+  return ElementViewPtr(sibling ? new ElementSnapshot(static_cast<const ElementView&>(*sibling)) : nullptr);
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ELEMENT_SNAPSHOT_H
+#define ELEMENT_SNAPSHOT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ElementView.h"
+
+/// Caches everything read from an `ElementView` while one element is
+/// matched, so that each property is fetched from the DOM at most once no
+/// matter how many candidate selectors look at it.
+///
+/// Values are fetched lazily on first use. A snapshot is meant to live for a
+/// single element visit on a single thread; it isn't thread-safe and doesn't
+/// notice changes to the element.
+class ElementSnapshot : public ElementView
+{
+public:
+  /// `source` has to outlive the snapshot.
+  explicit ElementSnapshot(const ElementView& source);
+  /// Takes ownership of `source`, used for ancestors and siblings.
+  explicit ElementSnapshot(ElementViewPtr source);
+
+  /// Seeds the tag name if the caller already knows it.
+  void SetTagName(const std::wstring& tagName);
+
+  /// Lower case tag name, empty if unavailable.
+  const std::wstring& GetLowerTagName() const;
+  /// Lower case inline style, null if unavailable.
+  const std::wstring* GetLowerStyle() const;
+  /// The whitespace separated tokens of the class name, sorted.
+  const std::vector<std::wstring>& GetClassList() const;
+  bool HasClass(const std::wstring& className) const;
+
+  /// Like the getters below, but without copying. Null if unavailable.
+  const std::wstring* FindId() const;
+  const std::wstring* FindClassName() const;
+  const std::wstring* FindAttribute(const std::wstring& name) const;
+
+  /// Ancestors and siblings are snapshots too, owned by this snapshot.
+  const ElementSnapshot* GetParentSnapshot() const;
+  const ElementSnapshot* GetPreviousSiblingSnapshot() const;
+
+  /// Results of partial selector matches with this element as subject, so
+  /// that descendant and sibling combinators don't test it repeatedly.
+  bool FindMemo(const void* key, bool& result) const;
+  void SetMemo(const void* key, bool result) const;
+
+  bool GetTagName(std::wstring& tagName) const override;
+  bool GetId(std::wstring& id) const override;
+  bool GetClassName(std::wstring& className) const override;
+  bool GetStyle(std::wstring& cssText) const override;
+  bool GetAttribute(const std::wstring& name, std::wstring& value) const override;
+  ElementViewPtr GetParent() const override;
+  ElementViewPtr GetPreviousSibling() const override;
+
+private:
+  struct CachedValue
+  {
+    CachedValue() : isFetched(false), isAvailable(false)
+    {
+    }
+    bool isFetched;
+    bool isAvailable;
+    std::wstring value;
+  };
+
+  const CachedValue& Fetch(CachedValue& cached, bool (ElementView::*getter)(std::wstring&) const) const;
+  static bool Copy(const CachedValue& cached, std::wstring& value);
+
+  ElementViewPtr m_ownedSource;
+  const ElementView& m_source;
+
+  mutable CachedValue m_tagName;
+  mutable std::wstring m_lowerTagName;
+  mutable CachedValue m_id;
+  mutable CachedValue m_className;
+  mutable bool m_isClassListSplit;
+  mutable std::vector<std::wstring> m_classList;
+  mutable CachedValue m_style;
+  mutable std::wstring m_lowerStyle;
+  mutable std::map<std::wstring, CachedValue> m_attributes;
+
+  mutable bool m_isParentFetched;
+  mutable std::unique_ptr<ElementSnapshot> m_parent;
+  mutable bool m_isPreviousSiblingFetched;
+  mutable std::unique_ptr<ElementSnapshot> m_previousSibling;
+  // Few entries, a vector is faster than a map
+  mutable std::vector<std::pair<const void*, bool> > m_memo;
+
+  ElementSnapshot(const ElementSnapshot&);
+  void operator=(const ElementSnapshot&);
+};
+
+#endif
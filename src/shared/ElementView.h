@@ -0,0 +1,52 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ELEMENT_VIEW_H
+#define ELEMENT_VIEW_H
+
+#include <memory>
+#include <string>
+
+class ElementView;
+typedef std::unique_ptr<ElementView> ElementViewPtr;
+
+/// Read-only view of a DOM element, everything the element hiding selectors
+/// need to know about it.
+///
+/// The plugin implements it on top of MSHTML (see `MsHTMLElementView`), the
+/// tests use a simple in-memory tree. All getters return false if the value
+/// isn't available, values are returned the way the DOM reports them.
+class ElementView
+{
+public:
+  virtual ~ElementView() {}
+
+  virtual bool GetTagName(std::wstring& tagName) const = 0;
+  virtual bool GetId(std::wstring& id) const = 0;
+  virtual bool GetClassName(std::wstring& className) const = 0;
+  /// The inline style, serialized.
+  virtual bool GetStyle(std::wstring& cssText) const = 0;
+  virtual bool GetAttribute(const std::wstring& name, std::wstring& value) const = 0;
+
+  /// Returns null if there is no parent element.
+  virtual ElementViewPtr GetParent() const = 0;
+  /// The closest preceding sibling which is an element, null if there is none.
+  virtual ElementViewPtr GetPreviousSibling() const = 0;
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HttpHeaders.h"
+
+namespace
+{
+  template<typename CharT>
+  bool IsWhitespace(CharT ch)
+  {
+    return ch == ' ' || ch == '\t';
+  }
+
+  // Only ASCII letters, header names are ASCII and this doesn't depend on the locale
+  template<typename CharT>
+  CharT ToLowerAscii(CharT ch)
+  {
+    return ch >= 'A' && ch <= 'Z' ? static_cast<CharT>(ch - 'A' + 'a') : ch;
+  }
+
+  template<typename CharT>
+  bool EqualsAscii(const CharT* begin, const CharT* end, const char* text, bool ignoreCase)
+  {
+    for (; begin != end; ++begin, ++text)
+    {
+      if (*text == '\0')
+      {
+        return false;
+      }
+      CharT ch = *begin;
+      CharT expected = static_cast<CharT>(static_cast<unsigned char>(*text));
+      if (ignoreCase ? ToLowerAscii(ch) != ToLowerAscii(expected) : ch != expected)
+      {
+        return false;
+      }
+    }
+    return *text == '\0';
+  }
+}
+
+template<typename CharT>
+const size_t HttpHeaders<CharT>::maxHeaders;
+
+template<typename CharT>
+bool HttpHeaders<CharT>::Range::Equals(const char* text) const
+{
+  return EqualsAscii(begin, end, text, false);
+}
+
+template<typename CharT>
+bool HttpHeaders<CharT>::Range::EqualsIgnoreCase(const char* text) const
+{
+  return EqualsAscii(begin, end, text, true);
+}
+
+template<typename CharT>
+HttpHeaders<CharT>::HttpHeaders(const CharT* begin, const CharT* end)
+  : m_count(0)
+{
+  Parse(begin, end);
+}
+
+template<typename CharT>
+HttpHeaders<CharT>::HttpHeaders(const CharT* headers)
+  : m_count(0)
+{
+  if (headers)
+  {
+    Parse(headers, headers + std::char_traits<CharT>::length(headers));
+  }
+}
+
+template<typename CharT>
+typename HttpHeaders<CharT>::Range HttpHeaders<CharT>::Find(const char* name) const
+{
+  for (size_t i = 0; i < m_count; i++)
+  {
+    if (m_headers[i].name.EqualsIgnoreCase(name))
+    {
+      return m_headers[i].value;
+    }
+  }
+  return Range();
+}
+
+template<typename CharT>
+bool HttpHeaders<CharT>::Has(const char* name) const
+{
+  for (size_t i = 0; i < m_count; i++)
+  {
+    if (m_headers[i].name.EqualsIgnoreCase(name))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename CharT>
+void HttpHeaders<CharT>::Parse(const CharT* begin, const CharT* end)
+{
+  const CharT* line = begin;
+  while (line < end && m_count < maxHeaders)
+  {
+    const CharT* lineEnd = line;
+    while (lineEnd < end && *lineEnd != '\n')
+    {
+      ++lineEnd;
+    }
+    const CharT* next = lineEnd < end ? lineEnd + 1 : end;
+    if (lineEnd > line && lineEnd[-1] == '\r')
+    {
+      --lineEnd;
+    }
+
+    if (line < lineEnd && !IsWhitespace(*line))
+    {
+      const CharT* colon = line;
+      while (colon < lineEnd && *colon != ':')
+      {
+        ++colon;
+      }
+      if (colon < lineEnd && colon > line)
+      {
+        const CharT* nameEnd = colon;
+        while (nameEnd > line && IsWhitespace(nameEnd[-1]))
+        {
+          --nameEnd;
+        }
+        const CharT* valueBegin = colon + 1;
+        while (valueBegin < lineEnd && IsWhitespace(*valueBegin))
+        {
+          ++valueBegin;
+        }
+        const CharT* valueEnd = lineEnd;
+        while (valueEnd > valueBegin && IsWhitespace(valueEnd[-1]))
+        {
+          --valueEnd;
+        }
+        Header& header = m_headers[m_count++];
+        header.name = Range(line, nameEnd);
+        header.value = Range(valueBegin, valueEnd);
+      }
+    }
+    line = next;
+  }
+}
+
+template class HttpHeaders<char>;
+template class HttpHeaders<wchar_t>;
@@ -0,0 +1,100 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HTTP_HEADERS_H
+#define HTTP_HEADERS_H
+
+#include <cstddef>
+#include <string>
+
+/// Header fields of an HTTP message, e.g. the additional headers passed to
+/// `IHttpNegotiate::BeginningTransaction` (`wchar_t`) or the raw request
+/// headers from `IWinInetHttpInfo::QueryInfo` (`char`).
+///
+/// The headers are parsed once in the constructor into names and values
+/// pointing into the buffer, nothing is allocated or copied. The buffer has
+/// to outlive the object. Lines are separated by "\n" or "\r\n". Lines
+/// without a colon, like the request line, and folded continuation lines are
+/// skipped, as are the headers after the first `maxHeaders`.
+template<typename CharT>
+class HttpHeaders
+{
+public:
+  static const size_t maxHeaders = 32;
+
+  /// Characters in [begin, end) of the buffer.
+  struct Range
+  {
+    Range() : begin(nullptr), end(nullptr)
+    {
+    }
+    Range(const CharT* begin, const CharT* end) : begin(begin), end(end)
+    {
+    }
+    bool IsEmpty() const
+    {
+      return begin == end;
+    }
+    size_t GetLength() const
+    {
+      return end - begin;
+    }
+    std::basic_string<CharT> ToString() const
+    {
+      return std::basic_string<CharT>(begin, end);
+    }
+    /// `text` is ASCII.
+    bool Equals(const char* text) const;
+    bool EqualsIgnoreCase(const char* text) const;
+
+    const CharT* begin;
+    const CharT* end;
+  };
+
+  struct Header
+  {
+    Range name;
+    // Without the surrounding whitespace
+    Range value;
+  };
+
+  HttpHeaders(const CharT* begin, const CharT* end);
+  /// `headers` is null terminated, it may be null.
+  explicit HttpHeaders(const CharT* headers);
+
+  /// Returns the value of the first header called `name`, compared case
+  /// insensitively. The value is empty if there is no such header.
+  Range Find(const char* name) const;
+  bool Has(const char* name) const;
+
+  size_t GetCount() const
+  {
+    return m_count;
+  }
+  const Header& operator[](size_t index) const
+  {
+    return m_headers[index];
+  }
+
+private:
+  void Parse(const CharT* begin, const CharT* end);
+
+  Header m_headers[maxHeaders];
+  size_t m_count;
+};
+
+#endif
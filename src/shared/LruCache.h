@@ -0,0 +1,118 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+/// Thread-safe cache which holds at most `capacity` entries and evicts the
+/// least recently used one when a new entry doesn't fit anymore.
+///
+/// Values are copied in and out, so they should be cheap to copy, e.g.
+/// `std::shared_ptr` to immutable objects.
+template<typename Key, typename Value>
+class LruCache
+{
+public:
+  struct Stats
+  {
+    Stats() : size(0), hits(0), misses(0), evictions(0) {}
+    size_t size;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+  };
+
+  explicit LruCache(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1)
+  {
+  }
+
+  /// Returns false if there is no entry for the key.
+  bool Get(const Key& key, Value& value)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    typename Index::iterator it = m_index.find(key);
+    if (it == m_index.end())
+    {
+      m_stats.misses++;
+      return false;
+    }
+    m_stats.hits++;
+    // Move the entry to the front, it's the most recently used one now
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    value = it->second->second;
+    return true;
+  }
+
+  void Put(const Key& key, const Value& value)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    typename Index::iterator it = m_index.find(key);
+    if (it != m_index.end())
+    {
+      it->second->second = value;
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return;
+    }
+    if (m_entries.size() >= m_capacity)
+    {
+      m_index.erase(m_entries.back().first);
+      m_entries.pop_back();
+      m_stats.evictions++;
+    }
+    m_entries.push_front(std::make_pair(key, value));
+    m_index[key] = m_entries.begin();
+  }
+
+  void Clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_entries.clear();
+  }
+
+  Stats GetStats() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.size = m_entries.size();
+    return stats;
+  }
+
+private:
+  LruCache(const LruCache&);
+  void operator=(const LruCache&);
+
+  // Most recently used entries first
+  typedef std::list<std::pair<Key, Value> > Entries;
+  typedef std::map<Key, typename Entries::iterator> Index;
+
+  const size_t m_capacity;
+  mutable std::mutex m_mutex;
+  Entries m_entries;
+  Index m_index;
+  Stats m_stats;
+};
+
+#endif
@@ -47,4 +47,118 @@ GetHtmlElementAttributeResult GetHtmlElementAttribute(IHTMLElement& htmlElement,
     retValue.attributeValue = std::to_wstring(vAttr.iVal);
   }
   return retValue;
-}
\ No newline at end of file
+}
+MsHTMLElementView::MsHTMLElementView(IHTMLElement* element, size_t* comCallCount)
+  : m_element(element), m_comCallCount(comCallCount)
+{
+}
+
+void MsHTMLElementView::CountComCalls(size_t count) const
+{
+  if (m_comCallCount)
+  {
+    *m_comCallCount += count;
+  }
+}
+
+bool MsHTMLElementView::GetTagName(std::wstring& tagName) const
+{
+  ATL::CComBSTR tagNameBstr;
+  CountComCalls(1);
+  if (FAILED(m_element->get_tagName(&tagNameBstr)) || !tagNameBstr)
+  {
+    return false;
+  }
+  tagName = tagNameBstr;
+  return true;
+}
+
+bool MsHTMLElementView::GetId(std::wstring& id) const
+{
+  ATL::CComBSTR idBstr;
+  CountComCalls(1);
+  if (FAILED(m_element->get_id(&idBstr)) || !idBstr)
+  {
+    return false;
+  }
+  id = idBstr;
+  return true;
+}
+
+bool MsHTMLElementView::GetClassName(std::wstring& className) const
+{
+  ATL::CComBSTR classNameBstr;
+  CountComCalls(1);
+  if (FAILED(m_element->get_className(&classNameBstr)) || !classNameBstr)
+  {
+    return false;
+  }
+  className = classNameBstr;
+  return true;
+}
+
+bool MsHTMLElementView::GetStyle(std::wstring& cssText) const
+{
+  ATL::CComPtr<IHTMLStyle> style;
+  CountComCalls(1);
+  if (FAILED(m_element->get_style(&style)) || !style)
+  {
+    return false;
+  }
+  ATL::CComBSTR styleBstr;
+  CountComCalls(1);
+  if (FAILED(style->get_cssText(&styleBstr)) || !styleBstr)
+  {
+    return false;
+  }
+  cssText = styleBstr;
+  return true;
+}
+
+bool MsHTMLElementView::GetAttribute(const std::wstring& name, std::wstring& value) const
+{
+  ATL::CComBSTR nameBstr(static_cast<int>(name.length()), name.c_str());
+  // QueryInterface, getAttributeNode and get_nodeValue
+  CountComCalls(3);
+  GetHtmlElementAttributeResult result = GetHtmlElementAttribute(*m_element, nameBstr);
+  if (!result.isAttributeFound)
+  {
+    return false;
+  }
+  value = result.attributeValue;
+  return true;
+}
+
+ElementViewPtr MsHTMLElementView::GetParent() const
+{
+  ATL::CComPtr<IHTMLElement> parent;
+  CountComCalls(1);
+  if (m_element->get_parentElement(&parent) != S_OK || !parent)
+  {
+    return ElementViewPtr();
+  }
+  return ElementViewPtr(new MsHTMLElementView(parent, m_comCallCount));
+}
+
+ElementViewPtr MsHTMLElementView::GetPreviousSibling() const
+{
+  ATL::CComQIPtr<IHTMLDOMNode> node = m_element;
+  long type = 0;
+  while (node && type != 1)
+  {
+    ATL::CComPtr<IHTMLDOMNode> previous;
+    CountComCalls(2);
+    node->get_previousSibling(&previous);
+    node = previous;
+    if (node && node->get_nodeType(&type) != S_OK)
+    {
+      node.Release();
+    }
+  }
+  ATL::CComPtr<IHTMLElement> sibling;
+  if (!node || node.QueryInterface(&sibling) != S_OK || !sibling)
+  {
+    return ElementViewPtr();
+  }
+  return ElementViewPtr(new MsHTMLElementView(sibling, m_comCallCount));
+}
@@ -21,6 +21,7 @@
 #include <string>
 #include <MsHTML.h>
 #include <atlbase.h>
+#include "ElementView.h"
 
 struct GetHtmlElementAttributeResult
 {
@@ -34,4 +35,26 @@ struct GetHtmlElementAttributeResult
 GetHtmlElementAttributeResult GetHtmlElementAttribute(IHTMLElement& htmlElement,
   const ATL::CComBSTR& attributeName);
 
+/// `ElementView` of an MSHTML element, every getter makes COM calls.
+/// They are counted in `comCallCount` if it isn't null.
+class MsHTMLElementView : public ElementView
+{
+public:
+  explicit MsHTMLElementView(IHTMLElement* element, size_t* comCallCount = nullptr);
+
+  bool GetTagName(std::wstring& tagName) const override;
+  bool GetId(std::wstring& id) const override;
+  bool GetClassName(std::wstring& className) const override;
+  bool GetStyle(std::wstring& cssText) const override;
+  bool GetAttribute(const std::wstring& name, std::wstring& value) const override;
+  ElementViewPtr GetParent() const override;
+  ElementViewPtr GetPreviousSibling() const override;
+
+private:
+  void CountComCalls(size_t count) const;
+
+  ATL::CComPtr<IHTMLElement> m_element;
+  size_t* m_comCallCount;
+};
+
 #endif
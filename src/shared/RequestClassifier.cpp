@@ -0,0 +1,174 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RequestClassifier.h"
+#include <chrono>
+
+namespace
+{
+  class StageTimer
+  {
+  public:
+    explicit StageTimer(RequestStageTimings* timings)
+      : m_timings(timings)
+    {
+      if (m_timings)
+      {
+        m_timings->requests++;
+        m_start = std::chrono::high_resolution_clock::now();
+      }
+    }
+
+    void Finish(RequestStage stage)
+    {
+      if (!m_timings)
+      {
+        return;
+      }
+      std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+      m_timings->ms[stage] += std::chrono::duration<double, std::milli>(now - m_start).count();
+      m_start = now;
+    }
+
+  private:
+    RequestStageTimings* m_timings;
+    std::chrono::high_resolution_clock::time_point m_start;
+  };
+}
+
+const char* GetRequestStageName(RequestStage stage)
+{
+  switch (stage)
+  {
+  case REQUEST_STAGE_HEADERS:
+    return "headers";
+  case REQUEST_STAGE_CONTENT_TYPE:
+    return "contentType";
+  case REQUEST_STAGE_DOCUMENT:
+    return "document";
+  case REQUEST_STAGE_OBJECT_SUBREQUEST:
+    return "objectSubrequest";
+  case REQUEST_STAGE_XMLHTTPREQUEST:
+    return "xmlHttpRequest";
+  case REQUEST_STAGE_FILTER:
+    return "filter";
+  default:
+    return "unknown";
+  }
+}
+
+RequestStageTimings::RequestStageTimings()
+  : requests(0)
+{
+  for (int i = 0; i < REQUEST_STAGE_COUNT; i++)
+  {
+    ms[i] = 0;
+  }
+}
+
+// Known IE Accept strings for documents and images:
+//     text/html, application/xhtml+xml, image/jxr, */*
+//     image/png, image/svg+xml, image/jxr, image/*;q=0.8, */*;q = 0.5
+// In IE9 the image/jxr part is missing.
+RequestContentType RequestStages::InferContentType(const RequestDescriptor& request, const std::wstring& referrer)
+{
+  // BINDSTRING_XDR_ORIGIN works only for IE v8+
+  if (request.accept.empty() && referrer.empty() && request.ieMajorVersion >= 8)
+  {
+    return REQUEST_TYPE_XMLHTTPREQUEST;
+  }
+  const std::wstring& accept = request.accept;
+  RequestContentType contentType = ClassifyMediaTypeList(accept.data(), accept.data() + accept.length());
+  if (contentType == REQUEST_TYPE_OTHER)
+  {
+    // IE8 passes the file of some requests in the query string
+    const std::wstring& url = request.url;
+    contentType = ClassifyUrl(url.data(), url.data() + url.length(), request.ieMajorVersion == 8);
+  }
+  return contentType;
+}
+
+// The implementation from Flash.ocx (tested version is 15.0.0.152) returns
+// quite minimal bind info in comparison with the implementation from
+// Microsoft's libraries, which often includes something else.
+bool RequestStages::IsObjectSubrequest(const RequestDescriptor& request, const HttpHeaders<wchar_t>& headers)
+{
+  if (!headers.Find("x-flash-version").IsEmpty())
+  {
+    return true;
+  }
+  return request.hasBindInfo && request.bindFlags == flashBindFlags &&
+    request.bindOptions == flashBindOptions;
+}
+
+bool RequestStages::IsXmlHttpRequest(const HttpHeaders<wchar_t>& headers)
+{
+  return headers.Find("X-Requested-With").Equals("XMLHttpRequest");
+}
+
+bool RequestStages::IsCustomResponse(RequestContentType contentType)
+{
+  return contentType != REQUEST_TYPE_OBJECT_SUBREQUEST;
+}
+
+RequestDecision ClassifyRequest(const RequestDescriptor& request, RequestEnvironment& environment,
+  RequestStageTimings* timings)
+{
+  StageTimer timer(timings);
+  RequestDecision decision;
+
+  // Parsed once, the header values point into the buffer
+  HttpHeaders<wchar_t> headers(request.additionalHeaders);
+  decision.referrer = headers.Find("Referer").ToString();
+  timer.Finish(REQUEST_STAGE_HEADERS);
+
+  decision.contentType = RequestStages::InferContentType(request, decision.referrer);
+  timer.Finish(REQUEST_STAGE_CONTENT_TYPE);
+
+  if (request.hasTab)
+  {
+    // Page is identical to document => don't block
+    if (request.documentUrl == request.url)
+    {
+      decision.isDocument = true;
+      timer.Finish(REQUEST_STAGE_DOCUMENT);
+      return decision;
+    }
+    if (environment.IsFilteringEnabled(request.documentUrl) && environment.IsFrameCached(request.url))
+    {
+      decision.contentType = REQUEST_TYPE_SUBDOCUMENT;
+    }
+  }
+  timer.Finish(REQUEST_STAGE_DOCUMENT);
+
+  if (RequestStages::IsObjectSubrequest(request, headers))
+  {
+    decision.contentType = REQUEST_TYPE_OBJECT_SUBREQUEST;
+  }
+  timer.Finish(REQUEST_STAGE_OBJECT_SUBREQUEST);
+
+  if (RequestStages::IsXmlHttpRequest(headers))
+  {
+    decision.contentType = REQUEST_TYPE_XMLHTTPREQUEST;
+  }
+  timer.Finish(REQUEST_STAGE_XMLHTTPREQUEST);
+
+  decision.shouldBlock = environment.ShouldBlock(request.url, decision.contentType, decision.referrer);
+  decision.isCustomResponse = decision.shouldBlock && RequestStages::IsCustomResponse(decision.contentType);
+  timer.Finish(REQUEST_STAGE_FILTER);
+  return decision;
+}
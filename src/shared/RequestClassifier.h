@@ -0,0 +1,138 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REQUEST_CLASSIFIER_H
+#define REQUEST_CLASSIFIER_H
+
+#include <string>
+#include "ContentTypeClassifier.h"
+#include "HttpHeaders.h"
+
+/// Everything the classification of a request depends on, gathered by the
+/// caller of `ClassifyRequest` before any stage runs, e.g. from the
+/// arguments of `IHttpNegotiate::BeginningTransaction` and the tab.
+struct RequestDescriptor
+{
+  RequestDescriptor()
+    : additionalHeaders(nullptr), hasBindInfo(false), bindFlags(0), bindOptions(0),
+      ieMajorVersion(0), hasTab(false)
+  {
+  }
+
+  std::wstring url;
+  // Additional headers of the request, may be null. Not copied, the buffer
+  // has to outlive the classification.
+  const wchar_t* additionalHeaders;
+  // Media type list of the Accept header
+  std::wstring accept;
+  // grfBINDF and BINDINFO::dwOptions, if the client provided its bind info
+  bool hasBindInfo;
+  unsigned long bindFlags;
+  unsigned long bindOptions;
+  int ieMajorVersion;
+  // URL of the document of the tab which made the request, if known
+  bool hasTab;
+  std::wstring documentUrl;
+};
+
+/// Lookups of the classification which aren't functions of the request alone.
+/// They are only made when a stage needs them.
+class RequestEnvironment
+{
+public:
+  virtual ~RequestEnvironment()
+  {
+  }
+  /// Whether requests of the document at `documentUrl` are filtered at all.
+  virtual bool IsFilteringEnabled(const std::wstring& documentUrl) = 0;
+  /// Whether `url` was seen as the source of a frame of the tab.
+  virtual bool IsFrameCached(const std::wstring& url) = 0;
+  /// Whether the filters block `url`, requested by the page at `referrer`.
+  virtual bool ShouldBlock(const std::wstring& url, RequestContentType contentType, const std::wstring& referrer) = 0;
+};
+
+enum RequestStage
+{
+  REQUEST_STAGE_HEADERS = 0,
+  REQUEST_STAGE_CONTENT_TYPE,
+  REQUEST_STAGE_DOCUMENT,
+  REQUEST_STAGE_OBJECT_SUBREQUEST,
+  REQUEST_STAGE_XMLHTTPREQUEST,
+  REQUEST_STAGE_FILTER,
+  REQUEST_STAGE_COUNT
+};
+
+/// Returns the name of `stage` for logging and benchmarks.
+const char* GetRequestStageName(RequestStage stage);
+
+/// Wall time spent in each stage, added up over all the classifications it
+/// is passed to.
+struct RequestStageTimings
+{
+  RequestStageTimings();
+  double ms[REQUEST_STAGE_COUNT];
+  unsigned long requests;
+};
+
+struct RequestDecision
+{
+  RequestDecision()
+    : contentType(REQUEST_TYPE_OTHER), isDocument(false), shouldBlock(false),
+      isCustomResponse(false)
+  {
+  }
+
+  RequestContentType contentType;
+  // Value of the Referer header, the domain the filters are matched for
+  std::wstring referrer;
+  // The request is for the document of the tab itself, it is never blocked
+  bool isDocument;
+  bool shouldBlock;
+  // A blocked request gets a `SyntheticResponse` instead of failing
+  bool isCustomResponse;
+};
+
+/// grfBINDF and BINDINFO::dwOptions of the requests issued by Flash.ocx, i.e.
+/// BINDF_ASYNCHRONOUS | BINDF_ASYNCSTORAGE | BINDF_PULLDATA and
+/// BINDINFO_OPTIONS_ENABLE_UTF8 | BINDINFO_OPTIONS_USE_IE_ENCODING.
+const unsigned long flashBindFlags = 0x83;
+const unsigned long flashBindOptions = 0xA0000;
+
+/// The stages of `ClassifyRequest`, each depends only on its arguments.
+namespace RequestStages
+{
+  /// Guesses the type from the Accept header, else from the URL. Requests
+  /// without both an Accept header and a referrer are XMLHttpRequests from IE 8
+  /// on.
+  RequestContentType InferContentType(const RequestDescriptor& request, const std::wstring& referrer);
+  /// Requests issued by Flash.ocx, recognized by the x-flash-version header
+  /// or by their minimal bind info.
+  bool IsObjectSubrequest(const RequestDescriptor& request, const HttpHeaders<wchar_t>& headers);
+  bool IsXmlHttpRequest(const HttpHeaders<wchar_t>& headers);
+  /// Blocked object subrequests fail, feeding HTML to Flash can e.g. break
+  /// videos, see https://issues.adblockplus.org/ticket/1669.
+  bool IsCustomResponse(RequestContentType contentType);
+}
+
+/// Runs the stages in order: parsing the headers, inferring the content type,
+/// recognizing the document itself and frames of the tab, object subrequests
+/// and XMLHttpRequests, and lastly matching the filters. The time of each
+/// stage is added to `timings` unless it is null.
+RequestDecision ClassifyRequest(const RequestDescriptor& request, RequestEnvironment& environment,
+  RequestStageTimings* timings = nullptr);
+
+#endif
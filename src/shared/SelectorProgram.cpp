@@ -0,0 +1,332 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include "ElementHiding.h"
+#include "SelectorProgram.h"
+
+SelectorProgram::SelectorProgram(const CFilterElementHide& selector)
+{
+  bool isRepeated = false;
+  bool isPreviousRepeating = false;
+  for (const CFilterElementHide* compound = &selector; compound; compound = compound->m_predecessor.get())
+  {
+    Compound compiled = CompileCompound(*compound);
+    compiled.combinator = COMBINATOR_NONE;
+    compiled.isMemoized = isRepeated;
+    if (compound->m_predecessor)
+    {
+      switch (compound->m_predecessor->m_type)
+      {
+      case CFilterElementHide::TRAVERSER_TYPE_IMMEDIATE:
+        compiled.combinator = COMBINATOR_ADJACENT_SIBLING;
+        break;
+      case CFilterElementHide::TRAVERSER_TYPE_SIBLING:
+        compiled.combinator = COMBINATOR_GENERAL_SIBLING;
+        break;
+      case CFilterElementHide::TRAVERSER_TYPE_ANCESTOR:
+        compiled.combinator = COMBINATOR_DESCENDANT;
+        break;
+      default:
+        compiled.combinator = COMBINATOR_CHILD;
+        break;
+      }
+    }
+    m_compounds.push_back(compiled);
+    isRepeated = isRepeated || isPreviousRepeating;
+    isPreviousRepeating = compiled.combinator == COMBINATOR_DESCENDANT ||
+      compiled.combinator == COMBINATOR_GENERAL_SIBLING;
+  }
+}
+
+SelectorProgram::Compound SelectorProgram::CompileCompound(const CFilterElementHide& compound)
+{
+  Compound compiled = {};
+  compiled.firstTest = static_cast<uint32_t>(m_code.size());
+  CompileTests(compound);
+  compiled.testCount = static_cast<uint32_t>(m_code.size()) - compiled.firstTest;
+
+  // :not() can't be nested, so the negations have no negations themselves
+  std::vector<Compound> negations;
+  for (auto it = compound.m_negations.begin(); it != compound.m_negations.end(); ++it)
+  {
+    negations.push_back(CompileCompound(*it));
+  }
+  compiled.firstNegation = static_cast<uint32_t>(m_negations.size());
+  compiled.negationCount = static_cast<uint32_t>(negations.size());
+  m_negations.insert(m_negations.end(), negations.begin(), negations.end());
+  return compiled;
+}
+
+void SelectorProgram::CompileTests(const CFilterElementHide& compound)
+{
+  std::vector<Instruction> tests;
+  // The tag is known before matching starts, the id and class name are
+  // fetched for the index lookup anyway. Other attributes cost COM calls,
+  // the style has to be lower cased as well.
+  if (!compound.m_tag.empty())
+  {
+    Instruction test = {OP_TAG, SOURCE_NONE, AddLiteral(compound.m_tag), 0, 0, 0};
+    tests.push_back(test);
+  }
+  if (!compound.m_tagId.empty())
+  {
+    Instruction test = {OP_ID, SOURCE_ID, AddLiteral(compound.m_tagId), 0, 0, 1};
+    tests.push_back(test);
+  }
+  for (auto it = compound.m_tagClassNames.begin(); it != compound.m_tagClassNames.end(); ++it)
+  {
+    Instruction test = {OP_CLASS, SOURCE_CLASS_NAME, AddLiteral(*it), 0, 0, 2};
+    tests.push_back(test);
+  }
+  for (auto it = compound.m_attributeSelectors.begin(); it != compound.m_attributeSelectors.end(); ++it)
+  {
+    Instruction test = {};
+    switch (it->m_type)
+    {
+    case ID:
+      test.source = SOURCE_ID;
+      test.cost = 3;
+      break;
+    case CLASS:
+      test.source = SOURCE_CLASS_NAME;
+      test.cost = 3;
+      break;
+    case STYLE:
+      test.source = SOURCE_STYLE;
+      test.cost = 6;
+      break;
+    default:
+      test.source = SOURCE_ATTRIBUTE;
+      test.name = AddLiteral(it->m_attr);
+      test.cost = 5;
+      break;
+    }
+    test.literal = AddLiteral(it->m_value);
+    switch (it->m_pos)
+    {
+    case EXACT:
+      test.op = OP_EQUALS;
+      break;
+    case STARTING:
+      test.op = OP_STARTS_WITH;
+      test.cost += 1;
+      break;
+    case ENDING:
+      test.op = OP_ENDS_WITH;
+      test.cost += 1;
+      break;
+    case ANYWHERE:
+      {
+        test.op = OP_CONTAINS;
+        test.cost += 2;
+        test.skipTable = static_cast<uint32_t>(m_skipTables.size());
+        const std::wstring& pattern = it->m_value;
+        size_t length = pattern.length();
+        SkipTable skipTable;
+        skipTable.fill(static_cast<uint8_t>(length < 255 ? length : 255));
+        for (size_t i = 0; i + 1 < length; i++)
+        {
+          size_t shift = length - 1 - i;
+          skipTable[pattern[i] & 0xFF] = static_cast<uint8_t>(shift < 255 ? shift : 255);
+        }
+        m_skipTables.push_back(skipTable);
+      }
+      break;
+    default:
+      test.op = OP_PRESENT;
+      break;
+    }
+    tests.push_back(test);
+  }
+  std::stable_sort(tests.begin(), tests.end(), [](const Instruction& a, const Instruction& b)
+  {
+    return a.cost < b.cost;
+  });
+  m_code.insert(m_code.end(), tests.begin(), tests.end());
+}
+
+uint32_t SelectorProgram::AddLiteral(const std::wstring& literal)
+{
+  m_literals.push_back(literal);
+  return static_cast<uint32_t>(m_literals.size() - 1);
+}
+
+const std::wstring* SelectorProgram::FetchValue(const ElementSnapshot& element, const Instruction& instruction) const
+{
+  switch (instruction.source)
+  {
+  case SOURCE_ID:
+    return element.FindId();
+  case SOURCE_CLASS_NAME:
+    return element.FindClassName();
+  case SOURCE_STYLE:
+    return element.GetLowerStyle();
+  default:
+    return element.FindAttribute(m_literals[instruction.name]);
+  }
+}
+
+bool SelectorProgram::Contains(const std::wstring& text, const std::wstring& pattern, const SkipTable& skipTable)
+{
+  size_t length = pattern.length();
+  if (length == 0)
+  {
+    return true;
+  }
+  size_t last = length - 1;
+  for (size_t pos = 0; pos + length <= text.length(); pos += skipTable[text[pos + last] & 0xFF])
+  {
+    size_t i = last;
+    while (text[pos + i] == pattern[i])
+    {
+      if (i == 0)
+      {
+        return true;
+      }
+      i--;
+    }
+  }
+  return false;
+}
+
+bool SelectorProgram::Matches(const ElementSnapshot& element) const
+{
+  return MatchesFrom(0, element);
+}
+
+bool SelectorProgram::MatchesFrom(size_t compoundIndex, const ElementSnapshot& element) const
+{
+  const Compound& compound = m_compounds[compoundIndex];
+  if (!MatchesCompound(compound, element))
+  {
+    return false;
+  }
+
+  size_t next = compoundIndex + 1;
+  switch (compound.combinator)
+  {
+  case COMBINATOR_CHILD:
+    {
+      const ElementSnapshot* parent = element.GetParentSnapshot();
+      return parent && MatchesFrom(next, *parent);
+    }
+  case COMBINATOR_ADJACENT_SIBLING:
+    {
+      const ElementSnapshot* sibling = element.GetPreviousSiblingSnapshot();
+      return sibling && MatchesFrom(next, *sibling);
+    }
+  case COMBINATOR_DESCENDANT:
+    for (const ElementSnapshot* ancestor = element.GetParentSnapshot(); ancestor; ancestor = ancestor->GetParentSnapshot())
+    {
+      if (MatchesFromMemoized(next, *ancestor))
+        return true;
+    }
+    return false;
+  case COMBINATOR_GENERAL_SIBLING:
+    for (const ElementSnapshot* sibling = element.GetPreviousSiblingSnapshot(); sibling; sibling = sibling->GetPreviousSiblingSnapshot())
+    {
+      if (MatchesFromMemoized(next, *sibling))
+        return true;
+    }
+    return false;
+  default:
+    return true;
+  }
+}
+
+bool SelectorProgram::MatchesFromMemoized(size_t compoundIndex, const ElementSnapshot& element) const
+{
+  // Without memoization a selector like ".a .b .c" visits the ancestors
+  // of the element once for every ancestor matching ".b".
+  if (!m_compounds[compoundIndex].isMemoized)
+  {
+    return MatchesFrom(compoundIndex, element);
+  }
+  const void* key = &m_compounds[compoundIndex];
+  bool result;
+  if (!element.FindMemo(key, result))
+  {
+    result = MatchesFrom(compoundIndex, element);
+    element.SetMemo(key, result);
+  }
+  return result;
+}
+
+bool SelectorProgram::MatchesCompound(const Compound& compound, const ElementSnapshot& element) const
+{
+  auto end = m_code.begin() + compound.firstTest + compound.testCount;
+  for (auto it = m_code.begin() + compound.firstTest; it != end; ++it)
+  {
+    switch (it->op)
+    {
+    case OP_TAG:
+      if (element.GetLowerTagName() != m_literals[it->literal])
+        return false;
+      break;
+    case OP_ID:
+      {
+        const std::wstring* id = element.FindId();
+        if (!id || *id != m_literals[it->literal])
+          return false;
+      }
+      break;
+    case OP_CLASS:
+      if (!element.HasClass(m_literals[it->literal]))
+        return false;
+      break;
+    default:
+      {
+        const std::wstring* value = FetchValue(element, *it);
+        if (!value)
+          return false;
+        const std::wstring& literal = m_literals[it->literal];
+        switch (it->op)
+        {
+        case OP_EQUALS:
+          if (*value != literal)
+            return false;
+          break;
+        case OP_STARTS_WITH:
+          if (value->compare(0, literal.length(), literal) != 0)
+            return false;
+          break;
+        case OP_ENDS_WITH:
+          if (value->length() < literal.length() ||
+              value->compare(value->length() - literal.length(), literal.length(), literal) != 0)
+            return false;
+          break;
+        case OP_CONTAINS:
+          if (!Contains(*value, literal, m_skipTables[it->skipTable]))
+            return false;
+          break;
+        default:
+          break;
+        }
+      }
+      break;
+    }
+  }
+
+  for (uint32_t i = 0; i < compound.negationCount; i++)
+  {
+    if (MatchesCompound(m_negations[compound.firstNegation + i], element))
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SELECTOR_PROGRAM_H
+#define SELECTOR_PROGRAM_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CFilterElementHide;
+class ElementSnapshot;
+
+/// An element hiding selector compiled into flat lists of tests.
+///
+/// The compounds are tested right to left, starting with the element itself
+/// and moving to its parents or previous siblings for each combinator.
+/// Results for descendant and general sibling combinators are memoized in the
+/// `ElementSnapshot`s, so no element is tested twice for the same compound.
+/// Within a compound the cheapest tests, the ones most likely to reject,
+/// come first. Literals are lower cased at compile time where the comparison
+/// is case insensitive, `*=` tests use precomputed Boyer-Moore-Horspool
+/// tables.
+class SelectorProgram
+{
+public:
+  explicit SelectorProgram(const CFilterElementHide& selector);
+
+  bool Matches(const ElementSnapshot& element) const;
+
+  size_t GetInstructionCount() const
+  {
+    return m_code.size();
+  }
+
+private:
+  enum OpCode
+  {
+    OP_TAG,
+    OP_ID,
+    OP_CLASS,
+    OP_PRESENT,
+    OP_EQUALS,
+    OP_STARTS_WITH,
+    OP_ENDS_WITH,
+    OP_CONTAINS
+  };
+
+  enum Combinator
+  {
+    COMBINATOR_NONE,
+    COMBINATOR_CHILD,
+    COMBINATOR_DESCENDANT,
+    COMBINATOR_ADJACENT_SIBLING,
+    COMBINATOR_GENERAL_SIBLING
+  };
+
+  enum Source
+  {
+    SOURCE_NONE,
+    SOURCE_ID,
+    SOURCE_CLASS_NAME,
+    SOURCE_STYLE,
+    SOURCE_ATTRIBUTE
+  };
+
+  struct Instruction
+  {
+    OpCode op;
+    Source source;
+    uint32_t literal;
+    // Literal index of the attribute name for SOURCE_ATTRIBUTE
+    uint32_t name;
+    // For OP_CONTAINS
+    uint32_t skipTable;
+    // Estimated cost, only used while compiling
+    int cost;
+  };
+
+  struct Compound
+  {
+    uint32_t firstTest;
+    uint32_t testCount;
+    // Into m_negations, compounds from :not()
+    uint32_t firstNegation;
+    uint32_t negationCount;
+    // Between this compound and the next one to the left
+    Combinator combinator;
+    // Whether the compound can be tested repeatedly on the same element.
+    // That needs a descendant or general sibling combinator further right
+    // than the one leading to it.
+    bool isMemoized;
+  };
+
+  // Shifts are capped, a smaller shift is always safe
+  typedef std::array<uint8_t, 256> SkipTable;
+
+  Compound CompileCompound(const CFilterElementHide& compound);
+  void CompileTests(const CFilterElementHide& compound);
+  bool MatchesCompound(const Compound& compound, const ElementSnapshot& element) const;
+  bool MatchesFrom(size_t compoundIndex, const ElementSnapshot& element) const;
+  bool MatchesFromMemoized(size_t compoundIndex, const ElementSnapshot& element) const;
+  uint32_t AddLiteral(const std::wstring& literal);
+  const std::wstring* FetchValue(const ElementSnapshot& element, const Instruction& instruction) const;
+  static bool Contains(const std::wstring& text, const std::wstring& pattern, const SkipTable& skipTable);
+
+  // Right to left
+  std::vector<Compound> m_compounds;
+  std::vector<Compound> m_negations;
+  std::vector<Instruction> m_code;
+  std::vector<std::wstring> m_literals;
+  std::vector<SkipTable> m_skipTables;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StylesheetBuilder.h"
+
+namespace
+{
+  const wchar_t* const ruleSeparator = L", ";
+  const wchar_t* const ruleDeclaration = L" { display: none !important; }";
+}
+
+StylesheetBuilder::StylesheetBuilder(size_t maxSelectors, size_t maxLength)
+  : m_maxSelectors(maxSelectors > 0 ? maxSelectors : 1), m_maxLength(maxLength)
+{
+}
+
+std::wstring StylesheetBuilder::CreateRule(const SelectorList& selectors, SelectorIterator begin, SelectorIterator end)
+{
+  std::wstring rule;
+  std::wstring buffer;
+  for (SelectorIterator it = begin; it != end; ++it)
+  {
+    if (it != begin)
+    {
+      rule += ruleSeparator;
+    }
+    rule += selectors.Get(*it, buffer);
+  }
+  rule += ruleDeclaration;
+  return rule;
+}
+
+bool StylesheetBuilder::IsRejected(const std::wstring& selector) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_rejected.find(selector) != m_rejected.end();
+}
+
+uint64_t StylesheetBuilder::GetRejectedCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_rejected.size();
+}
+
+void StylesheetBuilder::GroupSelectors(const SelectorList& selectors, std::vector<size_t>& accepted,
+  std::vector<size_t>& groupEnds, Stats& stats) const
+{
+  size_t count = selectors.GetSize();
+  accepted.reserve(count);
+  size_t separatorLength = std::wstring(ruleSeparator).length();
+  size_t groupBegin = 0;
+  size_t groupLength = 0;
+  std::wstring buffer;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < count; i++)
+  {
+    const std::wstring& selector = selectors.Get(i, buffer);
+    if (selector.empty())
+    {
+      continue;
+    }
+    if (m_rejected.find(selector) != m_rejected.end())
+    {
+      stats.skippedSelectors++;
+      continue;
+    }
+
+    // Every group gets as many selectors as fit, but at least one
+    size_t groupSize = accepted.size() - groupBegin;
+    size_t length = selector.length() + (groupSize > 0 ? separatorLength : 0);
+    if (groupSize > 0 && (groupSize >= m_maxSelectors || groupLength + length > m_maxLength))
+    {
+      groupEnds.push_back(accepted.size());
+      groupBegin = accepted.size();
+      length = selector.length();
+      groupLength = 0;
+    }
+    groupLength += length;
+    accepted.push_back(i);
+  }
+  if (groupBegin < accepted.size())
+  {
+    groupEnds.push_back(accepted.size());
+  }
+}
+
+StylesheetBuilder::Stats StylesheetBuilder::Insert(const SelectorList& selectors, const InsertRule& insertRule)
+{
+  Stats stats;
+  std::vector<size_t> accepted;
+  std::vector<size_t> groupEnds;
+  GroupSelectors(selectors, accepted, groupEnds, stats);
+  size_t groupBegin = 0;
+  for (auto it = groupEnds.begin(); it != groupEnds.end(); ++it)
+  {
+    InsertGroup(selectors, &accepted[0] + groupBegin, &accepted[0] + *it, insertRule, stats);
+    groupBegin = *it;
+  }
+  return stats;
+}
+
+std::shared_ptr<const StylesheetBuilder::Stylesheet> StylesheetBuilder::CreateStylesheet(const SelectorList& selectors) const
+{
+  std::shared_ptr<Stylesheet> stylesheet = std::make_shared<Stylesheet>();
+  // Read first, a selector rejected in the meantime makes the stylesheet outdated
+  stylesheet->rejectedCount = GetRejectedCount();
+
+  Stats stats;
+  std::vector<size_t> accepted;
+  std::vector<size_t> groupEnds;
+  GroupSelectors(selectors, accepted, groupEnds, stats);
+  size_t groupBegin = 0;
+  for (auto it = groupEnds.begin(); it != groupEnds.end(); ++it)
+  {
+    stylesheet->text += CreateRule(selectors, &accepted[0] + groupBegin, &accepted[0] + *it);
+    stylesheet->text += L'\n';
+    groupBegin = *it;
+  }
+  stylesheet->ruleCount = groupEnds.size();
+  return stylesheet;
+}
+
+void StylesheetBuilder::InsertGroup(const SelectorList& selectors, SelectorIterator begin, SelectorIterator end,
+  const InsertRule& insertRule, Stats& stats)
+{
+  stats.insertCalls++;
+  if (insertRule(CreateRule(selectors, begin, end)))
+  {
+    stats.rules++;
+    return;
+  }
+  if (end - begin == 1)
+  {
+    std::wstring buffer;
+    const std::wstring& selector = selectors.Get(*begin, buffer);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rejected.insert(selector);
+    stats.rejectedSelectors++;
+    return;
+  }
+  SelectorIterator middle = begin + (end - begin) / 2;
+  InsertGroup(selectors, begin, middle, insertRule, stats);
+  InsertGroup(selectors, middle, end, insertRule, stats);
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STYLESHEET_BUILDER_H
+#define STYLESHEET_BUILDER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+/// Turns element hiding selectors into as few stylesheet rules as possible.
+///
+/// Selectors are joined into rules like `a, b, c { display: none !important; }`
+/// of at most `maxSelectors` selectors and `maxLength` characters. A browser
+/// drops the whole rule if it doesn't support one of its selectors, so a
+/// rejected rule is split in halves until the rejected selectors are
+/// isolated. Those are remembered and left out of the rules for later
+/// documents. Thread-safe, one instance is meant to be shared by all tabs.
+///
+/// `CreateStylesheet` produces the same rules as a single text, so that they
+/// can be created once and assigned in one go.
+class StylesheetBuilder
+{
+public:
+  /// Inserts a rule into the stylesheet, returns false if it was rejected.
+  typedef std::function<bool(const std::wstring& rule)> InsertRule;
+
+  /// The selectors to create rules from. They are read by position, so that
+  /// they don't have to be copied out of e.g. a mapped `ElementHideBlob`.
+  class SelectorList
+  {
+  public:
+    virtual ~SelectorList()
+    {
+    }
+    virtual size_t GetSize() const = 0;
+    /// Returns the selector, either stored in `buffer` or in the list itself.
+    virtual const std::wstring& Get(size_t index, std::wstring& buffer) const = 0;
+  };
+
+  /// Reads the selectors from a vector, which has to outlive it.
+  class SelectorVector : public SelectorList
+  {
+  public:
+    explicit SelectorVector(const std::vector<std::wstring>& selectors)
+      : m_selectors(selectors)
+    {
+    }
+    size_t GetSize() const
+    {
+      return m_selectors.size();
+    }
+    const std::wstring& Get(size_t index, std::wstring&) const
+    {
+      return m_selectors[index];
+    }
+
+  private:
+    const std::vector<std::wstring>& m_selectors;
+
+    SelectorVector(const SelectorVector&);
+    void operator=(const SelectorVector&);
+  };
+
+  struct Stats
+  {
+    Stats()
+      : rules(0), insertCalls(0), rejectedSelectors(0), skippedSelectors(0)
+    {
+    }
+    // Rules which have been inserted
+    size_t rules;
+    // Including the rejected ones
+    size_t insertCalls;
+    // Newly found to be rejected
+    size_t rejectedSelectors;
+    // Left out because they were rejected for an earlier document
+    size_t skippedSelectors;
+  };
+
+  struct Stylesheet
+  {
+    Stylesheet() : ruleCount(0), rejectedCount(0)
+    {
+    }
+    // The rules, separated by line breaks
+    std::wstring text;
+    size_t ruleCount;
+    // GetRejectedCount() when the stylesheet was created, it is outdated
+    // once more selectors have been rejected
+    uint64_t rejectedCount;
+  };
+
+  StylesheetBuilder(size_t maxSelectors, size_t maxLength);
+
+  Stats Insert(const SelectorList& selectors, const InsertRule& insertRule);
+  Stats Insert(const std::vector<std::wstring>& selectors, const InsertRule& insertRule)
+  {
+    return Insert(SelectorVector(selectors), insertRule);
+  }
+  std::shared_ptr<const Stylesheet> CreateStylesheet(const SelectorList& selectors) const;
+  std::shared_ptr<const Stylesheet> CreateStylesheet(const std::vector<std::wstring>& selectors) const
+  {
+    return CreateStylesheet(SelectorVector(selectors));
+  }
+
+  bool IsRejected(const std::wstring& selector) const;
+  uint64_t GetRejectedCount() const;
+
+private:
+  // Positions in the SelectorList
+  typedef const size_t* SelectorIterator;
+
+  // Leaves out the rejected selectors and splits the rest into groups, the
+  // end of each group is added to groupEnds
+  void GroupSelectors(const SelectorList& selectors, std::vector<size_t>& accepted,
+    std::vector<size_t>& groupEnds, Stats& stats) const;
+  static std::wstring CreateRule(const SelectorList& selectors, SelectorIterator begin, SelectorIterator end);
+  void InsertGroup(const SelectorList& selectors, SelectorIterator begin, SelectorIterator end,
+    const InsertRule& insertRule, Stats& stats);
+
+  size_t m_maxSelectors;
+  size_t m_maxLength;
+  mutable std::mutex m_mutex;
+  std::set<std::wstring> m_rejected;
+
+  StylesheetBuilder(const StylesheetBuilder&);
+  void operator=(const StylesheetBuilder&);
+};
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SyntheticResponse.h"
+
+namespace
+{
+  // GIF89a, 1x1, a palette of two colors of which the first one is transparent
+  const char transparentGif[] =
+    "GIF89a\x01\x00\x01\x00\x80\x00\x00"
+    "\x00\x00\x00\xFF\xFF\xFF"
+    "\x21\xF9\x04\x01\x00\x00\x00\x00"
+    "\x2C\x00\x00\x00\x00\x01\x00\x01\x00\x00"
+    "\x02\x02\x44\x01\x00"
+    "\x3B";
+
+  const char blockedScript[] = "/* blocked by AdblockPlus */";
+  const char blockedStylesheet[] = "/* blocked by AdblockPlus */";
+  const char blockedDocument[] = "<!DOCTYPE html>"
+    "<html>"
+        "<body>"
+          "<!-- blocked by AdblockPlus -->"
+        "</body>"
+    "</html>";
+
+  // The size doesn't include the terminating null of the literal
+  const SyntheticResponse imageResponse = {L"image/gif", transparentGif, sizeof(transparentGif) - 1};
+  const SyntheticResponse scriptResponse = {L"application/javascript", blockedScript, sizeof(blockedScript) - 1};
+  const SyntheticResponse stylesheetResponse = {L"text/css", blockedStylesheet, sizeof(blockedStylesheet) - 1};
+  const SyntheticResponse documentResponse = {L"text/html", blockedDocument, sizeof(blockedDocument) - 1};
+}
+
+const SyntheticResponse& GetSyntheticResponse(RequestContentType type)
+{
+  switch (type)
+  {
+  case REQUEST_TYPE_IMAGE:
+    return imageResponse;
+  case REQUEST_TYPE_SCRIPT:
+    return scriptResponse;
+  case REQUEST_TYPE_STYLESHEET:
+    return stylesheetResponse;
+  default:
+    return documentResponse;
+  }
+}
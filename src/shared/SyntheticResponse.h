@@ -0,0 +1,37 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNTHETIC_RESPONSE_H
+#define SYNTHETIC_RESPONSE_H
+
+#include "ContentTypeClassifier.h"
+
+/// Served instead of a blocked resource, so that the page gets a valid but
+/// empty resource of the type it expects and neither parses HTML as an
+/// image or script nor runs its error handlers.
+struct SyntheticResponse
+{
+  const wchar_t* mimeType;
+  const char* body;
+  unsigned long size;
+};
+
+/// Images get a transparent 1x1 GIF, scripts and stylesheets a comment.
+/// Documents and all other types get an empty HTML document.
+const SyntheticResponse& GetSyntheticResponse(RequestContentType type);
+
+#endif
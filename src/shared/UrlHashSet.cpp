@@ -0,0 +1,125 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "UrlHashSet.h"
+
+UrlHashSet::UrlHashSet(size_t capacity)
+  : m_limit(capacity / 2 > 0 ? capacity / 2 : 1), m_slotCount(2), m_current(0)
+{
+  while (m_slotCount < m_limit * 2)
+  {
+    m_slotCount *= 2;
+  }
+  for (int i = 0; i < 2; i++)
+  {
+    m_tables[i].slots.reset(new std::atomic<uint64_t>[m_slotCount]);
+    Reset(m_tables[i]);
+  }
+}
+
+void UrlHashSet::Insert(const std::wstring& url)
+{
+  uint64_t hash = Hash(url);
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  unsigned current = m_current.load(std::memory_order_relaxed);
+  // URLs only found in the older table are inserted again, so that frequently
+  // used ones aren't dropped
+  if (Contains(m_tables[current], hash))
+  {
+    return;
+  }
+  if (m_tables[current].size.load(std::memory_order_relaxed) >= m_limit)
+  {
+    // Drop the older half of the entries
+    current ^= 1;
+    Reset(m_tables[current]);
+    m_current.store(current, std::memory_order_release);
+  }
+  Insert(m_tables[current], hash);
+}
+
+bool UrlHashSet::Contains(const std::wstring& url) const
+{
+  uint64_t hash = Hash(url);
+  unsigned current = m_current.load(std::memory_order_acquire);
+  return Contains(m_tables[current], hash) || Contains(m_tables[current ^ 1], hash);
+}
+
+void UrlHashSet::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  Reset(m_tables[0]);
+  Reset(m_tables[1]);
+}
+
+size_t UrlHashSet::GetSize() const
+{
+  return m_tables[0].size.load(std::memory_order_relaxed) + m_tables[1].size.load(std::memory_order_relaxed);
+}
+
+uint64_t UrlHashSet::Hash(const std::wstring& url)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < url.length(); i++)
+  {
+    uint16_t unit = static_cast<uint16_t>(url[i]);
+    hash = (hash ^ (unit & 0xFF)) * 1099511628211ULL;
+    hash = (hash ^ (unit >> 8)) * 1099511628211ULL;
+  }
+  // 0 marks empty slots
+  return hash ? hash : 1;
+}
+
+bool UrlHashSet::Contains(const Table& table, uint64_t hash) const
+{
+  size_t mask = m_slotCount - 1;
+  // The load factor is at most 1/2, so there always is an empty slot
+  for (size_t slot = static_cast<size_t>(hash) & mask, probes = 0; probes < m_slotCount; slot = (slot + 1) & mask, probes++)
+  {
+    uint64_t value = table.slots[slot].load(std::memory_order_acquire);
+    if (value == hash)
+    {
+      return true;
+    }
+    if (value == 0)
+    {
+      return false;
+    }
+  }
+  return false;
+}
+
+void UrlHashSet::Insert(Table& table, uint64_t hash)
+{
+  size_t mask = m_slotCount - 1;
+  size_t slot = static_cast<size_t>(hash) & mask;
+  while (table.slots[slot].load(std::memory_order_relaxed) != 0)
+  {
+    slot = (slot + 1) & mask;
+  }
+  table.slots[slot].store(hash, std::memory_order_release);
+  table.size.store(table.size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void UrlHashSet::Reset(Table& table)
+{
+  for (size_t i = 0; i < m_slotCount; i++)
+  {
+    table.slots[i].store(0, std::memory_order_relaxed);
+  }
+  table.size.store(0, std::memory_order_release);
+}
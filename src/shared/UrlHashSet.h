@@ -0,0 +1,82 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef URL_HASH_SET_H
+#define URL_HASH_SET_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/// Set of URLs with a bounded number of entries, storing only a 64-bit hash
+/// of each URL. Two URLs with the same hash are indistinguishable, which is
+/// acceptable for caches.
+///
+/// `Contains` doesn't lock and can be called from any thread while another
+/// one calls `Insert` or `Clear`, writers are serialized by a mutex.
+///
+/// The entries are kept in two open addressing tables with a load factor of
+/// at most 1/2, new URLs are inserted into the current one. When it is full
+/// the other table, holding the older half of the URLs, is emptied and
+/// becomes the current one. So at most `capacity` URLs are kept and the ones
+/// inserted least recently are dropped first. A URL being dropped can be
+/// missed by a concurrent `Contains` slightly before it is gone.
+class UrlHashSet
+{
+public:
+  explicit UrlHashSet(size_t capacity);
+
+  void Insert(const std::wstring& url);
+  bool Contains(const std::wstring& url) const;
+  void Clear();
+
+  /// Number of URLs, exact only if there are no concurrent writers.
+  size_t GetSize() const;
+  size_t GetCapacity() const
+  {
+    return m_limit * 2;
+  }
+
+  /// 64-bit FNV-1a of the UTF-16 code units of `url`, never 0.
+  static uint64_t Hash(const std::wstring& url);
+
+private:
+  struct Table
+  {
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    std::atomic<size_t> size;
+  };
+
+  bool Contains(const Table& table, uint64_t hash) const;
+  void Insert(Table& table, uint64_t hash);
+  void Reset(Table& table);
+
+  // Entries per table
+  size_t m_limit;
+  // Slots per table, a power of two
+  size_t m_slotCount;
+  Table m_tables[2];
+  std::atomic<unsigned> m_current;
+  std::mutex m_writeMutex;
+
+  UrlHashSet(const UrlHashSet&);
+  void operator=(const UrlHashSet&);
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <thread>
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(size_t maxThreads, size_t maxQueueSize, int idleTimeoutMsec)
+  : m_maxThreads(maxThreads > 0 ? maxThreads : 1),
+    m_maxQueueSize(maxQueueSize > 0 ? maxQueueSize : 1),
+    m_idleTimeoutMsec(idleTimeoutMsec),
+    m_idleThreads(0),
+    m_isStopping(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+  std::deque<QueuedTask> dropped;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_isStopping = true;
+    dropped.swap(m_queue);
+    m_stats.dropped += dropped.size();
+    m_taskPosted.notify_all();
+    m_threadExited.wait(lock, [this]() { return m_stats.threads == 0; });
+  }
+  // The dropped tasks are destroyed here, outside of the lock
+}
+
+void WorkerPool::Post(const Task& task, const CancellationTokenPtr& token)
+{
+  QueuedTask queuedTask;
+  queuedTask.task = task;
+  queuedTask.token = token;
+
+  QueuedTask dropped;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_isStopping)
+  {
+    m_stats.dropped++;
+    return;
+  }
+  if (m_queue.size() >= m_maxQueueSize)
+  {
+    dropped = m_queue.front();
+    m_queue.pop_front();
+    m_stats.dropped++;
+  }
+  m_queue.push_back(queuedTask);
+
+  if (m_idleThreads < m_queue.size() && m_stats.threads < m_maxThreads)
+  {
+    try
+    {
+      std::thread([this]() { ThreadProc(); }).detach();
+      m_stats.threads++;
+    }
+    catch (const std::system_error&)
+    {
+      if (m_stats.threads == 0)
+      {
+        // Nobody would ever run the task
+        m_queue.pop_back();
+        throw;
+      }
+    }
+  }
+  m_taskPosted.notify_one();
+}
+
+WorkerPool::Stats WorkerPool::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Stats stats = m_stats;
+  stats.queued = m_queue.size();
+  return stats;
+}
+
+void WorkerPool::ThreadProc()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    m_idleThreads++;
+    m_taskPosted.wait_for(lock, std::chrono::milliseconds(m_idleTimeoutMsec),
+      [this]() { return m_isStopping || !m_queue.empty(); });
+    m_idleThreads--;
+    if (m_queue.empty())
+    {
+      // Either idle for too long or the pool is being destroyed
+      break;
+    }
+
+    QueuedTask queuedTask = m_queue.front();
+    m_queue.pop_front();
+    if (queuedTask.token && queuedTask.token->IsCancelled())
+    {
+      m_stats.cancelled++;
+      lock.unlock();
+      queuedTask = QueuedTask();
+      lock.lock();
+      continue;
+    }
+
+    m_stats.running++;
+    lock.unlock();
+    try
+    {
+      queuedTask.task();
+    }
+    catch (...)
+    {
+      // As a thread-main function, we truncate any C++ exception.
+    }
+    // Release whatever the task holds before taking the lock again
+    queuedTask = QueuedTask();
+    lock.lock();
+    m_stats.running--;
+    m_stats.completed++;
+  }
+  m_stats.threads--;
+  m_threadExited.notify_all();
+}
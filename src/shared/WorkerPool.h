@@ -0,0 +1,112 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/// Flag shared between the poster of a task and the task itself.
+class CancellationToken
+{
+public:
+  CancellationToken() : m_isCancelled(false) {}
+  void Cancel()
+  {
+    m_isCancelled = true;
+  }
+  bool IsCancelled() const
+  {
+    return m_isCancelled;
+  }
+private:
+  CancellationToken(const CancellationToken&);
+  void operator=(const CancellationToken&);
+  std::atomic<bool> m_isCancelled;
+};
+
+typedef std::shared_ptr<CancellationToken> CancellationTokenPtr;
+
+/// Pool of at most `maxThreads` worker threads.
+///
+/// Threads are started on demand and exit after being idle for
+/// `idleTimeoutMsec`. A task whose token is cancelled before it has been
+/// started is dropped, a running task has to check its token itself. If the
+/// queue is full the oldest queued task is dropped, because it's the one
+/// which is most likely superseded. Dropped tasks are destroyed without being
+/// called, so anything they hold (e.g. `EventWithSetter::Setter`) is released.
+class WorkerPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  struct Stats
+  {
+    Stats()
+      : queued(0), running(0), threads(0), completed(0), cancelled(0), dropped(0)
+    {
+    }
+    size_t queued;
+    size_t running;
+    size_t threads;
+    uint64_t completed;
+    uint64_t cancelled;
+    uint64_t dropped;
+  };
+
+  WorkerPool(size_t maxThreads, size_t maxQueueSize, int idleTimeoutMsec = 30000);
+
+  /// Drops all queued tasks and waits for the running ones to finish.
+  ~WorkerPool();
+
+  /// Throws std::system_error if no worker thread can be started.
+  void Post(const Task& task, const CancellationTokenPtr& token = CancellationTokenPtr());
+
+  Stats GetStats() const;
+
+private:
+  WorkerPool(const WorkerPool&);
+  void operator=(const WorkerPool&);
+
+  struct QueuedTask
+  {
+    Task task;
+    CancellationTokenPtr token;
+  };
+
+  void ThreadProc();
+
+  const size_t m_maxThreads;
+  const size_t m_maxQueueSize;
+  const int m_idleTimeoutMsec;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_taskPosted;
+  std::condition_variable m_threadExited;
+  std::deque<QueuedTask> m_queue;
+  size_t m_idleThreads;
+  bool m_isStopping;
+  Stats m_stats;
+};
+
+#endif
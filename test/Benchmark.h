@@ -0,0 +1,57 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <string>
+#include <gtest/gtest.h>
+
+/// Benchmarks are disabled tests named `DISABLED_...` of a `...Benchmark`
+/// test case, run them with `--gtest_also_run_disabled_tests`. They record
+/// their timings as test properties, see `--gtest_output=xml`.
+namespace Benchmark
+{
+  class Timer
+  {
+  public:
+    Timer()
+      : m_start(std::chrono::high_resolution_clock::now())
+    {
+    }
+
+    /// Returns the time since the construction or the last call.
+    double Lap()
+    {
+      std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+      double milliseconds = std::chrono::duration<double, std::milli>(now - m_start).count();
+      m_start = now;
+      return milliseconds;
+    }
+
+  private:
+    std::chrono::high_resolution_clock::time_point m_start;
+  };
+
+  inline void RecordMilliseconds(const std::string& name, double milliseconds)
+  {
+    ::testing::Test::RecordProperty(name + "Ms", std::to_string(static_cast<long double>(milliseconds)));
+  }
+}
+
+#endif
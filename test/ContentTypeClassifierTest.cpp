@@ -0,0 +1,415 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <locale>
+#include <string>
+#include <vector>
+
+#include "../src/shared/ContentTypeClassifier.h"
+#include "Benchmark.h"
+
+namespace
+{
+  // The heuristics of WBPassthruSink before ContentTypeClassifier, the
+  // classifier has to give the same results.
+  namespace Previous
+  {
+    std::wstring ASCIIStringToLower(const std::wstring& text)
+    {
+      std::wstring textlower;
+      std::transform(text.begin(), text.end(), std::back_inserter(textlower),
+        [](wchar_t ch)
+        {
+          return std::tolower(ch, std::locale());
+        }
+      );
+      return textlower;
+    }
+
+    RequestContentType GetContentTypeFromString(const std::wstring& value)
+    {
+      auto lastDotPos = value.rfind(L'.');
+      if (lastDotPos == std::wstring::npos)
+        return REQUEST_TYPE_OTHER;
+
+      std::wstring ext = ASCIIStringToLower(value.substr(lastDotPos + 1));
+      if (ext == L"jpg" || ext == L"gif" || ext == L"png" || ext == L"jpeg")
+      {
+        return REQUEST_TYPE_IMAGE;
+      }
+      else if (ext == L"css")
+      {
+        return REQUEST_TYPE_STYLESHEET;
+      }
+      else if (ext == L"js")
+      {
+        return REQUEST_TYPE_SCRIPT;
+      }
+      else if (ext == L"xml")
+      {
+        return REQUEST_TYPE_XMLHTTPREQUEST;
+      }
+      else if (ext == L"swf")
+      {
+        return REQUEST_TYPE_OBJECT;
+      }
+      else if (ext == L"jsp" || ext == L"php" || ext == L"html")
+      {
+        return REQUEST_TYPE_SUBDOCUMENT;
+      }
+      return REQUEST_TYPE_OTHER;
+    }
+
+    RequestContentType InferContentTypeFromMediaTypeList(const std::wstring& mediaTypeList)
+    {
+      if ((mediaTypeList.find(L"text/html") != std::wstring::npos) ||
+        (mediaTypeList.find(L"application/xhtml+xml") != std::wstring::npos))
+      {
+        return REQUEST_TYPE_SUBDOCUMENT;
+      }
+      if (mediaTypeList.find(L"image/") != std::wstring::npos)
+      {
+        return REQUEST_TYPE_IMAGE;
+      }
+      if (mediaTypeList.find(L"text/css") != std::wstring::npos)
+      {
+        return REQUEST_TYPE_STYLESHEET;
+      }
+      if ((mediaTypeList.find(L"application/javascript") != std::wstring::npos) || (mediaTypeList.find(L"application/json") != std::wstring::npos))
+      {
+        return REQUEST_TYPE_SCRIPT;
+      }
+      if (mediaTypeList.find(L"application/x-shockwave-flash") != std::wstring::npos)
+      {
+        return REQUEST_TYPE_OBJECT;
+      }
+      if (mediaTypeList.find(L"xml") != std::wstring::npos)
+      {
+        return REQUEST_TYPE_XMLHTTPREQUEST;
+      }
+      return REQUEST_TYPE_OTHER;
+    }
+
+    // GetSchemeAndHierarchicalPart, GetQueryString and wcstok_s
+    RequestContentType InferContentTypeFromUrl(const std::wstring& src, bool isIE8)
+    {
+      auto pathEndsAt = src.find(L'?');
+      if (pathEndsAt == std::wstring::npos)
+      {
+        pathEndsAt = src.find(L'#');
+      }
+      auto contentType = GetContentTypeFromString(src.substr(0, pathEndsAt));
+      if (contentType == REQUEST_TYPE_OTHER && isIE8)
+      {
+        auto questionSignPos = src.find(L'?');
+        if (questionSignPos == std::wstring::npos)
+        {
+          return contentType;
+        }
+        auto queryEndsAt = src.find(L'#', questionSignPos + 1);
+        std::wstring queryString = src.substr(questionSignPos + 1,
+          queryEndsAt == std::wstring::npos ? std::wstring::npos : queryEndsAt - questionSignPos - 1);
+        size_t tokenBegin = queryString.find_first_not_of(L"&=");
+        while (tokenBegin != std::wstring::npos)
+        {
+          size_t tokenEnd = queryString.find_first_of(L"&=", tokenBegin);
+          contentType = GetContentTypeFromString(queryString.substr(tokenBegin,
+            tokenEnd == std::wstring::npos ? std::wstring::npos : tokenEnd - tokenBegin));
+          if (contentType != REQUEST_TYPE_OTHER)
+          {
+            return contentType;
+          }
+          tokenBegin = tokenEnd == std::wstring::npos ? tokenEnd : queryString.find_first_not_of(L"&=", tokenEnd);
+        }
+      }
+      return contentType;
+    }
+  }
+
+  RequestContentType ClassifyFileName(const std::wstring& name)
+  {
+    return ::ClassifyFileName(name.data(), name.data() + name.length());
+  }
+
+  RequestContentType ClassifyMediaTypeList(const std::wstring& list)
+  {
+    return ::ClassifyMediaTypeList(list.data(), list.data() + list.length());
+  }
+
+  RequestContentType ClassifyUrl(const std::wstring& url, bool searchQueryString)
+  {
+    return ::ClassifyUrl(url.data(), url.data() + url.length(), searchQueryString);
+  }
+
+  struct MediaTypeCase
+  {
+    const wchar_t* list;
+    RequestContentType type;
+  };
+
+  // Accept headers sent by IE 8 to 11 and the corner cases of the heuristic
+  const MediaTypeCase mediaTypeCases[] =
+  {
+    {L"text/html, application/xhtml+xml, image/jxr, */*", REQUEST_TYPE_SUBDOCUMENT},
+    {L"text/html, application/xhtml+xml, */*", REQUEST_TYPE_SUBDOCUMENT},
+    {L"image/gif, image/jpeg, image/pjpeg, application/x-ms-application, application/xaml+xml, */*", REQUEST_TYPE_IMAGE},
+    {L"image/png, image/svg+xml, image/jxr, image/*;q=0.8, */*;q=0.5", REQUEST_TYPE_IMAGE},
+    {L"image/png, image/svg+xml, image/*;q=0.8, */*;q=0.5", REQUEST_TYPE_IMAGE},
+    {L"text/css, */*", REQUEST_TYPE_STYLESHEET},
+    {L"text/css", REQUEST_TYPE_STYLESHEET},
+    {L"application/javascript, */*;q=0.8", REQUEST_TYPE_SCRIPT},
+    {L"application/json, text/javascript, */*; q=0.01", REQUEST_TYPE_SCRIPT},
+    {L"application/x-shockwave-flash, */*", REQUEST_TYPE_OBJECT},
+    {L"application/xml, text/xml, */*", REQUEST_TYPE_XMLHTTPREQUEST},
+    {L"text/plain, */*", REQUEST_TYPE_OTHER},
+    {L"*/*", REQUEST_TYPE_OTHER},
+    {L"", REQUEST_TYPE_OTHER},
+    // The patterns are found anywhere, in any media type
+    {L"*/*, image/svg+xml, text/html", REQUEST_TYPE_SUBDOCUMENT},
+    {L"foo/bartext/html", REQUEST_TYPE_SUBDOCUMENT},
+    {L"xtext/htmlx", REQUEST_TYPE_SUBDOCUMENT},
+    {L"myimage/x", REQUEST_TYPE_IMAGE},
+    {L"image/", REQUEST_TYPE_IMAGE},
+    {L"image", REQUEST_TYPE_OTHER},
+    {L"text/html;level=1", REQUEST_TYPE_SUBDOCUMENT},
+    {L"application/jsonp", REQUEST_TYPE_SCRIPT},
+    {L"application/x-shockwave-flash2", REQUEST_TYPE_OBJECT},
+    {L"text/xml;q=0.9, application/x-shockwave-flash", REQUEST_TYPE_OBJECT},
+    {L"application/xhtml+xml", REQUEST_TYPE_SUBDOCUMENT},
+    {L"application/xhtml", REQUEST_TYPE_OTHER},
+    {L"application/xhtml+xm", REQUEST_TYPE_OTHER},
+    {L"application/xml+xhtml", REQUEST_TYPE_XMLHTTPREQUEST},
+    {L"xml", REQUEST_TYPE_XMLHTTPREQUEST},
+    {L"x ml", REQUEST_TYPE_OTHER},
+    {L"XML, TEXT/HTML, IMAGE/PNG", REQUEST_TYPE_OTHER},
+    {L"text /html", REQUEST_TYPE_OTHER},
+    {L"text/ html", REQUEST_TYPE_OTHER}
+  };
+
+  struct UrlCase
+  {
+    const wchar_t* url;
+    RequestContentType type;
+    // The result for IE8, which also checks the query string
+    RequestContentType ie8Type;
+  };
+
+  const UrlCase urlCases[] =
+  {
+    {L"http://example.com/banner.gif", REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE},
+    {L"http://example.com/BANNER.JPEG", REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE},
+    {L"http://example.com/a.Png?x=1", REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE},
+    {L"http://example.com/style.css#top", REQUEST_TYPE_STYLESHEET, REQUEST_TYPE_STYLESHEET},
+    {L"http://example.com/ads.js?v=2.css", REQUEST_TYPE_SCRIPT, REQUEST_TYPE_SCRIPT},
+    {L"http://example.com/feed.xml", REQUEST_TYPE_XMLHTTPREQUEST, REQUEST_TYPE_XMLHTTPREQUEST},
+    {L"http://example.com/player.swf", REQUEST_TYPE_OBJECT, REQUEST_TYPE_OBJECT},
+    {L"http://example.com/index.jsp", REQUEST_TYPE_SUBDOCUMENT, REQUEST_TYPE_SUBDOCUMENT},
+    {L"http://example.com/index.php", REQUEST_TYPE_SUBDOCUMENT, REQUEST_TYPE_SUBDOCUMENT},
+    {L"http://example.com/index.html", REQUEST_TYPE_SUBDOCUMENT, REQUEST_TYPE_SUBDOCUMENT},
+    {L"http://example.com/index.htm", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/file.", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/a.gif/", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/a.jpgx", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/a.jsonp", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/serve?img=banner.gif", REQUEST_TYPE_OTHER, REQUEST_TYPE_IMAGE},
+    {L"http://example.com/serve?a=1&&b=ad.js&c=x.css", REQUEST_TYPE_OTHER, REQUEST_TYPE_SCRIPT},
+    {L"http://example.com/serve?file.swf=1", REQUEST_TYPE_OTHER, REQUEST_TYPE_OBJECT},
+    {L"http://example.com/serve?x=1#frag.gif", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/serve?x=a.gif#frag", REQUEST_TYPE_OTHER, REQUEST_TYPE_IMAGE},
+    {L"http://example.com/serve?=&=", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/serve?", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    // The path ends at the first '?', a '#' before it is part of it
+    {L"http://example.com/a.gif#x?y", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER},
+    {L"http://example.com/a#b.gif?c", REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE},
+    {L"http://example.com/a.html?q=b.gif", REQUEST_TYPE_SUBDOCUMENT, REQUEST_TYPE_SUBDOCUMENT},
+    {L"", REQUEST_TYPE_OTHER, REQUEST_TYPE_OTHER}
+  };
+
+  std::vector<std::wstring> MediaTypeLists()
+  {
+    std::vector<std::wstring> lists;
+    for (size_t i = 0; i < sizeof(mediaTypeCases) / sizeof(mediaTypeCases[0]); i++)
+    {
+      lists.push_back(mediaTypeCases[i].list);
+    }
+    return lists;
+  }
+}
+
+TEST(ContentTypeClassifierTest, KnownExtensions)
+{
+  const wchar_t* names[] = {L"jpg", L"gif", L"png", L"jpeg", L"css", L"js", L"xml", L"swf", L"jsp", L"php", L"html"};
+  const RequestContentType types[] = {REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE, REQUEST_TYPE_IMAGE,
+    REQUEST_TYPE_STYLESHEET, REQUEST_TYPE_SCRIPT, REQUEST_TYPE_XMLHTTPREQUEST, REQUEST_TYPE_OBJECT,
+    REQUEST_TYPE_SUBDOCUMENT, REQUEST_TYPE_SUBDOCUMENT, REQUEST_TYPE_SUBDOCUMENT};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+  {
+    std::wstring name = names[i];
+    EXPECT_EQ(types[i], ClassifyFileName(L"/a." + name)) << name;
+    std::wstring upper;
+    std::transform(name.begin(), name.end(), std::back_inserter(upper), ::towupper);
+    EXPECT_EQ(types[i], ClassifyFileName(L"/a.b." + upper)) << upper;
+    EXPECT_EQ(REQUEST_TYPE_OTHER, ClassifyFileName(name)) << name;
+    EXPECT_EQ(REQUEST_TYPE_OTHER, ClassifyFileName(L"/a." + name + L"x")) << name;
+    EXPECT_EQ(REQUEST_TYPE_OTHER, ClassifyFileName(L"/a." + name.substr(1))) << name;
+  }
+}
+
+// Every extension of up to four characters, this also covers each slot of
+// the perfect hash table
+TEST(ContentTypeClassifierTest, AllShortExtensionsMatchPrevious)
+{
+  const std::wstring alphabet = L"abcdefghijklmnopqrstuvwxyzGJLMPSX0.";
+  std::wstring name = L"/file.";
+  const size_t prefixLength = name.length();
+  size_t checked = 0;
+  for (size_t length = 0; length <= 4; length++)
+  {
+    std::vector<size_t> digits(length, 0);
+    while (true)
+    {
+      name.resize(prefixLength);
+      for (size_t i = 0; i < length; i++)
+      {
+        name += alphabet[digits[i]];
+      }
+      ASSERT_EQ(Previous::GetContentTypeFromString(name), ClassifyFileName(name)) << name;
+      checked++;
+      size_t i = 0;
+      while (i < length && ++digits[i] == alphabet.length())
+      {
+        digits[i++] = 0;
+      }
+      if (i == length)
+      {
+        break;
+      }
+    }
+  }
+  EXPECT_GT(checked, 1500000u);
+}
+
+TEST(ContentTypeClassifierTest, MediaTypeLists)
+{
+  for (size_t i = 0; i < sizeof(mediaTypeCases) / sizeof(mediaTypeCases[0]); i++)
+  {
+    const MediaTypeCase& testCase = mediaTypeCases[i];
+    EXPECT_EQ(testCase.type, ClassifyMediaTypeList(testCase.list)) << testCase.list;
+    EXPECT_EQ(Previous::InferContentTypeFromMediaTypeList(testCase.list), testCase.type) << testCase.list;
+  }
+}
+
+// Each pair of the lists above, joined by each separator
+TEST(ContentTypeClassifierTest, CombinedMediaTypeListsMatchPrevious)
+{
+  std::vector<std::wstring> lists = MediaTypeLists();
+  const wchar_t* separators[] = {L", ", L";", L",", L" ", L""};
+  for (size_t i = 0; i < lists.size(); i++)
+  {
+    for (size_t j = 0; j < lists.size(); j++)
+    {
+      for (size_t k = 0; k < sizeof(separators) / sizeof(separators[0]); k++)
+      {
+        std::wstring list = lists[i] + separators[k] + lists[j];
+        ASSERT_EQ(Previous::InferContentTypeFromMediaTypeList(list), ClassifyMediaTypeList(list)) << list;
+      }
+    }
+  }
+}
+
+TEST(ContentTypeClassifierTest, Urls)
+{
+  for (size_t i = 0; i < sizeof(urlCases) / sizeof(urlCases[0]); i++)
+  {
+    const UrlCase& testCase = urlCases[i];
+    EXPECT_EQ(testCase.type, ClassifyUrl(testCase.url, false)) << testCase.url;
+    EXPECT_EQ(testCase.ie8Type, ClassifyUrl(testCase.url, true)) << testCase.url;
+    EXPECT_EQ(Previous::InferContentTypeFromUrl(testCase.url, false), testCase.type) << testCase.url;
+    EXPECT_EQ(Previous::InferContentTypeFromUrl(testCase.url, true), testCase.ie8Type) << testCase.url;
+  }
+}
+
+// Every URL made of up to six of these fragments
+TEST(ContentTypeClassifierTest, GeneratedUrlsMatchPrevious)
+{
+  const wchar_t* fragments[] = {L"a", L".gif", L".JS", L"?", L"#", L"&", L"=", L".", L"/"};
+  const size_t fragmentCount = sizeof(fragments) / sizeof(fragments[0]);
+  for (size_t length = 0; length <= 6; length++)
+  {
+    std::vector<size_t> digits(length, 0);
+    while (true)
+    {
+      std::wstring url = L"http://example.com/";
+      for (size_t i = 0; i < length; i++)
+      {
+        url += fragments[digits[i]];
+      }
+      ASSERT_EQ(Previous::InferContentTypeFromUrl(url, false), ClassifyUrl(url, false)) << url;
+      ASSERT_EQ(Previous::InferContentTypeFromUrl(url, true), ClassifyUrl(url, true)) << url;
+      size_t i = 0;
+      while (i < length && ++digits[i] == fragmentCount)
+      {
+        digits[i++] = 0;
+      }
+      if (i == length)
+      {
+        break;
+      }
+    }
+  }
+}
+
+TEST(ContentTypeClassifierBenchmark, DISABLED_ClassifyRequests)
+{
+  const int iterations = 20000;
+  std::vector<std::wstring> lists = MediaTypeLists();
+  std::vector<std::wstring> urls;
+  for (size_t i = 0; i < sizeof(urlCases) / sizeof(urlCases[0]); i++)
+  {
+    urls.push_back(urlCases[i].url);
+  }
+
+  int previousSum = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    const std::wstring& list = lists[i % lists.size()];
+    const std::wstring& url = urls[i % urls.size()];
+    previousSum += Previous::InferContentTypeFromMediaTypeList(list);
+    previousSum += Previous::InferContentTypeFromUrl(url, true);
+  }
+  double previousMs = timer.Lap();
+
+  int sum = 0;
+  for (int i = 0; i < iterations; i++)
+  {
+    const std::wstring& list = lists[i % lists.size()];
+    const std::wstring& url = urls[i % urls.size()];
+    sum += ClassifyMediaTypeList(list);
+    sum += ClassifyUrl(url, true);
+  }
+  double classifierMs = timer.Lap();
+
+  EXPECT_EQ(previousSum, sum);
+  Benchmark::RecordMilliseconds("previous", previousMs);
+  Benchmark::RecordMilliseconds("classifier", classifierMs);
+}
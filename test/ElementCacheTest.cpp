@@ -0,0 +1,138 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "../src/shared/ElementCache.h"
+#include "Benchmark.h"
+
+namespace
+{
+  struct Entry
+  {
+    Entry() : elements(-1)
+    {
+    }
+    long elements;
+    // Stands in for the reference keeping the element alive
+    std::shared_ptr<int> element;
+  };
+}
+
+TEST(ElementCacheTest, GetAndFind)
+{
+  ElementCache<Entry> cache;
+  int elements[3];
+  bool isNew = false;
+  cache.Get(&elements[0], isNew).elements = 10;
+  EXPECT_TRUE(isNew);
+  cache.Get(&elements[1], isNew).elements = 11;
+  EXPECT_TRUE(isNew);
+  EXPECT_EQ(10, cache.Get(&elements[0], isNew).elements);
+  EXPECT_FALSE(isNew);
+
+  ASSERT_TRUE(cache.Find(&elements[1]) != nullptr);
+  EXPECT_EQ(11, cache.Find(&elements[1])->elements);
+  EXPECT_TRUE(cache.Find(&elements[2]) == nullptr);
+  EXPECT_EQ(2u, cache.GetSize());
+}
+
+TEST(ElementCacheTest, ReferencesStayValid)
+{
+  ElementCache<Entry> cache;
+  std::vector<int> elements(3 * ElementCache<Entry>::slabSize);
+  bool isNew = false;
+  Entry* first = &cache.Get(&elements[0], isNew);
+  first->elements = 42;
+  for (size_t i = 1; i < elements.size(); i++)
+  {
+    cache.Get(&elements[i], isNew).elements = static_cast<long>(i);
+  }
+  // The table has grown several times, the entries haven't moved
+  EXPECT_EQ(first, cache.Find(&elements[0]));
+  EXPECT_EQ(42, first->elements);
+  for (size_t i = 1; i < elements.size(); i++)
+  {
+    ASSERT_EQ(static_cast<long>(i), cache.Find(&elements[i])->elements);
+  }
+}
+
+TEST(ElementCacheTest, ClearStartsNewGeneration)
+{
+  ElementCache<Entry> cache;
+  int elements[2];
+  std::shared_ptr<int> element = std::make_shared<int>(0);
+  bool isNew = false;
+  Entry& entry = cache.Get(&elements[0], isNew);
+  entry.elements = 5;
+  entry.element = element;
+  cache.Get(&elements[1], isNew);
+  size_t memoryUsage = cache.GetMemoryUsage();
+  EXPECT_EQ(2, element.use_count());
+
+  cache.Clear();
+  EXPECT_EQ(1u, cache.GetGeneration());
+  EXPECT_EQ(0u, cache.GetSize());
+  // The references held by the entries are released
+  EXPECT_EQ(1, element.use_count());
+  EXPECT_TRUE(cache.Find(&elements[0]) == nullptr);
+
+  // An element at the same address is a new one
+  EXPECT_EQ(-1, cache.Get(&elements[0], isNew).elements);
+  EXPECT_TRUE(isNew);
+  // The slab is reused
+  EXPECT_EQ(memoryUsage, cache.GetMemoryUsage());
+}
+
+TEST(ElementCacheBenchmark, DISABLED_Retraversal)
+{
+  // Identities of a large page, as if the elements were allocated one after another
+  const size_t elementCount = 100000;
+  std::vector<int64_t> elements(elementCount);
+  const int passes = 10;
+
+  ElementCache<Entry> cache;
+  bool isNew = false;
+  Benchmark::Timer timer;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (size_t i = 0; i < elementCount; i++)
+    {
+      cache.Get(&elements[i], isNew).elements++;
+    }
+  }
+  double cacheTime = timer.Lap();
+
+  std::map<const void*, Entry> baseline;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (size_t i = 0; i < elementCount; i++)
+    {
+      baseline[&elements[i]].elements++;
+    }
+  }
+  double mapTime = timer.Lap();
+
+  EXPECT_EQ(elementCount, cache.GetSize());
+  EXPECT_EQ(passes - 1, cache.Find(&elements[elementCount - 1])->elements);
+  Benchmark::RecordMilliseconds("elementCache", cacheTime);
+  Benchmark::RecordMilliseconds("map", mapTime);
+  RecordProperty("elementCacheKiB", static_cast<int>(cache.GetMemoryUsage() / 1024));
+}
@@ -0,0 +1,200 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/shared/ElementHideBlob.h"
+#include "TestDom.h"
+
+namespace
+{
+  void BuildMatcher(const std::vector<std::wstring>& selectors, ElementHideMatcher& matcher)
+  {
+    matcher.AddAll(selectors, 1);
+    matcher.Build();
+  }
+
+  // Blobs are read in place, the buffer has to be aligned like a mapped view
+  std::vector<uint64_t> CopyAligned(const std::vector<char>& blob)
+  {
+    std::vector<uint64_t> buffer((blob.size() + 7) / 8);
+    std::memcpy(&buffer[0], &blob[0], blob.size());
+    return buffer;
+  }
+}
+
+TEST(ElementHideBlobTest, MatchesLikeMatcher)
+{
+  std::vector<std::wstring> selectors;
+  selectors.push_back(L"#banner");
+  selectors.push_back(L"div#sidebar > .ad");
+  selectors.push_back(L"span.ad");
+  selectors.push_back(L".ad.large");
+  selectors.push_back(L"iframe");
+  selectors.push_back(L"[data-ad]");
+  selectors.push_back(L"section ~ p:not(.keep)");
+  // Only in the selector list, for the stylesheet
+  selectors.push_back(L"li:first-child");
+  ElementHideMatcher matcher;
+  BuildMatcher(selectors, matcher);
+
+  std::vector<char> blob;
+  ElementHideBlob::Write(matcher, selectors, 42, blob);
+  // Only offsets are stored, the blob can be read from any address
+  std::vector<uint64_t> copy = CopyAligned(blob);
+  ElementHideBlob reader;
+  ASSERT_EQ(ElementHideBlob::STATUS_OK, reader.Open(&copy[0], blob.size()));
+  EXPECT_EQ(42, reader.GetGeneration());
+  EXPECT_EQ(selectors.size() - 1, reader.GetSelectorCount());
+  ASSERT_EQ(selectors.size(), reader.GetSelectorListSize());
+  std::wstring selector;
+  for (size_t i = 0; i < selectors.size(); i++)
+  {
+    reader.GetListSelector(i, selector);
+    EXPECT_EQ(selectors[i], selector);
+  }
+  EXPECT_EQ(matcher.GetAttributeNames(), reader.GetAttributeNames());
+  EXPECT_TRUE(reader.HasSiblingCombinators());
+
+  TestDom::Element body(L"body");
+  TestDom::Element& sidebar = body.Append(L"div").Attr(L"id", L"sidebar");
+  sidebar.Append(L"span").Attr(L"class", L"ad");
+  sidebar.Append(L"span").Attr(L"class", L"large ad");
+  sidebar.Append(L"span").Attr(L"class", L"other");
+  body.Append(L"section");
+  body.Append(L"p").Attr(L"class", L"keep");
+  body.Append(L"p");
+  body.Append(L"iframe");
+  body.Append(L"div").Attr(L"id", L"banner");
+  body.Append(L"img").Attr(L"data-ad", L"");
+  body.Append(L"b").Attr(L"id", L"unknown");
+
+  std::vector<const TestDom::Element*> elements;
+  for (auto it = body.children.begin(); it != body.children.end(); ++it)
+  {
+    elements.push_back(it->get());
+  }
+  for (auto it = sidebar.children.begin(); it != sidebar.children.end(); ++it)
+  {
+    elements.push_back(it->get());
+  }
+
+  size_t matches = 0;
+  for (auto it = elements.begin(); it != elements.end(); ++it)
+  {
+    const TestDom::Element& element = **it;
+    ElementHideMatcher::Match expected;
+    ElementHideMatcher::Match actual;
+    bool isHidden = matcher.FindMatch(element.tagName, TestDom::View(element), expected);
+    ASSERT_EQ(isHidden, reader.FindMatch(element.tagName, TestDom::View(element), actual)) << element.tagName.c_str();
+    if (isHidden)
+    {
+      EXPECT_EQ(expected.filter->m_filterText, actual.filter->m_filterText);
+      EXPECT_EQ(expected.indexName, actual.indexName);
+      EXPECT_EQ(expected.key, actual.key);
+      matches++;
+    }
+  }
+  EXPECT_EQ(6u, matches);
+}
+
+TEST(ElementHideBlobTest, CompilesOnlyCandidates)
+{
+  std::vector<std::wstring> selectors;
+  for (int i = 0; i < 1000; i++)
+  {
+    selectors.push_back(L"#id" + std::to_wstring(static_cast<long long>(i)));
+  }
+  ElementHideMatcher matcher;
+  BuildMatcher(selectors, matcher);
+  std::vector<char> blob;
+  ElementHideBlob::Write(matcher, selectors, 1, blob);
+  std::vector<uint64_t> copy = CopyAligned(blob);
+  ElementHideBlob reader;
+  ASSERT_EQ(ElementHideBlob::STATUS_OK, reader.Open(&copy[0], blob.size()));
+  EXPECT_EQ(0u, reader.GetCompiledCount());
+
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"id500");
+  ElementHideMatcher::Match match;
+  ASSERT_TRUE(reader.FindMatch(L"div", TestDom::View(div), match));
+  EXPECT_EQ(L"#id500", match.filter->m_filterText);
+  ASSERT_TRUE(reader.FindMatch(L"div", TestDom::View(div), match));
+  EXPECT_EQ(1u, reader.GetCompiledCount());
+}
+
+TEST(ElementHideBlobTest, OpensEmptyBlob)
+{
+  // Domains without specific selectors get one, the generic ones are in another blob
+  std::vector<std::wstring> selectors;
+  ElementHideMatcher matcher;
+  BuildMatcher(selectors, matcher);
+  std::vector<char> blob;
+  ElementHideBlob::Write(matcher, selectors, 1, blob);
+  std::vector<uint64_t> copy = CopyAligned(blob);
+  ElementHideBlob reader;
+  ASSERT_EQ(ElementHideBlob::STATUS_OK, reader.Open(&copy[0], blob.size()));
+  EXPECT_EQ(0u, reader.GetSelectorListSize());
+  EXPECT_TRUE(reader.GetAttributeNames().empty());
+
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"ad");
+  ElementHideMatcher::Match match;
+  EXPECT_FALSE(reader.FindMatch(L"div", TestDom::View(div), match));
+}
+
+TEST(ElementHideBlobTest, RejectsInvalidData)
+{
+  std::vector<std::wstring> selectors;
+  selectors.push_back(L"div.ad");
+  ElementHideMatcher matcher;
+  BuildMatcher(selectors, matcher);
+  std::vector<char> blob;
+  ElementHideBlob::Write(matcher, selectors, 1, blob);
+
+  {
+    std::vector<uint64_t> copy = CopyAligned(blob);
+    ElementHideBlob reader;
+    EXPECT_EQ(ElementHideBlob::STATUS_TOO_SMALL, reader.Open(&copy[0], 16));
+    EXPECT_EQ(ElementHideBlob::STATUS_BAD_SIZE, reader.Open(&copy[0], blob.size() - 1));
+    TestDom::Element div(L"div");
+    ElementHideMatcher::Match match;
+    EXPECT_FALSE(reader.FindMatch(L"div", TestDom::View(div), match));
+  }
+  {
+    std::vector<char> corrupt(blob);
+    corrupt[0] ^= 1;
+    std::vector<uint64_t> copy = CopyAligned(corrupt);
+    EXPECT_EQ(ElementHideBlob::STATUS_BAD_MAGIC, ElementHideBlob().Open(&copy[0], corrupt.size()));
+  }
+  {
+    // The version follows the magic
+    std::vector<char> corrupt(blob);
+    corrupt[4] ^= 1;
+    std::vector<uint64_t> copy = CopyAligned(corrupt);
+    EXPECT_EQ(ElementHideBlob::STATUS_VERSION_MISMATCH, ElementHideBlob().Open(&copy[0], corrupt.size()));
+  }
+  {
+    std::vector<char> corrupt(blob);
+    corrupt[corrupt.size() - 1] ^= 1;
+    std::vector<uint64_t> copy = CopyAligned(corrupt);
+    EXPECT_EQ(ElementHideBlob::STATUS_BAD_CHECKSUM, ElementHideBlob().Open(&copy[0], corrupt.size()));
+  }
+}
@@ -0,0 +1,270 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+
+#include "Benchmark.h"
+#include "../src/shared/AtomTable.h"
+#include "../src/shared/ElementHideIndex.h"
+
+namespace
+{
+  size_t allocatedBytes = 0;
+
+  // Counts the memory allocated by the containers of the baseline
+  template<typename T>
+  class CountingAllocator
+  {
+  public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<typename U>
+    struct rebind
+    {
+      typedef CountingAllocator<U> other;
+    };
+
+    CountingAllocator() {}
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    pointer allocate(size_type n, const void* = 0)
+    {
+      allocatedBytes += n * sizeof(T);
+      return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(pointer p, size_type n)
+    {
+      allocatedBytes -= n * sizeof(T);
+      ::operator delete(p);
+    }
+    size_type max_size() const
+    {
+      return static_cast<size_type>(-1) / sizeof(T);
+    }
+    void construct(pointer p, const T& value)
+    {
+      new(p) T(value);
+    }
+    void destroy(pointer p)
+    {
+      p->~T();
+    }
+    bool operator==(const CountingAllocator&) const
+    {
+      return true;
+    }
+    bool operator!=(const CountingAllocator&) const
+    {
+      return false;
+    }
+  };
+
+  typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, CountingAllocator<wchar_t> > CountedString;
+  typedef std::pair<CountedString, CountedString> CountedKey;
+
+  // Stands in for CFilterElementHide which is stored by value in the maps
+  struct Record
+  {
+    CountedString filterText;
+    CountedString tag;
+    CountedString name;
+  };
+
+  typedef std::multimap<CountedKey, Record, std::less<CountedKey>,
+    CountingAllocator<std::pair<const CountedKey, Record> > > BaselineIndex;
+
+  std::wstring Number(int i)
+  {
+    return std::to_wstring(static_cast<long long>(i));
+  }
+
+  // EasyList itself is not available to the tests, this corpus resembles its
+  // element hiding part: mostly class and id selectors, some of them
+  // restricted to a tag and some names shared by several selectors.
+  struct Selector
+  {
+    std::wstring text;
+    std::wstring tag;
+    std::wstring name;
+  };
+
+  std::vector<Selector> CreateCorpus(int count)
+  {
+    const wchar_t* tags[] = {L"", L"", L"", L"div", L"a", L"span", L"iframe", L"img"};
+    std::vector<Selector> corpus;
+    for (int i = 0; i < count; i++)
+    {
+      Selector selector;
+      selector.tag = tags[i % 8];
+      selector.name = (i % 3 == 0 ? L"ad_" : L"sponsored-box-") + Number(i % (count / 2));
+      selector.text = selector.tag + (i % 2 ? L"#" : L".") + selector.name;
+      corpus.push_back(selector);
+    }
+    return corpus;
+  }
+}
+
+TEST(AtomTableTest, InternReturnsSameAtomForEqualStrings)
+{
+  AtomTable atoms;
+  AtomTable::Atom foo = atoms.Intern(L"foo");
+  AtomTable::Atom bar = atoms.Intern(L"bar");
+  EXPECT_NE(foo, bar);
+  EXPECT_EQ(foo, atoms.Intern(L"foo"));
+  EXPECT_EQ(foo, atoms.Find(L"foo"));
+  EXPECT_EQ(L"bar", atoms.GetString(bar));
+  EXPECT_EQ(AtomTable::Atom(AtomTable::NotFound), atoms.Find(L"baz"));
+}
+
+TEST(AtomTableTest, EmptyStringIsAtomZero)
+{
+  AtomTable atoms;
+  EXPECT_EQ(0u, atoms.Find(L""));
+  EXPECT_EQ(0u, atoms.Intern(L""));
+  EXPECT_EQ(1u, atoms.GetSize());
+}
+
+TEST(AtomTableTest, ManyStrings)
+{
+  AtomTable atoms;
+  for (int i = 0; i < 10000; i++)
+  {
+    ASSERT_EQ(static_cast<AtomTable::Atom>(i + 1), atoms.Intern(L"class" + Number(i)));
+  }
+  for (int i = 0; i < 10000; i++)
+  {
+    std::wstring str = L"class" + Number(i);
+    size_t hash = AtomTable::Hash(str.c_str(), str.length());
+    ASSERT_EQ(static_cast<AtomTable::Atom>(i + 1), atoms.Find(str.c_str(), str.length(), hash));
+  }
+}
+
+TEST(ElementHideIndexTest, FindReturnsRecordsInInsertionOrder)
+{
+  ElementHideIndex index;
+  index.Add(1, 2, 10);
+  index.Add(0, 2, 11);
+  index.Add(1, 2, 12);
+  index.Add(1, 3, 13);
+  index.Build();
+  EXPECT_EQ(3u, index.GetKeyCount());
+
+  ElementHideIndex::Range range = index.Find(1, 2);
+  ASSERT_EQ(2, range.second - range.first);
+  EXPECT_EQ(10u, range.first[0]);
+  EXPECT_EQ(12u, range.first[1]);
+
+  range = index.Find(0, 2);
+  ASSERT_EQ(1, range.second - range.first);
+  EXPECT_EQ(11u, range.first[0]);
+
+  range = index.Find(2, 1);
+  EXPECT_EQ(range.first, range.second);
+}
+
+TEST(ElementHideIndexTest, EmptyIndex)
+{
+  ElementHideIndex index;
+  index.Build();
+  ElementHideIndex::Range range = index.Find(0, 0);
+  EXPECT_EQ(range.first, range.second);
+}
+
+TEST(ElementHideIndexBenchmark, DISABLED_CompareWithMultimap)
+{
+  const int corpusSize = 50000;
+  std::vector<Selector> corpus = CreateCorpus(corpusSize);
+
+  // Baseline, the way CPluginFilter used to index the selectors
+  size_t baselineMemory;
+  double baselineLookup;
+  size_t baselineHits = 0;
+  {
+    size_t before = allocatedBytes;
+    BaselineIndex baseline;
+    for (auto it = corpus.begin(); it != corpus.end(); ++it)
+    {
+      Record record;
+      record.filterText.assign(it->text.begin(), it->text.end());
+      record.tag.assign(it->tag.begin(), it->tag.end());
+      record.name.assign(it->name.begin(), it->name.end());
+      baseline.insert(std::make_pair(CountedKey(record.tag, record.name), record));
+    }
+    baselineMemory = allocatedBytes - before;
+
+    Benchmark::Timer timer;
+    for (auto it = corpus.begin(); it != corpus.end(); ++it)
+    {
+      CountedString name(it->name.begin(), it->name.end());
+      auto range = baseline.equal_range(CountedKey(CountedString(L"div"), name));
+      baselineHits += std::distance(range.first, range.second);
+      range = baseline.equal_range(CountedKey(CountedString(), name));
+      baselineHits += std::distance(range.first, range.second);
+    }
+    baselineLookup = timer.Lap();
+  }
+
+  // Interned and hash indexed, records are stored once in an arena
+  size_t before = allocatedBytes;
+  AtomTable atoms;
+  std::vector<Record, CountingAllocator<Record> > records;
+  records.reserve(corpus.size());
+  ElementHideIndex index;
+  for (auto it = corpus.begin(); it != corpus.end(); ++it)
+  {
+    index.Add(atoms.Intern(it->tag), atoms.Intern(it->name), static_cast<uint32_t>(records.size()));
+    Record record;
+    record.filterText.assign(it->text.begin(), it->text.end());
+    records.push_back(record);
+  }
+  index.Build();
+  size_t indexMemory = allocatedBytes - before + atoms.GetMemoryUsage() + index.GetMemoryUsage();
+
+  size_t indexHits = 0;
+  Benchmark::Timer timer;
+  AtomTable::Atom divAtom = atoms.Find(L"div");
+  for (auto it = corpus.begin(); it != corpus.end(); ++it)
+  {
+    // Hashed once per token, as when tokenizing the class names of an element
+    size_t hash = AtomTable::Hash(it->name.c_str(), it->name.length());
+    AtomTable::Atom name = atoms.Find(it->name.c_str(), it->name.length(), hash);
+    if (name == AtomTable::Atom(AtomTable::NotFound))
+    {
+      continue;
+    }
+    ElementHideIndex::Range range = index.Find(divAtom, name);
+    indexHits += range.second - range.first;
+    range = index.Find(0, name);
+    indexHits += range.second - range.first;
+  }
+  double indexLookup = timer.Lap();
+
+  EXPECT_EQ(baselineHits, indexHits);
+  RecordProperty("multimapKiB", static_cast<int>(baselineMemory / 1024));
+  RecordProperty("indexKiB", static_cast<int>(indexMemory / 1024));
+  Benchmark::RecordMilliseconds("multimapLookup", baselineLookup);
+  Benchmark::RecordMilliseconds("indexLookup", indexLookup);
+}
@@ -0,0 +1,311 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include "../src/shared/ElementHiding.h"
+#include "TestDom.h"
+
+namespace
+{
+  bool Matches(const std::wstring& selector, const TestDom::Element& element)
+  {
+    ElementHideMatcher matcher;
+    matcher.Add(selector);
+    matcher.Build();
+    ElementHideMatcher::Match match;
+    return matcher.FindMatch(element.tagName, TestDom::View(element), match);
+  }
+
+  void ExpectParseError(const std::wstring& selector, ElementHideParseError expected)
+  {
+    ElementHideMatcher matcher;
+    EXPECT_EQ(expected, matcher.Add(selector)) << selector.c_str();
+    EXPECT_EQ(0, matcher.GetSelectorCount());
+  }
+}
+
+TEST(ElementHidingTest, IdAndClass)
+{
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"banner").Attr(L"class", L"ad  large\tbox");
+
+  EXPECT_TRUE(Matches(L"#banner", div));
+  EXPECT_TRUE(Matches(L"div#banner", div));
+  EXPECT_FALSE(Matches(L"span#banner", div));
+  EXPECT_FALSE(Matches(L"#Banner", div));
+  EXPECT_TRUE(Matches(L".large", div));
+  EXPECT_TRUE(Matches(L"div.box", div));
+  EXPECT_TRUE(Matches(L"#banner.ad", div));
+  EXPECT_FALSE(Matches(L".lar", div));
+  EXPECT_FALSE(Matches(L"#banner.other", div));
+}
+
+TEST(ElementHidingTest, Tag)
+{
+  TestDom::Element iframe(L"iframe");
+  EXPECT_TRUE(Matches(L"iframe", iframe));
+  EXPECT_TRUE(Matches(L"IFRAME", iframe));
+  EXPECT_FALSE(Matches(L"img", iframe));
+}
+
+TEST(ElementHidingTest, Attributes)
+{
+  TestDom::Element a(L"a");
+  a.Attr(L"href", L"http://ads.example.com/click").Attr(L"style", L"Width: 300px");
+
+  EXPECT_TRUE(Matches(L"a[href=\"http://ads.example.com/click\"]", a));
+  EXPECT_TRUE(Matches(L"a[href^=\"http://ads.\"]", a));
+  EXPECT_TRUE(Matches(L"a[href$=click]", a));
+  EXPECT_TRUE(Matches(L"a[href*=example]", a));
+  EXPECT_TRUE(Matches(L"a[href*=example][href$=click]", a));
+  EXPECT_FALSE(Matches(L"a[href*=example][href$=other]", a));
+  EXPECT_FALSE(Matches(L"a[href^=https]", a));
+  EXPECT_FALSE(Matches(L"a[title=x]", a));
+  // The style is compared in lower case
+  EXPECT_TRUE(Matches(L"a[style*=\"WIDTH: 300\"]", a));
+}
+
+TEST(ElementHidingTest, Combinators)
+{
+  TestDom::Element body(L"body");
+  TestDom::Element& container = body.Append(L"div").Attr(L"id", L"sidebar");
+  TestDom::Element& label = container.Append(L"span").Attr(L"class", L"label");
+  TestDom::Element& ad = container.Append(L"img").Attr(L"class", L"ad");
+
+  EXPECT_TRUE(Matches(L"#sidebar > .ad", ad));
+  EXPECT_TRUE(Matches(L"div > img.ad", ad));
+  EXPECT_FALSE(Matches(L"span > .ad", ad));
+  EXPECT_TRUE(Matches(L".label + .ad", ad));
+  EXPECT_TRUE(Matches(L"body > #sidebar > span + img", ad));
+  EXPECT_FALSE(Matches(L".ad + .label", label));
+  EXPECT_FALSE(Matches(L"div + .label", label));
+}
+
+TEST(ElementHidingTest, DescendantAndGeneralSibling)
+{
+  TestDom::Element body(L"body");
+  TestDom::Element& main = body.Append(L"div").Attr(L"id", L"main");
+  TestDom::Element& article = main.Append(L"article");
+  article.Append(L"h1");
+  article.Append(L"p");
+  TestDom::Element& ad = article.Append(L"div").Attr(L"class", L"ad");
+
+  EXPECT_TRUE(Matches(L"#main .ad", ad));
+  EXPECT_TRUE(Matches(L"body  article\t.ad", ad));
+  EXPECT_TRUE(Matches(L"body #main > article div", ad));
+  EXPECT_FALSE(Matches(L"#main > .ad", ad));
+  EXPECT_FALSE(Matches(L"section .ad", ad));
+  EXPECT_TRUE(Matches(L"h1 ~ .ad", ad));
+  EXPECT_TRUE(Matches(L"#main h1 ~ p + div", ad));
+  EXPECT_FALSE(Matches(L"h1 + .ad", ad));
+  EXPECT_FALSE(Matches(L"span ~ .ad", ad));
+}
+
+TEST(ElementHidingTest, MultipleClassesAndNegation)
+{
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"box").Attr(L"class", L"ad large").Attr(L"data-ad", L"");
+
+  EXPECT_TRUE(Matches(L".ad.large", div));
+  EXPECT_TRUE(Matches(L"div.large.ad#box", div));
+  EXPECT_FALSE(Matches(L".ad.small", div));
+  EXPECT_TRUE(Matches(L".ad:not(.small)", div));
+  EXPECT_FALSE(Matches(L".ad:not(.large)", div));
+  EXPECT_TRUE(Matches(L"div:not(span):not(#other)", div));
+  EXPECT_FALSE(Matches(L"div:NOT(div#box)", div));
+  EXPECT_TRUE(Matches(L"[data-ad]", div));
+  EXPECT_TRUE(Matches(L"div[ data-ad ]", div));
+  EXPECT_FALSE(Matches(L"[data-other]", div));
+  EXPECT_TRUE(Matches(L"*:not([data-other])", div));
+}
+
+TEST(ElementHidingTest, QuotingAndEscapes)
+{
+  TestDom::Element a(L"a");
+  a.Attr(L"href", L"http://x/a>b+c]").Attr(L"id", L"ad:1");
+
+  EXPECT_TRUE(Matches(L"a[href$=\"a>b+c]\"]", a));
+  EXPECT_TRUE(Matches(L"a[href^='http://x/']", a));
+  EXPECT_TRUE(Matches(L"#ad\\:1", a));
+
+  // Hex escapes stand for code points, a single whitespace may end them
+  EXPECT_TRUE(Matches(L"#ad\\3A 1", a));
+  EXPECT_TRUE(Matches(L"#ad\\00003a1", a));
+  EXPECT_TRUE(Matches(L"#\\61 d\\:1", a));
+  EXPECT_TRUE(Matches(L"a[href$=\"a\\3e b+c]\"]", a));
+  EXPECT_FALSE(Matches(L"#ad\\3A  1", a));
+
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"1e").Attr(L"class", L"caf\u00E9");
+  EXPECT_TRUE(Matches(L"#\\31 e", div));
+  EXPECT_TRUE(Matches(L"#\\31\r\ne", div));
+  EXPECT_FALSE(Matches(L"#\\31e", div));
+  EXPECT_TRUE(Matches(L"div.caf\\E9", div));
+  EXPECT_TRUE(Matches(L"div.caf\\e9 ", div));
+}
+
+TEST(ElementHidingTest, IndexesByRarestClass)
+{
+  ElementHideMatcher matcher;
+  matcher.Add(L".common.rare");
+  matcher.Add(L".common.other");
+  matcher.Add(L"div.common:not(.rare)");
+  matcher.Build();
+
+  TestDom::Element div(L"div");
+  div.Attr(L"class", L"rare common");
+  ElementHideMatcher::Match match;
+  ASSERT_TRUE(matcher.FindMatch(L"div", TestDom::View(div), match));
+  EXPECT_EQ(L".common.rare", match.filter->m_filterText);
+  EXPECT_EQ(L"class:rare", match.key);
+}
+
+TEST(ElementHidingTest, SelectorsWithoutKey)
+{
+  ElementHideMatcher matcher;
+  matcher.Add(L"[style*=\"z-index: 9999\"]");
+  matcher.Build();
+
+  TestDom::Element div(L"div");
+  div.Attr(L"style", L"position: fixed; Z-Index: 9999");
+  ElementHideMatcher::Match match;
+  ASSERT_TRUE(matcher.FindMatch(L"div", TestDom::View(div), match));
+  EXPECT_EQ(L"?", match.indexName);
+}
+
+TEST(ElementHidingTest, MatchReportsIndexAndKey)
+{
+  ElementHideMatcher matcher;
+  matcher.Add(L"#banner");
+  matcher.Add(L"img.ad");
+  matcher.Build();
+
+  TestDom::Element img(L"img");
+  img.Attr(L"class", L"x ad");
+  ElementHideMatcher::Match match;
+  ASSERT_TRUE(matcher.FindMatch(L"img", TestDom::View(img), match));
+  EXPECT_EQ(L"img.ad", match.filter->m_filterText);
+  EXPECT_EQ(L"tag/class", match.indexName);
+  EXPECT_EQ(L"class:ad", match.key);
+
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"banner");
+  ASSERT_TRUE(matcher.FindMatch(L"div", TestDom::View(div), match));
+  EXPECT_EQ(L"?/id", match.indexName);
+  EXPECT_EQ(L"id:banner", match.key);
+
+  TestDom::Element span(L"span");
+  EXPECT_FALSE(matcher.FindMatch(L"span", TestDom::View(span), match));
+}
+
+TEST(ElementHidingTest, AttributeNamesAndSiblingCombinators)
+{
+  ElementHideMatcher matcher;
+  matcher.Add(L"#banner");
+  matcher.Add(L"div[Data-Ad] > span:not([title])");
+  matcher.Add(L"a[href^=\"http\"]");
+  matcher.Build();
+  std::vector<std::wstring> expected;
+  expected.push_back(L"data-ad");
+  expected.push_back(L"href");
+  expected.push_back(L"id");
+  expected.push_back(L"title");
+  EXPECT_EQ(expected, matcher.GetAttributeNames());
+  EXPECT_FALSE(matcher.HasSiblingCombinators());
+
+  ElementHideMatcher siblings;
+  siblings.Add(L".label ~ img");
+  siblings.Build();
+  EXPECT_EQ(std::vector<std::wstring>(1, L"class"), siblings.GetAttributeNames());
+  EXPECT_TRUE(siblings.HasSiblingCombinators());
+}
+
+TEST(ElementHidingTest, ParseErrors)
+{
+  ExpectParseError(L"", PARSE_ERROR_EMPTY);
+  ExpectParseError(L"  ", PARSE_ERROR_EMPTY);
+  ExpectParseError(L":root", PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS);
+  ExpectParseError(L"#.foo", PARSE_ERROR_EMPTY_NAME);
+  ExpectParseError(L"div[=foo]", PARSE_ERROR_EMPTY_NAME);
+  ExpectParseError(L"div[^=foo]", PARSE_ERROR_EMPTY_NAME);
+  ExpectParseError(L"div[foo", PARSE_ERROR_UNTERMINATED);
+  ExpectParseError(L"div > #.foo", PARSE_ERROR_EMPTY_NAME);
+  ExpectParseError(L"div > ", PARSE_ERROR_EMPTY);
+  ExpectParseError(L"div:first-child", PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS);
+  ExpectParseError(L":not(:not(.a))", PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS);
+  ExpectParseError(L".a:not(.b", PARSE_ERROR_UNTERMINATED);
+  ExpectParseError(L"#a#b", PARSE_ERROR_MULTIPLE_IDS);
+  ExpectParseError(L"a[href~=x]", PARSE_ERROR_UNSUPPORTED_OPERATOR);
+  ExpectParseError(L"a[href=\"x]", PARSE_ERROR_UNTERMINATED);
+  ExpectParseError(L"a, b", PARSE_ERROR_UNEXPECTED_CHARACTER);
+  ExpectParseError(L"a\\", PARSE_ERROR_UNTERMINATED);
+}
+
+TEST(ElementHidingTest, ParseRange)
+{
+  // Only [begin, end) is read, surrounding whitespace is dropped
+  std::wstring text = L"xx  div.ad > a  yy";
+  CFilterElementHide filter;
+  ASSERT_EQ(PARSE_OK, CFilterElementHide::Parse(text.data() + 2, text.data() + text.length() - 2, filter));
+  EXPECT_EQ(L"div.ad > a", filter.m_filterText);
+  EXPECT_EQ(L"a", filter.m_tag);
+  ASSERT_TRUE(filter.m_predecessor != nullptr);
+  EXPECT_EQ(L"ad", filter.m_predecessor->m_tagClassNames.at(0));
+}
+
+TEST(ElementHidingTest, AddAllKeepsOrderAcrossThreads)
+{
+  std::vector<std::wstring> selectors;
+  for (int i = 0; i < 10000; i++)
+  {
+    std::wstring suffix = std::to_wstring(static_cast<long long>(i));
+    if (i % 1000 == 1)
+      selectors.push_back(L"! comment " + suffix);
+    else if (i % 1000 == 2)
+      selectors.push_back(L"");
+    else if (i % 1000 == 3)
+      selectors.push_back(L"div:hover" + suffix);
+    else
+      selectors.push_back(L"#id" + suffix);
+  }
+
+  ElementHideMatcher single;
+  std::vector<ElementHideMatcher::ParseFailure> singleFailures = single.AddAll(selectors, 1);
+  ElementHideMatcher parallel;
+  std::vector<ElementHideMatcher::ParseFailure> parallelFailures = parallel.AddAll(selectors, 4);
+
+  EXPECT_EQ(9970u, single.GetSelectorCount());
+  EXPECT_EQ(9970u, parallel.GetSelectorCount());
+  ASSERT_EQ(10u, singleFailures.size());
+  ASSERT_EQ(10u, parallelFailures.size());
+  for (size_t i = 0; i < parallelFailures.size(); i++)
+  {
+    EXPECT_EQ(i * 1000 + 3, parallelFailures[i].index);
+    EXPECT_EQ(PARSE_ERROR_UNSUPPORTED_PSEUDO_CLASS, parallelFailures[i].error);
+    EXPECT_EQ(singleFailures[i].index, parallelFailures[i].index);
+  }
+
+  single.Build();
+  parallel.Build();
+  TestDom::Element div(L"div");
+  div.Attr(L"id", L"id9999");
+  ElementHideMatcher::Match match;
+  ASSERT_TRUE(parallel.FindMatch(L"div", TestDom::View(div), match));
+  EXPECT_EQ(L"#id9999", match.filter->m_filterText);
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include "../src/shared/ElementHiding.h"
+#include "../src/shared/ElementSnapshot.h"
+#include "TestDom.h"
+
+TEST(ElementSnapshotTest, FetchesEachPropertyOnce)
+{
+  TestDom::Element div(L"DIV");
+  div.Attr(L"id", L"main").Attr(L"class", L"b a  c").Attr(L"style", L"Color: Red").Attr(L"title", L"x");
+  size_t accessCount = 0;
+  TestDom::View view(div, &accessCount);
+  ElementSnapshot snapshot(view);
+
+  for (int i = 0; i < 3; i++)
+  {
+    std::wstring value;
+    EXPECT_EQ(L"div", snapshot.GetLowerTagName());
+    EXPECT_TRUE(snapshot.GetTagName(value));
+    EXPECT_EQ(L"DIV", value);
+    EXPECT_TRUE(snapshot.GetId(value));
+    EXPECT_EQ(L"main", value);
+    ASSERT_NE(nullptr, snapshot.GetLowerStyle());
+    EXPECT_EQ(L"color: red", *snapshot.GetLowerStyle());
+    EXPECT_TRUE(snapshot.HasClass(L"c"));
+    EXPECT_FALSE(snapshot.HasClass(L"d"));
+    EXPECT_TRUE(snapshot.GetAttribute(L"title", value));
+    EXPECT_FALSE(snapshot.GetAttribute(L"href", value));
+  }
+  // Tag, id, class, style and two attributes
+  EXPECT_EQ(6, accessCount);
+
+  std::vector<std::wstring> expectedClasses;
+  expectedClasses.push_back(L"a");
+  expectedClasses.push_back(L"b");
+  expectedClasses.push_back(L"c");
+  EXPECT_EQ(expectedClasses, snapshot.GetClassList());
+}
+
+TEST(ElementSnapshotTest, SeededTagName)
+{
+  TestDom::Element span(L"span");
+  size_t accessCount = 0;
+  TestDom::View view(span, &accessCount);
+  ElementSnapshot snapshot(view);
+  snapshot.SetTagName(L"SPAN");
+  EXPECT_EQ(L"span", snapshot.GetLowerTagName());
+  EXPECT_EQ(0, accessCount);
+}
+
+TEST(ElementSnapshotTest, AncestorsAreSnapshotsToo)
+{
+  TestDom::Element body(L"body");
+  body.Append(L"p").Attr(L"class", L"intro");
+  TestDom::Element& second = body.Append(L"p");
+  size_t accessCount = 0;
+  TestDom::View view(second, &accessCount);
+  ElementSnapshot snapshot(view);
+
+  for (int i = 0; i < 3; i++)
+  {
+    ASSERT_NE(nullptr, snapshot.GetParentSnapshot());
+    EXPECT_EQ(L"body", snapshot.GetParentSnapshot()->GetLowerTagName());
+    EXPECT_EQ(nullptr, snapshot.GetParentSnapshot()->GetParentSnapshot());
+    ASSERT_NE(nullptr, snapshot.GetPreviousSiblingSnapshot());
+    EXPECT_TRUE(snapshot.GetPreviousSiblingSnapshot()->HasClass(L"intro"));
+  }
+  // Parent, its tag and parent, sibling and its class
+  EXPECT_EQ(5, accessCount);
+}
+
+TEST(ElementSnapshotTest, MatcherReadsElementOnce)
+{
+  ElementHideMatcher matcher;
+  for (int i = 0; i < 20; i++)
+  {
+    std::wstring suffix = std::to_wstring(static_cast<long long>(i));
+    matcher.Add(L"div.ad[title=t" + suffix + L"]");
+    matcher.Add(L"#main[style*=\"width: " + suffix + L"px\"]");
+    matcher.Add(L"section > .ad[data-x=" + suffix + L"]");
+  }
+  matcher.Build();
+
+  TestDom::Element body(L"body");
+  TestDom::Element& div = body.Append(L"div").Attr(L"id", L"main").Attr(L"class", L"ad").Attr(L"title", L"none").Attr(L"data-x", L"3");
+  size_t accessCount = 0;
+  ElementHideMatcher::Match match;
+  EXPECT_FALSE(matcher.FindMatch(L"div", TestDom::View(div, &accessCount), match));
+  // Id, class, style, title, data-x, the parent and its tag (the tag is known)
+  EXPECT_EQ(7, accessCount);
+}
@@ -0,0 +1,229 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
+#include <locale>
+#include <string>
+
+#include "../src/shared/HttpHeaders.h"
+#include "Benchmark.h"
+
+namespace
+{
+  // Additional headers returned by IHttpNegotiate::BeginningTransaction, IE11 on Windows 7
+  const wchar_t* const ie11AdditionalHeaders =
+    L"Referer: http://www.example.com/news/index.html\r\n"
+    L"Accept-Language: en-US,en;q=0.8,de-DE;q=0.5,de;q=0.3\r\n"
+    L"User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64; Trident/7.0; rv:11.0) like Gecko\r\n"
+    L"Accept-Encoding: gzip, deflate\r\n";
+
+  // The same for an XMLHttpRequest issued by jQuery, IE9
+  const wchar_t* const ie9XhrAdditionalHeaders =
+    L"Accept: application/json, text/javascript, */*; q=0.01\r\n"
+    L"X-Requested-With: XMLHttpRequest\r\n"
+    L"Referer: http://www.example.com/\r\n"
+    L"Accept-Language: de-DE\r\n"
+    L"Accept-Encoding: gzip, deflate\r\n";
+
+  // Request of Flash.ocx 15, the lines are only separated by "\n"
+  const wchar_t* const flashAdditionalHeaders =
+    L"Referer: http://www.example.com/player.swf\n"
+    L"x-flash-version: 15,0,0,152\n";
+
+  // HTTP_QUERY_RAW_HEADERS_CRLF | HTTP_QUERY_FLAG_REQUEST_HEADERS of an image, IE11
+  const char* const ie11RawRequestHeaders =
+    "GET /ads/banner_468x60.gif HTTP/1.1\r\n"
+    "Accept: image/png, image/svg+xml, image/jxr, image/*;q=0.8, */*;q=0.5\r\n"
+    "Referer: http://www.example.com/news/index.html\r\n"
+    "Accept-Language: en-US,en;q=0.8,de-DE;q=0.5,de;q=0.3\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64; Trident/7.0; rv:11.0) like Gecko\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Host: ads.example.net\r\n"
+    "DNT: 1\r\n"
+    "Connection: Keep-Alive\r\n"
+    "Cookie: uid=4f2a9c1e; session=abcdef0123456789\r\n"
+    "\r\n";
+
+  // The implementation HttpHeaders replaced in WBPassthruSink
+  template <typename T>
+  T ASCIIStringToLower(const T& text)
+  {
+    T textlower;
+    std::transform(text.begin(), text.end(), std::back_inserter(textlower),
+      [](typename T::value_type ch)
+      {
+        return std::tolower(ch, std::locale());
+      }
+    );
+    return textlower;
+  }
+
+  template <class T>
+  T ExtractHttpHeader(const T& allHeaders, const T& targetHeaderNameWithColon, const T& delimiter)
+  {
+    const T allHeadersLower = ASCIIStringToLower(allHeaders);
+    auto targetHeaderBeginsAt = allHeadersLower.find(ASCIIStringToLower(targetHeaderNameWithColon));
+    if (targetHeaderBeginsAt == T::npos)
+    {
+      return T();
+    }
+    targetHeaderBeginsAt += targetHeaderNameWithColon.length();
+    auto targetHeaderEndsAt = allHeadersLower.find(ASCIIStringToLower(delimiter), targetHeaderBeginsAt);
+    if (targetHeaderEndsAt == T::npos)
+    {
+      return T();
+    }
+    return allHeaders.substr(targetHeaderBeginsAt, targetHeaderEndsAt - targetHeaderBeginsAt);
+  }
+}
+
+TEST(HttpHeadersTest, AdditionalHeaders)
+{
+  HttpHeaders<wchar_t> headers(ie11AdditionalHeaders);
+  ASSERT_EQ(4u, headers.GetCount());
+  EXPECT_EQ(L"Referer", headers[0].name.ToString());
+  EXPECT_EQ(L"http://www.example.com/news/index.html", headers.Find("Referer").ToString());
+  EXPECT_EQ(L"http://www.example.com/news/index.html", headers.Find("referer").ToString());
+  EXPECT_EQ(L"gzip, deflate", headers.Find("ACCEPT-ENCODING").ToString());
+  EXPECT_FALSE(headers.Has("X-Requested-With"));
+  EXPECT_TRUE(headers.Find("X-Requested-With").IsEmpty());
+  EXPECT_FALSE(headers.Has("Refere"));
+  EXPECT_FALSE(headers.Has("Referer:"));
+}
+
+TEST(HttpHeadersTest, XmlHttpRequest)
+{
+  HttpHeaders<wchar_t> headers(ie9XhrAdditionalHeaders);
+  EXPECT_TRUE(headers.Find("x-requested-with").Equals("XMLHttpRequest"));
+  EXPECT_FALSE(headers.Find("x-requested-with").Equals("XMLHttpRequests"));
+  EXPECT_FALSE(headers.Find("x-requested-with").Equals("xmlhttprequest"));
+  EXPECT_TRUE(headers.Find("x-requested-with").EqualsIgnoreCase("xmlhttprequest"));
+  EXPECT_EQ(L"application/json, text/javascript, */*; q=0.01", headers.Find("Accept").ToString());
+}
+
+TEST(HttpHeadersTest, LinesSeparatedByLineFeeds)
+{
+  HttpHeaders<wchar_t> headers(flashAdditionalHeaders);
+  ASSERT_EQ(2u, headers.GetCount());
+  EXPECT_EQ(L"15,0,0,152", headers.Find("X-Flash-Version").ToString());
+  EXPECT_EQ(L"http://www.example.com/player.swf", headers.Find("Referer").ToString());
+}
+
+TEST(HttpHeadersTest, RawRequestHeaders)
+{
+  std::string raw(ie11RawRequestHeaders);
+  HttpHeaders<char> headers(raw.data(), raw.data() + raw.length());
+  // The request line and the empty line at the end aren't headers
+  ASSERT_EQ(9u, headers.GetCount());
+  EXPECT_EQ("Accept", headers[0].name.ToString());
+  EXPECT_EQ("image/png, image/svg+xml, image/jxr, image/*;q=0.8, */*;q=0.5", headers.Find("accept").ToString());
+  EXPECT_EQ("ads.example.net", headers.Find("Host").ToString());
+  EXPECT_EQ("uid=4f2a9c1e; session=abcdef0123456789", headers.Find("Cookie").ToString());
+}
+
+TEST(HttpHeadersTest, Whitespace)
+{
+  HttpHeaders<char> headers("Name :  value with spaces \t\r\nEmpty:\r\nNoSpace:x\r\n  folded continuation\r\n");
+  ASSERT_EQ(3u, headers.GetCount());
+  EXPECT_EQ("Name", headers[0].name.ToString());
+  EXPECT_EQ("value with spaces", headers.Find("name").ToString());
+  EXPECT_TRUE(headers.Has("Empty"));
+  EXPECT_TRUE(headers.Find("Empty").IsEmpty());
+  EXPECT_EQ("x", headers.Find("nospace").ToString());
+}
+
+TEST(HttpHeadersTest, MalformedInput)
+{
+  EXPECT_EQ(0u, HttpHeaders<wchar_t>(static_cast<const wchar_t*>(nullptr)).GetCount());
+  EXPECT_EQ(0u, HttpHeaders<char>("").GetCount());
+  EXPECT_EQ(0u, HttpHeaders<char>("no colon\r\n\r\n: no name\r\n").GetCount());
+  HttpHeaders<char> unterminated("A: 1\r\nB: 2");
+  ASSERT_EQ(2u, unterminated.GetCount());
+  EXPECT_EQ("2", unterminated.Find("b").ToString());
+  // Duplicates are kept, Find returns the first one
+  HttpHeaders<char> duplicates("A: 1\r\na: 2\r\n");
+  ASSERT_EQ(2u, duplicates.GetCount());
+  EXPECT_EQ("1", duplicates.Find("A").ToString());
+}
+
+TEST(HttpHeadersTest, HeaderLimit)
+{
+  std::string raw;
+  for (int i = 0; i < 40; i++)
+  {
+    raw += "H" + std::to_string(static_cast<long long>(i)) + ": v\r\n";
+  }
+  HttpHeaders<char> headers(raw.data(), raw.data() + raw.length());
+  EXPECT_EQ(HttpHeaders<char>::maxHeaders, headers.GetCount());
+  EXPECT_TRUE(headers.Has("H31"));
+  EXPECT_FALSE(headers.Has("H32"));
+}
+
+TEST(HttpHeadersTest, MatchesPreviousExtraction)
+{
+  std::wstring additional(ie9XhrAdditionalHeaders);
+  HttpHeaders<wchar_t> headers(additional.data(), additional.data() + additional.length());
+  const char* names[] = {"Referer", "X-Requested-With", "Accept-Language"};
+  const wchar_t* namesWithColon[] = {L"Referer:", L"X-Requested-With:", L"Accept-Language:"};
+  for (int i = 0; i < 3; i++)
+  {
+    std::wstring previous = ExtractHttpHeader<std::wstring>(additional, namesWithColon[i], L"\n");
+    // The previous extraction left the whitespace to the callers
+    previous.erase(0, previous.find_first_not_of(L" \t"));
+    previous.erase(previous.find_last_not_of(L" \t\r") + 1);
+    EXPECT_EQ(previous, headers.Find(names[i]).ToString());
+  }
+}
+
+TEST(HttpHeadersBenchmark, DISABLED_BeginningTransactionLookups)
+{
+  const int iterations = 20000;
+  const std::wstring additional(ie11AdditionalHeaders);
+  const std::string raw(ie11RawRequestHeaders);
+
+  // Referer, X-Requested-With and x-flash-version from the additional
+  // headers and Accept from the raw headers, as in BeginningTransaction
+  size_t found = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    found += ExtractHttpHeader<std::wstring>(additional, L"Referer:", L"\n").length();
+    found += ExtractHttpHeader<std::wstring>(additional, L"X-Requested-With:", L"\n").length();
+    found += ExtractHttpHeader<std::wstring>(additional, L"x-flash-version:", L"\n").length();
+    found += ExtractHttpHeader<std::string>(raw, "Accept:", "\r\n").length();
+  }
+  double previousMs = timer.Lap();
+
+  size_t parsedFound = 0;
+  for (int i = 0; i < iterations; i++)
+  {
+    HttpHeaders<wchar_t> headers(additional.data(), additional.data() + additional.length());
+    parsedFound += headers.Find("Referer").GetLength();
+    parsedFound += headers.Find("X-Requested-With").GetLength();
+    parsedFound += headers.Find("x-flash-version").GetLength();
+    HttpHeaders<char> rawHeaders(raw.data(), raw.data() + raw.length());
+    parsedFound += rawHeaders.Find("Accept").GetLength();
+  }
+  double parsedMs = timer.Lap();
+
+  // The previous extraction kept the leading space and the "\r"
+  EXPECT_EQ(found, parsedFound + 3 * iterations);
+  Benchmark::RecordMilliseconds("lowercaseAndFind", previousMs);
+  Benchmark::RecordMilliseconds("httpHeaders", parsedMs);
+}
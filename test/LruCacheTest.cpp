@@ -0,0 +1,86 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "../src/shared/LruCache.h"
+
+TEST(LruCacheTest, GetReturnsPutValue)
+{
+  LruCache<std::wstring, int> cache(2);
+  int value = 0;
+  EXPECT_FALSE(cache.Get(L"foo", value));
+  cache.Put(L"foo", 1);
+  ASSERT_TRUE(cache.Get(L"foo", value));
+  EXPECT_EQ(1, value);
+
+  cache.Put(L"foo", 2);
+  ASSERT_TRUE(cache.Get(L"foo", value));
+  EXPECT_EQ(2, value);
+  EXPECT_EQ(1u, cache.GetStats().size);
+}
+
+TEST(LruCacheTest, LeastRecentlyUsedEntryIsEvicted)
+{
+  LruCache<std::wstring, int> cache(2);
+  cache.Put(L"foo", 1);
+  cache.Put(L"bar", 2);
+
+  // Makes "bar" the least recently used entry
+  int value = 0;
+  ASSERT_TRUE(cache.Get(L"foo", value));
+
+  cache.Put(L"baz", 3);
+  EXPECT_TRUE(cache.Get(L"foo", value));
+  EXPECT_FALSE(cache.Get(L"bar", value));
+  EXPECT_TRUE(cache.Get(L"baz", value));
+  EXPECT_EQ(3, value);
+
+  LruCache<std::wstring, int>::Stats stats = cache.GetStats();
+  EXPECT_EQ(2u, stats.size);
+  EXPECT_EQ(1u, stats.evictions);
+  EXPECT_EQ(3u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+}
+
+TEST(LruCacheTest, CompositeKeys)
+{
+  typedef std::pair<std::wstring, int64_t> Key;
+  LruCache<Key, std::shared_ptr<std::wstring> > cache(4);
+  cache.Put(Key(L"example.com", 1), std::make_shared<std::wstring>(L"first"));
+  cache.Put(Key(L"example.com", 2), std::make_shared<std::wstring>(L"second"));
+
+  std::shared_ptr<std::wstring> value;
+  ASSERT_TRUE(cache.Get(Key(L"example.com", 1), value));
+  EXPECT_EQ(L"first", *value);
+  ASSERT_TRUE(cache.Get(Key(L"example.com", 2), value));
+  EXPECT_EQ(L"second", *value);
+  EXPECT_FALSE(cache.Get(Key(L"example.org", 2), value));
+}
+
+TEST(LruCacheTest, Clear)
+{
+  LruCache<std::wstring, int> cache(2);
+  cache.Put(L"foo", 1);
+  cache.Clear();
+  int value = 0;
+  EXPECT_FALSE(cache.Get(L"foo", value));
+  EXPECT_EQ(0u, cache.GetStats().size);
+}
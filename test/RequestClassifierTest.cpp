@@ -0,0 +1,253 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+
+#include "../src/shared/RequestClassifier.h"
+#include "Benchmark.h"
+
+namespace
+{
+  // Answers the lookups from fixed sets and counts them
+  class FakeEnvironment : public RequestEnvironment
+  {
+  public:
+    FakeEnvironment()
+      : filteringEnabled(true), filteringEnabledCalls(0), frameCachedCalls(0), shouldBlockCalls(0),
+        lastContentType(REQUEST_TYPE_OTHER)
+    {
+    }
+
+    bool IsFilteringEnabled(const std::wstring&)
+    {
+      filteringEnabledCalls++;
+      return filteringEnabled;
+    }
+
+    bool IsFrameCached(const std::wstring& url)
+    {
+      frameCachedCalls++;
+      return frames.count(url) > 0;
+    }
+
+    bool ShouldBlock(const std::wstring& url, RequestContentType contentType, const std::wstring& referrer)
+    {
+      shouldBlockCalls++;
+      lastContentType = contentType;
+      lastReferrer = referrer;
+      return blocked.count(url) > 0;
+    }
+
+    bool filteringEnabled;
+    std::set<std::wstring> frames;
+    std::set<std::wstring> blocked;
+    int filteringEnabledCalls;
+    int frameCachedCalls;
+    int shouldBlockCalls;
+    RequestContentType lastContentType;
+    std::wstring lastReferrer;
+  };
+
+  RequestDescriptor Request(const std::wstring& url, const wchar_t* additionalHeaders, const std::wstring& accept)
+  {
+    RequestDescriptor request;
+    request.url = url;
+    request.additionalHeaders = additionalHeaders;
+    request.accept = accept;
+    request.ieMajorVersion = 11;
+    request.hasTab = true;
+    request.documentUrl = L"http://www.example.com/index.html";
+    return request;
+  }
+
+  const wchar_t* const referrerHeaders = L"Referer: http://www.example.com/index.html\r\n";
+}
+
+TEST(RequestClassifierTest, InfersContentTypeFromAcceptThenUrl)
+{
+  RequestDescriptor request = Request(L"http://ads.example.com/banner", nullptr,
+    L"image/png, image/svg+xml, image/jxr, image/*;q=0.8, */*;q=0.5");
+  EXPECT_EQ(REQUEST_TYPE_IMAGE, RequestStages::InferContentType(request, L"http://www.example.com/"));
+
+  request.accept = L"*/*";
+  request.url = L"http://ads.example.com/ad.js?x=1";
+  EXPECT_EQ(REQUEST_TYPE_SCRIPT, RequestStages::InferContentType(request, L"http://www.example.com/"));
+}
+
+TEST(RequestClassifierTest, NoAcceptAndNoReferrerIsXmlHttpRequestFromIe8)
+{
+  RequestDescriptor request = Request(L"http://api.example.com/data", nullptr, L"");
+  EXPECT_EQ(REQUEST_TYPE_XMLHTTPREQUEST, RequestStages::InferContentType(request, L""));
+  request.ieMajorVersion = 7;
+  EXPECT_EQ(REQUEST_TYPE_OTHER, RequestStages::InferContentType(request, L""));
+  request.ieMajorVersion = 8;
+  EXPECT_EQ(REQUEST_TYPE_OTHER, RequestStages::InferContentType(request, L"http://www.example.com/"));
+}
+
+TEST(RequestClassifierTest, Ie8SearchesQueryString)
+{
+  RequestDescriptor request = Request(L"http://cdn.example.com/load?file=ad.swf", nullptr, L"*/*");
+  request.ieMajorVersion = 8;
+  EXPECT_EQ(REQUEST_TYPE_OBJECT, RequestStages::InferContentType(request, L"http://www.example.com/"));
+  request.ieMajorVersion = 9;
+  EXPECT_EQ(REQUEST_TYPE_OTHER, RequestStages::InferContentType(request, L"http://www.example.com/"));
+}
+
+TEST(RequestClassifierTest, ObjectSubrequestFromHeaderOrBindInfo)
+{
+  RequestDescriptor request = Request(L"http://video.example.com/stream", nullptr, L"*/*");
+  HttpHeaders<wchar_t> flashHeaders(L"x-flash-version: 15,0,0,152\r\n");
+  EXPECT_TRUE(RequestStages::IsObjectSubrequest(request, flashHeaders));
+
+  HttpHeaders<wchar_t> noHeaders(nullptr);
+  EXPECT_FALSE(RequestStages::IsObjectSubrequest(request, noHeaders));
+  request.hasBindInfo = true;
+  request.bindFlags = flashBindFlags;
+  request.bindOptions = flashBindOptions;
+  EXPECT_TRUE(RequestStages::IsObjectSubrequest(request, noHeaders));
+  // Microsoft's implementation sets further flags
+  request.bindFlags |= 0x100;
+  EXPECT_FALSE(RequestStages::IsObjectSubrequest(request, noHeaders));
+}
+
+TEST(RequestClassifierTest, DocumentItselfIsNeverFiltered)
+{
+  FakeEnvironment environment;
+  RequestDescriptor request = Request(L"http://www.example.com/index.html", nullptr, L"text/html, */*");
+  environment.blocked.insert(request.url);
+  RequestDecision decision = ClassifyRequest(request, environment);
+  EXPECT_TRUE(decision.isDocument);
+  EXPECT_FALSE(decision.shouldBlock);
+  EXPECT_EQ(0, environment.filteringEnabledCalls);
+  EXPECT_EQ(0, environment.shouldBlockCalls);
+}
+
+TEST(RequestClassifierTest, CachedFrameIsSubdocument)
+{
+  FakeEnvironment environment;
+  RequestDescriptor request = Request(L"http://ads.example.com/frame", referrerHeaders, L"*/*");
+  environment.frames.insert(request.url);
+  environment.blocked.insert(request.url);
+  RequestDecision decision = ClassifyRequest(request, environment);
+  EXPECT_EQ(REQUEST_TYPE_SUBDOCUMENT, decision.contentType);
+  EXPECT_EQ(REQUEST_TYPE_SUBDOCUMENT, environment.lastContentType);
+  EXPECT_EQ(L"http://www.example.com/index.html", environment.lastReferrer);
+  EXPECT_TRUE(decision.shouldBlock);
+  EXPECT_TRUE(decision.isCustomResponse);
+
+  // Frames are only looked up if the page is filtered
+  environment.filteringEnabled = false;
+  environment.frameCachedCalls = 0;
+  decision = ClassifyRequest(request, environment);
+  EXPECT_EQ(REQUEST_TYPE_OTHER, decision.contentType);
+  EXPECT_EQ(0, environment.frameCachedCalls);
+}
+
+TEST(RequestClassifierTest, WithoutTabFramesAreNotLookedUp)
+{
+  FakeEnvironment environment;
+  RequestDescriptor request = Request(L"http://ads.example.com/frame", referrerHeaders, L"*/*");
+  request.hasTab = false;
+  environment.frames.insert(request.url);
+  RequestDecision decision = ClassifyRequest(request, environment);
+  EXPECT_EQ(REQUEST_TYPE_OTHER, decision.contentType);
+  EXPECT_EQ(0, environment.filteringEnabledCalls);
+  EXPECT_EQ(1, environment.shouldBlockCalls);
+}
+
+TEST(RequestClassifierTest, BlockedObjectSubrequestFails)
+{
+  FakeEnvironment environment;
+  RequestDescriptor request = Request(L"http://video.example.com/ad.flv",
+    L"Referer: http://www.example.com/index.html\r\nx-flash-version: 15,0,0,152\r\n", L"*/*");
+  environment.blocked.insert(request.url);
+  RequestDecision decision = ClassifyRequest(request, environment);
+  EXPECT_EQ(REQUEST_TYPE_OBJECT_SUBREQUEST, decision.contentType);
+  EXPECT_TRUE(decision.shouldBlock);
+  EXPECT_FALSE(decision.isCustomResponse);
+}
+
+TEST(RequestClassifierTest, XmlHttpRequestHeaderWins)
+{
+  FakeEnvironment environment;
+  RequestDescriptor request = Request(L"http://ads.example.com/track.gif",
+    L"Referer: http://www.example.com/index.html\r\nX-Requested-With: XMLHttpRequest\r\nx-flash-version: 15\r\n",
+    L"image/png, */*");
+  RequestDecision decision = ClassifyRequest(request, environment);
+  EXPECT_EQ(REQUEST_TYPE_XMLHTTPREQUEST, decision.contentType);
+  EXPECT_FALSE(decision.shouldBlock);
+  EXPECT_FALSE(decision.isCustomResponse);
+}
+
+// Replays recorded requests of a page load and checks every decision
+TEST(RequestClassifierTest, Replay)
+{
+  struct Recorded
+  {
+    const wchar_t* url;
+    const wchar_t* additionalHeaders;
+    const wchar_t* accept;
+    RequestContentType expectedType;
+    bool expectedBlock;
+  };
+  const Recorded recorded[] =
+  {
+    {L"http://www.example.com/style.css", referrerHeaders, L"text/css, */*", REQUEST_TYPE_STYLESHEET, false},
+    {L"http://ads.example.com/ad.js", referrerHeaders, L"application/javascript, */*;q=0.8", REQUEST_TYPE_SCRIPT, true},
+    {L"http://ads.example.com/banner.png", referrerHeaders, L"image/png, image/*;q=0.8, */*;q=0.5", REQUEST_TYPE_IMAGE, true},
+    {L"http://ads.example.com/frame", referrerHeaders, L"text/html, application/xhtml+xml, */*", REQUEST_TYPE_SUBDOCUMENT, true},
+    {L"http://www.example.com/api", L"Referer: http://www.example.com/index.html\r\nX-Requested-With: XMLHttpRequest\r\n",
+      L"application/json, */*", REQUEST_TYPE_XMLHTTPREQUEST, false},
+    {L"http://www.example.com/beacon", nullptr, L"", REQUEST_TYPE_XMLHTTPREQUEST, false}
+  };
+
+  FakeEnvironment environment;
+  environment.blocked.insert(L"http://ads.example.com/ad.js");
+  environment.blocked.insert(L"http://ads.example.com/banner.png");
+  environment.blocked.insert(L"http://ads.example.com/frame");
+  RequestStageTimings timings;
+  for (size_t i = 0; i < sizeof(recorded) / sizeof(recorded[0]); i++)
+  {
+    RequestDecision decision = ClassifyRequest(Request(recorded[i].url, recorded[i].additionalHeaders, recorded[i].accept),
+      environment, &timings);
+    EXPECT_EQ(recorded[i].expectedType, decision.contentType) << "request " << i;
+    EXPECT_EQ(recorded[i].expectedBlock, decision.shouldBlock) << "request " << i;
+  }
+  EXPECT_EQ(sizeof(recorded) / sizeof(recorded[0]), timings.requests);
+}
+
+TEST(RequestClassifierBenchmark, DISABLED_StageTimings)
+{
+  const int iterations = 20000;
+  FakeEnvironment environment;
+  environment.frames.insert(L"http://ads.example.com/frame");
+  RequestDescriptor request = Request(L"http://ads.example.com/banner.png?id=1234", referrerHeaders,
+    L"image/png, image/svg+xml, image/jxr, image/*;q=0.8, */*;q=0.5");
+  RequestStageTimings timings;
+  for (int i = 0; i < iterations; i++)
+  {
+    ClassifyRequest(request, environment, &timings);
+  }
+  ASSERT_EQ(static_cast<unsigned long>(iterations), timings.requests);
+  for (int stage = 0; stage < REQUEST_STAGE_COUNT; stage++)
+  {
+    EXPECT_GE(timings.ms[stage], 0);
+    Benchmark::RecordMilliseconds(GetRequestStageName(static_cast<RequestStage>(stage)), timings.ms[stage]);
+  }
+}
@@ -0,0 +1,312 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+
+#include "../src/shared/ElementHiding.h"
+#include "../src/shared/SelectorProgram.h"
+#include "Benchmark.h"
+#include "TestDom.h"
+
+namespace
+{
+  bool ProgramMatches(const std::wstring& selector, const TestDom::Element& element, size_t* accessCount = nullptr)
+  {
+    ElementHideMatcher matcher;
+    matcher.Add(selector);
+    matcher.Build();
+    ElementHideMatcher::Match match;
+    return matcher.FindMatch(element.tagName, TestDom::View(element, accessCount), match);
+  }
+
+  const wchar_t* tags[] = {L"div", L"span", L"a", L"img", L"iframe", L"p", L"section", L"li"};
+  const wchar_t* words[] = {L"ad", L"banner", L"content", L"sidebar", L"sponsored", L"promo", L"nav", L"footer",
+    L"header", L"item", L"teaser", L"widget"};
+
+  template<typename T, size_t N>
+  const T& Pick(std::mt19937& random, const T (&values)[N])
+  {
+    return values[random() % N];
+  }
+
+  std::wstring Number(std::mt19937& random, unsigned int range)
+  {
+    return std::to_wstring(static_cast<long long>(random() % range));
+  }
+
+  // Stands in for a recorded page, typical element hiding relevant attributes
+  void CreatePage(std::mt19937& random, TestDom::Element& parent, int depth, std::vector<const TestDom::Element*>& elements)
+  {
+    int childCount = depth == 0 ? 0 : 1 + random() % 6;
+    for (int i = 0; i < childCount; i++)
+    {
+      TestDom::Element& child = parent.Append(Pick(random, tags));
+      if (random() % 3 == 0)
+      {
+        child.Attr(L"id", std::wstring(Pick(random, words)) + Number(random, 20));
+      }
+      if (random() % 2 == 0)
+      {
+        child.Attr(L"class", std::wstring(Pick(random, words)) + L" " + Pick(random, words) + Number(random, 5));
+      }
+      if (child.tagName == L"a" || child.tagName == L"img" || child.tagName == L"iframe")
+      {
+        child.Attr(child.tagName == L"a" ? L"href" : L"src",
+          L"http://" + std::wstring(Pick(random, words)) + L".example.com/" + Pick(random, words) + L"/" + Number(random, 1000));
+      }
+      if (random() % 4 == 0)
+      {
+        child.Attr(L"style", L"width: " + Number(random, 800) + L"px; height: " + Number(random, 600) + L"px");
+      }
+      elements.push_back(&child);
+      CreatePage(random, child, depth - 1, elements);
+    }
+  }
+
+  std::vector<std::wstring> CreateSelectors(std::mt19937& random, int count)
+  {
+    std::vector<std::wstring> selectors;
+    for (int i = 0; i < count; i++)
+    {
+      std::wstring selector;
+      switch (random() % 9)
+      {
+      case 0:
+        selector = L"#" + std::wstring(Pick(random, words)) + Number(random, 20);
+        break;
+      case 1:
+        selector = std::wstring(Pick(random, tags)) + L"." + Pick(random, words) + Number(random, 5);
+        break;
+      case 2:
+        selector = L"a[href*=\"" + std::wstring(Pick(random, words)) + L".example.com/" + Pick(random, words) + L"\"]";
+        break;
+      case 3:
+        selector = L"div[style*=\"width: " + Number(random, 800) + L"px\"]";
+        break;
+      case 4:
+        selector = L"." + std::wstring(Pick(random, words)) + L" > " + Pick(random, tags) + L"[src^=\"http://" + Pick(random, words) + L"\"]";
+        break;
+      case 5:
+        selector = std::wstring(Pick(random, tags)) + L"#" + Pick(random, words) + Number(random, 20) + L" + ." + Pick(random, words);
+        break;
+      case 6:
+        selector = L"." + std::wstring(Pick(random, words)) + L" ." + Pick(random, words) + L" " + Pick(random, tags);
+        break;
+      case 7:
+        selector = std::wstring(Pick(random, tags)) + L"." + Pick(random, words) + L"." + Pick(random, words) + Number(random, 5)
+          + L":not(#" + Pick(random, words) + Number(random, 20) + L")";
+        break;
+      default:
+        selector = L"." + std::wstring(Pick(random, words)) + L" ~ " + Pick(random, tags) + L"[style]";
+        break;
+      }
+      selectors.push_back(selector);
+    }
+    return selectors;
+  }
+}
+
+TEST(SelectorProgramTest, AttributeTests)
+{
+  TestDom::Element a(L"a");
+  a.Attr(L"href", L"http://ads.example.com/click").Attr(L"style", L"Width: 300PX");
+
+  EXPECT_TRUE(ProgramMatches(L"A[href=\"http://ads.example.com/click\"]", a));
+  EXPECT_TRUE(ProgramMatches(L"a[href^=http://ads.]", a));
+  EXPECT_TRUE(ProgramMatches(L"a[href$=/click]", a));
+  EXPECT_FALSE(ProgramMatches(L"a[href$=http://ads.example.com/click/]", a));
+  EXPECT_TRUE(ProgramMatches(L"a[href*=example]", a));
+  EXPECT_TRUE(ProgramMatches(L"a[href*=\"\"]", a));
+  EXPECT_FALSE(ProgramMatches(L"a[href*=Example]", a));
+  EXPECT_TRUE(ProgramMatches(L"a[style*=\"width: 300px\"]", a));
+  EXPECT_TRUE(ProgramMatches(L"a[style=\"WIDTH: 300px\"]", a));
+}
+
+TEST(SelectorProgramTest, ContainsWithCollidingCharacters)
+{
+  // U+0141 and 'A' share a skip table slot
+  TestDom::Element div(L"div");
+  div.Attr(L"title", L"xx\x0141yyAzz\x0141yAz");
+
+  EXPECT_TRUE(ProgramMatches(L"div[title*=\"\x0141yA\"]", div));
+  EXPECT_TRUE(ProgramMatches(L"div[title*=\"A\"]", div));
+  EXPECT_TRUE(ProgramMatches(L"div[title*=\"z\x0141\"]", div));
+  EXPECT_FALSE(ProgramMatches(L"div[title*=\"AyA\"]", div));
+  EXPECT_FALSE(ProgramMatches(L"div[title*=\"xx\x0141yyAzz\x0141yAzz\"]", div));
+
+  std::wstring longPattern(300, L'a');
+  div.Attr(L"title", L"b" + longPattern + L"b");
+  EXPECT_TRUE(ProgramMatches(L"div[title*=\"" + longPattern + L"\"]", div));
+  EXPECT_FALSE(ProgramMatches(L"div[title*=\"" + longPattern + L"aa\"]", div));
+}
+
+TEST(SelectorProgramTest, CheapTestsRejectFirst)
+{
+  TestDom::Element div(L"div");
+  div.Attr(L"class", L"content").Attr(L"style", L"width: 1px").Attr(L"title", L"x");
+
+  // The style test is written first but runs last
+  size_t accessCount = 0;
+  EXPECT_FALSE(ProgramMatches(L"div.content[style*=\"width\"][title=y]", div, &accessCount));
+  // The id and class name for the index lookup and the title, not the style
+  EXPECT_EQ(3, accessCount);
+}
+
+TEST(SelectorProgramTest, CombinatorsRightToLeft)
+{
+  TestDom::Element body(L"body");
+  TestDom::Element& list = body.Append(L"ul").Attr(L"id", L"menu");
+  list.Append(L"li").Attr(L"class", L"first");
+  TestDom::Element& second = list.Append(L"li").Attr(L"class", L"ad");
+
+  EXPECT_TRUE(ProgramMatches(L"body > #menu > .first + li.ad", second));
+  EXPECT_FALSE(ProgramMatches(L"div > #menu > .first + li.ad", second));
+  EXPECT_FALSE(ProgramMatches(L"#menu > .ad + li", second));
+
+  // The rightmost compound fails before any ancestor is looked at
+  size_t accessCount = 0;
+  EXPECT_FALSE(ProgramMatches(L"body > #menu > li.other", second, &accessCount));
+  EXPECT_EQ(2, accessCount);
+}
+
+TEST(SelectorProgramTest, DescendantChecksAreMemoized)
+{
+  // Without memoization this needs about C(200, 5) steps to fail
+  TestDom::Element root(L"html");
+  TestDom::Element* element = &root;
+  for (int i = 0; i < 200; i++)
+  {
+    element = &element->Append(L"div").Attr(L"class", L"a");
+  }
+  TestDom::Element& leaf = element->Append(L"span").Attr(L"class", L"c");
+
+  EXPECT_FALSE(ProgramMatches(L".x .a .a .a .a .a .c", leaf));
+  EXPECT_TRUE(ProgramMatches(L"html .a .a .a .a .a .c", leaf));
+  EXPECT_FALSE(ProgramMatches(L".a ~ .a .c", leaf));
+}
+
+TEST(SelectorProgramTest, AgreesWithInterpreter)
+{
+  std::mt19937 random(7);
+  TestDom::Element html(L"html");
+  std::vector<const TestDom::Element*> elements;
+  CreatePage(random, html, 4, elements);
+  std::vector<std::wstring> selectorTexts = CreateSelectors(random, 300);
+
+  size_t matches = 0;
+  for (auto text = selectorTexts.begin(); text != selectorTexts.end(); ++text)
+  {
+    CFilterElementHide selector;
+    ASSERT_EQ(PARSE_OK, CFilterElementHide::Parse(*text, selector)) << text->c_str();
+    SelectorProgram program(selector);
+    for (auto element = elements.begin(); element != elements.end(); ++element)
+    {
+      TestDom::View view(**element);
+      ElementSnapshot snapshot(view);
+      bool expected = selector.IsMatchFilterElementHide(snapshot);
+      EXPECT_EQ(expected, program.Matches(snapshot)) << text->c_str();
+      matches += expected;
+    }
+  }
+  EXPECT_GT(matches, 0u);
+}
+
+TEST(SelectorProgramBenchmark, DISABLED_CompareWithInterpreter)
+{
+  std::mt19937 random(42);
+  TestDom::Element html(L"html");
+  std::vector<const TestDom::Element*> elements;
+  CreatePage(random, html, 6, elements);
+  std::vector<std::wstring> selectorTexts = CreateSelectors(random, 2000);
+
+  std::vector<CFilterElementHide> selectors;
+  std::vector<SelectorProgram> programs;
+  for (auto it = selectorTexts.begin(); it != selectorTexts.end(); ++it)
+  {
+    selectors.push_back(CFilterElementHide());
+    ASSERT_EQ(PARSE_OK, CFilterElementHide::Parse(*it, selectors.back()));
+    programs.push_back(SelectorProgram(selectors.back()));
+  }
+
+  const int passes = 5;
+  size_t interpreterMatches = 0;
+  Benchmark::Timer timer;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (auto element = elements.begin(); element != elements.end(); ++element)
+    {
+      TestDom::View view(**element);
+      ElementSnapshot snapshot(view);
+      for (auto it = selectors.begin(); it != selectors.end(); ++it)
+      {
+        interpreterMatches += it->IsMatchFilterElementHide(snapshot);
+      }
+    }
+  }
+  double interpreterTime = timer.Lap();
+
+  size_t programMatches = 0;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (auto element = elements.begin(); element != elements.end(); ++element)
+    {
+      TestDom::View view(**element);
+      ElementSnapshot snapshot(view);
+      for (auto it = programs.begin(); it != programs.end(); ++it)
+      {
+        programMatches += it->Matches(snapshot);
+      }
+    }
+  }
+  double programTime = timer.Lap();
+
+  EXPECT_EQ(interpreterMatches, programMatches);
+  EXPECT_GT(programMatches, 0u);
+  Benchmark::RecordMilliseconds("interpreter", interpreterTime);
+  Benchmark::RecordMilliseconds("compiled", programTime);
+}
+
+TEST(SelectorProgramBenchmark, DISABLED_ParseLargeList)
+{
+  std::mt19937 random(11);
+  std::vector<std::wstring> selectorTexts = CreateSelectors(random, 50000);
+  size_t threadCount = std::thread::hardware_concurrency();
+  if (threadCount < 2)
+  {
+    threadCount = 2;
+  }
+
+  Benchmark::Timer timer;
+  ElementHideMatcher single;
+  EXPECT_TRUE(single.AddAll(selectorTexts, 1).empty());
+  single.Build();
+  double singleTime = timer.Lap();
+
+  ElementHideMatcher parallel;
+  EXPECT_TRUE(parallel.AddAll(selectorTexts, threadCount).empty());
+  parallel.Build();
+  double parallelTime = timer.Lap();
+
+  EXPECT_EQ(selectorTexts.size(), single.GetSelectorCount());
+  EXPECT_EQ(selectorTexts.size(), parallel.GetSelectorCount());
+  RecordProperty("threads", static_cast<int>(threadCount));
+  Benchmark::RecordMilliseconds("singleThread", singleTime);
+  Benchmark::RecordMilliseconds("parallel", parallelTime);
+}
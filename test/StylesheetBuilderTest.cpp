@@ -0,0 +1,194 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/shared/StylesheetBuilder.h"
+
+namespace
+{
+  // Stands in for IHTMLStyleSheet4::insertRule, rejects rules containing an
+  // unsupported selector
+  class FakeStylesheet
+  {
+  public:
+    StylesheetBuilder::InsertRule GetInsertRule()
+    {
+      return [this](const std::wstring& rule) -> bool
+      {
+        calls++;
+        if (rule.find(L":unsupported") != std::wstring::npos)
+        {
+          return false;
+        }
+        rules.push_back(rule);
+        return true;
+      };
+    }
+
+    size_t calls;
+    std::vector<std::wstring> rules;
+
+    FakeStylesheet() : calls(0)
+    {
+    }
+  };
+
+  // Creates the selectors on every call like ElementHideBlob, so that every
+  // selector is only valid until the next one is read
+  class GeneratedSelectorList : public StylesheetBuilder::SelectorList
+  {
+  public:
+    explicit GeneratedSelectorList(size_t count) : m_count(count)
+    {
+    }
+    size_t GetSize() const
+    {
+      return m_count;
+    }
+    const std::wstring& Get(size_t index, std::wstring& buffer) const
+    {
+      buffer = index == 1 ? L"p:unsupported" : L".ad" + std::to_wstring(static_cast<unsigned long long>(index));
+      return buffer;
+    }
+
+  private:
+    size_t m_count;
+  };
+
+  std::vector<std::wstring> CreateSelectors(size_t count)
+  {
+    std::vector<std::wstring> selectors;
+    for (size_t i = 0; i < count; i++)
+    {
+      selectors.push_back(L".ad" + std::to_wstring(static_cast<unsigned long long>(i)));
+    }
+    return selectors;
+  }
+}
+
+TEST(StylesheetBuilderTest, GroupsSelectors)
+{
+  StylesheetBuilder builder(4, 1000);
+  FakeStylesheet stylesheet;
+  StylesheetBuilder::Stats stats = builder.Insert(CreateSelectors(10), stylesheet.GetInsertRule());
+  EXPECT_EQ(3u, stats.rules);
+  EXPECT_EQ(3u, stats.insertCalls);
+  ASSERT_EQ(3u, stylesheet.rules.size());
+  EXPECT_EQ(L".ad0, .ad1, .ad2, .ad3 { display: none !important; }", stylesheet.rules[0]);
+  EXPECT_EQ(L".ad8, .ad9 { display: none !important; }", stylesheet.rules[2]);
+}
+
+TEST(StylesheetBuilderTest, LimitsRuleLength)
+{
+  // ".adN" is 4 characters, the separator 2
+  StylesheetBuilder builder(100, 10);
+  FakeStylesheet stylesheet;
+  builder.Insert(CreateSelectors(5), stylesheet.GetInsertRule());
+  ASSERT_EQ(3u, stylesheet.rules.size());
+  EXPECT_EQ(L".ad0, .ad1 { display: none !important; }", stylesheet.rules[0]);
+  EXPECT_EQ(L".ad4 { display: none !important; }", stylesheet.rules[2]);
+
+  // Selectors longer than the limit get a rule of their own
+  std::vector<std::wstring> selectors(1, L"#a-very-long-selector");
+  selectors.push_back(L".b");
+  FakeStylesheet longStylesheet;
+  builder.Insert(selectors, longStylesheet.GetInsertRule());
+  EXPECT_EQ(2u, longStylesheet.rules.size());
+}
+
+TEST(StylesheetBuilderTest, IsolatesRejectedSelectors)
+{
+  std::vector<std::wstring> selectors = CreateSelectors(64);
+  selectors[5] = L"p:unsupported";
+  selectors[40] = L"div:unsupported(1)";
+  selectors.push_back(L"");
+
+  StylesheetBuilder builder(64, 10000);
+  FakeStylesheet stylesheet;
+  StylesheetBuilder::Stats stats = builder.Insert(selectors, stylesheet.GetInsertRule());
+  EXPECT_EQ(2u, stats.rejectedSelectors);
+  EXPECT_TRUE(builder.IsRejected(L"p:unsupported"));
+  EXPECT_TRUE(builder.IsRejected(L"div:unsupported(1)"));
+  EXPECT_FALSE(builder.IsRejected(L".ad6"));
+  // Each rejected selector costs about 2 * log2(64) calls, still far fewer than one per selector
+  EXPECT_LE(stats.insertCalls, 24u);
+
+  size_t inserted = 0;
+  for (auto it = stylesheet.rules.begin(); it != stylesheet.rules.end(); ++it)
+  {
+    inserted += std::count(it->begin(), it->end(), L',') + 1;
+  }
+  EXPECT_EQ(62u, inserted);
+
+  // The next document doesn't try them again
+  FakeStylesheet nextStylesheet;
+  stats = builder.Insert(selectors, nextStylesheet.GetInsertRule());
+  EXPECT_EQ(2u, stats.skippedSelectors);
+  EXPECT_EQ(0u, stats.rejectedSelectors);
+  EXPECT_EQ(1u, stats.insertCalls);
+  EXPECT_EQ(1u, nextStylesheet.calls);
+}
+
+TEST(StylesheetBuilderTest, EmptyList)
+{
+  StylesheetBuilder builder(10, 100);
+  FakeStylesheet stylesheet;
+  StylesheetBuilder::Stats stats = builder.Insert(std::vector<std::wstring>(), stylesheet.GetInsertRule());
+  EXPECT_EQ(0u, stats.insertCalls);
+  EXPECT_EQ(0u, stylesheet.calls);
+}
+
+TEST(StylesheetBuilderTest, CreatesStylesheetText)
+{
+  std::vector<std::wstring> selectors = CreateSelectors(5);
+  selectors[1] = L"p:unsupported";
+  StylesheetBuilder builder(2, 1000);
+
+  std::shared_ptr<const StylesheetBuilder::Stylesheet> stylesheet = builder.CreateStylesheet(selectors);
+  EXPECT_EQ(3u, stylesheet->ruleCount);
+  EXPECT_EQ(0u, stylesheet->rejectedCount);
+
+  // The same rules as inserted one by one
+  FakeStylesheet fake;
+  builder.Insert(selectors, fake.GetInsertRule());
+  EXPECT_EQ(1u, builder.GetRejectedCount());
+
+  stylesheet = builder.CreateStylesheet(selectors);
+  EXPECT_EQ(1u, stylesheet->rejectedCount);
+  EXPECT_EQ(2u, stylesheet->ruleCount);
+  EXPECT_EQ(L".ad0, .ad2 { display: none !important; }\n.ad3, .ad4 { display: none !important; }\n", stylesheet->text);
+}
+
+TEST(StylesheetBuilderTest, ReadsSelectorsThroughBuffer)
+{
+  std::vector<std::wstring> selectors = CreateSelectors(5);
+  selectors[1] = L"p:unsupported";
+  GeneratedSelectorList list(selectors.size());
+  StylesheetBuilder builder(2, 1000);
+  EXPECT_EQ(builder.CreateStylesheet(selectors)->text, builder.CreateStylesheet(list)->text);
+
+  FakeStylesheet stylesheet;
+  StylesheetBuilder::Stats stats = builder.Insert(list, stylesheet.GetInsertRule());
+  EXPECT_EQ(1u, stats.rejectedSelectors);
+  EXPECT_TRUE(builder.IsRejected(L"p:unsupported"));
+  EXPECT_EQ(L".ad0, .ad2 { display: none !important; }\n.ad3, .ad4 { display: none !important; }\n",
+    builder.CreateStylesheet(list)->text);
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "../src/shared/SyntheticResponse.h"
+
+namespace
+{
+  std::string Body(const SyntheticResponse& response)
+  {
+    return std::string(response.body, response.size);
+  }
+
+  unsigned Word(const std::string& data, size_t offset)
+  {
+    return static_cast<unsigned char>(data[offset]) | static_cast<unsigned char>(data[offset + 1]) << 8;
+  }
+}
+
+TEST(SyntheticResponseTest, ImageIsTransparentGif)
+{
+  const SyntheticResponse& response = GetSyntheticResponse(REQUEST_TYPE_IMAGE);
+  EXPECT_EQ(std::wstring(L"image/gif"), response.mimeType);
+  std::string gif = Body(response);
+  ASSERT_EQ(43u, gif.size());
+  EXPECT_EQ("GIF89a", gif.substr(0, 6));
+  // Logical screen and image descriptor are 1x1
+  EXPECT_EQ(1u, Word(gif, 6));
+  EXPECT_EQ(1u, Word(gif, 8));
+  ASSERT_EQ('\x2C', gif[27]);
+  EXPECT_EQ(1u, Word(gif, 32));
+  EXPECT_EQ(1u, Word(gif, 34));
+  // Graphic control extension with the transparency flag, index 0
+  EXPECT_EQ("\x21\xF9\x04", gif.substr(19, 3));
+  EXPECT_EQ(1, gif[22] & 1);
+  EXPECT_EQ(0, gif[25]);
+  EXPECT_EQ('\x3B', gif[gif.size() - 1]);
+}
+
+TEST(SyntheticResponseTest, ScriptsAndStylesheetsAreComments)
+{
+  const SyntheticResponse& script = GetSyntheticResponse(REQUEST_TYPE_SCRIPT);
+  EXPECT_EQ(std::wstring(L"application/javascript"), script.mimeType);
+  EXPECT_EQ("/* blocked by AdblockPlus */", Body(script));
+
+  const SyntheticResponse& stylesheet = GetSyntheticResponse(REQUEST_TYPE_STYLESHEET);
+  EXPECT_EQ(std::wstring(L"text/css"), stylesheet.mimeType);
+  EXPECT_EQ("/* blocked by AdblockPlus */", Body(stylesheet));
+}
+
+TEST(SyntheticResponseTest, OtherTypesGetEmptyDocument)
+{
+  RequestContentType types[] = {REQUEST_TYPE_OTHER, REQUEST_TYPE_SUBDOCUMENT,
+    REQUEST_TYPE_XMLHTTPREQUEST, REQUEST_TYPE_OBJECT};
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+  {
+    const SyntheticResponse& response = GetSyntheticResponse(types[i]);
+    EXPECT_EQ(std::wstring(L"text/html"), response.mimeType);
+    std::string body = Body(response);
+    EXPECT_EQ(0u, body.find("<!DOCTYPE html>"));
+    EXPECT_NE(std::string::npos, body.find("<!-- blocked by AdblockPlus -->"));
+    EXPECT_EQ(std::string::npos, body.find('\0'));
+  }
+}
@@ -0,0 +1,167 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TEST_DOM_H
+#define TEST_DOM_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../src/shared/ElementView.h"
+
+namespace TestDom
+{
+  /// In-memory element tree, stands in for MSHTML in the tests.
+  class Element
+  {
+  public:
+    explicit Element(const std::wstring& tagName)
+      : tagName(tagName), parent(nullptr)
+    {
+    }
+
+    Element& Attr(const std::wstring& name, const std::wstring& value)
+    {
+      attributes[name] = value;
+      return *this;
+    }
+
+    Element& Append(const std::wstring& childTagName)
+    {
+      std::unique_ptr<Element> child(new Element(childTagName));
+      child->parent = this;
+      children.push_back(std::move(child));
+      return *children.back();
+    }
+
+    const Element* GetPreviousSibling() const
+    {
+      if (!parent)
+      {
+        return nullptr;
+      }
+      const Element* previous = nullptr;
+      for (auto it = parent->children.begin(); it != parent->children.end(); ++it)
+      {
+        if (it->get() == this)
+        {
+          return previous;
+        }
+        previous = it->get();
+      }
+      return nullptr;
+    }
+
+    const std::wstring* FindAttribute(const std::wstring& name) const
+    {
+      auto it = attributes.find(name);
+      return it == attributes.end() ? nullptr : &it->second;
+    }
+
+    std::wstring tagName;
+    std::map<std::wstring, std::wstring> attributes;
+    Element* parent;
+    std::vector<std::unique_ptr<Element>> children;
+
+  private:
+    Element(const Element&);
+    void operator=(const Element&);
+  };
+
+  /// `ElementView` of an `Element`, counts how often the element is accessed.
+  class View : public ElementView
+  {
+  public:
+    explicit View(const Element& element, size_t* accessCount = nullptr)
+      : m_element(element), m_accessCount(accessCount)
+    {
+    }
+
+    bool GetTagName(std::wstring& tagName) const override
+    {
+      Count();
+      tagName = m_element.tagName;
+      return true;
+    }
+
+    bool GetId(std::wstring& id) const override
+    {
+      return Get(L"id", id);
+    }
+
+    bool GetClassName(std::wstring& className) const override
+    {
+      return Get(L"class", className);
+    }
+
+    bool GetStyle(std::wstring& cssText) const override
+    {
+      return Get(L"style", cssText);
+    }
+
+    bool GetAttribute(const std::wstring& name, std::wstring& value) const override
+    {
+      return Get(name, value);
+    }
+
+    ElementViewPtr GetParent() const override
+    {
+      Count();
+      return Wrap(m_element.parent);
+    }
+
+    ElementViewPtr GetPreviousSibling() const override
+    {
+      Count();
+      return Wrap(m_element.GetPreviousSibling());
+    }
+
+  private:
+    void Count() const
+    {
+      if (m_accessCount)
+      {
+        ++*m_accessCount;
+      }
+    }
+
+    bool Get(const std::wstring& name, std::wstring& value) const
+    {
+      Count();
+      const std::wstring* attribute = m_element.FindAttribute(name);
+      if (!attribute)
+      {
+        return false;
+      }
+      value = *attribute;
+      return true;
+    }
+
+    ElementViewPtr Wrap(const Element* element) const
+    {
+      return ElementViewPtr(element ? new View(*element, m_accessCount) : nullptr);
+    }
+
+    const Element& m_element;
+    size_t* m_accessCount;
+  };
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "../src/shared/UrlHashSet.h"
+
+namespace
+{
+  std::wstring Url(int i)
+  {
+    return L"http://example.com/frame" + std::to_wstring(static_cast<long long>(i)) + L".html";
+  }
+}
+
+TEST(UrlHashSetTest, InsertAndContains)
+{
+  UrlHashSet set(16);
+  EXPECT_FALSE(set.Contains(L"http://example.com/"));
+  set.Insert(L"http://example.com/");
+  set.Insert(L"http://example.com/");
+  EXPECT_TRUE(set.Contains(L"http://example.com/"));
+  EXPECT_FALSE(set.Contains(L"http://example.com"));
+  EXPECT_FALSE(set.Contains(L""));
+  EXPECT_EQ(1u, set.GetSize());
+}
+
+TEST(UrlHashSetTest, Clear)
+{
+  UrlHashSet set(16);
+  for (int i = 0; i < 10; i++)
+  {
+    set.Insert(Url(i));
+  }
+  set.Clear();
+  EXPECT_EQ(0u, set.GetSize());
+  for (int i = 0; i < 10; i++)
+  {
+    EXPECT_FALSE(set.Contains(Url(i)));
+  }
+  set.Insert(Url(3));
+  EXPECT_TRUE(set.Contains(Url(3)));
+}
+
+TEST(UrlHashSetTest, DropsOldestWhenFull)
+{
+  UrlHashSet set(64);
+  EXPECT_EQ(64u, set.GetCapacity());
+  for (int i = 0; i < 10000; i++)
+  {
+    set.Insert(Url(i));
+    ASSERT_LE(set.GetSize(), 64u);
+  }
+  // At least the newer half is kept
+  for (int i = 10000 - 32; i < 10000; i++)
+  {
+    EXPECT_TRUE(set.Contains(Url(i))) << i;
+  }
+  EXPECT_FALSE(set.Contains(Url(0)));
+  EXPECT_FALSE(set.Contains(Url(10000 - 65)));
+}
+
+TEST(UrlHashSetTest, ReinsertingKeepsUrl)
+{
+  UrlHashSet set(8);
+  set.Insert(L"http://example.com/top");
+  for (int i = 0; i < 100; i++)
+  {
+    set.Insert(Url(i));
+    set.Insert(L"http://example.com/top");
+    ASSERT_TRUE(set.Contains(L"http://example.com/top")) << i;
+  }
+}
+
+TEST(UrlHashSetTest, ConcurrentReaders)
+{
+  UrlHashSet set(256);
+  // Never dropped, it is inserted again before its table can be emptied
+  set.Insert(L"http://example.com/");
+  std::atomic<bool> done(false);
+  std::atomic<int> misses(0);
+  std::thread reader([&]()
+  {
+    while (!done)
+    {
+      if (!set.Contains(L"http://example.com/"))
+      {
+        misses++;
+      }
+    }
+  });
+  for (int i = 0; i < 20000; i++)
+  {
+    set.Insert(Url(i));
+    if (i % 64 == 0)
+    {
+      set.Insert(L"http://example.com/");
+    }
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(0, misses);
+  EXPECT_LE(set.GetSize(), 256u);
+}
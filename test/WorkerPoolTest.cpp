@@ -0,0 +1,165 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../src/shared/WorkerPool.h"
+
+namespace
+{
+  // Blocks the tasks which are waiting on it until Release is called
+  class Gate
+  {
+  public:
+    Gate() : m_isOpen(false) {}
+    void Wait()
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_opened.wait(lock, [this]() { return m_isOpen; });
+    }
+    void Release()
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_isOpen = true;
+      m_opened.notify_all();
+    }
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_opened;
+    bool m_isOpen;
+  };
+
+  template<class Predicate>
+  bool WaitUntil(Predicate predicate)
+  {
+    for (int i = 0; i < 500; i++)
+    {
+      if (predicate())
+        return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return predicate();
+  }
+}
+
+TEST(WorkerPoolTest, RunsAllPostedTasks)
+{
+  WorkerPool pool(3, 100);
+  std::atomic<int> counter(0);
+  for (int i = 0; i < 50; i++)
+  {
+    pool.Post([&counter]() { counter++; });
+  }
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().completed == 50; }));
+  EXPECT_EQ(50, counter.load());
+  EXPECT_EQ(0u, pool.GetStats().queued);
+}
+
+TEST(WorkerPoolTest, NumberOfThreadsIsBounded)
+{
+  WorkerPool pool(2, 100);
+  Gate gate;
+  for (int i = 0; i < 5; i++)
+  {
+    pool.Post([&gate]() { gate.Wait(); });
+  }
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().running == 2; }));
+  WorkerPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(2u, stats.threads);
+  EXPECT_EQ(3u, stats.queued);
+  gate.Release();
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().completed == 5; }));
+}
+
+TEST(WorkerPoolTest, CancelledTaskIsNotRun)
+{
+  WorkerPool pool(1, 100);
+  Gate gate;
+  pool.Post([&gate]() { gate.Wait(); });
+
+  bool isRun = false;
+  CancellationTokenPtr token = std::make_shared<CancellationToken>();
+  pool.Post([&isRun]() { isRun = true; }, token);
+  token->Cancel();
+  gate.Release();
+
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().cancelled == 1; }));
+  EXPECT_FALSE(isRun);
+  EXPECT_EQ(1u, pool.GetStats().completed);
+}
+
+TEST(WorkerPoolTest, OldestTaskIsDroppedWhenQueueIsFull)
+{
+  WorkerPool pool(1, 2);
+  Gate gate;
+  pool.Post([&gate]() { gate.Wait(); });
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().running == 1; }));
+
+  std::atomic<int> runTasks(0);
+  std::shared_ptr<int> heldByDroppedTask = std::make_shared<int>(0);
+  std::weak_ptr<int> weakHeld = heldByDroppedTask;
+  pool.Post([&runTasks, heldByDroppedTask]() { runTasks += 1; });
+  heldByDroppedTask.reset();
+  pool.Post([&runTasks]() { runTasks += 10; });
+  pool.Post([&runTasks]() { runTasks += 100; });
+
+  // The dropped task has to be destroyed right away
+  EXPECT_TRUE(weakHeld.expired());
+  EXPECT_EQ(1u, pool.GetStats().dropped);
+
+  gate.Release();
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().completed == 3; }));
+  EXPECT_EQ(110, runTasks.load());
+}
+
+TEST(WorkerPoolTest, IdleThreadsExit)
+{
+  WorkerPool pool(2, 100, 10);
+  pool.Post([]() {});
+  ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().completed == 1; }));
+  EXPECT_TRUE(WaitUntil([&pool]() { return pool.GetStats().threads == 0; }));
+
+  // New threads are started on demand
+  pool.Post([]() {});
+  EXPECT_TRUE(WaitUntil([&pool]() { return pool.GetStats().completed == 2; }));
+}
+
+TEST(WorkerPoolTest, DestructorDropsQueuedTasks)
+{
+  std::atomic<int> runTasks(0);
+  Gate gate;
+  {
+    WorkerPool pool(1, 100);
+    pool.Post([&gate, &runTasks]() { gate.Wait(); runTasks++; });
+    ASSERT_TRUE(WaitUntil([&pool]() { return pool.GetStats().running == 1; }));
+    pool.Post([&runTasks]() { runTasks++; });
+    std::thread releaser([&gate]()
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      gate.Release();
+    });
+    releaser.detach();
+  }
+  // The running task has finished, the queued one has never been started
+  EXPECT_EQ(1, runTasks.load());
+}
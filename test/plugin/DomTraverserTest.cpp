@@ -0,0 +1,140 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+#include "../../src/plugin/PluginStdAfx.h"
+#include "../../src/plugin/PluginDomTraverserBase.h"
+#include <set>
+
+namespace
+{
+  // Records the elements it visits, the body of a document stands in for
+  // the browser so that no window is needed
+  class RecordingTraverser : public CPluginDomTraverserBase<CPluginDomTraverserCacheBase>
+  {
+  public:
+    RecordingTraverser()
+      : CPluginDomTraverserBase<CPluginDomTraverserCacheBase>(std::make_shared<CPluginFilter>(std::vector<std::wstring>()))
+    {
+    }
+
+    // Starts a traversal like BeginDocument does, a running one is abandoned
+    void Start(IHTMLElement* body)
+    {
+      m_traversalStack.clear();
+      bool isCached = true;
+      long allElementsCount = 0;
+      if (VisitElement(body, L"", isCached, allElementsCount))
+      {
+        PushChildren(body, 1, isCached, allElementsCount);
+      }
+    }
+
+    std::set<IUnknown*> visited;
+
+  protected:
+    bool OnElement(IHTMLElement* pEl, const std::wstring& tag, CPluginDomTraverserCacheBase* cache, bool isDebug, const std::wstring& indent)
+    {
+      CComPtr<IUnknown> identity;
+      pEl->QueryInterface(&identity);
+      visited.insert(identity.p);
+      return true;
+    }
+  };
+
+  CComPtr<IHTMLDocument2> CreateDocument(const std::wstring& html)
+  {
+    CComPtr<IHTMLDocument2> document;
+    if (FAILED(document.CoCreateInstance(CLSID_HTMLDocument, nullptr, CLSCTX_INPROC_SERVER)))
+    {
+      return nullptr;
+    }
+    // Keeps scripts from running
+    document->put_designMode(CComBSTR(L"on"));
+    SAFEARRAY* content = SafeArrayCreateVector(VT_VARIANT, 0, 1);
+    VARIANT* item = nullptr;
+    SafeArrayAccessData(content, reinterpret_cast<void**>(&item));
+    item->vt = VT_BSTR;
+    item->bstrVal = SysAllocString(html.c_str());
+    SafeArrayUnaccessData(content);
+    document->write(content);
+    document->close();
+    // Frees the string as well
+    SafeArrayDestroy(content);
+    return document;
+  }
+
+  class DomTraverserTest : public ::testing::Test
+  {
+  protected:
+    void SetUp()
+    {
+      CoInitialize(nullptr);
+      std::wstring html = L"<html><body>";
+      for (int i = 0; i < 10; i++)
+      {
+        html += L"<div><p><span>a</span><span>b</span></p><p><a>c</a></p></div>";
+      }
+      html += L"</body></html>";
+      document = CreateDocument(html);
+      ASSERT_TRUE(document);
+      ASSERT_TRUE(SUCCEEDED(document->get_body(&body)) && body);
+    }
+
+    void TearDown()
+    {
+      body.Release();
+      document.Release();
+      CoUninitialize();
+    }
+
+    CComPtr<IHTMLDocument2> document;
+    CComPtr<IHTMLElement> body;
+  };
+}
+
+TEST_F(DomTraverserTest, RestartedTraversalVisitsUnfinishedSubtrees)
+{
+  RecordingTraverser complete;
+  complete.SetSliceBudget(0);
+  complete.Start(body);
+  ASSERT_TRUE(complete.ContinueTraversal());
+  size_t elementCount = complete.visited.size();
+  ASSERT_EQ(1u + 10 * 6, elementCount);
+
+  // Yields after every element: body, div, p and the first span are visited
+  RecordingTraverser restarted;
+  restarted.SetSliceBudget(1e-9);
+  restarted.Start(body);
+  for (int i = 0; i < 3; i++)
+  {
+    ASSERT_FALSE(restarted.ContinueTraversal());
+  }
+  restarted.visited.clear();
+  restarted.SetSliceBudget(0);
+  restarted.Start(body);
+  ASSERT_TRUE(restarted.ContinueTraversal());
+  // Only the first span had been finished, body, div and p are visited again
+  EXPECT_EQ(elementCount - 1, restarted.visited.size());
+
+  // Nothing changed since the restarted traversal completed
+  restarted.visited.clear();
+  restarted.Start(body);
+  ASSERT_TRUE(restarted.ContinueTraversal());
+  EXPECT_TRUE(restarted.visited.empty());
+}
@@ -0,0 +1,196 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-present eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gtest/gtest.h>
+#include "../../src/plugin/PluginStdAfx.h"
+#include "../../src/plugin/PluginFilter.h"
+#include "../../src/shared/Utils.h"
+#include "../Benchmark.h"
+#include <atomic>
+#include <thread>
+
+namespace
+{
+  // Synthetic corpus, every filter instance gets a slightly different one
+  std::vector<std::wstring> CreateSelectors(int seed)
+  {
+    std::vector<std::wstring> selectors;
+    for (int i = 0; i < 500; i++)
+    {
+      std::wstring n = std::to_wstring(static_cast<long long>(i + seed));
+      selectors.push_back(L".ad-class-" + n);
+      selectors.push_back(L"#ad-id-" + n);
+      selectors.push_back(L"div.sponsor-" + n);
+      selectors.push_back(L"a[href^=\"http://ads" + n + L".example.com\"]");
+      selectors.push_back(L"div#box-" + n + L" > span.text-" + n);
+    }
+    return selectors;
+  }
+
+  std::wstring CreateHtml()
+  {
+    std::wstring html = L"<html><body>";
+    for (int i = 0; i < 100; i++)
+    {
+      std::wstring n = std::to_wstring(static_cast<long long>(i * 7));
+      html += L"<div id=\"box-" + n + L"\" class=\"content sponsor-" + n + L"\">"
+        L"<span class=\"text-" + n + L"\">text</span>"
+        L"<a href=\"http://ads" + n + L".example.com/banner\">link</a>"
+        L"<p id=\"ad-id-" + n + L"\" class=\"ad-class-" + n + L" other\">paragraph</p>"
+        L"</div>";
+    }
+    html += L"</body></html>";
+    return html;
+  }
+
+  // Creates a standalone document, it belongs to the apartment of the calling thread
+  CComPtr<IHTMLDocument2> CreateDocument(const std::wstring& html)
+  {
+    CComPtr<IHTMLDocument2> document;
+    if (FAILED(document.CoCreateInstance(CLSID_HTMLDocument, nullptr, CLSCTX_INPROC_SERVER)))
+    {
+      return nullptr;
+    }
+    // Keeps scripts from running
+    document->put_designMode(CComBSTR(L"on"));
+    SAFEARRAY* content = SafeArrayCreateVector(VT_VARIANT, 0, 1);
+    VARIANT* item = nullptr;
+    SafeArrayAccessData(content, reinterpret_cast<void**>(&item));
+    item->vt = VT_BSTR;
+    item->bstrVal = SysAllocString(html.c_str());
+    SafeArrayUnaccessData(content);
+    document->write(content);
+    document->close();
+    // Frees the string as well
+    SafeArrayDestroy(content);
+    return document;
+  }
+
+  struct Element
+  {
+    CComPtr<IHTMLElement> element;
+    std::wstring tag;
+  };
+
+  std::vector<Element> GetElements(IHTMLDocument2* document)
+  {
+    std::vector<Element> elements;
+    CComPtr<IHTMLElementCollection> all;
+    if (FAILED(document->get_all(&all)) || !all)
+    {
+      return elements;
+    }
+    long length = 0;
+    all->get_length(&length);
+    for (long i = 0; i < length; i++)
+    {
+      CComPtr<IDispatch> dispatch;
+      all->item(CComVariant(i), CComVariant(i), &dispatch);
+      CComQIPtr<IHTMLElement> htmlElement = dispatch;
+      CComBSTR tagName;
+      if (!htmlElement || FAILED(htmlElement->get_tagName(&tagName)) || !tagName)
+      {
+        continue;
+      }
+      Element element;
+      element.element = htmlElement;
+      element.tag = ToLowerString(ToWstring(tagName));
+      elements.push_back(element);
+    }
+    return elements;
+  }
+
+  // Runs `passes` passes over a private document on every thread and returns
+  // the wall time. Fails if a pass gives a different result than the first one.
+  double RunConcurrently(const std::vector<PluginFilterPtr>& filters, int threadCount, int passes)
+  {
+    std::wstring html = CreateHtml();
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    Benchmark::Timer timer;
+    for (int t = 0; t < threadCount; t++)
+    {
+      threads.push_back(std::thread([&filters, &html, &failures, passes]()
+      {
+        CoInitialize(nullptr);
+        {
+          CComPtr<IHTMLDocument2> document = CreateDocument(html);
+          std::vector<Element> elements;
+          if (document)
+          {
+            elements = GetElements(document);
+          }
+          int expectedHidden = -1;
+          for (int pass = 0; pass < passes; pass++)
+          {
+            int hidden = 0;
+            for (auto filter = filters.begin(); filter != filters.end(); ++filter)
+            {
+              for (auto element = elements.begin(); element != elements.end(); ++element)
+              {
+                if ((*filter)->IsElementHidden(element->tag, element->element, L"example.com", L""))
+                {
+                  hidden++;
+                }
+              }
+            }
+            if (expectedHidden < 0)
+            {
+              expectedHidden = hidden;
+            }
+            if (hidden != expectedHidden || hidden == 0)
+            {
+              failures++;
+            }
+          }
+        }
+        CoUninitialize();
+      }));
+    }
+    for (auto thread = threads.begin(); thread != threads.end(); ++thread)
+    {
+      thread->join();
+    }
+    double elapsed = timer.Lap();
+    EXPECT_EQ(0, failures.load());
+    return elapsed;
+  }
+}
+
+TEST(PluginFilterTest, ConcurrentIsElementHidden)
+{
+  std::vector<PluginFilterPtr> filters;
+  for (int i = 0; i < 2; i++)
+  {
+    filters.push_back(std::make_shared<CPluginFilter>(CreateSelectors(i * 3)));
+  }
+  RunConcurrently(filters, 4, 2);
+}
+
+TEST(PluginFilterBenchmark, DISABLED_ConcurrentIsElementHidden)
+{
+  std::vector<PluginFilterPtr> filters;
+  for (int i = 0; i < 4; i++)
+  {
+    filters.push_back(std::make_shared<CPluginFilter>(CreateSelectors(i * 3)));
+  }
+
+  const int passes = 20;
+  Benchmark::RecordMilliseconds("singleThread", RunConcurrently(filters, 1, passes));
+  Benchmark::RecordMilliseconds("fourThreads", RunConcurrently(filters, 4, passes));
+}